@@ -51,6 +51,7 @@ struct _GDaemonFileEnumerator
   /* protected by infos lock */
   GList *infos;
   gboolean done;
+  GError *error; /* The listing broke off, reported after the infos */
 
   /* For async ops, also protected by infos lock */
   int async_requested_files;
@@ -114,6 +115,7 @@ g_daemon_file_enumerator_finalize (GObject *object)
   g_free (path);
 
   free_info_list (daemon->infos);
+  g_clear_error (&daemon->error);
 
   g_file_attribute_matcher_unref (daemon->matcher);
   if (daemon->metadata_tree)
@@ -178,6 +180,33 @@ handle_done (GVfsDBusEnumerator *object,
   return TRUE;
 }
 
+static gboolean
+handle_failed (GVfsDBusEnumerator *object,
+               GDBusMethodInvocation *invocation,
+               const gchar *arg_error_name,
+               const gchar *arg_error_message,
+               gpointer user_data)
+{
+  GDaemonFileEnumerator *enumerator = G_DAEMON_FILE_ENUMERATOR (user_data);
+
+  G_LOCK (infos);
+  if (enumerator->error == NULL)
+    {
+      enumerator->error = g_dbus_error_new_for_dbus_error (arg_error_name,
+                                                           arg_error_message);
+      g_dbus_error_strip_remote_error (enumerator->error);
+    }
+  enumerator->done = TRUE;
+  if (enumerator->async_requested_files > 0)
+    trigger_async_done (enumerator, TRUE);
+  next_files_sync_check (enumerator);
+  G_UNLOCK (infos);
+
+  gvfs_dbus_enumerator_complete_failed (object, invocation);
+  
+  return TRUE;
+}
+
 static gboolean
 handle_got_info (GVfsDBusEnumerator *object,
                  GDBusMethodInvocation *invocation,
@@ -235,6 +264,7 @@ register_vfs_filter_cb (GDBusConnection *connection,
   skeleton = gvfs_dbus_enumerator_skeleton_new ();
   g_signal_connect (skeleton, "handle-done", G_CALLBACK (handle_done), callback_data);
   g_signal_connect (skeleton, "handle-got-info", G_CALLBACK (handle_got_info), callback_data);
+  g_signal_connect (skeleton, "handle-failed", G_CALLBACK (handle_failed), callback_data);
 
   error = NULL;
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton),
@@ -409,11 +439,20 @@ trigger_async_done (GDaemonFileEnumerator *daemon, gboolean ok)
 	}
       daemon->infos = rest;
 
-      g_list_foreach (l, (GFunc)add_metadata, daemon);
+      if (l == NULL && daemon->error != NULL)
+	{
+	  /* All infos were handed out, now report why the listing ended */
+	  g_simple_async_result_set_from_error (daemon->async_res, daemon->error);
+	  g_clear_error (&daemon->error);
+	}
+      else
+	{
+	  g_list_foreach (l, (GFunc)add_metadata, daemon);
 
-      g_simple_async_result_set_op_res_gpointer (daemon->async_res,
-						 l,
-						 (GDestroyNotify)free_info_list);
+	  g_simple_async_result_set_op_res_gpointer (daemon->async_res,
+						     l,
+						     (GDestroyNotify)free_info_list);
+	}
     }
 
   g_simple_async_result_complete_in_idle (daemon->async_res);
@@ -511,6 +550,11 @@ g_daemon_file_enumerator_next_file (GFileEnumerator *enumerator,
         }
       daemon->infos = g_list_delete_link (daemon->infos, daemon->infos);
     }
+  else if (daemon->error != NULL)
+    {
+      g_propagate_error (error, daemon->error);
+      daemon->error = NULL;
+    }
   G_UNLOCK (infos);
 
   if (info)
@@ -613,6 +657,9 @@ g_daemon_file_enumerator_next_files_finish (GFileEnumerator  *enumerator,
       return NULL;
     }
 
+  if (g_simple_async_result_propagate_error (result, error))
+    return NULL;
+
   l = g_simple_async_result_get_op_res_gpointer (result);
   g_list_foreach (l, (GFunc)g_object_ref, NULL);
   return g_list_copy (l);
@@ -63,6 +63,7 @@
 #include "gvfsdaemondbus.h"
 #include <gvfsdaemonprotocol.h>
 #include <gvfsfileinfo.h>
+#include <gvfstrace.h>
 
 #define MAX_READ_SIZE (4*1024*1024)
 
@@ -613,6 +614,7 @@ iterate_read_state_machine (GDaemonFileInputStream *file, IOOperationData *io_op
 
 	  append_request (file, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_READ,
 			  op->buffer_size, 0, 0, &op->seq_nr);
+	  GVFS_TRACE3 (client__read, file, op->seq_nr, op->buffer_size);
 	  op->state = READ_STATE_WROTE_COMMAND;
 	  io_op->io_buffer = file->output_buffer->str;
 	  io_op->io_size = file->output_buffer->len;
@@ -745,6 +747,7 @@ iterate_read_state_machine (GDaemonFileInputStream *file, IOOperationData *io_op
 	    GVfsDaemonSocketProtocolReply reply;
 	    char *data;
 	    data = decode_reply (file->input_buffer, &reply);
+	    GVFS_TRACE4 (client__read__reply, file, reply.seq_nr, reply.type, reply.arg1);
 
 	    if (reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR &&
 		reply.seq_nr == op->seq_nr)
@@ -117,6 +117,48 @@ handle_changed (GVfsDBusMonitorClient *object,
   return TRUE;
 }
 
+static gboolean
+handle_changed_many (GVfsDBusMonitorClient *object,
+                     GDBusMethodInvocation *invocation,
+                     GVariant *arg_mount_spec,
+                     GVariant *arg_events,
+                     gpointer user_data)
+{
+  GDaemonFileMonitor *monitor = G_DAEMON_FILE_MONITOR (user_data);
+  GMountSpec *spec;
+  GFile *file1, *file2;
+  GVariantIter iter;
+  guint32 event_type;
+  const gchar *file_path, *other_file_path;
+
+  /* Sent by the daemon for bursts of events, all for the same mount */
+  spec = g_mount_spec_from_dbus (arg_mount_spec);
+
+  g_variant_iter_init (&iter, arg_events);
+  while (g_variant_iter_next (&iter, "(u^&ay^&ay)",
+                              &event_type, &file_path, &other_file_path))
+    {
+      file1 = g_daemon_file_new (spec, file_path);
+      file2 = NULL;
+      if (*other_file_path != 0)
+        file2 = g_daemon_file_new (spec, other_file_path);
+
+      g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
+                                 file1, file2,
+                                 event_type);
+
+      g_object_unref (file1);
+      if (file2)
+        g_object_unref (file2);
+    }
+
+  g_mount_spec_unref (spec);
+
+  gvfs_dbus_monitor_client_complete_changed_many (object, invocation);
+
+  return TRUE;
+}
+
 static GDBusInterfaceSkeleton *
 register_vfs_filter_cb (GDBusConnection *connection,
                         const char *obj_path,
@@ -127,6 +169,7 @@ register_vfs_filter_cb (GDBusConnection *connection,
 
   skeleton = gvfs_dbus_monitor_client_skeleton_new ();
   g_signal_connect (skeleton, "handle-changed", G_CALLBACK (handle_changed), callback_data);
+  g_signal_connect (skeleton, "handle-changed-many", G_CALLBACK (handle_changed_many), callback_data);
 
   error = NULL;
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton),
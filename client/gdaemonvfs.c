@@ -1090,6 +1090,122 @@ enumerate_keys_callback (const char *key,
   return TRUE;
 }
 
+/* Per-enumeration state for local_file_add_info. GIO hands us the
+ * same extra_data for all the files of a local directory enumeration,
+ * so once we see a second file from the same directory we fetch the
+ * metadata of all children at once rather than looking up each file.
+ */
+typedef struct {
+  MetaLookupCache *cache;
+  char *dirname;
+  guint64 device;
+  guint n_files;
+  GHashTable *children; /* basename -> GFileInfo, NULL if not batched */
+} LocalFileMetadata;
+
+static void
+local_file_metadata_clear (LocalFileMetadata *data)
+{
+  g_free (data->dirname);
+  data->dirname = NULL;
+  data->n_files = 0;
+  if (data->children)
+    g_hash_table_destroy (data->children);
+  data->children = NULL;
+}
+
+static void
+local_file_metadata_free (LocalFileMetadata *data)
+{
+  local_file_metadata_clear (data);
+  meta_lookup_cache_free (data->cache);
+  g_free (data);
+}
+
+static gboolean
+enumerate_dir_keys_callback (const char *entry,
+			     const char *key,
+			     MetaKeyType type,
+			     gpointer value,
+			     gpointer user_data)
+{
+  GHashTable *children = user_data;
+  GFileInfo *info;
+
+  info = g_hash_table_lookup (children, entry);
+  if (info == NULL)
+    {
+      info = g_file_info_new ();
+      g_hash_table_insert (children, g_strdup (entry), info);
+    }
+
+  return enumerate_keys_callback (key, type, value, info);
+}
+
+static void
+copy_metadata_attributes (GFileInfo *src,
+			  GFileInfo *dest)
+{
+  GFileAttributeType type;
+  gpointer value_pp;
+  char **attributes;
+  int i;
+
+  attributes = g_file_info_list_attributes (src, "metadata");
+  for (i = 0; attributes[i] != NULL; i++)
+    {
+      if (g_file_info_get_attribute_data (src, attributes[i],
+					  &type, &value_pp, NULL))
+	g_file_info_set_attribute (dest, attributes[i], type, value_pp);
+    }
+  g_strfreev (attributes);
+}
+
+/* Fetches the metadata of every child of the directory filename is in,
+   returns FALSE if that is not possible */
+static gboolean
+local_file_metadata_fetch_dir (LocalFileMetadata *data,
+			       const char *filename,
+			       guint64 device)
+{
+  MetaTree *tree;
+  char *tree_path, *tree_dir, *tree_basename, *basename;
+  gboolean res;
+
+  tree = meta_lookup_cache_lookup_path (data->cache,
+					filename,
+					device,
+					FALSE,
+					&tree_path);
+  if (tree == NULL)
+    return FALSE;
+
+  /* The file must map to a child of a directory in the same tree,
+     which is not the case for e.g. the root of the home tree */
+  res = FALSE;
+  basename = g_path_get_basename (filename);
+  tree_basename = g_path_get_basename (tree_path);
+  if (strcmp (basename, tree_basename) == 0 &&
+      strcmp (tree_path, "/") != 0)
+    {
+      tree_dir = g_path_get_dirname (tree_path);
+      data->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, g_object_unref);
+      meta_tree_enumerate_dir_keys (tree, tree_dir,
+				    enumerate_dir_keys_callback,
+				    data->children);
+      g_free (tree_dir);
+      res = TRUE;
+    }
+
+  g_free (basename);
+  g_free (tree_basename);
+  g_free (tree_path);
+  meta_tree_unref (tree);
+
+  return res;
+}
+
 static void
 g_daemon_vfs_local_file_add_info (GVfs       *vfs,
 				  const char *filename,
@@ -1100,9 +1216,11 @@ g_daemon_vfs_local_file_add_info (GVfs       *vfs,
 				  gpointer    *extra_data,
 				  GDestroyNotify *extra_data_free)
 {
-  MetaLookupCache *cache;
+  LocalFileMetadata *data;
+  GFileInfo *child_info;
   const char *first;
   char *tree_path;
+  char *dirname, *basename;
   gboolean all;
   MetaTree *tree;
 
@@ -1122,12 +1240,41 @@ g_daemon_vfs_local_file_add_info (GVfs       *vfs,
 
   if (*extra_data == NULL)
     {
-      *extra_data = meta_lookup_cache_new ();
-      *extra_data_free = (GDestroyNotify)meta_lookup_cache_free;
+      data = g_new0 (LocalFileMetadata, 1);
+      data->cache = meta_lookup_cache_new ();
+      *extra_data = data;
+      *extra_data_free = (GDestroyNotify)local_file_metadata_free;
     }
-  cache = (MetaLookupCache *)*extra_data;
+  data = (LocalFileMetadata *)*extra_data;
 
-  tree = meta_lookup_cache_lookup_path (cache,
+  dirname = g_path_get_dirname (filename);
+  if (data->dirname == NULL ||
+      strcmp (data->dirname, dirname) != 0 ||
+      data->device != device)
+    {
+      local_file_metadata_clear (data);
+      data->dirname = dirname;
+      data->device = device;
+    }
+  else
+    g_free (dirname);
+
+  /* Single queries only ever see one file, so only fetch the whole
+     directory when this looks like an enumeration */
+  if (++data->n_files == 2)
+    local_file_metadata_fetch_dir (data, filename, device);
+
+  if (data->children != NULL)
+    {
+      basename = g_path_get_basename (filename);
+      child_info = g_hash_table_lookup (data->children, basename);
+      if (child_info)
+	copy_metadata_attributes (child_info, info);
+      g_free (basename);
+      return;
+    }
+
+  tree = meta_lookup_cache_lookup_path (data->cache,
 					filename,
 					device,
 					FALSE,
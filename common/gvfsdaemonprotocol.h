@@ -11,6 +11,7 @@ G_BEGIN_DECLS
 #define G_VFS_DBUS_MOUNTTRACKER_PATH "/org/gtk/vfs/mounttracker"
 #define G_VFS_DBUS_MOUNTABLE_PATH "/org/gtk/vfs/mountable"
 #define G_VFS_DBUS_DAEMON_PATH "/org/gtk/vfs/Daemon"
+#define G_VFS_DBUS_METRICS_PATH "/org/gtk/vfs/metrics"
 #define G_VFS_DBUS_METADATA_NAME "org.gtk.vfs.Metadata"
 #define G_VFS_DBUS_METADATA_PATH "/org/gtk/vfs/metadata"
 
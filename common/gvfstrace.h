@@ -0,0 +1,59 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __G_VFS_TRACE_H__
+#define __G_VFS_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Static tracing probes in the "gvfs" provider. With sys/sdt.h they
+ * compile to a single nop plus a note in the ELF file, which perf,
+ * bpftrace and SystemTap can attach to at runtime. Otherwise they
+ * compile to nothing. See tracing/ for scripts using them.
+ *
+ * Keep the argument lists of existing probes stable, the scripts
+ * refer to arguments by position.
+ */
+
+#ifdef HAVE_SDT_PROBES
+
+#include <sys/sdt.h>
+
+#define GVFS_TRACE0(name)                 DTRACE_PROBE (gvfs, name)
+#define GVFS_TRACE1(name, a1)             DTRACE_PROBE1 (gvfs, name, a1)
+#define GVFS_TRACE2(name, a1, a2)         DTRACE_PROBE2 (gvfs, name, a1, a2)
+#define GVFS_TRACE3(name, a1, a2, a3)     DTRACE_PROBE3 (gvfs, name, a1, a2, a3)
+#define GVFS_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4 (gvfs, name, a1, a2, a3, a4)
+
+#else
+
+#define GVFS_TRACE0(name)                 G_STMT_START { } G_STMT_END
+#define GVFS_TRACE1(name, a1)             G_STMT_START { } G_STMT_END
+#define GVFS_TRACE2(name, a1, a2)         G_STMT_START { } G_STMT_END
+#define GVFS_TRACE3(name, a1, a2, a3)     G_STMT_START { } G_STMT_END
+#define GVFS_TRACE4(name, a1, a2, a3, a4) G_STMT_START { } G_STMT_END
+
+#endif
+
+G_END_DECLS
+
+#endif /* __G_VFS_TRACE_H__ */
@@ -2707,7 +2707,7 @@ g_vfs_afp_volume_write_to_fork (GVfsAfpVolume       *volume,
   
   /* ReqCount */
   max_req_count = g_vfs_afp_server_get_max_request_size (volume->priv->server) - 20;
-  req_count = MIN (buffer_size, G_MAXUINT32);
+  req_count = MIN (buffer_size, max_req_count);
   g_vfs_afp_command_put_int64 (comm, req_count);
 
   g_vfs_afp_command_set_buffer (comm, buffer, req_count);
@@ -2756,6 +2756,18 @@ g_vfs_afp_volume_write_to_fork_finish (GVfsAfpVolume  *volume,
   return TRUE;
 }
 
+typedef struct
+{
+  gsize bytes_read;
+  gboolean eof;
+} ReadExtResult;
+
+static void
+read_ext_result_free (ReadExtResult *rr)
+{
+  g_slice_free (ReadExtResult, rr);
+}
+
 static void
 read_ext_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
@@ -2765,6 +2777,7 @@ read_ext_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
   GVfsAfpReply *reply;
   GError *err = NULL;
   AfpResultCode res_code;
+  ReadExtResult *rr;
 
   reply = g_vfs_afp_connection_send_command_finish (conn, res, &err);
   if (!reply)
@@ -2792,7 +2805,13 @@ read_ext_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
     goto done;
   }
 
-  g_simple_async_result_set_op_res_gssize (simple, g_vfs_afp_reply_get_size (reply));
+  /* The server may return fewer bytes than requested without being at the
+   * end of the fork, only kFPEOFErr says that the read hit the end */
+  rr = g_slice_new (ReadExtResult);
+  rr->bytes_read = g_vfs_afp_reply_get_size (reply);
+  rr->eof = (res_code == AFP_RESULT_EOF_ERR);
+  g_simple_async_result_set_op_res_gpointer (simple, rr,
+                                             (GDestroyNotify)read_ext_result_free);
   g_object_unref (reply);
 
 done:
@@ -2856,6 +2875,7 @@ g_vfs_afp_volume_read_from_fork (GVfsAfpVolume       *volume,
  * @volume: a #GVfsAfpVolume.
  * @result: a #GAsyncResult.
  * @bytes_read: (out) (allow-none): the number of bytes that were read.
+ * @eof: (out) (allow-none): %TRUE if the read reached the end of the fork.
  * @error: a #GError, %NULL to ignore.
  * 
  * Finalizes the asynchronous operation started by
@@ -2867,9 +2887,11 @@ gboolean
 g_vfs_afp_volume_read_from_fork_finish (GVfsAfpVolume  *volume,
                                         GAsyncResult   *res,
                                         gsize          *bytes_read,
+                                        gboolean       *eof,
                                         GError        **error)
 {
   GSimpleAsyncResult *simple;
+  ReadExtResult *rr;
   
   g_return_val_if_fail (g_simple_async_result_is_valid (res, G_OBJECT (volume),
                                                         g_vfs_afp_volume_read_from_fork),
@@ -2880,8 +2902,11 @@ g_vfs_afp_volume_read_from_fork_finish (GVfsAfpVolume  *volume,
   if (g_simple_async_result_propagate_error (simple, error))
     return FALSE;
 
+  rr = g_simple_async_result_get_op_res_gpointer (simple);
   if (bytes_read)
-    *bytes_read = g_simple_async_result_get_op_res_gssize (simple);
+    *bytes_read = rr->bytes_read;
+  if (eof)
+    *eof = rr->eof;
   
   return TRUE;
 }
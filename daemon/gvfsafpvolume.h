@@ -259,6 +259,7 @@ void          g_vfs_afp_volume_read_from_fork        (GVfsAfpVolume       *volum
 gboolean      g_vfs_afp_volume_read_from_fork_finish (GVfsAfpVolume  *volume,
                                                       GAsyncResult   *res,
                                                       gsize          *bytes_read,
+                                                      gboolean       *eof,
                                                       GError        **error);
 
 
@@ -32,6 +32,7 @@
 #include <glib/gi18n.h>
 #include "gvfsbackend.h"
 #include "gvfsjobsource.h"
+#include "gvfsjobmetrics.h"
 #include <gvfsjobopenforread.h>
 #include <gvfsjobopeniconforread.h>
 #include <gvfsjobopenforwrite.h>
@@ -79,6 +80,7 @@ struct _GVfsBackendPrivate
   char *default_location;
   GMountSpec *mount_spec;
   gboolean block_requests;
+  GVfsJobMetrics *metrics;
 };
 
 
@@ -152,6 +154,7 @@ g_vfs_backend_finalize (GObject *object)
   g_free (backend->priv->default_location);
   if (backend->priv->mount_spec)
     g_mount_spec_unref (backend->priv->mount_spec);
+  g_vfs_job_metrics_unref (backend->priv->metrics);
   
   if (G_OBJECT_CLASS (g_vfs_backend_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_parent_class)->finalize) (object);
@@ -202,6 +205,7 @@ g_vfs_backend_init (GVfsBackend *backend)
   backend->priv->stable_name = g_strdup ("");
   backend->priv->user_visible = TRUE;
   backend->priv->default_location = g_strdup ("");
+  backend->priv->metrics = g_vfs_job_metrics_new ();
 }
 
 static void
@@ -326,6 +330,18 @@ g_vfs_backend_get_daemon (GVfsBackend *backend)
   return backend->priv->daemon;
 }
 
+const char *
+g_vfs_backend_get_object_path (GVfsBackend *backend)
+{
+  return backend->priv->object_path;
+}
+
+GVfsJobMetrics *
+g_vfs_backend_get_metrics (GVfsBackend *backend)
+{
+  return backend->priv->metrics;
+}
+
 gboolean
 g_vfs_backend_is_mounted (GVfsBackend *backend)
 {
@@ -816,7 +832,8 @@ on_update_processes_timeout (gpointer user_data)
   UnmountWithOpData *data = user_data;
   GArray *processes;
 
-  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (data->backend));
+  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (data->backend),
+                                                   G_VFS_JOB_SOURCE (data->backend));
   if (processes->len == 0)
     {
       /* no more processes, abort mount op */
@@ -914,7 +931,8 @@ g_vfs_backend_unmount_with_operation (GVfsBackend        *backend,
   g_return_if_fail (G_IS_MOUNT_SOURCE (mount_source));
   g_return_if_fail (callback != NULL);
 
-  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (backend));
+  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (backend),
+                                                   G_VFS_JOB_SOURCE (backend));
   /* if no processes are blocking, complete immediately */
   if (processes->len == 0)
     {
@@ -973,7 +991,8 @@ g_vfs_backend_has_blocking_processes (GVfsBackend  *backend)
   GArray *processes;
 
   ret = FALSE;
-  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (backend));
+  processes = g_vfs_daemon_get_blocking_processes (g_vfs_backend_get_daemon (backend),
+                                                   G_VFS_JOB_SOURCE (backend));
   if (processes->len > 0)
     ret = TRUE;
 
@@ -489,6 +489,8 @@ GIcon      *g_vfs_backend_get_icon                       (GVfsBackend        *ba
 const char *g_vfs_backend_get_default_location           (GVfsBackend        *backend);
 GMountSpec *g_vfs_backend_get_mount_spec                 (GVfsBackend        *backend);
 GVfsDaemon *g_vfs_backend_get_daemon                     (GVfsBackend        *backend);
+const char *g_vfs_backend_get_object_path                (GVfsBackend        *backend);
+GVfsJobMetrics *g_vfs_backend_get_metrics                (GVfsBackend        *backend);
 gboolean    g_vfs_backend_is_mounted                     (GVfsBackend        *backend);
 
 void        g_vfs_backend_add_auto_info                  (GVfsBackend           *backend,
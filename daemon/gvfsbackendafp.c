@@ -23,6 +23,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -58,6 +59,11 @@
 
 #include "gvfsbackendafp.h"
 
+/* Number of FPReadExt/FPWriteExt requests kept in flight per open fork.
+ * Can be overridden with the GVFS_AFP_PIPELINE_DEPTH environment variable. */
+#define DEFAULT_PIPELINE_DEPTH 8
+#define MAX_PIPELINE_DEPTH 64
+
 struct _GVfsBackendAfpClass
 {
   GVfsBackendClass parent_class;
@@ -76,6 +82,8 @@ struct _GVfsBackendAfp
 
   guint32             user_id;
   guint32             group_id;
+
+  guint               pipeline_depth;
 };
 
 
@@ -130,8 +138,64 @@ typedef struct
   char *filename;
   char *tmp_filename;
   gboolean make_backup;
+
+  /* Read pipeline, used if type == AFP_HANDLE_TYPE_READ_FILE */
+  GQueue *read_chunks;
+  guint read_window;
+  gint64 read_ahead_offset;
+  gboolean read_eof;
+  GVfsJobRead *read_job;
+
+  /* Write pipeline, used for all other types */
+  guint writes_in_flight;
+  GError *write_error;
+  GVfsJob *write_job;
+  void (*write_job_func) (GVfsJob *job);
 } AfpHandle;
 
+typedef struct
+{
+  AfpHandle *afp_handle;
+
+  gint64 offset;
+  char *buffer;
+  gsize size;
+  gsize bytes_read;
+  gsize consumed;
+
+  gboolean done;
+  gboolean eof;
+  GError *error;
+} AfpReadChunk;
+
+static void
+afp_read_chunk_free (AfpReadChunk *chunk)
+{
+  g_free (chunk->buffer);
+  if (chunk->error)
+    g_error_free (chunk->error);
+
+  g_slice_free (AfpReadChunk, chunk);
+}
+
+/* Drops all chunks in the read pipeline. Chunks whose request is still in
+ * flight are orphaned and freed once their reply arrives. */
+static void
+afp_handle_clear_read_chunks (AfpHandle *afp_handle)
+{
+  AfpReadChunk *chunk;
+
+  while ((chunk = g_queue_pop_head (afp_handle->read_chunks)))
+  {
+    if (chunk->done)
+      afp_read_chunk_free (chunk);
+    else
+      chunk->afp_handle = NULL;
+  }
+
+  afp_handle->read_eof = FALSE;
+}
+
 static AfpHandle *
 afp_handle_new (GVfsBackendAfp *backend, gint16 fork_refnum)
 {
@@ -140,6 +204,8 @@ afp_handle_new (GVfsBackendAfp *backend, gint16 fork_refnum)
   afp_handle = g_slice_new0 (AfpHandle);
   afp_handle->backend = backend;
   afp_handle->fork_refnum = fork_refnum;
+  afp_handle->read_chunks = g_queue_new ();
+  afp_handle->read_window = 1;
 
   return afp_handle;
 }
@@ -149,10 +215,34 @@ afp_handle_free (AfpHandle *afp_handle)
 {
   g_free (afp_handle->filename);
   g_free (afp_handle->tmp_filename);
+
+  afp_handle_clear_read_chunks (afp_handle);
+  g_queue_free (afp_handle->read_chunks);
+
+  if (afp_handle->write_error)
+    g_error_free (afp_handle->write_error);
   
   g_slice_free (AfpHandle, afp_handle);
 }
 
+/* Size of a single FPReadExt/FPWriteExt request. The DSI request quantum
+ * bounds the payload of one request so larger transfers are split into
+ * several requests which are kept in flight at the same time. */
+static gsize
+get_chunk_size (GVfsBackendAfp *afp_backend)
+{
+  guint32 max_request_size;
+
+  max_request_size = g_vfs_afp_server_get_max_request_size (afp_backend->server);
+
+  /* Server didn't tell us its quantum, use the DSI default */
+  if (max_request_size == 0 || max_request_size == G_MAXUINT32)
+    max_request_size = 128 * 1024;
+
+  /* Leave room for the FPWriteExt command header */
+  return MAX (max_request_size, 4096 + 20) - 20;
+}
+
 /*
  * Backend code
  */
@@ -658,32 +748,90 @@ try_delete (GVfsBackend *backend,
   return TRUE;
 }
 
+/* Calls @func once all pipelined writes on @afp_handle have completed */
+static void
+afp_handle_wait_for_writes (AfpHandle *afp_handle,
+                            GVfsJob   *job,
+                            void     (*func) (GVfsJob *job))
+{
+  if (afp_handle->writes_in_flight == 0)
+  {
+    func (job);
+    return;
+  }
+
+  afp_handle->write_job = job;
+  afp_handle->write_job_func = func;
+}
+
+/* Fails @job with the error of an earlier pipelined write, if any */
+static gboolean
+afp_handle_take_write_error (AfpHandle *afp_handle, GVfsJob *job)
+{
+  if (!afp_handle->write_error)
+    return FALSE;
+
+  g_vfs_job_failed_from_error (job, afp_handle->write_error);
+  g_clear_error (&afp_handle->write_error);
+  return TRUE;
+}
+
+typedef struct
+{
+  AfpHandle *afp_handle;
+
+  gint64 offset;
+  char *buffer;
+  gsize size;
+} AfpWriteChunk;
+
 static void
 write_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
   GVfsAfpVolume *volume = G_VFS_AFP_VOLUME (source_object);
-  GVfsJobWrite *job = G_VFS_JOB_WRITE (user_data);
-  AfpHandle *afp_handle = (AfpHandle *)job->handle;
+  AfpWriteChunk *chunk = (AfpWriteChunk *)user_data;
+  AfpHandle *afp_handle = chunk->afp_handle;
 
   GError *err = NULL;
   gint64 last_written;
-  gsize written_size;
+  GVfsJob *job;
+
+  afp_handle->writes_in_flight--;
 
   if (!g_vfs_afp_volume_write_to_fork_finish (volume, res, &last_written, &err))
   {
-    g_vfs_job_failed_from_error (G_VFS_JOB (job), err);
-    g_error_free (err);
-    return;
+    if (!afp_handle->write_error)
+      afp_handle->write_error = err;
+    else
+      g_error_free (err);
+  }
+  else if (last_written != chunk->offset + (gint64)chunk->size &&
+           !afp_handle->write_error)
+  {
+    afp_handle->write_error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                                   _("Not all data could be written"));
   }
 
-  written_size = last_written - afp_handle->offset;
-  afp_handle->offset = last_written;
+  g_free (chunk->buffer);
+  g_slice_free (AfpWriteChunk, chunk);
 
-  if (afp_handle->type == AFP_HANDLE_TYPE_REPLACE_FILE_DIRECT)
-    afp_handle->size = MAX (last_written, afp_handle->size);
-  
-  g_vfs_job_write_set_written_size (job, written_size); 
-  g_vfs_job_succeeded (G_VFS_JOB (job));
+  job = afp_handle->write_job;
+  if (!job)
+    return;
+
+  /* A write job only waits for a free slot in the pipeline while other
+   * jobs wait for all outstanding writes to finish */
+  if (G_VFS_IS_JOB_WRITE (job))
+  {
+    afp_handle->write_job = NULL;
+    if (!afp_handle_take_write_error (afp_handle, job))
+      g_vfs_job_succeeded (job);
+  }
+  else if (afp_handle->writes_in_flight == 0)
+  {
+    afp_handle->write_job = NULL;
+    afp_handle->write_job_func (job);
+  }
 }
 
 static gboolean
@@ -696,9 +844,34 @@ try_write (GVfsBackend *backend,
   GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (backend);
   AfpHandle *afp_handle = (AfpHandle *)handle;
 
+  AfpWriteChunk *chunk;
+
+  if (afp_handle_take_write_error (afp_handle, G_VFS_JOB (job)))
+    return TRUE;
+
+  /* Copy the data so that the job can complete while the FPWriteExt request
+   * is still in flight. Errors are reported by the following operation. */
+  chunk = g_slice_new (AfpWriteChunk);
+  chunk->afp_handle = afp_handle;
+  chunk->offset = afp_handle->offset;
+  chunk->size = MIN (buffer_size, get_chunk_size (afp_backend));
+  chunk->buffer = g_memdup (buffer, chunk->size);
+
   g_vfs_afp_volume_write_to_fork (afp_backend->volume, afp_handle->fork_refnum,
-                                  buffer, buffer_size, afp_handle->offset,
-                                  G_VFS_JOB (job)->cancellable, write_cb, job);
+                                  chunk->buffer, chunk->size, chunk->offset,
+                                  G_VFS_JOB (job)->cancellable, write_cb, chunk);
+  afp_handle->writes_in_flight++;
+
+  afp_handle->offset += chunk->size;
+  if (afp_handle->type == AFP_HANDLE_TYPE_REPLACE_FILE_DIRECT)
+    afp_handle->size = MAX (afp_handle->offset, afp_handle->size);
+  
+  g_vfs_job_write_set_written_size (job, chunk->size);
+
+  if (afp_handle->writes_in_flight < afp_backend->pipeline_depth)
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+  else
+    afp_handle->write_job = G_VFS_JOB (job);
 
   return TRUE;
 }
@@ -747,15 +920,15 @@ seek_on_write_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
-static gboolean
-try_seek_on_write (GVfsBackend *backend,
-                   GVfsJobSeekWrite *job,
-                   GVfsBackendHandle handle,
-                   goffset    offset,
-                   GSeekType  type)
+static void
+seek_on_write_writes_done (GVfsJob *job_)
 {
-  GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (backend);
-  AfpHandle *afp_handle = (AfpHandle *)handle;
+  GVfsJobSeekWrite *job = G_VFS_JOB_SEEK_WRITE (job_);
+  GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (job->backend);
+  AfpHandle *afp_handle = (AfpHandle *)job->handle;
+
+  if (afp_handle_take_write_error (afp_handle, G_VFS_JOB (job)))
+    return;
 
   if (afp_handle->type == AFP_HANDLE_TYPE_REPLACE_FILE_DIRECT)
   {
@@ -787,7 +960,19 @@ try_seek_on_write (GVfsBackend *backend,
                                      AFP_FILE_BITMAP_EXT_DATA_FORK_LEN_BIT,
                                      G_VFS_JOB (job)->cancellable, seek_on_write_cb, job);
   }
-    
+}
+
+static gboolean
+try_seek_on_write (GVfsBackend *backend,
+                   GVfsJobSeekWrite *job,
+                   GVfsBackendHandle handle,
+                   goffset    offset,
+                   GSeekType  type)
+{
+  AfpHandle *afp_handle = (AfpHandle *)handle;
+
+  afp_handle_wait_for_writes (afp_handle, G_VFS_JOB (job),
+                              seek_on_write_writes_done);
   return TRUE;
 }
 
@@ -852,27 +1037,208 @@ try_seek_on_read (GVfsBackend *backend,
   return TRUE;
 }
 
+static void read_cb (GObject *source_object, GAsyncResult *res, gpointer user_data);
+
+/* Requests the part of the chunk that hasn't been read yet. Requests are
+ * tied to the read job waiting for them, prefetches aren't cancellable. */
+static void
+send_read_chunk (AfpHandle *afp_handle, AfpReadChunk *chunk)
+{
+  GVfsBackendAfp *afp_backend = afp_handle->backend;
+  GCancellable *cancellable = NULL;
+
+  if (afp_handle->read_job)
+    cancellable = G_VFS_JOB (afp_handle->read_job)->cancellable;
+
+  g_vfs_afp_volume_read_from_fork (afp_backend->volume, afp_handle->fork_refnum,
+                                   chunk->buffer + chunk->bytes_read,
+                                   chunk->size - chunk->bytes_read,
+                                   chunk->offset + chunk->bytes_read,
+                                   cancellable, read_cb, chunk);
+}
+
+static void
+fill_read_pipeline (AfpHandle *afp_handle)
+{
+  GVfsBackendAfp *afp_backend = afp_handle->backend;
+
+  gsize chunk_size;
+
+  chunk_size = get_chunk_size (afp_backend);
+  
+  while (!afp_handle->read_eof &&
+         g_queue_get_length (afp_handle->read_chunks) < afp_handle->read_window)
+  {
+    AfpReadChunk *chunk;
+
+    chunk = g_slice_new0 (AfpReadChunk);
+    chunk->afp_handle = afp_handle;
+    chunk->offset = afp_handle->read_ahead_offset;
+    chunk->size = chunk_size;
+    chunk->buffer = g_malloc (chunk_size);
+    
+    g_queue_push_tail (afp_handle->read_chunks, chunk);
+    afp_handle->read_ahead_offset += chunk_size;
+
+    send_read_chunk (afp_handle, chunk);
+  }
+}
+
+static void
+serve_read_job (AfpHandle *afp_handle)
+{
+  GVfsJobRead *job = afp_handle->read_job;
+
+  AfpReadChunk *chunk;
+  gsize copied = 0;
+  gboolean eof = FALSE;
+
+  while (job && copied < job->bytes_requested)
+  {
+    gsize size;
+    
+    chunk = g_queue_peek_head (afp_handle->read_chunks);
+    if (!chunk || !chunk->done)
+      break;
+
+    if (chunk->error)
+    {
+      /* Return what we have, the error is reported by the next read */
+      if (copied > 0)
+        break;
+
+      afp_handle->read_job = NULL;
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), chunk->error);
+      afp_handle_clear_read_chunks (afp_handle);
+      afp_handle->read_window = 1;
+      return;
+    }
+
+    /* An empty chunk marks end of file */
+    if (chunk->bytes_read == 0)
+    {
+      eof = TRUE;
+      break;
+    }
+
+    size = MIN (job->bytes_requested - copied, chunk->bytes_read - chunk->consumed);
+    memcpy (job->buffer + copied, chunk->buffer + chunk->consumed, size);
+    chunk->consumed += size;
+    copied += size;
+
+    if (chunk->consumed == chunk->bytes_read)
+    {
+      g_queue_pop_head (afp_handle->read_chunks);
+      
+      /* The pipeline was cut at end of file, restart it from here */
+      if (chunk->eof)
+      {
+        afp_handle->read_eof = FALSE;
+        afp_handle->read_ahead_offset = chunk->offset + chunk->bytes_read;
+      }
+      afp_read_chunk_free (chunk);
+
+      /* Sequential access, widen the window */
+      if (afp_handle->read_window < afp_handle->backend->pipeline_depth)
+        afp_handle->read_window++;
+    }
+  }
+
+  if (job && (copied > 0 || eof))
+  {
+    afp_handle->read_job = NULL;
+    afp_handle->offset += copied;
+    g_vfs_job_read_set_size (job, copied);
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+  }
+
+  /* Don't read past the end of file, the next read restarts the pipeline
+   * in case the file has grown */
+  if (eof && copied == 0)
+  {
+    afp_handle_clear_read_chunks (afp_handle);
+    afp_handle->read_window = 1;
+    return;
+  }
+
+  fill_read_pipeline (afp_handle);
+}
+
 static void
 read_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
   GVfsAfpVolume *volume = G_VFS_AFP_VOLUME (source_object);
-  GVfsJobRead *job = G_VFS_JOB_READ (user_data);
-  AfpHandle *afp_handle = (AfpHandle *)job->handle;
+  AfpReadChunk *chunk = (AfpReadChunk *)user_data;
+  AfpHandle *afp_handle = chunk->afp_handle;
 
-  GError *err = NULL;
-  gsize bytes_read;
+  gsize bytes_read = 0;
+  gboolean eof = FALSE;
+
+  if (g_vfs_afp_volume_read_from_fork_finish (volume, res, &bytes_read, &eof,
+                                              &chunk->error))
+    chunk->bytes_read += bytes_read;
 
-  if (!g_vfs_afp_volume_read_from_fork_finish (volume, res, &bytes_read, &err))
+  /* Orphaned by a seek or close */
+  if (!afp_handle)
   {
-    g_vfs_job_failed_from_error (G_VFS_JOB (job), err);
+    afp_read_chunk_free (chunk);
+    return;
+  }
+
+  /* A short reply doesn't mean end of file, ask for the rest */
+  if (!chunk->error && !eof && bytes_read > 0 &&
+      chunk->bytes_read < chunk->size)
+  {
+    send_read_chunk (afp_handle, chunk);
+    return;
+  }
+
+  chunk->done = TRUE;
+  chunk->eof = !chunk->error && (eof || bytes_read == 0);
+
+  if (g_error_matches (chunk->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+  {
+    GVfsJobRead *job = afp_handle->read_job;
+    GError *err;
+
+    err = chunk->error;
+    chunk->error = NULL;
+
+    /* Start over from the current offset unless the waiting job is the one
+     * that was cancelled */
+    afp_handle_clear_read_chunks (afp_handle);
+    afp_handle->read_window = 1;
+    afp_handle->read_ahead_offset = afp_handle->offset;
+
+    if (job && g_cancellable_is_cancelled (G_VFS_JOB (job)->cancellable))
+    {
+      afp_handle->read_job = NULL;
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), err);
+    }
+    else
+      serve_read_job (afp_handle);
+
     g_error_free (err);
     return;
   }
 
-  afp_handle->offset += bytes_read;
-  g_vfs_job_read_set_size (job, bytes_read);
-  
-  g_vfs_job_succeeded (G_VFS_JOB (job));
+  if (chunk->error || chunk->eof)
+  {
+    AfpReadChunk *tail;
+    
+    /* Requests after end of file or an error are pointless */
+    while ((tail = g_queue_peek_tail (afp_handle->read_chunks)) != chunk)
+    {
+      g_queue_pop_tail (afp_handle->read_chunks);
+      if (tail->done)
+        afp_read_chunk_free (tail);
+      else
+        tail->afp_handle = NULL;
+    }
+    afp_handle->read_eof = TRUE;
+  }
+
+  serve_read_job (afp_handle);
 }
   
 static gboolean 
@@ -882,12 +1248,24 @@ try_read (GVfsBackend *backend,
           char *buffer,
           gsize bytes_requested)
 {
-  GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (backend);
   AfpHandle *afp_handle = (AfpHandle *)handle;
 
-  g_vfs_afp_volume_read_from_fork (afp_backend->volume, afp_handle->fork_refnum,
-                                   buffer, bytes_requested, afp_handle->offset,
-                                   G_VFS_JOB (job)->cancellable, read_cb, job);
+  AfpReadChunk *chunk;
+
+  /* Throw away the pipeline if the client seeked */
+  chunk = g_queue_peek_head (afp_handle->read_chunks);
+  if (chunk && chunk->offset + (gint64)chunk->consumed != afp_handle->offset)
+  {
+    afp_handle_clear_read_chunks (afp_handle);
+    afp_handle->read_window = 1;
+  }
+
+  if (g_queue_is_empty (afp_handle->read_chunks))
+    afp_handle->read_ahead_offset = afp_handle->offset;
+
+  afp_handle->read_job = job;
+  serve_read_job (afp_handle);
+
   return TRUE;
 }
 
@@ -1055,13 +1433,26 @@ close_replace_set_fork_size_cb (GObject *source_object, GAsyncResult *res, gpoin
                                    close_write_get_fork_parms_cb, job);
 }
 
-static gboolean
-try_close_write (GVfsBackend *backend,
-                 GVfsJobCloseWrite *job,
-                 GVfsBackendHandle handle)
+static void
+close_write_writes_done (GVfsJob *job_)
 {
-  GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (backend);
-  AfpHandle *afp_handle = (AfpHandle *)handle;
+  GVfsJobCloseWrite *job = G_VFS_JOB_CLOSE_WRITE (job_);
+  GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (job->backend);
+  AfpHandle *afp_handle = (AfpHandle *)job->handle;
+
+  if (afp_handle->write_error)
+  {
+    /* Don't replace the original file with a partially written one */
+    g_vfs_afp_volume_close_fork (afp_backend->volume, afp_handle->fork_refnum,
+                                 NULL, NULL, NULL);
+    if (afp_handle->type == AFP_HANDLE_TYPE_REPLACE_FILE_TEMP)
+      g_vfs_afp_volume_delete (afp_backend->volume, afp_handle->tmp_filename,
+                               NULL, NULL, NULL);
+
+    afp_handle_take_write_error (afp_handle, G_VFS_JOB (job));
+    afp_handle_free (afp_handle);
+    return;
+  }
   
   if (afp_handle->type == AFP_HANDLE_TYPE_REPLACE_FILE_TEMP)
   {
@@ -1084,7 +1475,17 @@ try_close_write (GVfsBackend *backend,
                                      G_VFS_JOB (job)->cancellable,
                                      close_write_get_fork_parms_cb, job);
   }
-  
+}
+
+static gboolean
+try_close_write (GVfsBackend *backend,
+                 GVfsJobCloseWrite *job,
+                 GVfsBackendHandle handle)
+{
+  AfpHandle *afp_handle = (AfpHandle *)handle;
+
+  afp_handle_wait_for_writes (afp_handle, G_VFS_JOB (job),
+                              close_write_writes_done);
   return TRUE;
 }
 
@@ -2126,11 +2527,18 @@ static void
 g_vfs_backend_afp_init (GVfsBackendAfp *object)
 {
   GVfsBackendAfp *afp_backend = G_VFS_BACKEND_AFP (object);
+
+  const char *depth;
   
   afp_backend->volume_name = NULL;
   afp_backend->user = NULL;
 
   afp_backend->addr = NULL;
+
+  afp_backend->pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+  depth = g_getenv ("GVFS_AFP_PIPELINE_DEPTH");
+  if (depth)
+    afp_backend->pipeline_depth = CLAMP (atoi (depth), 1, MAX_PIPELINE_DEPTH);
 }
 
 static void
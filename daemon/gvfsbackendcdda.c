@@ -80,7 +80,6 @@
  *     specify whether he wants us to try hard to get the hard result (ripping) or whether 
  *     he's fine with some noise (playback)
  *
- * - Sector cache? Might be useful to maintain a cache of previously read sectors
  */
 
 /*--------------------------------------------------------------------------------------------------------------*/
@@ -107,6 +106,7 @@ struct _GVfsBackendCdda
 
   char *device_path;
   cdrom_drive_t *drive;
+  GMutex drive_lock; /* held by reader threads while using the drive */
   int num_open_files;
 
   /* Metadata from CD-Text */
@@ -285,6 +285,8 @@ g_vfs_backend_cdda_finalize (GObject *object)
   release_device (cdda_backend);
   release_metadata (cdda_backend);
 
+  g_mutex_clear (&cdda_backend->drive_lock);
+
   if (G_OBJECT_CLASS (g_vfs_backend_cdda_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_cdda_parent_class)->finalize) (object);
 }
@@ -298,6 +300,8 @@ g_vfs_backend_cdda_init (GVfsBackendCdda *cdda_backend)
 
   //g_warning ("initing %p", cdda_backend);
 
+  g_mutex_init (&cdda_backend->drive_lock);
+
   g_vfs_backend_set_display_name (backend, "cdda");
   g_vfs_backend_set_x_content_types (backend, x_content_types);
   // TODO: HMM: g_vfs_backend_set_user_visible (backend, FALSE);  
@@ -539,7 +543,12 @@ get_track_num_from_name (GVfsBackendCdda *cdda_backend, const char *filename)
   return -1;
 }
 
+/* Number of sectors read ahead of the cursor of an open track, 75
+ * sectors make up one second of audio */
+#define READ_AHEAD_SECTORS (75 * 4)
+
 typedef struct {
+  GVfsBackendCdda *backend;
   cdrom_paranoia_t *paranoia;
 
   long size;           /* size of file being read */
@@ -550,23 +559,111 @@ typedef struct {
 
   long first_sector;   /* first sector of raw PCM audio data */
   long last_sector;    /* last sector of raw PCM audio data */
-  long sector_cursor;  /* sector we're currently at */
+  long sector_cursor;  /* sector paranoia is at, only used by the reader */
 
   char *header;        /* header payload */
 
-  /* These following two fields are used for caching the last read sector. This
-   * is to avoid seeking back if fewer bytes than whole sector is requested.
+  /* A reader thread keeps a ring of READ_AHEAD_SECTORS sectors filled
+   * ahead of the cursor, sector n lives in slot n % READ_AHEAD_SECTORS.
+   * The fields below are protected by lock.
    */
-  long buf_at_sector_num;                     /* the sector that is cached */
-  char buf_at_sector[CDIO_CD_FRAMESIZE_RAW];  /* the data of the sector */
+  GThread *reader;
+  GMutex lock;
+  GCond cond;
+  char *ring;
+  long ring_start;     /* first sector in the ring */
+  long ring_count;     /* number of sectors available from ring_start */
+  guint generation;    /* bumped when the ring is restarted elsewhere */
+  int read_errno;      /* set if reading at ring_start + ring_count failed */
+  gboolean stop;
 
 } ReadHandle;
 
+/* We have to pass in a callback to paranoia_read, even though we don't use it */
+static void 
+paranoia_callback (long int inpos, paranoia_cb_mode_t function)
+{
+}
+
+static gpointer
+reader_thread_func (gpointer data)
+{
+  ReadHandle *read_handle = data;
+  GVfsBackendCdda *cdda_backend = read_handle->backend;
+  long sector;
+  guint generation;
+  char *readbuf;
+  int errsv;
+
+  g_mutex_lock (&read_handle->lock);
+
+  while (!read_handle->stop)
+    {
+      sector = read_handle->ring_start + read_handle->ring_count;
+
+      /* Wait while the ring is full, we're at the end of the track or
+         the last read failed, until the consumer moves on */
+      if (read_handle->ring_count == READ_AHEAD_SECTORS ||
+          sector > read_handle->last_sector ||
+          read_handle->read_errno != 0)
+        {
+          g_cond_wait (&read_handle->cond, &read_handle->lock);
+          continue;
+        }
+
+      generation = read_handle->generation;
+      g_mutex_unlock (&read_handle->lock);
+
+      g_mutex_lock (&cdda_backend->drive_lock);
+      if (sector != read_handle->sector_cursor)
+        cdio_paranoia_seek (read_handle->paranoia, sector, SEEK_SET);
+      readbuf = (char *) cdio_paranoia_read (read_handle->paranoia, paranoia_callback);
+      errsv = errno;
+      g_mutex_unlock (&cdda_backend->drive_lock);
+
+      read_handle->sector_cursor = readbuf != NULL ? sector + 1 : -1;
+
+      g_mutex_lock (&read_handle->lock);
+
+      /* The consumer seeked away while we were reading */
+      if (generation != read_handle->generation)
+        continue;
+
+      if (readbuf == NULL)
+        read_handle->read_errno = errsv != 0 ? errsv : EIO;
+      else
+        {
+          memcpy (read_handle->ring + (sector % READ_AHEAD_SECTORS) * CDIO_CD_FRAMESIZE_RAW,
+                  readbuf, CDIO_CD_FRAMESIZE_RAW);
+          read_handle->ring_count++;
+        }
+
+      g_cond_broadcast (&read_handle->cond);
+    }
+
+  g_mutex_unlock (&read_handle->lock);
+
+  return NULL;
+}
+
 static void
 free_read_handle (ReadHandle *read_handle)
 {
+  if (read_handle->reader != NULL)
+    {
+      g_mutex_lock (&read_handle->lock);
+      read_handle->stop = TRUE;
+      g_cond_broadcast (&read_handle->cond);
+      g_mutex_unlock (&read_handle->lock);
+
+      g_thread_join (read_handle->reader);
+    }
+
   if (read_handle->paranoia != NULL)
     cdio_paranoia_free (read_handle->paranoia);
+  g_mutex_clear (&read_handle->lock);
+  g_cond_clear (&read_handle->cond);
+  g_free (read_handle->ring);
   g_free (read_handle->header);
   g_free (read_handle);
 }
@@ -692,6 +789,9 @@ do_open_for_read (GVfsBackend *backend,
   //g_warning ("open_for_read (%s)", filename);
 
   read_handle = g_new0 (ReadHandle, 1);
+  read_handle->backend = cdda_backend;
+  g_mutex_init (&read_handle->lock);
+  g_cond_init (&read_handle->cond);
 
   track_num = get_track_num_from_name (cdda_backend, job->filename);
   if (track_num == -1)
@@ -709,7 +809,6 @@ do_open_for_read (GVfsBackend *backend,
   read_handle->sector_cursor = -1;
 
   read_handle->cursor = 0;
-  read_handle->buf_at_sector_num = -1;
   read_handle->content_size  = ((read_handle->last_sector - read_handle->first_sector) + 1) * CDIO_CD_FRAMESIZE_RAW;
 
   read_handle->header = create_header (cdda_backend, &(read_handle->header_size), read_handle->content_size);
@@ -718,6 +817,11 @@ do_open_for_read (GVfsBackend *backend,
   read_handle->paranoia = cdio_paranoia_init (cdda_backend->drive);
   cdio_paranoia_modeset (read_handle->paranoia, PARANOIA_MODE_DISABLE);
 
+  /* Start reading the audio right away, most readers will want it */
+  read_handle->ring = g_malloc (READ_AHEAD_SECTORS * CDIO_CD_FRAMESIZE_RAW);
+  read_handle->ring_start = read_handle->first_sector;
+  read_handle->reader = g_thread_new ("cdda reader", reader_thread_func, read_handle);
+
   cdda_backend->num_open_files++;
 
   g_vfs_job_open_for_read_set_can_seek (job, TRUE);
@@ -725,13 +829,6 @@ do_open_for_read (GVfsBackend *backend,
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
-/* We have to pass in a callback to paranoia_read, even though we don't use it */
-static void 
-paranoia_callback (long int inpos, paranoia_cb_mode_t function)
-{
-}
-
-
 static void
 do_read (GVfsBackend *backend,
          GVfsJobRead *job,
@@ -741,98 +838,95 @@ do_read (GVfsBackend *backend,
 {
   GVfsBackendCdda *cdda_backend = G_VFS_BACKEND_CDDA (backend);
   ReadHandle *read_handle = (ReadHandle *) handle;
-  int bytes_read;
   long skip_bytes;
-  char *readbuf;
   long desired_sector;
-  int bytes_to_copy;
+  long sector;
+  gsize bytes_to_copy;
+  gsize n;
   long cursor_in_stream;
+  int errsv;
 
   //g_warning ("read (%"G_GSSIZE_FORMAT") (@ %ld)", bytes_requested, read_handle->cursor);
 
   /* header */
   if (read_handle->cursor < read_handle->header_size)
     {
-      skip_bytes = read_handle->cursor;
-      bytes_read = read_handle->header_size - read_handle->cursor;
-      readbuf = read_handle->header + skip_bytes;
+      bytes_to_copy = MIN (bytes_requested, read_handle->header_size - read_handle->cursor);
+      memcpy (buffer, read_handle->header + read_handle->cursor, bytes_to_copy);
       goto read_data_done;
     }
 
   /* EOF */
   if (read_handle->cursor >= read_handle->size)
     {
-      skip_bytes = 0;
-      bytes_read = 0;
-      readbuf = NULL;
+      bytes_to_copy = 0;
       goto read_data_done;
     }
 
   cursor_in_stream = read_handle->cursor - read_handle->header_size;
 
   desired_sector = cursor_in_stream / CDIO_CD_FRAMESIZE_RAW + read_handle->first_sector;
+  skip_bytes = cursor_in_stream - (desired_sector - read_handle->first_sector) * CDIO_CD_FRAMESIZE_RAW;
 
-  if (desired_sector == read_handle->buf_at_sector_num)
-    {
-      /* got it cached */
-
-      /* skip some bytes */
-      skip_bytes = cursor_in_stream - (desired_sector - read_handle->first_sector) * CDIO_CD_FRAMESIZE_RAW;
-      readbuf = read_handle->buf_at_sector + skip_bytes;
-      bytes_read = CDIO_CD_FRAMESIZE_RAW - skip_bytes;
+  g_mutex_lock (&read_handle->lock);
 
-      //g_warning ("read from cache for cursor @ %ld", read_handle->buf_at_sector_num);
+  if (desired_sector < read_handle->ring_start ||
+      desired_sector > read_handle->ring_start + read_handle->ring_count)
+    {
+      /* Seeked outside of what we have, restart the reader there */
+      //g_warning ("restarting reader at %ld", desired_sector);
+      read_handle->ring_start = desired_sector;
+      read_handle->ring_count = 0;
+      read_handle->read_errno = 0;
+      read_handle->generation++;
     }
   else
     {
-      /* first check that we're at the right sector */
-      if (desired_sector != read_handle->sector_cursor)
-        {
-          cdio_paranoia_seek (read_handle->paranoia, desired_sector, SEEK_SET);
-          read_handle->sector_cursor = desired_sector;
-          //g_warning ("seeking cursor to %ld", read_handle->sector_cursor);
-        }
-      
-      /* skip some bytes */
-      skip_bytes = cursor_in_stream - (read_handle->sector_cursor - read_handle->first_sector) * CDIO_CD_FRAMESIZE_RAW;
-      //g_warning ("advanced cursor to %ld", read_handle->sector_cursor);
-      
-      readbuf = (char *) cdio_paranoia_read (read_handle->paranoia, paranoia_callback);
+      /* Sectors before the cursor won't be needed again, make room */
+      read_handle->ring_count -= desired_sector - read_handle->ring_start;
+      read_handle->ring_start = desired_sector;
+    }
+  g_cond_broadcast (&read_handle->cond);
 
-      if (readbuf == NULL)
-        {
-          int errsv = errno;
+  while (read_handle->ring_count == 0 && read_handle->read_errno == 0)
+    g_cond_wait (&read_handle->cond, &read_handle->lock);
 
-          g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
-                            g_io_error_from_errno (errsv),
-                            /* Translators: paranoia is the name of the cd audio reading library */
-                            _("Error from 'paranoia' on drive %s"), cdda_backend->device_path);
-          return;
-        }
-
-      read_handle->buf_at_sector_num = read_handle->sector_cursor;
-      memcpy (read_handle->buf_at_sector, readbuf, CDIO_CD_FRAMESIZE_RAW);
+  if (read_handle->ring_count == 0)
+    {
+      errsv = read_handle->read_errno;
+      /* Let the next read retry */
+      read_handle->read_errno = 0;
+      g_cond_broadcast (&read_handle->cond);
+      g_mutex_unlock (&read_handle->lock);
 
-      read_handle->sector_cursor++;
+      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
+                        g_io_error_from_errno (errsv),
+                        /* Translators: paranoia is the name of the cd audio reading library */
+                        _("Error from 'paranoia' on drive %s"), cdda_backend->device_path);
+      return;
+    }
 
-      readbuf += skip_bytes;
-      bytes_read = CDIO_CD_FRAMESIZE_RAW - skip_bytes;
+  /* Hand out everything that's available, up to what was asked for.
+     The reader never touches available sectors, so no need to hold
+     the lock while copying */
+  bytes_to_copy = MIN (bytes_requested,
+                       read_handle->ring_count * CDIO_CD_FRAMESIZE_RAW - skip_bytes);
+  g_mutex_unlock (&read_handle->lock);
 
+  for (sector = desired_sector, n = 0; n < bytes_to_copy; sector++)
+    {
+      gsize len = MIN (bytes_to_copy - n, CDIO_CD_FRAMESIZE_RAW - skip_bytes);
 
+      memcpy (buffer + n,
+              read_handle->ring + (sector % READ_AHEAD_SECTORS) * CDIO_CD_FRAMESIZE_RAW + skip_bytes,
+              len);
+      n += len;
+      skip_bytes = 0;
     }
-  
- read_data_done:
 
-  bytes_to_copy = bytes_read;
-  if (bytes_requested < bytes_read)
-    bytes_to_copy = bytes_requested;
+ read_data_done:
 
   read_handle->cursor += bytes_to_copy;
-  cursor_in_stream = read_handle->cursor - read_handle->header_size;
-
-
-  if (bytes_to_copy > 0 && readbuf != NULL)
-    memcpy (buffer, readbuf, bytes_to_copy);
 
   g_vfs_job_read_set_size (job, bytes_to_copy);
   g_vfs_job_succeeded (G_VFS_JOB (job));
@@ -38,6 +38,7 @@
 /* LibXML2 includes */
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/SAX2.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
@@ -56,7 +57,11 @@
 #include "gvfsjobqueryfsinfo.h"
 #include "gvfsjobqueryattributes.h"
 #include "gvfsjobenumerate.h"
+#include "gvfsjobclosewrite.h"
+#include "gvfsjobcreatemonitor.h"
+#include "gvfspollmonitor.h"
 #include "gvfsdaemonprotocol.h"
+#include "gvfstrace.h"
 
 #include "soup-input-stream.h"
 #include "soup-output-stream.h"
@@ -70,6 +75,10 @@ typedef struct _MountAuthData MountAuthData;
 
 static void mount_auth_info_free (MountAuthData *info);
 
+typedef struct _PropCacheEntry PropCacheEntry;
+
+static void prop_cache_entry_free (PropCacheEntry *entry);
+
 
 #ifdef HAVE_AVAHI
 static void dns_sd_resolver_changed  (GVfsDnsSdResolver *resolver, GVfsBackendDav *dav_backend);
@@ -102,6 +111,10 @@ struct _GVfsBackendDav
 
   MountAuthData auth_info;
 
+  /* Properties from recent PROPFINDs, see PROP_CACHE_TTL */
+  GHashTable *prop_cache;
+  GMutex prop_cache_lock;
+
 #ifdef HAVE_AVAHI
   /* only set if we're handling a [dav|davs]+sd:// mounts */
   GVfsDnsSdResolver *resolver;
@@ -126,6 +139,9 @@ g_vfs_backend_dav_finalize (GObject *object)
 #endif
 
   mount_auth_info_free (&(dav_backend->auth_info));
+
+  g_hash_table_destroy (dav_backend->prop_cache);
+  g_mutex_clear (&dav_backend->prop_cache_lock);
   
   if (G_OBJECT_CLASS (g_vfs_backend_dav_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_dav_parent_class)->finalize) (object);
@@ -135,6 +151,10 @@ static void
 g_vfs_backend_dav_init (GVfsBackendDav *backend)
 {
   g_vfs_backend_set_user_visible (G_VFS_BACKEND (backend), TRUE);
+
+  backend->prop_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) prop_cache_entry_free);
+  g_mutex_init (&backend->prop_cache_lock);
 }
 
 /* ************************************************************************* */
@@ -503,6 +523,7 @@ g_vfs_backend_dav_send_message (GVfsBackend *backend, SoupMessage *message)
 {
   GVfsBackendHttp *http_backend;
   SoupSession     *session;
+  guint            status;
 
   http_backend = G_VFS_BACKEND_HTTP (backend);
   session = http_backend->session;
@@ -513,7 +534,11 @@ g_vfs_backend_dav_send_message (GVfsBackend *backend, SoupMessage *message)
   soup_message_add_header_handler (message, "got_body", "Location",
                                    G_CALLBACK (redirect_handler), session);
 
-  return http_backend_send_message (backend, message);
+  GVFS_TRACE3 (dav__request, backend, message, message->method);
+  status = http_backend_send_message (backend, message);
+  GVFS_TRACE3 (dav__response, backend, message, status);
+
+  return status;
 }
 
 /* ************************************************************************* */
@@ -1397,6 +1422,488 @@ stat_location (GVfsBackend  *backend,
 }
 
 
+/* ************************************************************************* */
+/* Streaming multistatus parsing */
+
+/* Big collections produce multistatus replies of many megabytes. Instead
+ * of building the whole document, the reply is fed to a push parser as it
+ * arrives and every <response> element is handed out and freed as soon
+ * as it is complete.
+ */
+
+typedef void (*MsResponseFunc) (MsResponse *response,
+                                gpointer    user_data);
+
+typedef struct _MsStream {
+
+  Multistatus       multistatus;
+  xmlParserCtxtPtr  ctxt;
+
+  MsResponseFunc    func;
+  gpointer          user_data;
+
+} MsStream;
+
+static void
+ms_stream_end_element (void          *ctx,
+                       const xmlChar *localname,
+                       const xmlChar *prefix,
+                       const xmlChar *URI)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  MsStream        *stream;
+  xmlNodePtr       node;
+  xmlNodeIter      iter;
+  MsResponse       response;
+
+  stream = ctxt->_private;
+  node = ctxt->node;
+
+  xmlSAX2EndElementNs (ctx, localname, prefix, URI);
+
+  if (node == NULL || node->parent == NULL ||
+      node->parent != xmlDocGetRootElement (ctxt->myDoc) ||
+      ! node_has_name_ns (node, "response", "DAV:"))
+    return;
+
+  iter.cur_node = node;
+  iter.next_node = NULL;
+  iter.name = "response";
+  iter.ns_href = "DAV:";
+  iter.user_data = &stream->multistatus;
+
+  if (multistatus_get_response (&iter, &response))
+    {
+      stream->func (&response, stream->user_data);
+      ms_response_clear (&response);
+    }
+
+  /* Done with it, keep the document small */
+  xmlUnlinkNode (node);
+  xmlFreeNode (node);
+}
+
+static void
+ms_stream_got_chunk (SoupMessage *msg,
+                     SoupBuffer  *chunk,
+                     gpointer     user_data)
+{
+  MsStream *stream = user_data;
+
+  /* Bodies of redirects and auth challenges are not for us */
+  if (! SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    return;
+
+  if (stream->ctxt == NULL)
+    {
+      SoupURI *uri;
+
+      uri = soup_message_get_uri (msg);
+      stream->multistatus.target = uri;
+      stream->multistatus.path = g_uri_unescape_string (uri->path, "/");
+
+      stream->ctxt = xmlCreatePushParserCtxt (NULL, NULL, NULL, 0,
+                                              "response.xml");
+      if (stream->ctxt == NULL)
+        return;
+
+      xmlCtxtUseOptions (stream->ctxt,
+                         XML_PARSE_NONET |
+                         XML_PARSE_NOWARNING |
+                         XML_PARSE_NOBLANKS |
+                         XML_PARSE_NSCLEAN |
+                         XML_PARSE_NOCDATA |
+                         XML_PARSE_COMPACT);
+      stream->ctxt->_private = stream;
+      stream->ctxt->sax->endElementNs = ms_stream_end_element;
+    }
+
+  xmlParseChunk (stream->ctxt, chunk->data, chunk->length, 0);
+}
+
+/* Sends @msg and calls @func for every response in the multistatus reply
+ * while it is being received. Note that @func may already have been
+ * called when this fails. */
+static gboolean
+multistatus_parse_streaming (GVfsBackend     *backend,
+                             SoupMessage     *msg,
+                             MsResponseFunc   func,
+                             gpointer         user_data,
+                             GError         **error)
+{
+  MsStream    stream;
+  xmlNodePtr  root;
+  gulong      handler;
+  gboolean    res;
+
+  memset (&stream, 0, sizeof (stream));
+  stream.func = func;
+  stream.user_data = user_data;
+
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+  handler = g_signal_connect (msg, "got-chunk",
+                              G_CALLBACK (ms_stream_got_chunk), &stream);
+
+  g_vfs_backend_dav_send_message (backend, msg);
+
+  g_signal_handler_disconnect (msg, handler);
+
+  if (! SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    {
+      g_set_error (error, G_IO_ERROR, http_to_gio_error (msg->status_code),
+                   _("HTTP Error: %s"), msg->reason_phrase);
+      res = FALSE;
+    }
+  else if (stream.ctxt == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           _("Empty response"));
+      res = FALSE;
+    }
+  else
+    {
+      xmlParseChunk (stream.ctxt, NULL, 0, 1);
+      root = stream.ctxt->myDoc ? xmlDocGetRootElement (stream.ctxt->myDoc) : NULL;
+
+      if (! stream.ctxt->wellFormed)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("Could not parse response"));
+          res = FALSE;
+        }
+      else if (root == NULL || strcmp ((char *) root->name, "multistatus"))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("Unexpected reply from server"));
+          res = FALSE;
+        }
+      else
+        res = TRUE;
+    }
+
+  if (stream.ctxt)
+    {
+      if (stream.ctxt->myDoc)
+        xmlFreeDoc (stream.ctxt->myDoc);
+      xmlFreeParserCtxt (stream.ctxt);
+    }
+  g_free (stream.multistatus.path);
+
+  return res;
+}
+
+/* ************************************************************************* */
+/* Property cache */
+
+/* Time in seconds properties from a PROPFIND are reused without asking
+ * the server again. Clients typically enumerate a directory and then
+ * query each child right after, which is answered from the listing. */
+#define PROP_CACHE_TTL 10
+
+/* Once a listing is older than PROP_CACHE_TTL it can still be reused
+ * if the collection's ETag is unchanged, but only up to this age in
+ * seconds: not every server changes collection ETags when a child is
+ * modified (as opposed to added or removed). */
+#define PROP_CACHE_MAX_AGE 60
+
+struct _PropCacheEntry {
+  GFileInfo *info;
+  gint64     info_stamp;
+
+  /* Basenames of the children, NULL unless filled from a Depth:1 reply */
+  char     **children;
+  gint64     listing_stamp;   /* last time the listing was known valid */
+  gint64     listing_fetched; /* last time it was actually fetched */
+};
+
+static void
+prop_cache_entry_free (PropCacheEntry *entry)
+{
+  if (entry->info)
+    g_object_unref (entry->info);
+  g_strfreev (entry->children);
+  g_slice_free (PropCacheEntry, entry);
+}
+
+static inline gboolean
+prop_cache_stamp_valid (gint64 stamp, gint64 now, int max_age)
+{
+  return stamp <= now && now - stamp < (gint64) max_age * G_USEC_PER_SEC;
+}
+
+/* Returns @path with duplicate and trailing slashes removed */
+static char *
+prop_cache_key (const char *path)
+{
+  GString *key;
+  const char *p;
+
+  key = g_string_new ("/");
+  for (p = path; *p; p++)
+    {
+      if (*p == '/' && key->str[key->len - 1] == '/')
+        continue;
+      g_string_append_c (key, *p);
+    }
+
+  if (key->len > 1 && key->str[key->len - 1] == '/')
+    g_string_truncate (key, key->len - 1);
+
+  return g_string_free (key, FALSE);
+}
+
+/* Must be called with prop_cache_lock held */
+static PropCacheEntry *
+prop_cache_lookup_unlocked (GVfsBackendDav *dav_backend,
+                            const char     *path)
+{
+  PropCacheEntry *entry;
+  char *key;
+
+  key = prop_cache_key (path);
+  entry = g_hash_table_lookup (dav_backend->prop_cache, key);
+  g_free (key);
+
+  return entry;
+}
+
+static void
+prop_cache_set_info (GVfsBackendDav *dav_backend,
+                     const char     *path,
+                     GFileInfo      *info)
+{
+  PropCacheEntry *entry;
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  if (entry == NULL)
+    {
+      entry = g_slice_new0 (PropCacheEntry);
+      g_hash_table_insert (dav_backend->prop_cache, prop_cache_key (path), entry);
+    }
+
+  if (entry->info)
+    g_object_unref (entry->info);
+  entry->info = g_file_info_dup (info);
+  entry->info_stamp = g_get_monotonic_time ();
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+}
+
+/* Stores the result of a Depth:1 PROPFIND, @infos are the children */
+static void
+prop_cache_set_listing (GVfsBackendDav *dav_backend,
+                        const char     *path,
+                        GFileInfo      *info,
+                        GList          *infos)
+{
+  PropCacheEntry *entry;
+  GList *l;
+  char *child_path;
+  int i;
+
+  for (l = infos; l != NULL; l = l->next)
+    {
+      child_path = g_build_path ("/", path, g_file_info_get_name (l->data), NULL);
+      prop_cache_set_info (dav_backend, child_path, l->data);
+      g_free (child_path);
+    }
+
+  prop_cache_set_info (dav_backend, path, info);
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  g_strfreev (entry->children);
+  entry->children = g_new (char *, g_list_length (infos) + 1);
+  for (l = infos, i = 0; l != NULL; l = l->next, i++)
+    entry->children[i] = g_strdup (g_file_info_get_name (l->data));
+  entry->children[i] = NULL;
+  entry->listing_stamp = entry->listing_fetched = entry->info_stamp;
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+}
+
+/* Fills @info from the cache, returns FALSE if there's no recent entry */
+static gboolean
+prop_cache_get_info (GVfsBackendDav *dav_backend,
+                     const char     *path,
+                     GFileInfo      *info)
+{
+  PropCacheEntry *entry;
+  gboolean res;
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  res = entry != NULL && entry->info != NULL &&
+        prop_cache_stamp_valid (entry->info_stamp, g_get_monotonic_time (),
+                                PROP_CACHE_TTL);
+  if (res)
+    g_file_info_copy_into (entry->info, info);
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+
+  return res;
+}
+
+/* Returns the cached children of @path in @infos, or FALSE if there is
+ * no valid listing */
+static gboolean
+prop_cache_get_listing (GVfsBackendDav  *dav_backend,
+                        const char      *path,
+                        GList          **infos)
+{
+  PropCacheEntry *entry, *child;
+  GList *list;
+  char *child_path;
+  int i;
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  if (entry == NULL || entry->children == NULL ||
+      !prop_cache_stamp_valid (entry->listing_stamp, g_get_monotonic_time (),
+                               PROP_CACHE_TTL))
+    {
+      g_mutex_unlock (&dav_backend->prop_cache_lock);
+      return FALSE;
+    }
+
+  list = NULL;
+  for (i = 0; entry->children[i] != NULL; i++)
+    {
+      child_path = g_build_path ("/", path, entry->children[i], NULL);
+      child = prop_cache_lookup_unlocked (dav_backend, child_path);
+      g_free (child_path);
+
+      /* A child was invalidated behind our back */
+      if (child == NULL || child->info == NULL)
+        {
+          g_list_free_full (list, g_object_unref);
+          g_mutex_unlock (&dav_backend->prop_cache_lock);
+          return FALSE;
+        }
+
+      list = g_list_prepend (list, g_file_info_dup (child->info));
+    }
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+
+  *infos = g_list_reverse (list);
+  return TRUE;
+}
+
+/* Returns the ETag of @path if it has an outdated listing that may
+ * still be revalidated */
+static char *
+prop_cache_get_listing_etag (GVfsBackendDav *dav_backend,
+                             const char     *path)
+{
+  PropCacheEntry *entry;
+  char *etag;
+
+  etag = NULL;
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  if (entry != NULL && entry->children != NULL && entry->info != NULL &&
+      prop_cache_stamp_valid (entry->listing_fetched, g_get_monotonic_time (),
+                              PROP_CACHE_MAX_AGE))
+    etag = g_strdup (g_file_info_get_etag (entry->info));
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+
+  return etag;
+}
+
+/* Marks the listing of @path and its children as valid again if the
+ * collection still has the ETag @etag */
+static gboolean
+prop_cache_revalidate_listing (GVfsBackendDav *dav_backend,
+                               const char     *path,
+                               const char     *etag)
+{
+  PropCacheEntry *entry, *child;
+  char *child_path;
+  gint64 now;
+  gboolean res;
+  int i;
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  entry = prop_cache_lookup_unlocked (dav_backend, path);
+  res = entry != NULL && entry->children != NULL && entry->info != NULL &&
+        g_strcmp0 (g_file_info_get_etag (entry->info), etag) == 0;
+
+  if (res)
+    {
+      now = g_get_monotonic_time ();
+      entry->info_stamp = entry->listing_stamp = now;
+
+      for (i = 0; entry->children[i] != NULL; i++)
+        {
+          child_path = g_build_path ("/", path, entry->children[i], NULL);
+          child = prop_cache_lookup_unlocked (dav_backend, child_path);
+          g_free (child_path);
+
+          if (child != NULL)
+            child->info_stamp = now;
+        }
+    }
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+
+  return res;
+}
+
+static gboolean
+prop_cache_remove_descendant (gpointer key,
+                              gpointer value,
+                              gpointer user_data)
+{
+  const char *prefix = user_data;
+
+  return g_str_has_prefix (key, prefix);
+}
+
+/* Drops @path, everything below it and the listing of its parent */
+static void
+prop_cache_invalidate (GVfsBackendDav *dav_backend,
+                       const char     *path)
+{
+  char *key, *prefix, *parent;
+
+  key = prop_cache_key (path);
+
+  g_mutex_lock (&dav_backend->prop_cache_lock);
+
+  g_hash_table_remove (dav_backend->prop_cache, key);
+
+  prefix = g_strconcat (strcmp (key, "/") == 0 ? "" : key, "/", NULL);
+  g_hash_table_foreach_remove (dav_backend->prop_cache,
+                               prop_cache_remove_descendant,
+                               prefix);
+  g_free (prefix);
+
+  /* The parent's listing and modification time are outdated too */
+  parent = path_get_parent_dir (key);
+  if (parent)
+    {
+      char *parent_key;
+
+      parent_key = prop_cache_key (parent);
+      g_hash_table_remove (dav_backend->prop_cache, parent_key);
+      g_free (parent_key);
+      g_free (parent);
+    }
+
+  g_mutex_unlock (&dav_backend->prop_cache_lock);
+
+  g_free (key);
+}
+
 /* ************************************************************************* */
 /* Authentication */
 
@@ -1974,16 +2481,30 @@ do_query_info (GVfsBackend           *backend,
                GFileInfo             *info,
                GFileAttributeMatcher *matcher)
 {
+  GVfsBackendDav *dav_backend = G_VFS_BACKEND_DAV (backend);
   SoupMessage *msg;
   Multistatus  ms;
   xmlNodeIter  iter;
   gboolean     res;
   GError      *error;
+  GFileInfo   *target_info;
+  gboolean     use_cache;
 
   error   = NULL;
+  target_info = NULL;
 
   g_debug ("Query info %s\n", filename);
 
+  /* The cache only holds results of queries that follow redirects */
+  use_cache = !(flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS);
+
+  if (use_cache && prop_cache_get_info (dav_backend, filename, job->file_info))
+    {
+      g_file_info_set_attribute_mask (job->file_info, matcher);
+      g_vfs_job_succeeded (G_VFS_JOB (job));
+      return;
+    }
+
   msg = propfind_request_new (backend, filename, 0, ls_propnames);
 
   if (msg == NULL)
@@ -2019,9 +2540,12 @@ do_query_info (GVfsBackend           *backend,
       if (! multistatus_get_response (&iter, &response))
         continue;
 
-      if (response.is_target)
+      if (response.is_target && target_info == NULL)
         {
-          ms_response_to_file_info (&response, job->file_info);
+          /* Unlike job->file_info this has no attribute mask, so the
+             cached copy can serve any later query */
+          target_info = g_file_info_new ();
+          ms_response_to_file_info (&response, target_info);
           res = TRUE;
         }
 
@@ -2031,6 +2555,15 @@ do_query_info (GVfsBackend           *backend,
   multistatus_free (&ms);
   g_object_unref (msg);
 
+  if (res)
+    {
+      if (use_cache)
+        prop_cache_set_info (dav_backend, filename, target_info);
+      g_file_info_copy_into (target_info, job->file_info);
+      g_file_info_set_attribute_mask (job->file_info, matcher);
+      g_object_unref (target_info);
+    }
+
   if (res)
     g_vfs_job_succeeded (G_VFS_JOB (job));
   else
@@ -2128,6 +2661,134 @@ do_query_fs_info (GVfsBackend           *backend,
 }
 
 /* *** enumerate *** */
+static PropName etag_propnames[] = {
+    {"getetag", NULL},
+    {NULL,      NULL}
+};
+
+/* Checks with a cheap Depth:0 PROPFIND whether the collection at
+ * @filename still has the ETag @etag */
+static gboolean
+collection_has_etag (GVfsBackend *backend,
+                     const char  *filename,
+                     const char  *etag)
+{
+  SoupMessage *msg;
+  Multistatus  ms;
+  xmlNodeIter  iter;
+  GFileInfo   *info;
+  gboolean     res;
+
+  msg = propfind_request_new (backend, filename, 0, etag_propnames);
+
+  if (msg == NULL)
+    return FALSE;
+
+  /* Revalidates cached listings, which follow redirects */
+  message_add_redirect_header (msg, 0);
+
+  g_vfs_backend_dav_send_message (backend, msg);
+
+  if (! multistatus_parse (msg, &ms, NULL))
+    {
+      g_object_unref (msg);
+      return FALSE;
+    }
+
+  res = FALSE;
+  multistatus_get_response_iter (&ms, &iter);
+
+  while (xml_node_iter_next (&iter))
+    {
+      MsResponse response;
+
+      if (! multistatus_get_response (&iter, &response))
+        continue;
+
+      if (response.is_target)
+        {
+          info = g_file_info_new ();
+          ms_response_to_file_info (&response, info);
+          res = g_strcmp0 (g_file_info_get_etag (info), etag) == 0;
+          g_object_unref (info);
+        }
+
+      ms_response_clear (&response);
+    }
+
+  multistatus_free (&ms);
+  g_object_unref (msg);
+
+  return res;
+}
+
+/* Listings bigger than this are not kept in the property cache, so
+   enumerating huge collections runs in bounded memory */
+#define PROP_CACHE_MAX_LISTING 1000
+
+/* The reply is parsed as it comes in and every info is sent as soon as
+ * it is parsed. If the reply breaks off, the listing ends with an error.
+ * Only listings that stay small are also kept for the property cache.
+ * Without a job (polling) all infos are collected. */
+typedef struct {
+
+  GVfsBackendDav   *dav_backend;
+  GVfsJobEnumerate *job;
+  gboolean          started;
+
+  GFileInfo        *target_info;
+  GList            *infos;
+  guint             n_infos;
+
+} EnumerateData;
+
+static void
+enumerate_got_response (MsResponse *response,
+                        gpointer    user_data)
+{
+  EnumerateData *data = user_data;
+  GFileInfo     *info;
+
+  if (data->job && !data->started)
+    {
+      g_vfs_job_succeeded (G_VFS_JOB (data->job));
+      data->started = TRUE;
+    }
+
+  info = g_file_info_new ();
+  ms_response_to_file_info (response, info);
+
+  if (response->is_target)
+    {
+      if (data->target_info == NULL)
+        data->target_info = info;
+      else
+        g_object_unref (info);
+      return;
+    }
+
+  if (data->job == NULL)
+    {
+      data->infos = g_list_prepend (data->infos, info);
+      data->n_infos++;
+      return;
+    }
+
+  /* The cache keeps its own copy, adding the info to the job applies
+     the attribute mask */
+  data->n_infos++;
+  if (data->n_infos <= PROP_CACHE_MAX_LISTING)
+    data->infos = g_list_prepend (data->infos, g_file_info_dup (info));
+  else if (data->infos != NULL)
+    {
+      g_list_free_full (data->infos, g_object_unref);
+      data->infos = NULL;
+    }
+
+  g_vfs_job_enumerate_add_info (data->job, info);
+  g_object_unref (info);
+}
+
 static void
 do_enumerate (GVfsBackend           *backend,
               GVfsJobEnumerate      *job,
@@ -2135,16 +2796,41 @@ do_enumerate (GVfsBackend           *backend,
               GFileAttributeMatcher *matcher,
               GFileQueryInfoFlags    flags)
 {
-  SoupMessage *msg;
-  Multistatus  ms;
-  xmlNodeIter  iter;
-  gboolean     res;
-  GError      *error;
+  GVfsBackendDav *dav_backend = G_VFS_BACKEND_DAV (backend);
+  SoupMessage   *msg;
+  gboolean       res;
+  GError        *error;
+  GList         *infos;
+  char          *etag;
+  EnumerateData  data;
+  gboolean       use_cache;
  
   error = NULL;
 
   g_debug ("+ do_enumerate: %s\n", filename);
 
+  /* The cache only holds results of queries that follow redirects */
+  use_cache = !(flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS);
+
+  res = use_cache && prop_cache_get_listing (dav_backend, filename, &infos);
+
+  if (use_cache && res == FALSE && (etag = prop_cache_get_listing_etag (dav_backend, filename)))
+    {
+      if (collection_has_etag (backend, filename, etag) &&
+          prop_cache_revalidate_listing (dav_backend, filename, etag))
+        res = prop_cache_get_listing (dav_backend, filename, &infos);
+      g_free (etag);
+    }
+
+  if (res)
+    {
+      g_vfs_job_succeeded (G_VFS_JOB (job));
+      g_vfs_job_enumerate_add_infos (job, infos);
+      g_list_free_full (infos, g_object_unref);
+      g_vfs_job_enumerate_done (job);
+      return;
+    }
+
   msg = propfind_request_new (backend, filename, 1, ls_propnames);
 
   if (msg == NULL)
@@ -2158,43 +2844,125 @@ do_enumerate (GVfsBackend           *backend,
 
   message_add_redirect_header (msg, flags);
 
-  g_vfs_backend_dav_send_message (backend, msg);
+  memset (&data, 0, sizeof (data));
+  data.dav_backend = dav_backend;
+  data.job = job;
 
-  res = multistatus_parse (msg, &ms, &error);
+  res = multistatus_parse_streaming (backend, msg,
+                                     enumerate_got_response, &data,
+                                     &error);
+  g_object_unref (msg);
 
   if (res == FALSE)
     {
-      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      if (data.started)
+        g_vfs_job_enumerate_failed (job, error);
+      else
+        g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
       g_error_free (error);
-      g_object_unref (msg);
+      g_list_free_full (data.infos, g_object_unref);
+      if (data.target_info)
+        g_object_unref (data.target_info);
       return;
     }
 
-  multistatus_get_response_iter (&ms, &iter);
+  /* Keep the listing around for the query_info calls that usually follow */
+  if (use_cache && data.target_info && data.n_infos <= PROP_CACHE_MAX_LISTING)
+    {
+      data.infos = g_list_reverse (data.infos);
+      prop_cache_set_listing (dav_backend, filename, data.target_info, data.infos);
+    }
+  if (data.target_info)
+    g_object_unref (data.target_info);
+  g_list_free_full (data.infos, g_object_unref);
 
-  while (xml_node_iter_next (&iter))
+  if (!data.started)
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+  g_vfs_job_enumerate_done (job);
+}
+
+/* *** create_dir_monitor *** */
+
+/* Runs on a poll monitor thread. Unchanged collections are answered
+ * from the property cache or with a Depth:0 ETag check, so a quiet
+ * directory costs one small request per poll. */
+static GList *
+poll_list_dir (GVfsBackend *backend,
+               const char  *filename,
+               GError     **error)
+{
+  GVfsBackendDav *dav_backend = G_VFS_BACKEND_DAV (backend);
+  SoupMessage   *msg;
+  GList         *infos;
+  char          *etag;
+  gboolean       res;
+  EnumerateData  data;
+
+  if (prop_cache_get_listing (dav_backend, filename, &infos))
+    return infos;
+
+  if ((etag = prop_cache_get_listing_etag (dav_backend, filename)))
     {
-      MsResponse  response;
-      GFileInfo  *info;
+      res = collection_has_etag (backend, filename, etag) &&
+            prop_cache_revalidate_listing (dav_backend, filename, etag) &&
+            prop_cache_get_listing (dav_backend, filename, &infos);
+      g_free (etag);
 
-      if (! multistatus_get_response (&iter, &response))
-        continue;
+      if (res)
+        return infos;
+    }
 
-      if (response.is_target == FALSE)
-	{
-	  info = g_file_info_new ();
-	  ms_response_to_file_info (&response, info);
-	  g_vfs_job_enumerate_add_info (job, info);
-	}
+  msg = propfind_request_new (backend, filename, 1, ls_propnames);
 
-      ms_response_clear (&response);
+  if (msg == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           _("Could not create request"));
+      return NULL;
     }
 
-  multistatus_free (&ms);
+  /* Same request as the enumerations whose results it shares */
+  message_add_redirect_header (msg, 0);
+
+  memset (&data, 0, sizeof (data));
+  data.dav_backend = dav_backend;
+
+  res = multistatus_parse_streaming (backend, msg,
+                                     enumerate_got_response, &data,
+                                     error);
   g_object_unref (msg);
 
-  g_vfs_job_succeeded (G_VFS_JOB (job)); /* should that be called earlier? */
-  g_vfs_job_enumerate_done (G_VFS_JOB_ENUMERATE (job));
+  if (res == FALSE)
+    {
+      g_list_free_full (data.infos, g_object_unref);
+      if (data.target_info)
+        g_object_unref (data.target_info);
+      return NULL;
+    }
+
+  data.infos = g_list_reverse (data.infos);
+  if (data.target_info && data.n_infos <= PROP_CACHE_MAX_LISTING)
+    prop_cache_set_listing (dav_backend, filename, data.target_info, data.infos);
+  if (data.target_info)
+    g_object_unref (data.target_info);
+
+  return data.infos;
+}
+
+static gboolean
+try_create_dir_monitor (GVfsBackend          *backend,
+                        GVfsJobCreateMonitor *job,
+                        const char           *filename,
+                        GFileMonitorFlags     flags)
+{
+  GVfsMonitor *monitor;
+
+  monitor = g_vfs_poll_monitor_new_sync (backend, filename, poll_list_dir);
+  g_vfs_job_create_monitor_set_monitor (job, monitor);
+  g_object_unref (monitor);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  return TRUE;
 }
 
 /* ************************************************************************* */
@@ -2278,6 +3046,15 @@ try_open_for_read (GVfsBackend        *backend,
 
 
 
+/* Remembers which file a PUT stream writes to, so the cached
+   properties can be dropped once it's done */
+static void
+stream_set_path (GOutputStream *stream, const char *filename)
+{
+  g_object_set_data_full (G_OBJECT (stream), "gvfs-dav-path",
+                          g_strdup (filename), g_free);
+}
+
 /* *** create () *** */
 static void
 try_create_tested_existence (SoupSession *session, SoupMessage *msg,
@@ -2308,6 +3085,7 @@ try_create_tested_existence (SoupSession *session, SoupMessage *msg,
    */
   stream = soup_output_stream_new (op_backend->session, put_msg, -1);
   g_object_unref (put_msg);
+  stream_set_path (stream, G_VFS_JOB_OPEN_FOR_WRITE (job)->filename);
 
   g_vfs_job_open_for_write_set_handle (G_VFS_JOB_OPEN_FOR_WRITE (job), stream);
   g_vfs_job_succeeded (job);
@@ -2325,6 +3103,8 @@ try_create (GVfsBackend *backend,
   /* TODO: if SoupOutputStream supported chunked requests, we could
    * use a PUT with "If-None-Match: *" and "Expect: 100-continue"
    */
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), filename);
+
   uri = g_vfs_backend_dav_uri_for_path (backend, filename, FALSE);
   msg = soup_message_new_from_uri (SOUP_METHOD_HEAD, uri);
   soup_uri_free (uri);
@@ -2350,6 +3130,7 @@ open_for_replace_succeeded (GVfsBackendHttp *op_backend, GVfsJob *job,
 
   stream = soup_output_stream_new (op_backend->session, put_msg, -1);
   g_object_unref (put_msg);
+  stream_set_path (stream, G_VFS_JOB_OPEN_FOR_WRITE (job)->filename);
 
   g_vfs_job_open_for_write_set_handle (G_VFS_JOB_OPEN_FOR_WRITE (job), stream);
   g_vfs_job_succeeded (job);
@@ -2404,6 +3185,8 @@ try_replace (GVfsBackend *backend,
 
 
 
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), filename);
+
   uri = g_vfs_backend_dav_uri_for_path (backend, filename, FALSE);
 
   if (etag)
@@ -2495,6 +3278,9 @@ close_write_ready (GObject      *source_object,
   res = g_output_stream_close_finish (stream,
                                       result,
                                       &error);
+
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (G_VFS_JOB_CLOSE_WRITE (job)->backend),
+                         g_object_get_data (G_OBJECT (stream), "gvfs-dav-path"));
   if (res == FALSE)
     {
       g_vfs_job_failed_literal (G_VFS_JOB (job),
@@ -2543,6 +3329,8 @@ do_make_directory (GVfsBackend          *backend,
 
   status = g_vfs_backend_dav_send_message (backend, msg);
 
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), filename);
+
   if (! SOUP_STATUS_IS_SUCCESSFUL (status))
     if (status == SOUP_STATUS_METHOD_NOT_ALLOWED)
       g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
@@ -2595,6 +3383,8 @@ do_delete (GVfsBackend   *backend,
 
   status = g_vfs_backend_dav_send_message (backend, msg);
 
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), filename);
+
   if (!SOUP_STATUS_IS_SUCCESSFUL (status))
     g_vfs_job_failed_literal (G_VFS_JOB (job),
                               G_IO_ERROR,
@@ -2632,6 +3422,9 @@ do_set_display_name (GVfsBackend           *backend,
 
   status = g_vfs_backend_dav_send_message (backend, msg);
 
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), filename);
+  prop_cache_invalidate (G_VFS_BACKEND_DAV (backend), target_path);
+
   /*
    * The precondition of SOUP_STATUS_PRECONDITION_FAILED (412) in
    * this case was triggered by the "Overwrite: F" header which
@@ -2690,6 +3483,7 @@ g_vfs_backend_dav_class_init (GVfsBackendDavClass *klass)
   backend_class->query_info        = do_query_info;
   backend_class->query_fs_info     = do_query_fs_info;
   backend_class->enumerate         = do_enumerate;
+  backend_class->try_create_dir_monitor = try_create_dir_monitor;
   backend_class->try_open_for_read = try_open_for_read;
   backend_class->try_create        = try_create;
   backend_class->try_replace       = try_replace;
@@ -44,6 +44,8 @@
 #include "gvfsjobqueryfsinfo.h"
 #include "gvfsjobqueryattributes.h"
 #include "gvfsjobenumerate.h"
+#include "gvfsjobcreatemonitor.h"
+#include "gvfspollmonitor.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfsdaemonutils.h"
 #include "gvfskeyring.h"
@@ -1204,6 +1206,53 @@ do_enumerate (GVfsBackend *backend,
   g_list_free (list);
 }
 
+/* Runs on a poll monitor thread, refreshes the cached listing */
+static GList *
+poll_list_dir (GVfsBackend *backend,
+               const char  *dirname,
+               GError     **error)
+{
+  GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
+  /* No job to report to and nothing to cancel, the task code copes
+     with both being NULL */
+  GVfsFtpTask task = { ftp, NULL, NULL, };
+  GVfsFtpFile *dir;
+  GList *list;
+
+  dir = g_vfs_ftp_file_new_from_gvfs (ftp, dirname);
+  list = g_vfs_ftp_dir_cache_lookup_dir (ftp->dir_cache,
+                                         &task,
+                                         dir,
+                                         TRUE,
+                                         FALSE);
+  g_vfs_ftp_file_free (dir);
+
+  if (g_vfs_ftp_task_is_in_error (&task))
+    {
+      g_propagate_error (error, task.error);
+      task.error = NULL;
+    }
+  g_vfs_ftp_task_done (&task);
+
+  return list;
+}
+
+static gboolean
+try_create_dir_monitor (GVfsBackend *backend,
+                        GVfsJobCreateMonitor *job,
+                        const char *dirname,
+                        GFileMonitorFlags flags)
+{
+  GVfsMonitor *monitor;
+
+  monitor = g_vfs_poll_monitor_new_sync (backend, dirname, poll_list_dir);
+  g_vfs_job_create_monitor_set_monitor (job, monitor);
+  g_object_unref (monitor);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  return TRUE;
+}
+
 static void
 do_set_display_name (GVfsBackend *backend,
                      GVfsJobSetDisplayName *job,
@@ -1681,6 +1730,7 @@ g_vfs_backend_ftp_class_init (GVfsBackendFtpClass *klass)
   backend_class->write = do_write;
   backend_class->query_info = do_query_info;
   backend_class->enumerate = do_enumerate;
+  backend_class->try_create_dir_monitor = try_create_dir_monitor;
   backend_class->set_display_name = do_set_display_name;
   backend_class->delete = do_delete;
   backend_class->make_directory = do_make_directory;
@@ -209,6 +209,14 @@ struct _GVfsBackendGphoto2
    */
   GMutex lock;
 
+  /* Serializes access to @camera between the IO thread and the
+   * preview prefetch thread; see camera_lock(). Calls on the IO
+   * thread are counted in camera_waiters so the prefetch thread
+   * can back off and let them go first.
+   */
+  GMutex camera_lock;
+  volatile gint camera_waiters;
+
   /* CACHES */
 
   /* free_space is set to -1 if we don't know or have modified the
@@ -234,8 +242,26 @@ struct _GVfsBackendGphoto2
   /* list of open read handles (only used on the IO thread) */
   GList *open_read_handles;
 
+  /* number of open read handles streaming from the camera (only used on the IO thread) */
+  int num_streaming_read_handles;
+
   /* list of open write handles (only used on the IO thread) */
   GList *open_write_handles;
+
+  /* PREVIEW PREFETCHING
+   *
+   * After a directory has been enumerated, previews of the files in it
+   * are fetched in the background and stored in preview_cache_dir so
+   * thumbnailers don't have to wait for each one in turn. The prefetch_*
+   * members are protected by @lock; preview_cache_dir is NULL if the
+   * camera couldn't be identified and nothing is prefetched.
+   */
+  char *preview_cache_dir;
+  GThread *prefetch_thread;
+  GCond prefetch_cond;
+  char *prefetch_dir;
+  char **prefetch_names;
+  gboolean prefetch_stop;
 };
 
 G_DEFINE_TYPE (GVfsBackendGphoto2, g_vfs_backend_gphoto2, G_VFS_TYPE_BACKEND);
@@ -283,12 +309,33 @@ typedef struct {
 /* how much more memory to ask for when using g_realloc() when writing a file */
 #define WRITE_INCREMENT 4096
 
+/* Files bigger than this are read from the camera in pieces as they
+ * are being read instead of being loaded completely on open */
+#define STREAMING_THRESHOLD (8 * 1024 * 1024)
+
+/* size of the buffer of a streaming read handle */
+#define STREAMING_BUFFER_SIZE (1024 * 1024)
+
+/* how many files can be streamed from a camera at the same time; bounds
+ * the memory used for buffers */
+#define STREAMING_MAX_HANDLES 4
+
 typedef struct {
+  /* whole file mode: the file is loaded completely on open */
   CameraFile *file;
 
   const char *data;
   unsigned long int size;
   unsigned long int cursor;
+
+  /* streaming mode: data is NULL and buffer holds buffer_size bytes
+   * of the file starting at buffer_offset */
+  gboolean streaming;
+  char *dir;
+  char *name;
+  char *buffer;
+  unsigned long int buffer_offset;
+  unsigned long int buffer_size;
 } ReadHandle;
 
 /* ------------------------------------------------------------------------------------------------- */
@@ -355,6 +402,23 @@ dup_for_gphoto2 (char *gmem, unsigned long int size)
 
 /* ------------------------------------------------------------------------------------------------- */
 
+/* Used on the IO thread around every call that talks to the camera */
+static void
+camera_lock (GVfsBackendGphoto2 *gphoto2_backend)
+{
+  g_atomic_int_inc (&gphoto2_backend->camera_waiters);
+  g_mutex_lock (&gphoto2_backend->camera_lock);
+  g_atomic_int_add (&gphoto2_backend->camera_waiters, -1);
+}
+
+static void
+camera_unlock (GVfsBackendGphoto2 *gphoto2_backend)
+{
+  g_mutex_unlock (&gphoto2_backend->camera_lock);
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+
 static void
 monitors_emit_internal (GVfsBackendGphoto2 *gphoto2_backend, 
                         const char *dir, 
@@ -540,6 +604,9 @@ release_device (GVfsBackendGphoto2 *gphoto2_backend)
 {
   GList *l;
 
+  /* the prefetch thread uses the camera */
+  prefetch_shutdown (gphoto2_backend);
+
   g_free (gphoto2_backend->gphoto2_port);
   gphoto2_backend->gphoto2_port = NULL;
 
@@ -634,6 +701,9 @@ g_vfs_backend_gphoto2_finalize (GObject *object)
 
   release_device (gphoto2_backend);
 
+  g_mutex_clear (&gphoto2_backend->camera_lock);
+  g_cond_clear (&gphoto2_backend->prefetch_cond);
+
   if (G_OBJECT_CLASS (g_vfs_backend_gphoto2_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_gphoto2_parent_class)->finalize) (object);
 }
@@ -660,6 +730,8 @@ g_vfs_backend_gphoto2_init (GVfsBackendGphoto2 *gphoto2_backend)
   DEBUG ("initing %p", gphoto2_backend);
 
   g_mutex_init (&gphoto2_backend->lock);
+  g_mutex_init (&gphoto2_backend->camera_lock);
+  g_cond_init (&gphoto2_backend->prefetch_cond);
 
   g_vfs_backend_set_display_name (backend, "gphoto2");
 
@@ -1144,11 +1216,13 @@ file_get_info (GVfsBackendGphoto2 *gphoto2_backend,
       goto add_to_cache;
     }
 
+  camera_lock (gphoto2_backend);
   rc = gp_camera_file_get_info (gphoto2_backend->camera,
                                 dir,
                                 name,
                                 &gp_info,
                                 gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc != 0)
     {
       CameraList *list;
@@ -1157,10 +1231,12 @@ file_get_info (GVfsBackendGphoto2 *gphoto2_backend,
       /* gphoto2 doesn't know about this file.. it may be a folder; try that */
       is_folder = FALSE;
       gp_list_new (&list);
+      camera_lock (gphoto2_backend);
       rc = gp_camera_folder_list_folders (gphoto2_backend->camera, 
                                         dir, 
                                         list, 
                                         gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc == 0)
         {
           for (n = 0; n < gp_list_count (list) && !is_folder; n++)
@@ -1380,10 +1456,12 @@ is_directory_empty (GVfsBackendGphoto2 *gphoto2_backend, const char *dir)
   num_files = 0;
   
   gp_list_new (&list);
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_list_files (gphoto2_backend->camera, 
                                     dir, 
                                     list, 
                                     gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc == 0)
     num_files = gp_list_count (list);
   gp_list_free (list);
@@ -1392,10 +1470,12 @@ is_directory_empty (GVfsBackendGphoto2 *gphoto2_backend, const char *dir)
     goto out;
   
   gp_list_new (&list);
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_list_folders (gphoto2_backend->camera, 
                                       dir, 
                                       list, 
                                       gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc == 0)
     num_dirs = gp_list_count (list);
   gp_list_free (list);
@@ -1474,6 +1554,337 @@ ensure_ignore_prefix (GVfsBackendGphoto2 *gphoto2_backend, GVfsJob *job)
 
 /* ------------------------------------------------------------------------------------------------- */
 
+/* how much disk space the previews of a single camera may use */
+#define PREVIEW_CACHE_MAX_SIZE (128 * 1024 * 1024)
+
+static char *
+get_camera_serial (GVfsBackendGphoto2 *gphoto2_backend)
+{
+  CameraText summary;
+  char **lines;
+  char *serial;
+  guint n;
+
+#ifdef HAVE_GUDEV
+  if (gphoto2_backend->udev_device != NULL &&
+      g_udev_device_has_property (gphoto2_backend->udev_device, "ID_SERIAL"))
+    return g_strdup (g_udev_device_get_property (gphoto2_backend->udev_device, "ID_SERIAL"));
+#endif
+
+  /* PTP cameras include the serial number in the summary */
+  if (gp_camera_get_summary (gphoto2_backend->camera, &summary, gphoto2_backend->context) != 0)
+    return NULL;
+
+  serial = NULL;
+  lines = g_strsplit (summary.text, "\n", 0);
+  for (n = 0; lines[n] != NULL && serial == NULL; n++)
+    {
+      if (g_str_has_prefix (lines[n], "Serial Number:"))
+        {
+          serial = g_strstrip (g_strdup (lines[n] + sizeof ("Serial Number:") - 1));
+          if (*serial == '\0')
+            {
+              g_free (serial);
+              serial = NULL;
+            }
+        }
+    }
+  g_strfreev (lines);
+
+  return serial;
+}
+
+/* Returns the name of the file in the preview cache for @dir/@name; the
+ * size and modification time of the file is part of the key so the
+ * previews of changed files are not used. Returns NULL if the file has
+ * no info in the cache or doesn't have a preview.
+ */
+static char *
+preview_cache_get_filename (GVfsBackendGphoto2 *gphoto2_backend, const char *dir, const char *name)
+{
+  GFileInfo *info;
+  GTimeVal mtime;
+  char *full_path;
+  char *key;
+  char *checksum;
+  char *filename;
+
+  if (gphoto2_backend->preview_cache_dir == NULL)
+    return NULL;
+
+  full_path = g_build_filename (dir, name, NULL);
+  key = NULL;
+
+  g_mutex_lock (&gphoto2_backend->lock);
+  info = g_hash_table_lookup (gphoto2_backend->info_cache, full_path);
+  if (info != NULL && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_PREVIEW_ICON))
+    {
+      g_file_info_get_modification_time (info, &mtime);
+      key = g_strdup_printf ("%s\n%" G_GOFFSET_FORMAT "\n%ld",
+                             full_path, g_file_info_get_size (info), mtime.tv_sec);
+    }
+  g_mutex_unlock (&gphoto2_backend->lock);
+  g_free (full_path);
+
+  if (key == NULL)
+    return NULL;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, key, -1);
+  filename = g_build_filename (gphoto2_backend->preview_cache_dir, checksum, NULL);
+  g_free (checksum);
+  g_free (key);
+
+  return filename;
+}
+
+/* Fills @file with the cached preview of @dir/@name */
+static gboolean
+preview_cache_load (GVfsBackendGphoto2 *gphoto2_backend, const char *dir, const char *name, CameraFile *file)
+{
+  char *filename;
+  char *contents;
+  gsize length;
+  gboolean ret;
+
+  ret = FALSE;
+  filename = preview_cache_get_filename (gphoto2_backend, dir, name);
+  if (filename == NULL)
+    goto out;
+
+  if (!g_file_get_contents (filename, &contents, &length, NULL))
+    goto out;
+
+  if (length > 0 &&
+      gp_file_set_data_and_size (file, dup_for_gphoto2 (contents, length), length) == 0)
+    ret = TRUE;
+  g_free (contents);
+
+ out:
+  g_free (filename);
+  return ret;
+}
+
+static void
+preview_cache_store (GVfsBackendGphoto2 *gphoto2_backend, const char *dir, const char *name, CameraFile *file)
+{
+  char *filename;
+  const char *data;
+  unsigned long int size;
+
+  filename = preview_cache_get_filename (gphoto2_backend, dir, name);
+  if (filename == NULL)
+    return;
+
+  if (gp_file_get_data_and_size (file, &data, &size) == 0 && size > 0)
+    g_file_set_contents (filename, data, size, NULL);
+
+  g_free (filename);
+}
+
+typedef struct {
+  char *filename;
+  time_t mtime;
+  goffset size;
+} PreviewCacheFile;
+
+static gint
+preview_cache_file_compare (gconstpointer a, gconstpointer b)
+{
+  const PreviewCacheFile *fa = a;
+  const PreviewCacheFile *fb = b;
+
+  return fa->mtime < fb->mtime ? -1 : (fa->mtime > fb->mtime ? 1 : 0);
+}
+
+/* Removes the oldest previews until the cache fits in PREVIEW_CACHE_MAX_SIZE */
+static void
+preview_cache_trim (GVfsBackendGphoto2 *gphoto2_backend)
+{
+  GDir *cache_dir;
+  const char *basename;
+  GArray *files;
+  PreviewCacheFile file;
+  struct stat statbuf;
+  goffset total_size;
+  guint n;
+
+  cache_dir = g_dir_open (gphoto2_backend->preview_cache_dir, 0, NULL);
+  if (cache_dir == NULL)
+    return;
+
+  files = g_array_new (FALSE, FALSE, sizeof (PreviewCacheFile));
+  total_size = 0;
+  while ((basename = g_dir_read_name (cache_dir)) != NULL)
+    {
+      file.filename = g_build_filename (gphoto2_backend->preview_cache_dir, basename, NULL);
+      if (g_stat (file.filename, &statbuf) != 0)
+        {
+          g_free (file.filename);
+          continue;
+        }
+      file.mtime = statbuf.st_mtime;
+      file.size = statbuf.st_size;
+      total_size += file.size;
+      g_array_append_val (files, file);
+    }
+  g_dir_close (cache_dir);
+
+  if (total_size > PREVIEW_CACHE_MAX_SIZE)
+    {
+      g_array_sort (files, preview_cache_file_compare);
+      for (n = 0; n < files->len && total_size > PREVIEW_CACHE_MAX_SIZE; n++)
+        {
+          PreviewCacheFile *f = &g_array_index (files, PreviewCacheFile, n);
+          if (g_unlink (f->filename) == 0)
+            total_size -= f->size;
+        }
+    }
+
+  for (n = 0; n < files->len; n++)
+    g_free (g_array_index (files, PreviewCacheFile, n).filename);
+  g_array_free (files, TRUE);
+}
+
+/* Called on the prefetch thread */
+static void
+prefetch_preview (GVfsBackendGphoto2 *gphoto2_backend, const char *dir, const char *name)
+{
+  CameraFile *file;
+  char *filename;
+  int rc;
+
+  filename = preview_cache_get_filename (gphoto2_backend, dir, name);
+  if (filename == NULL || g_file_test (filename, G_FILE_TEST_EXISTS))
+    {
+      g_free (filename);
+      return;
+    }
+  g_free (filename);
+
+  if (gp_file_new (&file) != 0)
+    return;
+
+  /* let the IO thread go first; it's serving a request someone is waiting for */
+  while (g_atomic_int_get (&gphoto2_backend->camera_waiters) > 0)
+    g_usleep (G_USEC_PER_SEC / 100);
+
+  g_mutex_lock (&gphoto2_backend->camera_lock);
+  rc = gp_camera_file_get (gphoto2_backend->camera,
+                           dir,
+                           name,
+                           GP_FILE_TYPE_PREVIEW,
+                           file,
+                           gphoto2_backend->context);
+  g_mutex_unlock (&gphoto2_backend->camera_lock);
+
+  DEBUG ("  prefetched preview for '%s/%s' rc=%d", dir, name, rc);
+
+  if (rc == 0)
+    preview_cache_store (gphoto2_backend, dir, name, file);
+
+  gp_file_unref (file);
+}
+
+static gpointer
+prefetch_thread_func (gpointer user_data)
+{
+  GVfsBackendGphoto2 *gphoto2_backend = G_VFS_BACKEND_GPHOTO2 (user_data);
+  char *dir;
+  char **names;
+  gboolean superseded;
+  guint n;
+
+  g_mutex_lock (&gphoto2_backend->lock);
+  while (TRUE)
+    {
+      while (gphoto2_backend->prefetch_names == NULL && !gphoto2_backend->prefetch_stop)
+        g_cond_wait (&gphoto2_backend->prefetch_cond, &gphoto2_backend->lock);
+
+      if (gphoto2_backend->prefetch_stop)
+        break;
+
+      dir = gphoto2_backend->prefetch_dir;
+      names = gphoto2_backend->prefetch_names;
+      gphoto2_backend->prefetch_dir = NULL;
+      gphoto2_backend->prefetch_names = NULL;
+      g_mutex_unlock (&gphoto2_backend->lock);
+
+      DEBUG ("prefetching previews for '%s'", dir);
+
+      /* Go in the order the camera listed the files; that's the order
+       * they are stored in and thus the cheapest to read. Stop if another
+       * directory is enumerated, the user is looking at that one now.
+       */
+      for (n = 0; names[n] != NULL; n++)
+        {
+          g_mutex_lock (&gphoto2_backend->lock);
+          superseded = gphoto2_backend->prefetch_names != NULL || gphoto2_backend->prefetch_stop;
+          g_mutex_unlock (&gphoto2_backend->lock);
+          if (superseded)
+            break;
+
+          prefetch_preview (gphoto2_backend, dir, names[n]);
+        }
+
+      g_free (dir);
+      g_strfreev (names);
+
+      preview_cache_trim (gphoto2_backend);
+
+      g_mutex_lock (&gphoto2_backend->lock);
+    }
+  g_mutex_unlock (&gphoto2_backend->lock);
+
+  return NULL;
+}
+
+/* Takes ownership of @names */
+static void
+prefetch_schedule (GVfsBackendGphoto2 *gphoto2_backend, const char *dir, char **names)
+{
+  if (gphoto2_backend->preview_cache_dir == NULL)
+    {
+      g_strfreev (names);
+      return;
+    }
+
+  g_mutex_lock (&gphoto2_backend->lock);
+  g_free (gphoto2_backend->prefetch_dir);
+  g_strfreev (gphoto2_backend->prefetch_names);
+  gphoto2_backend->prefetch_dir = g_strdup (dir);
+  gphoto2_backend->prefetch_names = names;
+  if (gphoto2_backend->prefetch_thread == NULL)
+    gphoto2_backend->prefetch_thread = g_thread_new ("gvfs-gphoto2-prefetch",
+                                                     prefetch_thread_func,
+                                                     gphoto2_backend);
+  g_cond_signal (&gphoto2_backend->prefetch_cond);
+  g_mutex_unlock (&gphoto2_backend->lock);
+}
+
+static void
+prefetch_shutdown (GVfsBackendGphoto2 *gphoto2_backend)
+{
+  if (gphoto2_backend->prefetch_thread != NULL)
+    {
+      g_mutex_lock (&gphoto2_backend->lock);
+      gphoto2_backend->prefetch_stop = TRUE;
+      g_cond_signal (&gphoto2_backend->prefetch_cond);
+      g_mutex_unlock (&gphoto2_backend->lock);
+
+      g_thread_join (gphoto2_backend->prefetch_thread);
+      gphoto2_backend->prefetch_thread = NULL;
+    }
+
+  g_free (gphoto2_backend->prefetch_dir);
+  gphoto2_backend->prefetch_dir = NULL;
+  g_strfreev (gphoto2_backend->prefetch_names);
+  gphoto2_backend->prefetch_names = NULL;
+  g_free (gphoto2_backend->preview_cache_dir);
+  gphoto2_backend->preview_cache_dir = NULL;
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+
 static void
 do_mount (GVfsBackend *backend,
 	  GVfsJobMount *job,
@@ -1494,6 +1905,7 @@ do_mount (GVfsBackend *backend,
   int n;
   CameraStorageInformation *storage_info;
   int num_storage_info;
+  char *serial;
 
   DEBUG ("do_mount %p", gphoto2_backend);
 
@@ -1712,6 +2124,25 @@ do_mount (GVfsBackend *backend,
   DEBUG ("  can_write = %d", gphoto2_backend->can_write);
   DEBUG ("  can_delete = %d", gphoto2_backend->can_delete);
 
+  serial = get_camera_serial (gphoto2_backend);
+  if (serial != NULL)
+    {
+      char *escaped_serial;
+
+      escaped_serial = g_uri_escape_string (serial, NULL, FALSE);
+      gphoto2_backend->preview_cache_dir = g_build_filename (g_get_user_cache_dir (),
+                                                             "gvfs", "gphoto2", escaped_serial,
+                                                             NULL);
+      if (g_mkdir_with_parents (gphoto2_backend->preview_cache_dir, 0700) != 0)
+        {
+          g_free (gphoto2_backend->preview_cache_dir);
+          gphoto2_backend->preview_cache_dir = NULL;
+        }
+      g_free (escaped_serial);
+      g_free (serial);
+    }
+  DEBUG ("  preview_cache_dir = %s", gphoto2_backend->preview_cache_dir);
+
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
   gphoto2_backend->free_space = -1;
@@ -1783,9 +2214,100 @@ free_read_handle (ReadHandle *read_handle)
     {
       gp_file_unref (read_handle->file);
     }
+  g_free (read_handle->dir);
+  g_free (read_handle->name);
+  g_free (read_handle->buffer);
   g_free (read_handle);
 }
 
+#ifdef HAVE_GP_CAMERA_FILE_READ
+/* Fills the buffer of a streaming read handle with data starting at the cursor;
+ * must be called on the IO thread */
+static int
+fill_read_buffer (GVfsBackendGphoto2 *gphoto2_backend, ReadHandle *read_handle)
+{
+  uint64_t size;
+  int rc;
+
+  size = MIN (STREAMING_BUFFER_SIZE, read_handle->size - read_handle->cursor);
+  camera_lock (gphoto2_backend);
+  rc = gp_camera_file_read (gphoto2_backend->camera,
+                            read_handle->dir,
+                            read_handle->name,
+                            GP_FILE_TYPE_NORMAL,
+                            read_handle->cursor,
+                            read_handle->buffer,
+                            &size,
+                            gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
+  if (rc != 0)
+    return rc;
+
+  read_handle->buffer_offset = read_handle->cursor;
+  read_handle->buffer_size = size;
+
+  DEBUG ("  filled buffer with %ld bytes @ %ld, handle=%p",
+         read_handle->buffer_size, read_handle->buffer_offset, read_handle);
+
+  return 0;
+}
+
+/* Sets up @read_handle for streaming @dir/@name if it's big enough to be worth
+ * it and the camera supports partial reads. Returns FALSE if the file should
+ * be loaded completely instead. */
+static gboolean
+open_for_streaming (GVfsBackendGphoto2 *gphoto2_backend,
+                    ReadHandle *read_handle,
+                    const char *dir,
+                    const char *name)
+{
+  CameraFileInfo info;
+  int rc;
+
+  camera_lock (gphoto2_backend);
+  rc = gp_camera_file_get_info (gphoto2_backend->camera,
+                                dir,
+                                name,
+                                &info,
+                                gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
+  if (rc != 0 ||
+      !(info.file.fields & GP_FILE_INFO_SIZE) ||
+      info.file.size < STREAMING_THRESHOLD)
+    return FALSE;
+
+  /* Too many streams already, this one is loaded whole like before */
+  if (gphoto2_backend->num_streaming_read_handles >= STREAMING_MAX_HANDLES)
+    {
+      DEBUG ("  too many streaming handles, loading whole file");
+      return FALSE;
+    }
+
+  read_handle->streaming = TRUE;
+  read_handle->dir = g_strdup (dir);
+  read_handle->name = g_strdup (name);
+  read_handle->size = info.file.size;
+  read_handle->buffer = g_malloc (STREAMING_BUFFER_SIZE);
+
+  /* Fetch the start of the file right away; this also tells us whether
+   * the camera driver can do partial reads at all */
+  rc = fill_read_buffer (gphoto2_backend, read_handle);
+  if (rc != 0)
+    {
+      DEBUG ("  partial reads not possible (rc=%d), loading whole file", rc);
+      read_handle->streaming = FALSE;
+      g_free (read_handle->buffer);
+      read_handle->buffer = NULL;
+      read_handle->size = 0;
+      return FALSE;
+    }
+
+  gphoto2_backend->num_streaming_read_handles++;
+
+  return TRUE;
+}
+#endif
+
 static void
 do_open_for_read_real (GVfsBackend *backend,
                        GVfsJobOpenForRead *job,
@@ -1820,6 +2342,13 @@ do_open_for_read_real (GVfsBackend *backend,
     }
 
   read_handle = g_new0 (ReadHandle, 1);
+
+#ifdef HAVE_GP_CAMERA_FILE_READ
+  if (!get_preview &&
+      open_for_streaming (gphoto2_backend, read_handle, dir, name))
+    goto opened;
+#endif
+
   rc = gp_file_new (&read_handle->file);
   if (rc != 0)
     {
@@ -1830,19 +2359,31 @@ do_open_for_read_real (GVfsBackend *backend,
       goto out;
     }
 
-  rc = gp_camera_file_get (gphoto2_backend->camera,
-                           dir,
-                           name,
-                           get_preview ? GP_FILE_TYPE_PREVIEW : GP_FILE_TYPE_NORMAL,
-                           read_handle->file,
-                           gphoto2_backend->context);
-  if (rc != 0)
+  if (get_preview && preview_cache_load (gphoto2_backend, dir, name, read_handle->file))
     {
-      error = get_error_from_gphoto2 (_("Error getting file"), rc);
-      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
-      g_error_free (error);
-      free_read_handle (read_handle);
-      goto out;
+      DEBUG ("  using cached preview");
+    }
+  else
+    {
+      camera_lock (gphoto2_backend);
+      rc = gp_camera_file_get (gphoto2_backend->camera,
+                               dir,
+                               name,
+                               get_preview ? GP_FILE_TYPE_PREVIEW : GP_FILE_TYPE_NORMAL,
+                               read_handle->file,
+                               gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
+      if (rc != 0)
+        {
+          error = get_error_from_gphoto2 (_("Error getting file"), rc);
+          g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+          g_error_free (error);
+          free_read_handle (read_handle);
+          goto out;
+        }
+
+      if (get_preview)
+        preview_cache_store (gphoto2_backend, dir, name, read_handle->file);
     }
 
   rc = gp_file_get_data_and_size (read_handle->file, &read_handle->data, &read_handle->size);
@@ -1858,6 +2399,9 @@ do_open_for_read_real (GVfsBackend *backend,
   DEBUG ("  data=%p size=%ld handle=%p get_preview=%d",
          read_handle->data, read_handle->size, read_handle, get_preview);
 
+#ifdef HAVE_GP_CAMERA_FILE_READ
+ opened:
+#endif
   g_mutex_lock (&gphoto2_backend->lock);
   gphoto2_backend->open_read_handles = g_list_prepend (gphoto2_backend->open_read_handles, read_handle);
   g_mutex_unlock (&gphoto2_backend->lock);
@@ -1925,13 +2469,29 @@ try_read (GVfsBackend *backend,
   gsize bytes_left;
   gsize bytes_to_copy;
 
-  DEBUG ("do_read() %d @ %ld of %ld, handle=%p", bytes_requested, read_handle->cursor, read_handle->size, handle);
+  DEBUG ("do_read() %" G_GSIZE_FORMAT " @ %ld of %ld, handle=%p", bytes_requested, read_handle->cursor, read_handle->size, handle);
 
   if (read_handle->cursor >= read_handle->size)
     {
       bytes_to_copy = 0;
       goto out;
     }
+
+  if (read_handle->streaming)
+    {
+      /* Data not in the buffer, let do_read() get it from the camera */
+      if (read_handle->cursor < read_handle->buffer_offset ||
+          read_handle->cursor >= read_handle->buffer_offset + read_handle->buffer_size)
+        return FALSE;
+
+      bytes_left = read_handle->buffer_offset + read_handle->buffer_size - read_handle->cursor;
+      bytes_to_copy = MIN (bytes_requested, bytes_left);
+      memcpy (buffer,
+              read_handle->buffer + (read_handle->cursor - read_handle->buffer_offset),
+              bytes_to_copy);
+      read_handle->cursor += bytes_to_copy;
+      goto out;
+    }
   
   bytes_left = read_handle->size - read_handle->cursor;
   if (bytes_requested > bytes_left)
@@ -1949,6 +2509,45 @@ try_read (GVfsBackend *backend,
   return TRUE;
 }
 
+#ifdef HAVE_GP_CAMERA_FILE_READ
+/* Only used for streaming read handles when the data isn't buffered */
+static void
+do_read (GVfsBackend *backend,
+         GVfsJobRead *job,
+         GVfsBackendHandle handle,
+         char *buffer,
+         gsize bytes_requested)
+{
+  GVfsBackendGphoto2 *gphoto2_backend = G_VFS_BACKEND_GPHOTO2 (backend);
+  ReadHandle *read_handle = (ReadHandle *) handle;
+  GError *error;
+  int rc;
+
+  DEBUG ("do_read() %" G_GSIZE_FORMAT " @ %ld of %ld, handle=%p", bytes_requested, read_handle->cursor, read_handle->size, handle);
+
+  g_assert (read_handle->streaming);
+
+  rc = fill_read_buffer (gphoto2_backend, read_handle);
+  if (rc != 0)
+    {
+      error = get_error_from_gphoto2 (_("Error getting file"), rc);
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
+      return;
+    }
+
+  if (read_handle->buffer_size == 0)
+    {
+      g_vfs_job_read_set_size (job, 0);
+      g_vfs_job_succeeded (G_VFS_JOB (job));
+      return;
+    }
+
+  /* The buffer now starts at the cursor */
+  try_read (backend, job, handle, buffer, bytes_requested);
+}
+#endif
+
 /* ------------------------------------------------------------------------------------------------- */
 
 static gboolean
@@ -2010,6 +2609,9 @@ do_close_read (GVfsBackend *backend,
   gphoto2_backend->open_read_handles = g_list_remove (gphoto2_backend->open_read_handles, read_handle);
   g_mutex_unlock (&gphoto2_backend->lock);
 
+  if (read_handle->streaming)
+    gphoto2_backend->num_streaming_read_handles--;
+
   free_read_handle (read_handle);
   
   g_vfs_job_succeeded (G_VFS_JOB (job));
@@ -2107,6 +2709,7 @@ do_enumerate (GVfsBackend *backend,
   gboolean using_cached_file_list;
   char *as_dir;
   char *as_name;
+  GPtrArray *file_names;
 
   l = NULL;
   using_cached_dir_list = FALSE;
@@ -2149,10 +2752,12 @@ do_enumerate (GVfsBackend *backend,
       DEBUG ("  Generating dir list for dir '%s'", filename);
 
       gp_list_new (&list);
+      camera_lock (gphoto2_backend);
       rc = gp_camera_folder_list_folders (gphoto2_backend->camera, 
                                           filename, 
                                           list, 
                                           gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         {
           error = get_error_from_gphoto2 (_("Failed to get folder list"), rc);
@@ -2215,10 +2820,12 @@ do_enumerate (GVfsBackend *backend,
       DEBUG ("  Generating file list for dir '%s'", filename);
 
       gp_list_new (&list);
+      camera_lock (gphoto2_backend);
       rc = gp_camera_folder_list_files (gphoto2_backend->camera, 
                                         filename, 
                                         list, 
                                         gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         {
           error = get_error_from_gphoto2 (_("Failed to get file list"), rc);
@@ -2235,6 +2842,7 @@ do_enumerate (GVfsBackend *backend,
       gp_list_ref (list);
       g_mutex_unlock (&gphoto2_backend->lock);
     }
+  file_names = g_ptr_array_new ();
   for (n = 0; n < gp_list_count (list); n++) 
     {
       const char *name;
@@ -2251,10 +2859,14 @@ do_enumerate (GVfsBackend *backend,
           g_list_foreach (l, (GFunc) g_object_unref, NULL);
           g_list_free (l);
           gp_list_free (list);
+          g_ptr_array_foreach (file_names, (GFunc) g_free, NULL);
+          g_ptr_array_free (file_names, TRUE);
           return;
         }
       l = g_list_append (l, info);
+      g_ptr_array_add (file_names, g_strdup (name));
     }
+  g_ptr_array_add (file_names, NULL);
   if (!using_cached_file_list)
     {
 #ifndef DEBUG_NO_CACHING
@@ -2278,6 +2890,9 @@ do_enumerate (GVfsBackend *backend,
   g_list_free (l);
   g_vfs_job_enumerate_done (job);
 
+  /* get the previews ready before the user asks for them */
+  prefetch_schedule (gphoto2_backend, filename, (char **) g_ptr_array_free (file_names, FALSE));
+
   g_free (filename);
 }
 
@@ -2402,7 +3017,9 @@ do_query_fs_info (GVfsBackend *backend,
   g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW, G_FILESYSTEM_PREVIEW_TYPE_IF_LOCAL);
   g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY, !gphoto2_backend->can_write);
 
+  camera_lock (gphoto2_backend);
   rc = gp_camera_get_storageinfo (gphoto2_backend->camera, &storage_info, &num_storage_info, gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc == 0)
     {
       if (num_storage_info >= 1)
@@ -2507,10 +3124,12 @@ do_make_directory (GVfsBackend *backend,
 
   split_filename_with_ignore_prefix (gphoto2_backend, filename, &dir, &name);
 
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_make_dir (gphoto2_backend->camera,
                                   dir,
                                   name,
                                   gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc != 0)
     {
       error = get_error_from_gphoto2 (_("Error creating directory"), rc);
@@ -2554,12 +3173,14 @@ do_slow_file_rename_in_same_dir (GVfsBackendGphoto2 *gphoto2_backend,
   if (rc != 0)
     goto out;
 
+  camera_lock (gphoto2_backend);
   rc = gp_camera_file_get (gphoto2_backend->camera,
                            dir,
                            name,
                            GP_FILE_TYPE_NORMAL,
                            file,
                            gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc != 0)
     goto out;
 
@@ -2581,10 +3202,12 @@ do_slow_file_rename_in_same_dir (GVfsBackendGphoto2 *gphoto2_backend,
 
   if (allow_overwrite)
     {
+      camera_lock (gphoto2_backend);
       gp_camera_file_delete (gphoto2_backend->camera,
                              dir,
                              new_name,
                              gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         {
           DEBUG ("  file delete failed as part of slow rename rc=%d", rc);
@@ -2593,24 +3216,32 @@ do_slow_file_rename_in_same_dir (GVfsBackendGphoto2 *gphoto2_backend,
     }
 
 #ifdef HAVE_GPHOTO25
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_put_file (gphoto2_backend->camera, dir, new_name, GP_FILE_TYPE_NORMAL, file_dest, gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
 #else
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_put_file (gphoto2_backend->camera, dir, file_dest, gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
 #endif
   if (rc != 0)
     goto out;
 
+  camera_lock (gphoto2_backend);
   rc = gp_camera_file_delete (gphoto2_backend->camera,
                               dir,
                               name,
                               gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
   if (rc != 0)
     {
       /* at least try to clean up the newly created file... */
+      camera_lock (gphoto2_backend);
       gp_camera_file_delete (gphoto2_backend->camera,
                              dir,
                              new_name,
                              gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       goto out;
     }
 
@@ -2661,17 +3292,21 @@ do_dir_rename_in_same_dir (GVfsBackendGphoto2 *gphoto2_backend,
    */
   if (is_directory_empty (gphoto2_backend, dir_name))
     {
+      camera_lock (gphoto2_backend);
       rc = gp_camera_folder_make_dir (gphoto2_backend->camera,
                                       dir,
                                       new_name,
                                       gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         goto out;
       
+      camera_lock (gphoto2_backend);
       rc = gp_camera_folder_remove_dir (gphoto2_backend->camera,
                                         dir,
                                         name,
                                         gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         goto out;
     }
@@ -2829,10 +3464,12 @@ do_delete (GVfsBackend *backend,
         }
       else
         {
+          camera_lock (gphoto2_backend);
           rc = gp_camera_folder_remove_dir (gphoto2_backend->camera,
                                             dir,
                                             name,
                                             gphoto2_backend->context);
+          camera_unlock (gphoto2_backend);
           if (rc != 0)
             {
               error = get_error_from_gphoto2 (_("Error deleting directory"), rc);
@@ -2855,10 +3492,12 @@ do_delete (GVfsBackend *backend,
           goto out;
         }
 
+      camera_lock (gphoto2_backend);
       rc = gp_camera_file_delete (gphoto2_backend->camera,
                                   dir,
                                   name,
                                   gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         {
           error = get_error_from_gphoto2 (_("Error deleting file"), rc);
@@ -2968,12 +3607,14 @@ do_create_internal (GVfsBackend *backend,
           goto out;
         }
 
+      camera_lock (gphoto2_backend);
       rc = gp_camera_file_get (gphoto2_backend->camera,
                                dir,
                                name,
                                GP_FILE_TYPE_NORMAL,
                                file,
                                gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         {
           error = get_error_from_gphoto2 (_("Cannot read file to append to"), rc);
@@ -3212,10 +3853,12 @@ commit_write_handle (GVfsBackendGphoto2 *gphoto2_backend, WriteHandle *write_han
        *
        * So first delete the existing file...
        */
+      camera_lock (gphoto2_backend);
       rc = gp_camera_file_delete (gphoto2_backend->camera,
                                   write_handle->dir,
                                   write_handle->name,
                                   gphoto2_backend->context);
+      camera_unlock (gphoto2_backend);
       if (rc != 0)
         goto out;
 
@@ -3235,10 +3878,14 @@ commit_write_handle (GVfsBackendGphoto2 *gphoto2_backend, WriteHandle *write_han
                              write_handle->size);
   
 #ifdef HAVE_GPHOTO25
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_put_file (gphoto2_backend->camera, write_handle->dir, write_handle->name, GP_FILE_TYPE_NORMAL, file, gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
 #else
   gp_file_set_type (file, GP_FILE_TYPE_NORMAL);
+  camera_lock (gphoto2_backend);
   rc = gp_camera_folder_put_file (gphoto2_backend->camera, write_handle->dir, file, gphoto2_backend->context);
+  camera_unlock (gphoto2_backend);
 #endif
   if (rc != 0)
     {
@@ -3531,6 +4178,9 @@ g_vfs_backend_gphoto2_class_init (GVfsBackendGphoto2Class *klass)
    backend_class->open_icon_for_read = do_open_icon_for_read;
   backend_class->open_for_read = do_open_for_read;
   backend_class->try_read = try_read;
+#ifdef HAVE_GP_CAMERA_FILE_READ
+  backend_class->read = do_read;
+#endif
   backend_class->try_seek_on_read = try_seek_on_read;
   backend_class->close_read = do_close_read;
   backend_class->query_info = do_query_info;
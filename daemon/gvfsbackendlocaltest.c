@@ -27,6 +27,14 @@
  *  - behaviour is controlled via environment variable (i.e. set from the shell, before launching /usr/libexec/gvfsd)
  *    GVFS_ERRORNEOUS: number, how often operation should fail (a random() is used, this number is not a sequence) 
  *    GVFS_ERRORNEOUS_OPS: bitmask of operations to fail - see GVfsJobType enum
+ *
+ *  - the backend can also pretend to sit behind a slow link, to benchmark the client, channel and job layers
+ *    (see test/run-benchmark-matrix.sh). Only successful operations are delayed:
+ *    GVFS_LOCALTEST_LATENCY: microseconds added to every operation
+ *    GVFS_LOCALTEST_JITTER: up to this many microseconds added on top of the latency
+ *    GVFS_LOCALTEST_BANDWIDTH: bytes per second for reads and writes, all open files share the link
+ *    GVFS_LOCALTEST_SHAPE_OPS: bitmask of operations to delay - see GVfsJobType enum, all by default
+ *    GVFS_LOCALTEST_SEED: seed for the jitter, the same seed gives the same sequence of delays
  * 
  ***/
 
@@ -87,6 +95,61 @@
  */
 
 
+/*  cheap integer hash, gives reproducible jitter for a given seed  */
+static guint32
+shape_random (guint32 seed, guint32 n)
+{
+  guint32 x;
+
+  x = seed ^ (n * 0x9e3779b9U);
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+
+  return x;
+}
+
+/*  called on the job thread, blocks it for as long as the simulated link would take  */
+static void
+shape_operation (GVfsBackendLocalTest *op_backend,
+				 GVfsJob *job,
+				 GVfsJobType job_type)
+{
+  gint64 delay, now, start;
+  gsize bytes;
+  guint n;
+
+  if ((op_backend->shape_op_types & job_type) != job_type)
+	  return;
+
+  delay = op_backend->latency;
+  if (op_backend->jitter > 0) {
+	  n = g_atomic_int_add (&op_backend->shape_counter, 1);
+	  delay += shape_random (op_backend->seed, n) % (op_backend->jitter + 1);
+  }
+
+  bytes = 0;
+  if (G_VFS_IS_JOB_READ (job))
+	  bytes = G_VFS_JOB_READ (job)->data_count;
+  else if (G_VFS_IS_JOB_WRITE (job))
+	  bytes = G_VFS_JOB_WRITE (job)->written_size;
+
+  if ((op_backend->bandwidth > 0) && (bytes > 0)) {
+	  /*  transfers queue up behind each other like on a real link  */
+	  g_mutex_lock (&op_backend->link_lock);
+	  now = g_get_monotonic_time ();
+	  start = MAX (now, op_backend->link_busy_until);
+	  op_backend->link_busy_until = start + (gint64) bytes * G_USEC_PER_SEC / op_backend->bandwidth;
+	  delay += op_backend->link_busy_until - now;
+	  g_mutex_unlock (&op_backend->link_lock);
+  }
+
+  if (delay > 0)
+	  g_usleep (delay);
+}
+
 static gboolean     
 inject_error (GVfsBackend *backend,
 			  GVfsJob *job,
@@ -94,6 +157,8 @@ inject_error (GVfsBackend *backend,
 {
   GVfsBackendLocalTest *op_backend = G_VFS_BACKEND_LOCALTEST (backend);
 
+  shape_operation (op_backend, job, job_type);
+
   if ((op_backend->errorneous > 0) && ((random() % op_backend->errorneous) == 0) && 
 	  ((op_backend->inject_op_types < 1) || ((op_backend->inject_op_types & job_type) == job_type)))
   {
@@ -199,6 +264,40 @@ g_vfs_backend_localtest_init (GVfsBackendLocalTest *backend)
 		backend->inject_op_types = g_ascii_strtoll(c, NULL, 0);
 		g_print ("(II) g_vfs_backend_localtest_init: setting 'inject_op_types' to '%lu' \n", (unsigned long)backend->inject_op_types);
 	}
+
+	/*  link simulation  */
+	backend->shape_op_types = -1;
+	g_mutex_init (&backend->link_lock);
+
+	c = g_getenv("GVFS_LOCALTEST_LATENCY");
+	if (c) {
+		backend->latency = MAX (g_ascii_strtoll(c, NULL, 0), 0);
+		g_print ("(II) g_vfs_backend_localtest_init: setting 'latency' to '%" G_GINT64_FORMAT "' \n", backend->latency);
+	}
+
+	c = g_getenv("GVFS_LOCALTEST_JITTER");
+	if (c) {
+		backend->jitter = CLAMP (g_ascii_strtoll(c, NULL, 0), 0, G_MAXUINT32 - 1);
+		g_print ("(II) g_vfs_backend_localtest_init: setting 'jitter' to '%" G_GINT64_FORMAT "' \n", backend->jitter);
+	}
+
+	c = g_getenv("GVFS_LOCALTEST_BANDWIDTH");
+	if (c) {
+		backend->bandwidth = MAX (g_ascii_strtoll(c, NULL, 0), 0);
+		g_print ("(II) g_vfs_backend_localtest_init: setting 'bandwidth' to '%" G_GINT64_FORMAT "' \n", backend->bandwidth);
+	}
+
+	c = g_getenv("GVFS_LOCALTEST_SHAPE_OPS");
+	if (c) {
+		backend->shape_op_types = g_ascii_strtoll(c, NULL, 0);
+		g_print ("(II) g_vfs_backend_localtest_init: setting 'shape_op_types' to '%lu' \n", (unsigned long)backend->shape_op_types);
+	}
+
+	c = g_getenv("GVFS_LOCALTEST_SEED");
+	if (c) {
+		backend->seed = g_ascii_strtoull(c, NULL, 0);
+		g_print ("(II) g_vfs_backend_localtest_init: setting 'seed' to '%u' \n", backend->seed);
+	}
 	
 	g_print ("(II) g_vfs_backend_localtest_init done.\n");
 }
@@ -214,6 +313,8 @@ g_vfs_backend_localtest_finalize (GObject *object)
 
     if (backend->test)
     	g_free ((gpointer)backend->test);  
+
+	g_mutex_clear (&backend->link_lock);
   
 	if (G_OBJECT_CLASS (g_vfs_backend_localtest_parent_class)->finalize)
       (*G_OBJECT_CLASS (g_vfs_backend_localtest_parent_class)->finalize) (object);
@@ -238,12 +339,17 @@ do_mount (GVfsBackend *backend,
            gboolean is_automount)
 {
   GVfsBackendLocalTest *op_backend = G_VFS_BACKEND_LOCALTEST (backend);
+  const char *host;
 
   g_print ("(II) try_mount \n");
 
   g_vfs_backend_set_display_name (backend, "localtest");
 
   op_backend->mount_spec = g_mount_spec_new ("localtest");
+  /* localtest://<name>/ gives separate mounts of the same tree */
+  host = g_mount_spec_get (mount_spec, "host");
+  if (host != NULL)
+    g_mount_spec_set (op_backend->mount_spec, "host", host);
   g_vfs_backend_set_mount_spec (backend, op_backend->mount_spec);
 
   g_vfs_backend_set_icon_name (backend, "folder-remote");
@@ -80,6 +80,16 @@ struct _GVfsBackendLocalTest
 	  GMountSpec *mount_spec;
 	  int errorneous;
 	  GVfsJobType inject_op_types;
+
+	  /*  simulated link, see USAGE in gvfsbackendlocaltest.c  */
+	  gint64 latency;
+	  gint64 jitter;
+	  gint64 bandwidth;
+	  GVfsJobType shape_op_types;
+	  guint32 seed;
+	  volatile gint shape_counter;
+	  GMutex link_lock;
+	  gint64 link_busy_until;
 };
 
 struct _GVfsBackendLocalTestClass
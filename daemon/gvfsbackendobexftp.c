@@ -71,6 +71,22 @@
 
 #define CACHE_LIFESPAN 3
 
+typedef struct {
+    char *source;
+    goffset size;
+    int fd;
+
+    /* The file is read from a pipe as it arrives if streaming is set; otherwise
+     * fd is a temporary file holding the data from offset base on */
+    gboolean streaming;
+    gboolean writer_seen;
+    goffset offset;
+    goffset base;
+
+    /* set if the data was lost while moving it into a temporary file */
+    GError *error;
+} ObexFTPOpenHandle;
+
 struct _GVfsBackendObexftp
 {
   GVfsBackend parent_instance;
@@ -95,13 +111,12 @@ struct _GVfsBackendObexftp
   char *files_listing;
   char *directory;
   time_t time_captured;
+
+  /* The open handle the current download is for, protected by mutex */
+  ObexFTPOpenHandle *read_handle;
+  gboolean read_transfer_done;
 };
 
-typedef struct {
-    char *source;
-    goffset size;
-    int fd;
-} ObexFTPOpenHandle;
 
 G_DEFINE_TYPE (GVfsBackendObexftp, g_vfs_backend_obexftp, G_VFS_TYPE_BACKEND);
 
@@ -548,6 +563,228 @@ g_vfs_backend_obexftp_init (GVfsBackendObexftp *backend)
                               G_CALLBACK(session_connected_cb), backend, NULL);
 }
 
+static void
+read_transfer_completed_cb (DBusGProxy *proxy, gpointer user_data)
+{
+  GVfsBackendObexftp *op_backend = G_VFS_BACKEND_OBEXFTP (user_data);
+
+  g_mutex_lock (&op_backend->mutex);
+  op_backend->read_transfer_done = TRUE;
+  g_cond_signal (&op_backend->cond);
+  g_mutex_unlock (&op_backend->mutex);
+}
+
+static gboolean
+_read_transfer_is_done (GVfsBackendObexftp *op_backend,
+                        ObexFTPOpenHandle *handle)
+{
+  return op_backend->read_handle != handle || op_backend->read_transfer_done;
+}
+
+/* Reads from the file being transferred for @handle, waiting for data to
+ * arrive. Returns the number of bytes read, 0 at the end of the file or
+ * -1 on error. Must be called with the mutex held.
+ */
+static gssize
+_read_transfer (GVfsBackendObexftp *op_backend,
+                ObexFTPOpenHandle *handle,
+                GVfsJob *job,
+                char *buffer,
+                gsize count,
+                GError **error)
+{
+  gssize n;
+  int errsv;
+
+  while (TRUE)
+    {
+      n = read (handle->fd, buffer, count);
+      if (n > 0)
+        {
+          handle->writer_seen = TRUE;
+          return n;
+        }
+
+      if (n < 0)
+        {
+          errsv = errno;
+          if (errsv == EINTR)
+            continue;
+          if (errsv != EAGAIN)
+            {
+              g_set_error_literal (error, G_IO_ERROR,
+                                   g_io_error_from_errno (errsv),
+                                   g_strerror (errsv));
+              return -1;
+            }
+          /* the pipe is open on the other end but empty */
+          handle->writer_seen = TRUE;
+        }
+      else if (_read_transfer_is_done (op_backend, handle) ||
+               (handle->streaming && handle->writer_seen))
+        {
+          return 0;
+        }
+
+      if (op_backend->status == ASYNC_ERROR)
+        {
+          if (op_backend->error != NULL)
+            {
+              g_propagate_error (error, op_backend->error);
+              op_backend->error = NULL;
+            }
+          else
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                 _("Transfer failed"));
+          op_backend->status = ASYNC_PENDING;
+          return -1;
+        }
+
+      if (job != NULL && g_vfs_job_is_cancelled (job))
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                               _("Operation was cancelled"));
+          return -1;
+        }
+
+      g_cond_wait_until (&op_backend->cond, &op_backend->mutex,
+                         g_get_monotonic_time () + G_TIME_SPAN_SECOND / 100);
+    }
+}
+
+static gboolean
+_write_all (int fd, const char *buffer, gsize count)
+{
+  gssize n;
+
+  while (count > 0)
+    {
+      n = write (fd, buffer, count);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+      buffer += n;
+      count -= n;
+    }
+
+  return TRUE;
+}
+
+/* OBEX can only do one thing at a time, and obex-data-server blocks
+ * while the pipe of a streamed file is full. So before doing anything
+ * else, the rest of a streamed file is read into a temporary file and
+ * served from there. A file being downloaded into a temporary file is
+ * waited for. Must be called with the mutex held.
+ */
+static void
+_finish_read_transfer (GVfsBackendObexftp *op_backend)
+{
+  ObexFTPOpenHandle *handle;
+  GError *error;
+  char *buffer, *target;
+  gssize n;
+  int fd;
+
+  handle = op_backend->read_handle;
+  if (handle == NULL)
+    return;
+
+  if (!handle->streaming)
+    {
+      while (!op_backend->read_transfer_done && op_backend->status != ASYNC_ERROR)
+        g_cond_wait (&op_backend->cond, &op_backend->mutex);
+      op_backend->read_handle = NULL;
+      return;
+    }
+
+  g_debug ("spilling %s at offset %" G_GOFFSET_FORMAT " to a temporary file\n",
+           handle->source, handle->offset);
+
+  error = NULL;
+  fd = g_file_open_tmp ("gvfsobexftp-tmp-XXXXXX", &target, &error);
+  if (fd >= 0)
+    {
+      g_unlink (target);
+      g_free (target);
+    }
+
+  buffer = g_malloc (64 * 1024);
+  while ((n = _read_transfer (op_backend, handle, NULL, buffer, 64 * 1024,
+                              error == NULL ? &error : NULL)) > 0)
+    {
+      /* keep draining even if we can't keep the data */
+      if (fd >= 0 && !_write_all (fd, buffer, n))
+        {
+          int errsv = errno;
+          if (error == NULL)
+            g_set_error_literal (&error, G_IO_ERROR,
+                                 g_io_error_from_errno (errsv),
+                                 g_strerror (errsv));
+          close (fd);
+          fd = -1;
+        }
+    }
+  g_free (buffer);
+
+  close (handle->fd);
+  handle->fd = fd;
+  handle->streaming = FALSE;
+  handle->base = handle->offset;
+  if (fd >= 0)
+    lseek (fd, 0, SEEK_SET);
+  if (error != NULL)
+    {
+      if (handle->error == NULL)
+        handle->error = error;
+      else
+        g_error_free (error);
+    }
+
+  op_backend->read_handle = NULL;
+}
+
+/* Aborts the transfer of @handle, if it's still running. Must be called
+ * with the mutex held. */
+static void
+_cancel_read_transfer (GVfsBackendObexftp *op_backend,
+                       ObexFTPOpenHandle *handle)
+{
+  char *buffer;
+
+  if (_read_transfer_is_done (op_backend, handle))
+    {
+      if (op_backend->read_handle == handle)
+        op_backend->read_handle = NULL;
+      return;
+    }
+
+  op_backend->status = ASYNC_PENDING;
+
+  if (handle->streaming)
+    {
+      /* obex-data-server may be blocked writing to the pipe, don't wait
+       * for a reply but empty the pipe until it closes it */
+      dbus_g_proxy_call_no_reply (op_backend->session_proxy, "Cancel",
+                                  G_TYPE_INVALID);
+      buffer = g_malloc (64 * 1024);
+      while (_read_transfer (op_backend, handle, NULL, buffer, 64 * 1024, NULL) > 0)
+        ;
+      g_free (buffer);
+    }
+  else if (dbus_g_proxy_call (op_backend->session_proxy, "Cancel", NULL,
+                              G_TYPE_INVALID, G_TYPE_INVALID) != FALSE)
+    {
+      while (op_backend->status == ASYNC_PENDING && !op_backend->read_transfer_done)
+        g_cond_wait (&op_backend->cond, &op_backend->mutex);
+    }
+
+  op_backend->status = ASYNC_PENDING;
+  op_backend->read_handle = NULL;
+}
+
 static gboolean
 _change_directory (GVfsBackendObexftp *op_backend,
                      const char *filename,
@@ -556,6 +793,8 @@ _change_directory (GVfsBackendObexftp *op_backend,
   char *current_path, **req_components;
   guint i;
 
+  _finish_read_transfer (op_backend);
+
   if (dbus_g_proxy_call (op_backend->session_proxy, "GetCurrentPath", error,
                          G_TYPE_INVALID,
                          G_TYPE_STRING, &current_path, G_TYPE_INVALID) == FALSE)
@@ -975,6 +1214,8 @@ do_mount (GVfsBackend *backend,
                           G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT64, G_TYPE_INVALID);
   dbus_g_proxy_add_signal(op_backend->session_proxy, "TransferCompleted",
                           G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(op_backend->session_proxy, "TransferCompleted",
+                              G_CALLBACK(read_transfer_completed_cb), op_backend, NULL);
   dbus_g_proxy_add_signal(op_backend->session_proxy, "TransferProgress",
                           G_TYPE_UINT64, G_TYPE_INVALID);
 
@@ -1032,6 +1273,127 @@ transfer_started_cb (DBusGProxy *proxy, const gchar *filename,
   g_mutex_unlock (&op_backend->mutex);
 }
 
+/* Starts downloading the file of @handle into a pipe it can be read from
+ * as the data arrives if @streaming, or otherwise into a temporary file,
+ * which allows seeking. Must be called with the mutex held.
+ */
+static gboolean
+_start_read_transfer (GVfsBackendObexftp *op_backend,
+                      ObexFTPOpenHandle *handle,
+                      gboolean streaming,
+                      GError **error)
+{
+  char *dirname, *basename, *target, *fifo_dir;
+  gboolean called;
+  int fd, success, errsv;
+
+  /* someone else might still be reading */
+  _finish_read_transfer (op_backend);
+
+  dirname = g_path_get_dirname (handle->source);
+  if (_change_directory (op_backend, dirname, error) == FALSE)
+    {
+      g_free (dirname);
+      return FALSE;
+    }
+  g_free (dirname);
+
+  fifo_dir = NULL;
+  if (streaming)
+    {
+      fifo_dir = g_dir_make_tmp ("gvfsobexftp-XXXXXX", error);
+      if (fifo_dir == NULL)
+        return FALSE;
+
+      target = g_build_filename (fifo_dir, "fifo", NULL);
+      fd = -1;
+      if (mkfifo (target, 0600) == 0)
+        fd = open (target, O_RDONLY | O_NONBLOCK);
+      if (fd < 0)
+        {
+          errsv = errno;
+          g_set_error_literal (error, G_IO_ERROR,
+                               g_io_error_from_errno (errsv),
+                               g_strerror (errsv));
+          g_unlink (target);
+          g_rmdir (fifo_dir);
+          g_free (target);
+          g_free (fifo_dir);
+          return FALSE;
+        }
+    }
+  else
+    {
+      fd = g_file_open_tmp ("gvfsobexftp-tmp-XXXXXX", &target, error);
+      if (fd < 0)
+        return FALSE;
+    }
+
+  op_backend->status = ASYNC_PENDING;
+  op_backend->read_handle = handle;
+  op_backend->read_transfer_done = FALSE;
+
+  dbus_g_proxy_connect_signal(op_backend->session_proxy, "TransferStarted",
+                              G_CALLBACK(transfer_started_cb), op_backend, NULL);
+
+  basename = g_path_get_basename (handle->source);
+  called = dbus_g_proxy_call (op_backend->session_proxy, "CopyRemoteFile", error,
+                              G_TYPE_STRING, basename,
+                              G_TYPE_STRING, target,
+                              G_TYPE_INVALID,
+                              G_TYPE_INVALID);
+  if (called == FALSE)
+    {
+      g_message ("CopyRemoteFile failed");
+      success = ASYNC_ERROR;
+    }
+  else
+    {
+      /* Wait for TransferStarted or ErrorOccurred to have happened */
+      while (op_backend->status == ASYNC_PENDING)
+            g_cond_wait (&op_backend->cond, &op_backend->mutex);
+      success = op_backend->status;
+
+      g_message ("filename: %s (%s) copying to %s (retval %d)", handle->source, basename, target, success);
+    }
+  dbus_g_proxy_disconnect_signal(op_backend->session_proxy, "TransferStarted",
+                                 G_CALLBACK(transfer_started_cb), op_backend);
+  g_free (basename);
+
+  /* obex-data-server has the file open by now */
+  g_unlink (target);
+  g_free (target);
+  if (fifo_dir != NULL)
+    {
+      g_rmdir (fifo_dir);
+      g_free (fifo_dir);
+    }
+
+  op_backend->status = ASYNC_PENDING;
+
+  if (success == ASYNC_ERROR)
+    {
+      op_backend->read_handle = NULL;
+      close (fd);
+      if (called)
+        {
+          g_propagate_error (error, op_backend->error);
+          op_backend->error = NULL;
+        }
+      return FALSE;
+    }
+
+  if (handle->fd >= 0)
+    close (handle->fd);
+  handle->fd = fd;
+  handle->streaming = streaming;
+  handle->writer_seen = FALSE;
+  handle->offset = 0;
+  handle->base = 0;
+
+  return TRUE;
+}
+
 static void
 do_open_for_read (GVfsBackend *backend,
                   GVfsJobOpenForRead *job,
@@ -1040,10 +1402,8 @@ do_open_for_read (GVfsBackend *backend,
   GVfsBackendObexftp *op_backend = G_VFS_BACKEND_OBEXFTP (backend);
   GError *error = NULL;
   ObexFTPOpenHandle *handle;
-  char *target, *basename;
   GFileInfo *info;
   goffset size;
-  int fd, success;
 
   g_debug ("+ do_open_for_read, filename: %s\n", filename);
 
@@ -1086,167 +1446,187 @@ do_open_for_read (GVfsBackend *backend,
       return;
     }
 
-  fd = g_file_open_tmp ("gvfsobexftp-tmp-XXXXXX",
-                        &target, &error);
-  if (fd < 0)
-    {
-      op_backend->doing_io = FALSE;
-      g_mutex_unlock (&op_backend->mutex);
-      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
-      g_error_free (error);
-      return;
-    }
+  handle = g_new0 (ObexFTPOpenHandle, 1);
+  handle->source = g_strdup (filename);
+  handle->fd = -1;
+  handle->size = size;
 
-  if (g_vfs_job_is_cancelled (G_VFS_JOB (job)))
+  /* Stream the file through a pipe so reading can start right away
+   * without keeping a copy of it; only seeking backwards needs one */
+  if (_start_read_transfer (op_backend, handle, TRUE, &error) == FALSE)
     {
       op_backend->doing_io = FALSE;
       g_mutex_unlock (&op_backend->mutex);
-      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
-                                   G_IO_ERROR_CANCELLED,
-                                   _("Operation was cancelled"));
-      return;
-    }
-
-  op_backend->status = ASYNC_PENDING;
-
-  dbus_g_proxy_connect_signal(op_backend->session_proxy, "TransferStarted",
-                              G_CALLBACK(transfer_started_cb), op_backend, NULL);
-
-  basename = g_path_get_basename (filename);
-  if (dbus_g_proxy_call (op_backend->session_proxy, "CopyRemoteFile", &error,
-                         G_TYPE_STRING, basename,
-                         G_TYPE_STRING, target,
-                         G_TYPE_INVALID,
-                         G_TYPE_INVALID) == FALSE)
-    {
-      g_message ("CopyRemoteFile failed");
-
-      g_free (basename);
       g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
       g_error_free (error);
-
-      dbus_g_proxy_disconnect_signal(op_backend->session_proxy, "TransferStarted",
-                                     G_CALLBACK(transfer_started_cb), op_backend);
-
-      /* Close the target */
-      g_unlink (target);
-      g_free (target);
-      close (fd);
-
-      op_backend->doing_io = FALSE;
-      g_mutex_unlock (&op_backend->mutex);
-      return;
-    }
-
-  /* Wait for TransferStarted or ErrorOccurred to have happened */
-  while (op_backend->status == ASYNC_PENDING)
-        g_cond_wait (&op_backend->cond, &op_backend->mutex);
-  success = op_backend->status;
-  dbus_g_proxy_disconnect_signal(op_backend->session_proxy, "TransferStarted",
-                                 G_CALLBACK(transfer_started_cb), op_backend);
-
-  /* We either got success or an async error */
-  g_assert (success != ASYNC_PENDING);
-
-  g_message ("filename: %s (%s) copying to %s (retval %d)", filename, basename, target, success);
-  g_free (basename);
-
-  g_unlink (target);
-  g_free (target);
-  op_backend->status = ASYNC_PENDING;
-
-  if (success == ASYNC_ERROR)
-    {
-      op_backend->doing_io = FALSE;
-      g_mutex_unlock (&op_backend->mutex);
-      close (fd);
-      g_vfs_job_failed_from_error (G_VFS_JOB (job),
-                                   op_backend->error);
-      g_error_free (op_backend->error);
-      op_backend->error = NULL;
+      g_free (handle->source);
+      g_free (handle);
       return;
     }
 
-  handle = g_new0 (ObexFTPOpenHandle, 1);
-  handle->source = g_strdup (filename);
-  handle->fd = fd;
-  handle->size = size;
   g_vfs_job_open_for_read_set_handle (job, handle);
 
   g_debug ("- do_open_for_read, filename: %s\n", filename);
 
-  g_vfs_job_open_for_read_set_can_seek (G_VFS_JOB_OPEN_FOR_READ (job), FALSE);
+  g_vfs_job_open_for_read_set_can_seek (G_VFS_JOB_OPEN_FOR_READ (job), TRUE);
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
   op_backend->doing_io = FALSE;
   g_mutex_unlock (&op_backend->mutex);
 }
 
-static int
-is_busy (DBusGProxy *session_proxy, GVfsJob *job)
+static void
+do_read (GVfsBackend *backend,
+         GVfsJobRead *job,
+         GVfsBackendHandle handle,
+         char *buffer,
+         gsize bytes_requested)
 {
+  GVfsBackendObexftp *op_backend = G_VFS_BACKEND_OBEXFTP (backend);
+  ObexFTPOpenHandle *backend_handle = (ObexFTPOpenHandle *) handle;
   GError *error = NULL;
-  gboolean busy;
+  gssize bytes_read;
 
-  if (dbus_g_proxy_call (session_proxy, "IsBusy", &error,
-                         G_TYPE_INVALID,
-                         G_TYPE_BOOLEAN, &busy, G_TYPE_INVALID) == FALSE)
+  g_mutex_lock (&op_backend->mutex);
+  op_backend->doing_io = TRUE;
+
+  if (backend_handle->error != NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), backend_handle->error);
+      goto out;
+    }
+
+  bytes_read = _read_transfer (op_backend, backend_handle, G_VFS_JOB (job),
+                               buffer, bytes_requested, &error);
+  if (bytes_read < 0)
     {
-      g_vfs_job_failed_from_error (job, error);
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
       g_error_free (error);
-      return -1;
+    }
+  else
+    {
+      backend_handle->offset += bytes_read;
+      g_vfs_job_read_set_size (job, bytes_read);
+      g_vfs_job_succeeded (G_VFS_JOB (job));
     }
 
-  return busy;
+ out:
+  op_backend->doing_io = FALSE;
+  g_mutex_unlock (&op_backend->mutex);
 }
 
 static void
-do_read (GVfsBackend *backend,
-         GVfsJobRead *job,
-         GVfsBackendHandle handle,
-         char *buffer,
-         gsize bytes_requested)
+do_seek_on_read (GVfsBackend *backend,
+                 GVfsJobSeekRead *job,
+                 GVfsBackendHandle handle,
+                 goffset offset,
+                 GSeekType type)
 {
   GVfsBackendObexftp *op_backend = G_VFS_BACKEND_OBEXFTP (backend);
   ObexFTPOpenHandle *backend_handle = (ObexFTPOpenHandle *) handle;
-  ssize_t bytes_read = 0;
-  gboolean busy = TRUE;
+  GError *error = NULL;
+  goffset new_offset;
+  char *buffer;
+  gssize n;
 
-  while (bytes_read == 0 && busy != FALSE)
+  switch (type)
     {
-      bytes_read = read (backend_handle->fd, buffer, bytes_requested);
-      if (bytes_read != 0)
-            break;
+    default:
+    case G_SEEK_SET:
+      new_offset = offset;
+      break;
+    case G_SEEK_CUR:
+      new_offset = backend_handle->offset + offset;
+      break;
+    case G_SEEK_END:
+      new_offset = backend_handle->size + offset;
+      break;
+    }
 
-      if (g_vfs_job_is_cancelled (G_VFS_JOB (job)))
-        {
-          g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
-                            G_IO_ERROR_CANCELLED,
-                            _("Operation was cancelled"));
-          return;
-        }
+  if (new_offset < 0)
+    {
+      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
+                        G_IO_ERROR_INVALID_ARGUMENT,
+                        _("Invalid seek offset"));
+      return;
+    }
 
-      busy = is_busy (op_backend->session_proxy, G_VFS_JOB (job));
-      if (busy < 0)
-            return;
+  g_mutex_lock (&op_backend->mutex);
+  op_backend->doing_io = TRUE;
 
-      g_usleep (G_USEC_PER_SEC / 100);
+  if (backend_handle->error != NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), backend_handle->error);
+      goto out;
     }
 
-  if (bytes_read < 0)
+  if (backend_handle->streaming && new_offset >= backend_handle->offset)
     {
-      g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+      /* Skip forward in the stream */
+      buffer = g_malloc (64 * 1024);
+      while (backend_handle->offset < new_offset)
+        {
+          n = _read_transfer (op_backend, backend_handle, G_VFS_JOB (job), buffer,
+                              MIN (64 * 1024, new_offset - backend_handle->offset),
+                              &error);
+          if (n < 0)
+            break;
+          if (n == 0)
+            {
+              /* past the end of the file */
+              backend_handle->offset = new_offset;
+              break;
+            }
+          backend_handle->offset += n;
+        }
+      g_free (buffer);
+
+      if (error != NULL)
+        {
+          g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+          g_error_free (error);
+          goto out;
+        }
     }
-  else if (bytes_read == 0)
+  else if (!backend_handle->streaming && backend_handle->fd >= 0 &&
+           new_offset >= backend_handle->base)
     {
-      g_vfs_job_read_set_size (job, 0);
-      g_vfs_job_succeeded (G_VFS_JOB (job));
+      /* Within the temporary file; reads wait for the data if it's not
+       * there yet */
+      if (lseek (backend_handle->fd, new_offset - backend_handle->base, SEEK_SET) < 0)
+        {
+          g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+          goto out;
+        }
+      backend_handle->offset = new_offset;
     }
   else
     {
-      g_vfs_job_read_set_size (job, bytes_read);
-      g_vfs_job_succeeded (G_VFS_JOB (job));
+      /* The data is gone, download the file again, this time into a
+       * temporary file so we can seek around in it */
+      g_debug ("seeking back in %s, downloading it again\n", backend_handle->source);
+
+      _cancel_read_transfer (op_backend, backend_handle);
+      if (_start_read_transfer (op_backend, backend_handle, FALSE, &error) == FALSE)
+        {
+          g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+          g_error_free (error);
+          goto out;
+        }
+      if (lseek (backend_handle->fd, new_offset, SEEK_SET) < 0)
+        {
+          g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+          goto out;
+        }
+      backend_handle->offset = new_offset;
     }
+
+  g_vfs_job_seek_read_set_offset (job, new_offset);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+ out:
+  op_backend->doing_io = FALSE;
+  g_mutex_unlock (&op_backend->mutex);
 }
 
 static void
@@ -1256,33 +1636,21 @@ do_close_read (GVfsBackend *backend,
 {
   GVfsBackendObexftp *op_backend = G_VFS_BACKEND_OBEXFTP (backend);
   ObexFTPOpenHandle *backend_handle = (ObexFTPOpenHandle *) handle;
-  int busy;
 
   g_debug ("+ do_close_read\n");
 
-  busy = is_busy (op_backend->session_proxy, G_VFS_JOB (job));
-  if (busy < 0) {
-      g_message ("busy error");
-        return;
-  }
-
   g_mutex_lock (&op_backend->mutex);
+  op_backend->doing_io = TRUE;
 
-  if (busy > 0)
-    {
-      op_backend->status = ASYNC_PENDING;
-
-      if (dbus_g_proxy_call (op_backend->session_proxy, "Cancel", NULL,
-                         G_TYPE_INVALID, G_TYPE_INVALID) != FALSE)
-        {
-          while (op_backend->status == ASYNC_PENDING)
-                g_cond_wait (&op_backend->cond, &op_backend->mutex);
-        }
-    }
+  _cancel_read_transfer (op_backend, backend_handle);
 
+  op_backend->doing_io = FALSE;
   g_mutex_unlock (&op_backend->mutex);
 
-  close (backend_handle->fd);
+  if (backend_handle->fd >= 0)
+    close (backend_handle->fd);
+  if (backend_handle->error != NULL)
+    g_error_free (backend_handle->error);
   g_free (backend_handle->source);
   g_free (backend_handle);
 
@@ -2124,6 +2492,7 @@ g_vfs_backend_obexftp_class_init (GVfsBackendObexftpClass *klass)
   backend_class->mount = do_mount;
   backend_class->open_for_read = do_open_for_read;
   backend_class->read = do_read;
+  backend_class->seek_on_read = do_seek_on_read;
   backend_class->close_read = do_close_read;
   backend_class->query_info = do_query_info;
   backend_class->query_fs_info = do_query_fs_info;
@@ -62,6 +62,9 @@
 #include "gvfsjobenumerate.h"
 #include "gvfsjobmakedirectory.h"
 #include "gvfsjobprogress.h"
+#include "gvfsjobcreatemonitor.h"
+#include "gvfspollmonitor.h"
+#include "gvfstrace.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfskeyring.h"
 #include "sftp.h"
@@ -275,7 +278,8 @@ g_vfs_backend_sftp_finalize (GObject *object)
 static void
 expected_reply_free (ExpectedReply *reply)
 {
-  g_object_unref (reply->job);
+  if (reply->job)
+    g_object_unref (reply->job);
   g_slice_free (ExpectedReply, reply);
 }
 
@@ -1142,7 +1146,8 @@ fail_jobs_and_die (GVfsBackendSftp *backend, GError *error)
   while (g_hash_table_iter_next (&iter, &key, &value))
     {
       ExpectedReply *expected_reply = (ExpectedReply *) value;
-      g_vfs_job_failed_from_error (expected_reply->job, error);
+      if (expected_reply->job)
+        g_vfs_job_failed_from_error (expected_reply->job, error);
     }
 
   g_error_free (error);
@@ -1203,6 +1208,8 @@ read_reply_async_got_data  (GObject *source_object,
   type = g_data_input_stream_read_byte (reply, NULL, NULL);
   id = g_data_input_stream_read_uint32 (reply, NULL, NULL);
 
+  GVFS_TRACE4 (sftp__reply, backend, id, type, backend->reply_size);
+
   expected_reply = g_hash_table_lookup (backend->expected_replies, GINT_TO_POINTER (id));
   if (expected_reply)
     {
@@ -1343,7 +1350,7 @@ expect_reply (GVfsBackendSftp *backend,
 
   expected = g_slice_new (ExpectedReply);
   expected->callback = callback;
-  expected->job = g_object_ref (job);
+  expected->job = job ? g_object_ref (job) : NULL; /* NULL for internal requests */
   expected->user_data = user_data;
 
   g_hash_table_replace (backend->expected_replies, GINT_TO_POINTER (id), expected);
@@ -1393,6 +1400,8 @@ queue_command_stream_and_free (GVfsBackendSftp *backend,
   buffer = data_buffer_new (data, len);
   g_object_unref (command_stream);
 
+  GVFS_TRACE3 (sftp__send, backend, id, len);
+
   expect_reply (backend, id, callback, job, user_data);
   queue_command_buffer (backend, buffer);
 }
@@ -3950,6 +3959,171 @@ try_enumerate (GVfsBackend *backend,
   return TRUE;
 }
 
+/* Directory listings for the poll monitor, these run without a job */
+typedef struct {
+  GVfsPollMonitor *poll;
+  DataBuffer *handle;
+  GList *infos;
+} PollListData;
+
+static GFileAttributeMatcher *poll_list_matcher = NULL;
+
+static void
+poll_list_finish (GVfsBackendSftp *backend,
+                  PollListData *data,
+                  GError *error)
+{
+  GDataOutputStream *command;
+
+  if (data->handle)
+    {
+      command = new_command_stream (backend,
+                                    SSH_FXP_CLOSE);
+      put_data_buffer (command, data->handle);
+      queue_command_stream_and_free (backend, command, NULL, NULL, NULL);
+      data_buffer_free (data->handle);
+    }
+
+  if (error)
+    {
+      g_list_free_full (data->infos, g_object_unref);
+      g_vfs_poll_monitor_list_done (data->poll, NULL, error);
+    }
+  else
+    g_vfs_poll_monitor_list_done (data->poll, g_list_reverse (data->infos), NULL);
+
+  g_slice_free (PollListData, data);
+}
+
+static void
+poll_read_dir_reply (GVfsBackendSftp *backend,
+                     int reply_type,
+                     GDataInputStream *reply,
+                     guint32 len,
+                     GVfsJob *job,
+                     gpointer user_data)
+{
+  PollListData *data = user_data;
+  GDataOutputStream *command;
+  GError *error;
+  guint32 count;
+  int i;
+
+  if (reply_type != SSH_FXP_NAME)
+    {
+      error = NULL;
+      if (reply_type == SSH_FXP_STATUS)
+        error_from_status (NULL, reply, -1, SSH_FX_EOF, &error);
+      else
+        error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                     _("Invalid reply received"));
+      poll_list_finish (backend, data, error);
+      return;
+    }
+
+  count = g_data_input_stream_read_uint32 (reply, NULL, NULL);
+  for (i = 0; i < count; i++)
+    {
+      GFileInfo *info;
+      char *name;
+      char *longname;
+
+      info = g_file_info_new ();
+      name = read_string (reply, NULL);
+      g_file_info_set_name (info, name);
+
+      longname = read_string (reply, NULL);
+      g_free (longname);
+
+      parse_attributes (backend, info, name, reply, poll_list_matcher);
+
+      if (strcmp (".", name) != 0 &&
+          strcmp ("..", name) != 0)
+        data->infos = g_list_prepend (data->infos, info);
+      else
+        g_object_unref (info);
+
+      g_free (name);
+    }
+
+  command = new_command_stream (backend,
+                                SSH_FXP_READDIR);
+  put_data_buffer (command, data->handle);
+  queue_command_stream_and_free (backend, command, poll_read_dir_reply, NULL, data);
+}
+
+static void
+poll_open_dir_reply (GVfsBackendSftp *backend,
+                     int reply_type,
+                     GDataInputStream *reply,
+                     guint32 len,
+                     GVfsJob *job,
+                     gpointer user_data)
+{
+  PollListData *data = user_data;
+  GDataOutputStream *command;
+  GError *error;
+
+  if (reply_type != SSH_FXP_HANDLE)
+    {
+      error = NULL;
+      if (reply_type == SSH_FXP_STATUS)
+        error_from_status (NULL, reply, -1, -1, &error);
+      else
+        error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                     _("Invalid reply received"));
+      poll_list_finish (backend, data, error);
+      return;
+    }
+
+  data->handle = read_data_buffer (reply);
+
+  command = new_command_stream (backend,
+                                SSH_FXP_READDIR);
+  put_data_buffer (command, data->handle);
+  queue_command_stream_and_free (backend, command, poll_read_dir_reply, NULL, data);
+}
+
+static void
+poll_list_dir (GVfsBackend *backend,
+               const char *filename,
+               GVfsPollMonitor *poll)
+{
+  GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
+  GDataOutputStream *command;
+  PollListData *data;
+
+  if (poll_list_matcher == NULL)
+    poll_list_matcher = g_file_attribute_matcher_new (G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                                      G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                                      G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  data = g_slice_new0 (PollListData);
+  data->poll = poll;
+
+  command = new_command_stream (op_backend,
+                                SSH_FXP_OPENDIR);
+  put_string (command, filename);
+  queue_command_stream_and_free (op_backend, command, poll_open_dir_reply, NULL, data);
+}
+
+static gboolean
+try_create_dir_monitor (GVfsBackend *backend,
+                        GVfsJobCreateMonitor *job,
+                        const char *filename,
+                        GFileMonitorFlags flags)
+{
+  GVfsMonitor *monitor;
+
+  monitor = g_vfs_poll_monitor_new (backend, filename, poll_list_dir);
+  g_vfs_job_create_monitor_set_monitor (job, monitor);
+  g_object_unref (monitor);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  return TRUE;
+}
+
 static void
 query_info_reply (GVfsBackendSftp *backend,
                   MultiReply *replies,
@@ -4725,6 +4899,7 @@ g_vfs_backend_sftp_class_init (GVfsBackendSftpClass *klass)
   backend_class->try_query_info_on_read = (gpointer) try_query_info_fstat;
   backend_class->try_query_info_on_write = (gpointer) try_query_info_fstat;
   backend_class->try_enumerate = try_enumerate;
+  backend_class->try_create_dir_monitor = try_create_dir_monitor;
   backend_class->try_create = try_create;
   backend_class->try_append_to = try_append_to;
   backend_class->try_replace = try_replace;
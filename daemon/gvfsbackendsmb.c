@@ -49,10 +49,40 @@
 #include "gvfsjobenumerate.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfskeyring.h"
+#include "gvfstrace.h"
 
 #include <libsmbclient.h>
 #include "libsmb-compat.h"
 
+/* libsmbclient contexts are not thread safe, so each job borrows one
+ * from a pool for its duration. Open files are bound to the context
+ * they were opened with. */
+#ifdef HAVE_SAMBA_THREAD_POSIX
+#define SMB_CONTEXT_POOL_SIZE 4
+#else
+#define SMB_CONTEXT_POOL_SIZE 1
+#endif
+
+typedef struct {
+  GVfsBackendSmb *backend;
+  SMBCCTX *smb_context;
+
+  gboolean in_use;
+  volatile gint n_open_files;
+
+  /* Cache */
+  char *cached_server_name;
+  char *cached_share_name;
+  char *cached_domain;
+  char *cached_username;
+  SMBCSRV *cached_server;
+} SmbContext;
+
+typedef struct {
+  SmbContext *context;
+  SMBCFILE *file;
+} SmbReadHandle;
+
 struct _GVfsBackendSmb
 {
   GVfsBackend parent_instance;
@@ -64,8 +94,12 @@ struct _GVfsBackendSmb
   char *path;
   char *default_workgroup;
   
-  SMBCCTX *smb_context;
+  GPtrArray *contexts;
+  int n_contexts_pending; /* Being created outside pool_lock */
+  GMutex pool_lock;
+  GCond pool_cond;
 
+  GMutex auth_lock;
   char *last_user;
   char *last_domain;
   char *last_password;
@@ -77,18 +111,12 @@ struct _GVfsBackendSmb
 	
   gboolean password_in_keyring;
   GPasswordSave password_save;
-  
-  /* Cache */
-  char *cached_server_name;
-  char *cached_share_name;
-  char *cached_domain;
-  char *cached_username;
-  SMBCSRV *cached_server;
 };
 
 
 G_DEFINE_TYPE (GVfsBackendSmb, g_vfs_backend_smb, G_VFS_TYPE_BACKEND)
 
+static void smb_context_free (SmbContext *ctx);
 static void set_info_from_stat (GVfsBackendSmb *backend,
 				GFileInfo *info,
 				struct stat *statbuf,
@@ -109,6 +137,15 @@ g_vfs_backend_smb_finalize (GObject *object)
   g_free (backend->domain);
   g_free (backend->path);
   g_free (backend->default_workgroup);
+
+  g_free (backend->last_user);
+  g_free (backend->last_domain);
+  g_free (backend->last_password);
+
+  g_ptr_array_free (backend->contexts, TRUE);
+  g_mutex_clear (&backend->pool_lock);
+  g_cond_clear (&backend->pool_cond);
+  g_mutex_clear (&backend->auth_lock);
   
   if (G_OBJECT_CLASS (g_vfs_backend_smb_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_smb_parent_class)->finalize) (object);
@@ -130,6 +167,11 @@ g_vfs_backend_smb_init (GVfsBackendSmb *backend)
     g_free (workgroup);
 
   g_object_unref (settings);
+
+  backend->contexts = g_ptr_array_new_with_free_func ((GDestroyNotify) smb_context_free);
+  g_mutex_init (&backend->pool_lock);
+  g_cond_init (&backend->pool_cond);
+  g_mutex_init (&backend->auth_lock);
 }
 
 /**
@@ -162,11 +204,13 @@ auth_callback (SMBCCTX *context,
 	       char *username_out, int unmaxlen,
 	       char *password_out, int pwmaxlen)
 {
+  SmbContext *smb_ctx;
   GVfsBackendSmb *backend;
   char *ask_password, *ask_user, *ask_domain;
   gboolean handled, abort;
 
-  backend = smbc_getOptionUserData (context);
+  smb_ctx = smbc_getOptionUserData (context);
+  backend = smb_ctx->backend;
 
   strncpy (password_out, "", pwmaxlen);
   
@@ -186,12 +230,14 @@ auth_callback (SMBCCTX *context,
   if (backend->mount_source == NULL)
     {
       /* Not during mount, use last password */
+      g_mutex_lock (&backend->auth_lock);
       if (backend->last_user)
 	strncpy (username_out, backend->last_user, unmaxlen);
       if (backend->last_domain)
 	strncpy (domain_out, backend->last_domain, domainmaxlen);
       if (backend->last_password)
 	strncpy (password_out, backend->last_password, pwmaxlen);
+      g_mutex_unlock (&backend->auth_lock);
       
       return;
     }
@@ -276,9 +322,14 @@ auth_callback (SMBCCTX *context,
       g_free (ask_domain);
     }
 
+  g_mutex_lock (&backend->auth_lock);
+  g_free (backend->last_user);
   backend->last_user = g_strdup (username_out);
+  g_free (backend->last_domain);
   backend->last_domain = g_strdup (domain_out);
+  g_free (backend->last_password);
   backend->last_password = g_strdup (password_out);
+  g_mutex_unlock (&backend->auth_lock);
 }
 
 /* Add a server to the cache system
@@ -297,18 +348,18 @@ add_cached_server (SMBCCTX *context, SMBCSRV *new,
 		   const char *server_name, const char *share_name, 
 		   const char *domain, const char *username)
 {
-  GVfsBackendSmb *backend;
+  SmbContext *smb_ctx;
 
-  backend = smbc_getOptionUserData (context);
+  smb_ctx = smbc_getOptionUserData (context);
   
-  if (backend->cached_server != NULL)
+  if (smb_ctx->cached_server != NULL)
     return 1;
 
-  backend->cached_server_name = g_strdup (server_name);
-  backend->cached_share_name = g_strdup (share_name);
-  backend->cached_domain = g_strdup (domain);
-  backend->cached_username = g_strdup (username);
-  backend->cached_server = new;
+  smb_ctx->cached_server_name = g_strdup (server_name);
+  smb_ctx->cached_share_name = g_strdup (share_name);
+  smb_ctx->cached_domain = g_strdup (domain);
+  smb_ctx->cached_username = g_strdup (username);
+  smb_ctx->cached_server = new;
 
   return 0;
 }
@@ -323,21 +374,21 @@ add_cached_server (SMBCCTX *context, SMBCSRV *new,
 static int
 remove_cached_server(SMBCCTX * context, SMBCSRV * server)
 {
-  GVfsBackendSmb *backend;
+  SmbContext *smb_ctx;
 
-  backend = smbc_getOptionUserData (context);
+  smb_ctx = smbc_getOptionUserData (context);
   
-  if (backend->cached_server == server)
+  if (smb_ctx->cached_server == server)
     {
-      g_free (backend->cached_server_name);
-      backend->cached_server_name = NULL;
-      g_free (backend->cached_share_name);
-      backend->cached_share_name = NULL;
-      g_free (backend->cached_domain);
-      backend->cached_domain = NULL;
-      g_free (backend->cached_username);
-      backend->cached_username = NULL;
-      backend->cached_server = NULL;
+      g_free (smb_ctx->cached_server_name);
+      smb_ctx->cached_server_name = NULL;
+      g_free (smb_ctx->cached_share_name);
+      smb_ctx->cached_share_name = NULL;
+      g_free (smb_ctx->cached_domain);
+      smb_ctx->cached_domain = NULL;
+      g_free (smb_ctx->cached_username);
+      smb_ctx->cached_username = NULL;
+      smb_ctx->cached_server = NULL;
       return 0;
     }
   return 1;
@@ -359,16 +410,16 @@ get_cached_server (SMBCCTX * context,
 		   const char *server_name, const char *share_name,
 		   const char *domain, const char *username)
 {
-  GVfsBackendSmb *backend;
+  SmbContext *smb_ctx;
 
-  backend = smbc_getOptionUserData (context);
+  smb_ctx = smbc_getOptionUserData (context);
 
-  if (backend->cached_server != NULL &&
-      strcmp (backend->cached_server_name, server_name) == 0 &&
-      strcmp (backend->cached_share_name, share_name) == 0 &&
-      strcmp (backend->cached_domain, domain) == 0 &&
-      strcmp (backend->cached_username, username) == 0)
-    return backend->cached_server;
+  if (smb_ctx->cached_server != NULL &&
+      strcmp (smb_ctx->cached_server_name, server_name) == 0 &&
+      strcmp (smb_ctx->cached_share_name, share_name) == 0 &&
+      strcmp (smb_ctx->cached_domain, domain) == 0 &&
+      strcmp (smb_ctx->cached_username, username) == 0)
+    return smb_ctx->cached_server;
 
   return NULL;
 }
@@ -383,16 +434,180 @@ get_cached_server (SMBCCTX * context,
 static int
 purge_cached (SMBCCTX * context)
 {
-  GVfsBackendSmb *backend;
+  SmbContext *smb_ctx;
   
-  backend = smbc_getOptionUserData (context);
+  smb_ctx = smbc_getOptionUserData (context);
 
-  if (backend->cached_server)
-    remove_cached_server(context, backend->cached_server);
+  if (smb_ctx->cached_server)
+    remove_cached_server(context, smb_ctx->cached_server);
   
   return 0;
 }
 
+static SmbContext *
+smb_context_new (GVfsBackendSmb *backend,
+		 GError **error)
+{
+  SmbContext *ctx;
+  SMBCCTX *smb_context;
+  const char *debug;
+  int debug_val;
+
+  smb_context = smbc_new_context ();
+  if (smb_context == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		   _("Internal Error (%s)"), "Failed to allocate smb context");
+      return NULL;
+    }
+
+  ctx = g_new0 (SmbContext, 1);
+  ctx->backend = backend;
+  ctx->smb_context = smb_context;
+  smbc_setOptionUserData (smb_context, ctx);
+
+  debug = g_getenv ("GVFS_SMB_DEBUG");
+  if (debug)
+    debug_val = atoi (debug);
+  else
+    debug_val = 0;
+
+  smbc_setDebug (smb_context, debug_val);
+  smbc_setFunctionAuthDataWithContext (smb_context, auth_callback);
+  
+  smbc_setFunctionAddCachedServer (smb_context, add_cached_server);
+  smbc_setFunctionGetCachedServer (smb_context, get_cached_server);
+  smbc_setFunctionRemoveCachedServer (smb_context, remove_cached_server);
+  smbc_setFunctionPurgeCachedServers (smb_context, purge_cached);
+
+  /* FIXME: is strdup() still needed here? -- removed */
+  if (backend->default_workgroup != NULL)
+    smbc_setWorkgroup (smb_context, backend->default_workgroup);
+
+#ifndef DEPRECATED_SMBC_INTERFACE
+  smb_context->flags = 0;
+#endif
+  
+  /* Initial settings:
+   *   - use Kerberos (always)
+   *   - in case of no username specified, try anonymous login
+   * Contexts created after the first mount round use the same
+   * fallbacks as the mount loop ended up with.
+   */
+  smbc_setOptionUseKerberos (smb_context, 1);
+  smbc_setOptionFallbackAfterKerberos (smb_context,
+                                       backend->user != NULL ||
+                                       backend->mount_try > 0);
+  smbc_setOptionNoAutoAnonymousLogin (smb_context,
+                                      backend->user != NULL ||
+                                      backend->mount_try > 0);
+
+  
+#if 0
+  smbc_setOptionDebugToStderr (smb_context, 1);
+#endif
+  
+  if (!smbc_init_context (smb_context))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		   _("Internal Error (%s)"), "Failed to initialize smb context");
+      smbc_free_context (smb_context, FALSE);
+      g_free (ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+static void
+smb_context_free (SmbContext *ctx)
+{
+  /* Shutting down calls back into the cache functions, which use ctx */
+  smbc_free_context (ctx->smb_context, TRUE);
+
+  g_free (ctx->cached_server_name);
+  g_free (ctx->cached_share_name);
+  g_free (ctx->cached_domain);
+  g_free (ctx->cached_username);
+  g_free (ctx);
+}
+
+static SmbContext *
+find_free_context (GVfsBackendSmb *backend)
+{
+  SmbContext *ctx, *best;
+  guint i;
+
+  /* Prefer contexts without open files so that jobs on those files
+     don't have to wait for us */
+  best = NULL;
+  for (i = 0; i < backend->contexts->len; i++)
+    {
+      ctx = g_ptr_array_index (backend->contexts, i);
+      if (!ctx->in_use &&
+	  (best == NULL ||
+	   g_atomic_int_get (&ctx->n_open_files) < g_atomic_int_get (&best->n_open_files)))
+	best = ctx;
+    }
+
+  return best;
+}
+
+/* Borrows a context for the current job. If @ctx is non-%NULL (e.g. the
+ * context an open file belongs to) waits for that one, otherwise takes any
+ * free context, growing the pool if needed. */
+static SmbContext *
+smb_context_acquire (GVfsBackendSmb *backend,
+		     SmbContext *ctx)
+{
+  g_mutex_lock (&backend->pool_lock);
+
+  if (ctx != NULL)
+    {
+      while (ctx->in_use)
+	g_cond_wait (&backend->pool_cond, &backend->pool_lock);
+    }
+  else
+    {
+      while ((ctx = find_free_context (backend)) == NULL)
+	{
+	  if (backend->contexts->len + backend->n_contexts_pending < SMB_CONTEXT_POOL_SIZE)
+	    {
+	      /* Initializing may talk to the network, don't block other
+		 jobs meanwhile */
+	      backend->n_contexts_pending++;
+	      g_mutex_unlock (&backend->pool_lock);
+	      ctx = smb_context_new (backend, NULL);
+	      g_mutex_lock (&backend->pool_lock);
+	      backend->n_contexts_pending--;
+
+	      if (ctx != NULL)
+		{
+		  g_ptr_array_add (backend->contexts, ctx);
+		  break;
+		}
+	    }
+	  g_cond_wait (&backend->pool_cond, &backend->pool_lock);
+	}
+    }
+
+  ctx->in_use = TRUE;
+  g_mutex_unlock (&backend->pool_lock);
+
+  return ctx;
+}
+
+static void
+smb_context_release (SmbContext *ctx)
+{
+  GVfsBackendSmb *backend = ctx->backend;
+
+  g_mutex_lock (&backend->pool_lock);
+  ctx->in_use = FALSE;
+  g_cond_broadcast (&backend->pool_cond);
+  g_mutex_unlock (&backend->pool_lock);
+}
+
 #define SUB_DELIM_CHARS  "!$&'()*+,;="
 
 static gboolean
@@ -476,73 +691,27 @@ do_mount (GVfsBackend *backend,
 	  gboolean is_automount)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   SMBCCTX *smb_context;
   struct stat st;
   char *uri;
   int res;
   char *display_name;
-  const char *debug;
-  int debug_val;
   GMountSpec *smb_mount_spec;
   smbc_stat_fn smbc_stat;
+  GError *error = NULL;
 
-  smb_context = smbc_new_context ();
-  if (smb_context == NULL)
-    {
-      g_vfs_job_failed (G_VFS_JOB (job),
-			G_IO_ERROR, G_IO_ERROR_FAILED,
-			_("Internal Error (%s)"), "Failed to allocate smb context");
-      return;
-    }
-  smbc_setOptionUserData (smb_context, backend);
-
-  debug = g_getenv ("GVFS_SMB_DEBUG");
-  if (debug)
-    debug_val = atoi (debug);
-  else
-    debug_val = 0;
-
-  smbc_setDebug (smb_context, debug_val);
-  smbc_setFunctionAuthDataWithContext (smb_context, auth_callback);
-  
-  smbc_setFunctionAddCachedServer (smb_context, add_cached_server);
-  smbc_setFunctionGetCachedServer (smb_context, get_cached_server);
-  smbc_setFunctionRemoveCachedServer (smb_context, remove_cached_server);
-  smbc_setFunctionPurgeCachedServers (smb_context, purge_cached);
-
-  /* FIXME: is strdup() still needed here? -- removed */
-  if (op_backend->default_workgroup != NULL)
-    smbc_setWorkgroup (smb_context, op_backend->default_workgroup);
-
-#ifndef DEPRECATED_SMBC_INTERFACE
-  smb_context->flags = 0;
-#endif
-  
-  /* Initial settings:
-   *   - use Kerberos (always)
-   *   - in case of no username specified, try anonymous login
-   */
-  smbc_setOptionUseKerberos (smb_context, 1);
-  smbc_setOptionFallbackAfterKerberos (smb_context,
-                                       op_backend->user != NULL);
-  smbc_setOptionNoAutoAnonymousLogin (smb_context,
-                                      op_backend->user != NULL);
-
-  
-#if 0
-  smbc_setOptionDebugToStderr (smb_context, 1);
-#endif
-  
-  if (!smbc_init_context (smb_context))
+  ctx = smb_context_new (op_backend, &error);
+  if (ctx == NULL)
     {
-      g_vfs_job_failed (G_VFS_JOB (job),
-			G_IO_ERROR, G_IO_ERROR_FAILED,
-			_("Internal Error (%s)"), "Failed to initialize smb context");
-      smbc_free_context (smb_context, FALSE);
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
       return;
     }
 
-  op_backend->smb_context = smb_context;
+  /* The mount context is the first one in the pool */
+  smb_context = ctx->smb_context;
+  g_ptr_array_add (op_backend->contexts, ctx);
 
   /* Set the mountspec according to original uri, no matter whether user changes
      credentials during mount loop. Nautilus and other gio clients depend
@@ -597,8 +766,8 @@ do_mount (GVfsBackend *backend,
        */
       if (op_backend->mount_try == 0)
         {
-          smbc_setOptionFallbackAfterKerberos (op_backend->smb_context, 1);
-          smbc_setOptionNoAutoAnonymousLogin (op_backend->smb_context, 1);
+          smbc_setOptionFallbackAfterKerberos (smb_context, 1);
+          smbc_setOptionNoAutoAnonymousLogin (smb_context, 1);
         }
       op_backend->mount_try ++;
     }
@@ -691,8 +860,10 @@ do_open_for_read (GVfsBackend *backend,
 		  const char *filename)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *context;
   char *uri;
   SMBCFILE *file;
+  SmbReadHandle *handle;
   struct stat st;
   smbc_open_fn smbc_open;
   smbc_stat_fn smbc_stat;
@@ -700,17 +871,18 @@ do_open_for_read (GVfsBackend *backend,
   int olderr;
 
 
+  context = smb_context_acquire (op_backend, NULL);
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
+  smbc_open = smbc_getFunctionOpen (context->smb_context);
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri, O_RDONLY, 0);
+  file = smbc_open (context->smb_context, uri, O_RDONLY, 0);
 
   if (file == NULL)
     {
       olderr = fixup_open_errno (errno);
       
-      smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-      res = smbc_stat (op_backend->smb_context, uri, &st);
+      smbc_stat = smbc_getFunctionStat (context->smb_context);
+      res = smbc_stat (context->smb_context, uri, &st);
       g_free (uri);
       if ((res == 0) && (S_ISDIR (st.st_mode)))
             g_vfs_job_failed (G_VFS_JOB (job),
@@ -721,37 +893,48 @@ do_open_for_read (GVfsBackend *backend,
   }
   else
     {
+      g_free (uri);
+
+      handle = g_new (SmbReadHandle, 1);
+      handle->context = context;
+      handle->file = file;
+      g_atomic_int_inc (&context->n_open_files);
       
       g_vfs_job_open_for_read_set_can_seek (job, TRUE);
-      g_vfs_job_open_for_read_set_handle (job, file);
+      g_vfs_job_open_for_read_set_handle (job, handle);
       g_vfs_job_succeeded (G_VFS_JOB (job));
     }
+
+  smb_context_release (context);
 }
 
 static void
 do_read (GVfsBackend *backend,
 	 GVfsJobRead *job,
-	 GVfsBackendHandle handle,
+	 GVfsBackendHandle _handle,
 	 char *buffer,
 	 gsize bytes_requested)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *context;
   ssize_t res;
+  int errsv;
   smbc_read_fn smbc_read;
 
-  /* libsmbclient limits blocksize to (64*1024)-2 for Windows servers,
-   * let's do the same here to achieve reasonable performance. (#588391)
-   *
-   * TODO: port to pull mechanism (#592468)
-   */
-  if (bytes_requested > 65534)
-    bytes_requested = 65534;
-
-  smbc_read = smbc_getFunctionRead (op_backend->smb_context);
-  res = smbc_read (op_backend->smb_context, (SMBCFILE *)handle, buffer, bytes_requested);
+  /* Pass the whole request down, libsmbclient splits it according to
+   * the read size negotiated with the server and keeps several requests
+   * in flight (#588391, #592468). */
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_read = smbc_getFunctionRead (context->smb_context);
+  GVFS_TRACE2 (smb__read, handle, bytes_requested);
+  res = smbc_read (context->smb_context, handle->file, buffer, bytes_requested);
+  errsv = errno;
+  GVFS_TRACE2 (smb__read__done, handle, res);
+  smb_context_release (context);
 
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_read_set_size (job, res);
@@ -762,12 +945,14 @@ do_read (GVfsBackend *backend,
 static void
 do_seek_on_read (GVfsBackend *backend,
 		 GVfsJobSeekRead *job,
-		 GVfsBackendHandle handle,
+		 GVfsBackendHandle _handle,
 		 goffset    offset,
 		 GSeekType  type)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
-  int whence;
+  SmbReadHandle *handle = _handle;
+  SmbContext *context;
+  int whence, errsv;
   off_t res;
   smbc_lseek_fn smbc_lseek;
 
@@ -789,11 +974,14 @@ do_seek_on_read (GVfsBackend *backend,
       return;
     }
 
-  smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-  res = smbc_lseek (op_backend->smb_context, (SMBCFILE *)handle, offset, whence);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_lseek = smbc_getFunctionLseek (context->smb_context);
+  res = smbc_lseek (context->smb_context, handle->file, offset, whence);
+  errsv = errno;
+  smb_context_release (context);
 
   if (res == (off_t)-1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_seek_read_set_offset (job, res);
@@ -806,18 +994,22 @@ do_seek_on_read (GVfsBackend *backend,
 static void
 do_query_info_on_read (GVfsBackend *backend,
 		       GVfsJobQueryInfoRead *job,
-		       GVfsBackendHandle handle,
+		       GVfsBackendHandle _handle,
 		       GFileInfo *info,
 		       GFileAttributeMatcher *matcher)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *context;
   struct stat st = {0};
   int res, saved_errno;
   smbc_fstat_fn smbc_fstat;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  res = smbc_fstat (op_backend->smb_context, (SMBCFILE *)handle, &st);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_fstat = smbc_getFunctionFstat (context->smb_context);
+  res = smbc_fstat (context->smb_context, handle->file, &st);
   saved_errno = errno;
+  smb_context_release (context);
 
   if (res == 0)
     {
@@ -833,21 +1025,31 @@ do_query_info_on_read (GVfsBackend *backend,
 static void
 do_close_read (GVfsBackend *backend,
 	       GVfsJobCloseRead *job,
-	       GVfsBackendHandle handle)
+	       GVfsBackendHandle _handle)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *context;
   ssize_t res;
+  int errsv;
   smbc_close_fn smbc_close;
 
-  smbc_close = smbc_getFunctionClose (op_backend->smb_context);
-  res = smbc_close (op_backend->smb_context, (SMBCFILE *)handle);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_close = smbc_getFunctionClose (context->smb_context);
+  res = smbc_close (context->smb_context, handle->file);
+  errsv = errno;
+  g_atomic_int_add (&context->n_open_files, -1);
+  smb_context_release (context);
+  g_free (handle);
+
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
 typedef struct {
+  SmbContext *context;
   SMBCFILE *file;
   char *uri;
   char *tmp_uri;
@@ -870,16 +1072,18 @@ do_create (GVfsBackend *backend,
 	   GFileCreateFlags flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *context;
   char *uri;
   SMBCFILE *file;
   SmbWriteHandle *handle;
   smbc_open_fn smbc_open;
   int errsv;
 
+  context = smb_context_acquire (op_backend, NULL);
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
+  smbc_open = smbc_getFunctionOpen (context->smb_context);
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri,
+  file = smbc_open (context->smb_context, uri,
 		    O_CREAT|O_WRONLY|O_EXCL, 0666);
   g_free (uri);
 
@@ -895,12 +1099,16 @@ do_create (GVfsBackend *backend,
   else
     {
       handle = g_new0 (SmbWriteHandle, 1);
+      handle->context = context;
       handle->file = file;
+      g_atomic_int_inc (&context->n_open_files);
 
       g_vfs_job_open_for_write_set_can_seek (job, TRUE);
       g_vfs_job_open_for_write_set_handle (job, handle);
       g_vfs_job_succeeded (G_VFS_JOB (job));
     }
+
+  smb_context_release (context);
 }
 
 static void
@@ -910,6 +1118,7 @@ do_append_to (GVfsBackend *backend,
 	      GFileCreateFlags flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *context;
   char *uri;
   SMBCFILE *file;
   SmbWriteHandle *handle;
@@ -917,10 +1126,11 @@ do_append_to (GVfsBackend *backend,
   smbc_open_fn smbc_open;
   smbc_lseek_fn smbc_lseek;
 
+  context = smb_context_acquire (op_backend, NULL);
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
+  smbc_open = smbc_getFunctionOpen (context->smb_context);
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri,
+  file = smbc_open (context->smb_context, uri,
 					O_CREAT|O_WRONLY|O_APPEND, 0666);
   g_free (uri);
 
@@ -929,10 +1139,12 @@ do_append_to (GVfsBackend *backend,
   else
     {
       handle = g_new0 (SmbWriteHandle, 1);
+      handle->context = context;
       handle->file = file;
+      g_atomic_int_inc (&context->n_open_files);
 
-      smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-      initial_offset = smbc_lseek (op_backend->smb_context, file,
+      smbc_lseek = smbc_getFunctionLseek (context->smb_context);
+      initial_offset = smbc_lseek (context->smb_context, file,
 						       0, SEEK_CUR);
       if (initial_offset == (off_t) -1)
 	g_vfs_job_open_for_write_set_can_seek (job, FALSE);
@@ -944,6 +1156,8 @@ do_append_to (GVfsBackend *backend,
       g_vfs_job_open_for_write_set_handle (job, handle);
       g_vfs_job_succeeded (G_VFS_JOB (job));
     }
+
+  smb_context_release (context);
 }
 
 
@@ -978,7 +1192,7 @@ get_dir_from_uri (const char *uri)
 }
 
 static SMBCFILE *
-open_tmpfile (GVfsBackendSmb *backend,
+open_tmpfile (SmbContext *context,
 	      const char *uri,
 	      char **tmp_uri_out)
 {
@@ -993,9 +1207,9 @@ open_tmpfile (GVfsBackendSmb *backend,
     random_chars (filename + 4, 4);
     tmp_uri = g_strconcat (dir_uri, filename, NULL);
 
-    smbc_open = smbc_getFunctionOpen (backend->smb_context);
+    smbc_open = smbc_getFunctionOpen (context->smb_context);
     errno = 0;
-    file = smbc_open (backend->smb_context, tmp_uri,
+    file = smbc_open (context->smb_context, tmp_uri,
 		      O_CREAT|O_WRONLY|O_EXCL, 0666);
   } while (file == NULL && errno == EEXIST);
 
@@ -1013,14 +1227,16 @@ open_tmpfile (GVfsBackendSmb *backend,
     }
 }
 
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
 static gboolean
-copy_file (GVfsBackendSmb *backend,
+copy_file (SmbContext *context,
 	   GVfsJob *job,
 	   const char *from_uri,
 	   const char *to_uri)
 {
   SMBCFILE *from_file, *to_file;
-  char buffer[4096];
+  char *buffer;
   size_t buffer_size;
   ssize_t res;
   char *p;
@@ -1035,18 +1251,19 @@ copy_file (GVfsBackendSmb *backend,
   to_file = NULL;
 
   succeeded = FALSE;
+  buffer = g_malloc (COPY_BUFFER_SIZE);
 
-  smbc_open = smbc_getFunctionOpen (backend->smb_context);
-  smbc_read = smbc_getFunctionRead (backend->smb_context);
-  smbc_write = smbc_getFunctionWrite (backend->smb_context);
-  smbc_close = smbc_getFunctionClose (backend->smb_context);
+  smbc_open = smbc_getFunctionOpen (context->smb_context);
+  smbc_read = smbc_getFunctionRead (context->smb_context);
+  smbc_write = smbc_getFunctionWrite (context->smb_context);
+  smbc_close = smbc_getFunctionClose (context->smb_context);
 
-  from_file = smbc_open (backend->smb_context, from_uri,
+  from_file = smbc_open (context->smb_context, from_uri,
 			 O_RDONLY, 0666);
   if (from_file == NULL || g_vfs_job_is_cancelled (job))
     goto out;
   
-  to_file = smbc_open (backend->smb_context, to_uri,
+  to_file = smbc_open (context->smb_context, to_uri,
 		       O_CREAT|O_WRONLY|O_TRUNC, 0666);
   
   if (from_file == NULL || g_vfs_job_is_cancelled (job))
@@ -1055,8 +1272,8 @@ copy_file (GVfsBackendSmb *backend,
   while (1)
     {
       
-      res = smbc_read (backend->smb_context, from_file,
-					buffer, sizeof(buffer));
+      res = smbc_read (context->smb_context, from_file,
+					buffer, COPY_BUFFER_SIZE);
       if (res < 0 || g_vfs_job_is_cancelled (job))
 	goto out;
       if (res == 0)
@@ -1066,7 +1283,7 @@ copy_file (GVfsBackendSmb *backend,
       p = buffer;
       while (buffer_size > 0)
 	{
-	  res = smbc_write (backend->smb_context, to_file,
+	  res = smbc_write (context->smb_context, to_file,
 					     p, buffer_size);
 	  if (res < 0 || g_vfs_job_is_cancelled (job))
 	    goto out;
@@ -1078,9 +1295,10 @@ copy_file (GVfsBackendSmb *backend,
  
  out: 
   if (to_file)
-	  smbc_close (backend->smb_context, to_file);
+	  smbc_close (context->smb_context, to_file);
   if (from_file)
-	  smbc_close (backend->smb_context, from_file);
+	  smbc_close (context->smb_context, from_file);
+  g_free (buffer);
   return succeeded;
 }
 
@@ -1099,6 +1317,7 @@ do_replace (GVfsBackend *backend,
 	    GFileCreateFlags flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *context;
   struct stat original_stat;
   int res;
   char *uri, *tmp_uri, *backup_uri, *current_etag;
@@ -1115,11 +1334,12 @@ do_replace (GVfsBackend *backend,
   else
     backup_uri = NULL;
 
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
+  context = smb_context_acquire (op_backend, NULL);
+  smbc_open = smbc_getFunctionOpen (context->smb_context);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
   
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri,
+  file = smbc_open (context->smb_context, uri,
 		    O_CREAT|O_WRONLY|O_EXCL, 0);
   if (file == NULL && errno != EEXIST)
     {
@@ -1134,7 +1354,7 @@ do_replace (GVfsBackend *backend,
     {
       if (etag != NULL)
 	{
-	  res = smbc_stat (op_backend->smb_context, uri, &original_stat);
+	  res = smbc_stat (context->smb_context, uri, &original_stat);
 	  
 	  if (res == 0)
 	    {
@@ -1165,12 +1385,12 @@ do_replace (GVfsBackend *backend,
        * copied directly to the backup filename.
        */
 
-      file = open_tmpfile (op_backend, uri, &tmp_uri);
+      file = open_tmpfile (context, uri, &tmp_uri);
       if (file == NULL)
 	{
 	  if (make_backup)
 	    {
-	      if (!copy_file (op_backend, G_VFS_JOB (job), uri, backup_uri))
+	      if (!copy_file (context, G_VFS_JOB (job), uri, backup_uri))
 		{
 		  if (g_vfs_job_is_cancelled (G_VFS_JOB (job)))
 		    g_set_error_literal (&error,
@@ -1189,7 +1409,7 @@ do_replace (GVfsBackend *backend,
 	    }
 	  
 	  errno = 0;
-	  file = smbc_open (op_backend->smb_context, uri,
+	  file = smbc_open (context->smb_context, uri,
 			    O_CREAT|O_WRONLY|O_TRUNC, 0);
 	  if (file == NULL)
 	    {
@@ -1210,10 +1430,13 @@ do_replace (GVfsBackend *backend,
     }
 
   handle = g_new (SmbWriteHandle, 1);
+  handle->context = context;
   handle->file = file;
   handle->uri = uri;
   handle->tmp_uri = tmp_uri;
   handle->backup_uri = backup_uri;
+  g_atomic_int_inc (&context->n_open_files);
+  smb_context_release (context);
   
   g_vfs_job_open_for_write_set_can_seek (job, TRUE);
   g_vfs_job_open_for_write_set_handle (job, handle);
@@ -1222,6 +1445,7 @@ do_replace (GVfsBackend *backend,
   return;
   
  error:
+  smb_context_release (context);
   g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
   g_error_free (error);
   g_free (backup_uri);
@@ -1239,14 +1463,22 @@ do_write (GVfsBackend *backend,
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
+  SmbContext *context;
   ssize_t res;
+  int errsv;
   smbc_write_fn smbc_write;
 
-  smbc_write = smbc_getFunctionWrite (op_backend->smb_context);
-  res = smbc_write (op_backend->smb_context, handle->file,
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_write = smbc_getFunctionWrite (context->smb_context);
+  GVFS_TRACE2 (smb__write, handle, buffer_size);
+  res = smbc_write (context->smb_context, handle->file,
 					buffer, buffer_size);
+  errsv = errno;
+  GVFS_TRACE2 (smb__write__done, handle, res);
+  smb_context_release (context);
+
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_write_set_written_size (job, res);
@@ -1263,7 +1495,8 @@ do_seek_on_write (GVfsBackend *backend,
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
-  int whence;
+  SmbContext *context;
+  int whence, errsv;
   off_t res;
   smbc_lseek_fn smbc_lseek;
 
@@ -1285,11 +1518,14 @@ do_seek_on_write (GVfsBackend *backend,
       return;
     }
 
-  smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-  res = smbc_lseek (op_backend->smb_context, handle->file, offset, whence);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_lseek = smbc_getFunctionLseek (context->smb_context);
+  res = smbc_lseek (context->smb_context, handle->file, offset, whence);
+  errsv = errno;
+  smb_context_release (context);
 
   if (res == (off_t)-1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_seek_write_set_offset (job, res);
@@ -1309,12 +1545,15 @@ do_query_info_on_write (GVfsBackend *backend,
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   struct stat st = {0};
   SmbWriteHandle *handle = _handle;
+  SmbContext *context;
   int res, saved_errno;
   smbc_fstat_fn smbc_fstat;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  res = smbc_fstat (op_backend->smb_context, handle->file, &st);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_fstat = smbc_getFunctionFstat (context->smb_context);
+  res = smbc_fstat (context->smb_context, handle->file, &st);
   saved_errno = errno;
+  smb_context_release (context);
 
   if (res == 0)
     {
@@ -1334,6 +1573,7 @@ do_close_write (GVfsBackend *backend,
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
+  SmbContext *context;
   struct stat stat_at_close;
   int stat_res;
   ssize_t res;
@@ -1342,21 +1582,23 @@ do_close_write (GVfsBackend *backend,
   smbc_unlink_fn smbc_unlink;
   smbc_rename_fn smbc_rename;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  smbc_close = smbc_getFunctionClose (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
+  context = smb_context_acquire (op_backend, handle->context);
+  smbc_fstat = smbc_getFunctionFstat (context->smb_context);
+  smbc_close = smbc_getFunctionClose (context->smb_context);
+  smbc_unlink = smbc_getFunctionUnlink (context->smb_context);
+  smbc_rename = smbc_getFunctionRename (context->smb_context);
   
-  stat_res = smbc_fstat (op_backend->smb_context, handle->file, &stat_at_close);
+  stat_res = smbc_fstat (context->smb_context, handle->file, &stat_at_close);
   
-  res = smbc_close (op_backend->smb_context, handle->file);
+  res = smbc_close (context->smb_context, handle->file);
+  g_atomic_int_add (&context->n_open_files, -1);
 
   if (res == -1)
     {
       g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
       
       if (handle->tmp_uri)
-    	  smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+    	  smbc_unlink (context->smb_context, handle->tmp_uri);
       goto out;
     }
 
@@ -1364,13 +1606,13 @@ do_close_write (GVfsBackend *backend,
     {
       if (handle->backup_uri)
 	{
-	  res = smbc_rename (op_backend->smb_context, handle->uri,
-						 op_backend->smb_context, handle->backup_uri);
+	  res = smbc_rename (context->smb_context, handle->uri,
+						 context->smb_context, handle->backup_uri);
 	  if (res ==  -1)
 	    {
               int errsv = errno;
 
-          smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+          smbc_unlink (context->smb_context, handle->tmp_uri);
 	      g_vfs_job_failed (G_VFS_JOB (job),
 				G_IO_ERROR, G_IO_ERROR_CANT_CREATE_BACKUP,
 				_("Backup file creation failed: %s"), g_strerror (errsv));
@@ -1378,13 +1620,13 @@ do_close_write (GVfsBackend *backend,
 	    }
 	}
       else
-	smbc_unlink (op_backend->smb_context, handle->uri);
+	smbc_unlink (context->smb_context, handle->uri);
       
-      res = smbc_rename (op_backend->smb_context, handle->tmp_uri,
-					     op_backend->smb_context, handle->uri);
+      res = smbc_rename (context->smb_context, handle->tmp_uri,
+					     context->smb_context, handle->uri);
       if (res ==  -1)
 	{
-	  smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+	  smbc_unlink (context->smb_context, handle->tmp_uri);
 	  g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
 	  goto out;
 	}
@@ -1401,6 +1643,7 @@ do_close_write (GVfsBackend *backend,
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
  out:
+  smb_context_release (context);
   smb_write_handle_free (handle);  
 }
 
@@ -1580,12 +1823,15 @@ do_query_info (GVfsBackend *backend,
   char *uri;
   int res, saved_errno;
   char *basename;
+  SmbContext *context;
   smbc_stat_fn smbc_stat;
 
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  res = smbc_stat (op_backend->smb_context, uri, &st);
+  context = smb_context_acquire (op_backend, NULL);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
+  res = smbc_stat (context->smb_context, uri, &st);
   saved_errno = errno;
+  smb_context_release (context);
   g_free (uri);
 
   if (res == 0)
@@ -1613,6 +1859,7 @@ do_query_fs_info (GVfsBackend *backend,
   g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE, "cifs");
 
 #ifdef HAVE_SAMBA_STAT_VFS
+  SmbContext *context;
   smbc_statvfs_fn smbc_statvfs;
   struct statvfs st = {0};
   char *uri;
@@ -1626,8 +1873,10 @@ do_query_fs_info (GVfsBackend *backend,
 					G_FILE_ATTRIBUTE_FILESYSTEM_READONLY))
     {
       uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-      smbc_statvfs = smbc_getFunctionStatVFS (op_backend->smb_context);
-      res = smbc_statvfs (op_backend->smb_context, uri, &st);
+      context = smb_context_acquire (op_backend, NULL);
+      smbc_statvfs = smbc_getFunctionStatVFS (context->smb_context);
+      res = smbc_statvfs (context->smb_context, uri, &st);
+      smb_context_release (context);
       g_free (uri);
 
       if (res == 0)
@@ -1697,6 +1946,7 @@ do_set_attribute (GVfsBackend *backend,
                   GFileQueryInfoFlags flags)
 {
   GVfsBackendSmb *op_backend;
+  SmbContext *context;
   char *uri;
   int res, errsv;
   struct timeval tbuf[2];
@@ -1721,6 +1971,7 @@ do_set_attribute (GVfsBackend *backend,
     }
 
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
+  context = smb_context_acquire (op_backend, NULL);
   res = -1;
 
   if (strcmp (attribute, G_FILE_ATTRIBUTE_TIME_MODIFIED) == 0)
@@ -1734,24 +1985,25 @@ do_set_attribute (GVfsBackend *backend,
                             _("Invalid attribute type (uint64 expected)"));
         }
 
-      smbc_utimes = smbc_getFunctionUtimes (op_backend->smb_context);
+      smbc_utimes = smbc_getFunctionUtimes (context->smb_context);
       tbuf[1].tv_sec = (*(guint64 *)value_p);  /* mtime */
       tbuf[1].tv_usec = 0;
       /* atime = mtime (atimes are usually disabled on desktop systems) */
       tbuf[0].tv_sec = tbuf[1].tv_sec;  
       tbuf[0].tv_usec = 0;
-      res = smbc_utimes (op_backend->smb_context, uri, &tbuf[0]);
+      res = smbc_utimes (context->smb_context, uri, &tbuf[0]);
     }
 #if 0
   else
   if (strcmp (attribute, G_FILE_ATTRIBUTE_UNIX_MODE) == 0)
     {
-      smbc_chmod = smbc_getFunctionChmod (op_backend->smb_context);
-      res = smbc_chmod (op_backend->smb_context, uri, (*(guint32 *)value_p) & 0777);
+      smbc_chmod = smbc_getFunctionChmod (context->smb_context);
+      res = smbc_chmod (context->smb_context, uri, (*(guint32 *)value_p) & 0777);
     }
 #endif    
 
   errsv = errno;
+  smb_context_release (context);
   g_free (uri);
 
   if (res != 0)
@@ -1782,15 +2034,17 @@ do_enumerate (GVfsBackend *backend,
   smbc_getdents_fn smbc_getdents;
   smbc_stat_fn smbc_stat;
   smbc_closedir_fn smbc_closedir;
+  SmbContext *context;
 
   uri = create_smb_uri_string (op_backend->server, op_backend->share, filename);
+  context = smb_context_acquire (op_backend, NULL);
   
-  smbc_opendir = smbc_getFunctionOpendir (op_backend->smb_context);
-  smbc_getdents = smbc_getFunctionGetdents (op_backend->smb_context);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  smbc_closedir = smbc_getFunctionClosedir (op_backend->smb_context);
+  smbc_opendir = smbc_getFunctionOpendir (context->smb_context);
+  smbc_getdents = smbc_getFunctionGetdents (context->smb_context);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
+  smbc_closedir = smbc_getFunctionClosedir (context->smb_context);
   
-  dir = smbc_opendir (op_backend->smb_context, uri->str);
+  dir = smbc_opendir (context->smb_context, uri->str);
 
   if (dir == NULL)
     {
@@ -1813,7 +2067,7 @@ do_enumerate (GVfsBackend *backend,
     {
       files = NULL;
       
-      res = smbc_getdents (op_backend->smb_context, dir, (struct smbc_dirent *)dirents, sizeof (dirents));
+      res = smbc_getdents (context->smb_context, dir, (struct smbc_dirent *)dirents, sizeof (dirents));
       if (res <= 0)
 	break;
       
@@ -1845,7 +2099,7 @@ do_enumerate (GVfsBackend *backend,
 		}
 	      else
 		{
-		  stat_res = smbc_stat (op_backend->smb_context,
+		  stat_res = smbc_stat (context->smb_context,
 							    uri->str, &st);
 		  if (stat_res == 0)
 		    {
@@ -1870,7 +2124,8 @@ do_enumerate (GVfsBackend *backend,
 	}
     }
       
-  res = smbc_closedir (op_backend->smb_context, dir);
+  res = smbc_closedir (context->smb_context, dir);
+  smb_context_release (context);
 
   g_vfs_job_enumerate_done (job);
 
@@ -1878,6 +2133,7 @@ do_enumerate (GVfsBackend *backend,
   return;
   
  error:
+  smb_context_release (context);
   g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
   g_error_free (error);
   g_string_free (uri, TRUE);
@@ -1894,6 +2150,7 @@ do_set_display_name (GVfsBackend *backend,
   char *dirname, *new_path;
   int res, errsv;
   struct stat st;
+  SmbContext *context;
   smbc_rename_fn smbc_rename;
   smbc_stat_fn smbc_stat;
 
@@ -1913,8 +2170,9 @@ do_set_display_name (GVfsBackend *backend,
   /* We can't rely on libsmbclient reporting EEXIST, let's always stat first.
    * https://bugzilla.gnome.org/show_bug.cgi?id=616645
    */
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  res = smbc_stat (op_backend->smb_context, to_uri, &st);
+  context = smb_context_acquire (op_backend, NULL);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
+  res = smbc_stat (context->smb_context, to_uri, &st);
   if (res == 0)
     {
       g_vfs_job_failed (G_VFS_JOB (job),
@@ -1923,9 +2181,9 @@ do_set_display_name (GVfsBackend *backend,
       goto out;
     }
 
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
-  res = smbc_rename (op_backend->smb_context, from_uri,
-                     op_backend->smb_context, to_uri);
+  smbc_rename = smbc_getFunctionRename (context->smb_context);
+  res = smbc_rename (context->smb_context, from_uri,
+                     context->smb_context, to_uri);
   errsv = errno;
 
   if (res != 0)
@@ -1937,6 +2195,7 @@ do_set_display_name (GVfsBackend *backend,
     }
 
  out:
+  smb_context_release (context);
   g_free (from_uri);
   g_free (to_uri);
   g_free (new_path);
@@ -1951,18 +2210,20 @@ do_delete (GVfsBackend *backend,
   struct stat statbuf;
   char *uri;
   int errsv, res;
+  SmbContext *context;
   smbc_stat_fn smbc_stat;
   smbc_rmdir_fn smbc_rmdir;
   smbc_unlink_fn smbc_unlink;
 
 
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
+  context = smb_context_acquire (op_backend, NULL);
 
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  smbc_rmdir = smbc_getFunctionRmdir (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
+  smbc_rmdir = smbc_getFunctionRmdir (context->smb_context);
+  smbc_unlink = smbc_getFunctionUnlink (context->smb_context);
 
-  res = smbc_stat (op_backend->smb_context, uri, &statbuf);
+  res = smbc_stat (context->smb_context, uri, &statbuf);
   if (res == -1)
     {
       errsv = errno;
@@ -1972,15 +2233,17 @@ do_delete (GVfsBackend *backend,
 			g_io_error_from_errno (errsv),
 			_("Error deleting file: %s"),
 			g_strerror (errsv));
+      smb_context_release (context);
       g_free (uri);
       return;
     }
 
   if (S_ISDIR (statbuf.st_mode))
-    res = smbc_rmdir (op_backend->smb_context, uri);
+    res = smbc_rmdir (context->smb_context, uri);
   else
-    res = smbc_unlink (op_backend->smb_context, uri);
+    res = smbc_unlink (context->smb_context, uri);
   errsv = errno;
+  smb_context_release (context);
   g_free (uri);
 
   if (res != 0)
@@ -1997,12 +2260,15 @@ do_make_directory (GVfsBackend *backend,
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   char *uri;
   int errsv, res;
+  SmbContext *context;
   smbc_mkdir_fn smbc_mkdir;
 
   uri = create_smb_uri (op_backend->server, op_backend->share, filename);
-  smbc_mkdir = smbc_getFunctionMkdir (op_backend->smb_context);
-  res = smbc_mkdir (op_backend->smb_context, uri, 0666);
+  context = smb_context_acquire (op_backend, NULL);
+  smbc_mkdir = smbc_getFunctionMkdir (context->smb_context);
+  res = smbc_mkdir (context->smb_context, uri, 0666);
   errsv = errno;
+  smb_context_release (context);
   g_free (uri);
 
   if (res != 0)
@@ -2012,15 +2278,13 @@ do_make_directory (GVfsBackend *backend,
 }
 
 static void
-do_move (GVfsBackend *backend,
-	 GVfsJobMove *job,
-	 const char *source,
-	 const char *destination,
-	 GFileCopyFlags flags,
-	 GFileProgressCallback progress_callback,
-	 gpointer progress_callback_data)
+move_file (GVfsBackendSmb *op_backend,
+	   SmbContext *context,
+	   GVfsJobMove *job,
+	   const char *source,
+	   const char *destination,
+	   GFileCopyFlags flags)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   char *source_uri, *dest_uri, *backup_uri;
   gboolean destination_exist, source_is_dir;
   struct stat statbuf;
@@ -2032,11 +2296,11 @@ do_move (GVfsBackend *backend,
   
   source_uri = create_smb_uri (op_backend->server, op_backend->share, source);
 
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
+  smbc_stat = smbc_getFunctionStat (context->smb_context);
+  smbc_rename = smbc_getFunctionRename (context->smb_context);
+  smbc_unlink = smbc_getFunctionUnlink (context->smb_context);
 
-  res = smbc_stat (op_backend->smb_context, source_uri, &statbuf);
+  res = smbc_stat (context->smb_context, source_uri, &statbuf);
   if (res == -1)
     {
       errsv = errno;
@@ -2055,7 +2319,7 @@ do_move (GVfsBackend *backend,
   dest_uri = create_smb_uri (op_backend->server, op_backend->share, destination);
   
   destination_exist = FALSE;
-  res = smbc_stat (op_backend->smb_context, dest_uri, &statbuf);
+  res = smbc_stat (context->smb_context, dest_uri, &statbuf);
   if (res == 0)
     {
       destination_exist = TRUE; /* Target file exists */
@@ -2089,8 +2353,8 @@ do_move (GVfsBackend *backend,
   if (flags & G_FILE_COPY_BACKUP && destination_exist)
     {
       backup_uri = g_strconcat (dest_uri, "~", NULL);
-      res = smbc_rename (op_backend->smb_context, dest_uri,
-					     op_backend->smb_context, backup_uri);
+      res = smbc_rename (context->smb_context, dest_uri,
+					     context->smb_context, backup_uri);
       if (res == -1)
 	{
 	  g_vfs_job_failed (G_VFS_JOB (job),
@@ -2110,7 +2374,7 @@ do_move (GVfsBackend *backend,
     {
       /* Source is a dir, destination exists (and is not a dir, because that would have failed
 	 earlier), and we're overwriting. Manually remove the target so we can do the rename. */
-      res = smbc_unlink (op_backend->smb_context, dest_uri);
+      res = smbc_unlink (context->smb_context, dest_uri);
       errsv = errno;
       if (res == -1)
 	{
@@ -2125,8 +2389,8 @@ do_move (GVfsBackend *backend,
     }
 
   
-  res = smbc_rename (op_backend->smb_context, source_uri,
-					 op_backend->smb_context, dest_uri);
+  res = smbc_rename (context->smb_context, source_uri,
+					 context->smb_context, dest_uri);
   errsv = errno;
   g_free (source_uri);
   g_free (dest_uri);
@@ -2148,6 +2412,23 @@ do_move (GVfsBackend *backend,
     g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
+static void
+do_move (GVfsBackend *backend,
+	 GVfsJobMove *job,
+	 const char *source,
+	 const char *destination,
+	 GFileCopyFlags flags,
+	 GFileProgressCallback progress_callback,
+	 gpointer progress_callback_data)
+{
+  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *context;
+
+  context = smb_context_acquire (op_backend, NULL);
+  move_file (op_backend, context, job, source, destination, flags);
+  smb_context_release (context);
+}
+
 static void
 g_vfs_backend_smb_class_init (GVfsBackendSmbClass *klass)
 {
@@ -2185,4 +2466,9 @@ void
 g_vfs_smb_daemon_init (void)
 {
   g_set_application_name (_("Windows Shares File System Service"));
+
+#ifdef HAVE_SAMBA_THREAD_POSIX
+  /* Must happen before the first context is created */
+  smbc_thread_posix ();
+#endif
 }
@@ -41,6 +41,8 @@
 #include "gvfsjobseekread.h"
 #include "gvfsjobqueryinfo.h"
 #include "gvfsjobenumerate.h"
+#include "gvfsjobcreatemonitor.h"
+#include "gvfsmonitor.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfskeyring.h"
 #include "gmounttracker.h"
@@ -54,6 +56,10 @@
 /* Time in seconds before we mark dirents cache outdated */
 #define DEFAULT_CACHE_EXPIRATION_TIME 10
 
+/* Time in seconds an on-disk share list may be used to mount without
+   contacting the network first */
+#define DISK_CACHE_MAX_AGE (60 * 60 * 24)
+
 
 #define PRINT_DEBUG 
 
@@ -99,6 +105,12 @@ struct _GVfsBackendSmbBrowse
   time_t last_entry_update;
   GList *entries;
   int entry_errno;
+
+  /* Whether the share list can be fetched without asking for a password,
+     i.e. it may be persisted and refreshed after answering a job */
+  gboolean can_refresh_unattended;
+
+  GVfsMonitor *root_monitor;
 };
 
 
@@ -173,6 +185,8 @@ static void
 browse_entry_free (BrowseEntry *entry)
 {
   g_free (entry->name);
+  g_free (entry->name_normalized);
+  g_free (entry->name_utf8);
   g_free (entry->comment);
   g_free (entry);
 }
@@ -230,6 +244,9 @@ g_vfs_backend_smb_browse_finalize (GObject *object)
   g_mutex_clear (&backend->update_cache_lock);
 
   smbc_free_context (backend->smb_context, TRUE);
+
+  if (backend->root_monitor)
+    g_object_unref (backend->root_monitor);
   
   g_list_foreach (backend->entries, (GFunc)browse_entry_free, NULL);
   g_list_free (backend->entries);
@@ -573,16 +590,219 @@ g_string_append_encoded (GString *string,
     }
 }
 
+static BrowseEntry *
+browse_entry_new (unsigned int smbc_type,
+		  const char *name,
+		  const char *comment)
+{
+  BrowseEntry *entry;
+  gboolean valid_utf8;
+
+  entry = g_new (BrowseEntry, 1);
+  entry->smbc_type = smbc_type;
+  entry->name = g_strdup (name);
+  entry->name_utf8 = smb_name_to_utf8 (name, &valid_utf8);
+  entry->name_normalized = normalize_smb_name_helper (name, -1, valid_utf8);
+  entry->comment = smb_name_to_utf8 (comment, NULL);
+
+  return entry;
+}
+
+/* The share list of each browsed network/server is kept on disk so that
+ * new daemons (and new mounts of the same location) can serve it right
+ * away while a fresh copy is fetched in the background.
+ */
+static char *
+get_disk_cache_filename (GVfsBackendSmbBrowse *backend)
+{
+  char *normalized, *escaped, *basename, *filename;
+
+  if (backend->server == NULL)
+    basename = g_strdup ("network");
+  else
+    {
+      normalized = normalize_smb_name (backend->server, -1);
+      escaped = g_uri_escape_string (normalized, NULL, FALSE);
+      basename = g_strconcat ("server-", escaped, NULL);
+      g_free (escaped);
+      g_free (normalized);
+    }
+
+  filename = g_build_filename (g_get_user_cache_dir (),
+			       "gvfs", "smb-browse", basename, NULL);
+  g_free (basename);
+
+  return filename;
+}
+
+static void
+save_disk_cache (GVfsBackendSmbBrowse *backend,
+		 GList *entries,
+		 time_t timestamp)
+{
+  GKeyFile *key_file;
+  GList *l;
+  char *filename, *dirname, *data, *group;
+  gsize length;
+  int i;
+
+  key_file = g_key_file_new ();
+  g_key_file_set_int64 (key_file, "Cache", "Timestamp", timestamp);
+
+  for (l = entries, i = 0; l != NULL; l = l->next)
+    {
+      BrowseEntry *entry = l->data;
+
+      /* Key files are UTF-8, the rare non-UTF-8 names are picked up on
+	 the next refresh instead */
+      if (!g_utf8_validate (entry->name, -1, NULL))
+	continue;
+
+      group = g_strdup_printf ("Entry %d", i++);
+      g_key_file_set_integer (key_file, group, "Type", entry->smbc_type);
+      g_key_file_set_string (key_file, group, "Name", entry->name);
+      g_key_file_set_string (key_file, group, "Comment", entry->comment);
+      g_free (group);
+    }
+
+  data = g_key_file_to_data (key_file, &length, NULL);
+  g_key_file_free (key_file);
+
+  filename = get_disk_cache_filename (backend);
+  dirname = g_path_get_dirname (filename);
+  if (g_mkdir_with_parents (dirname, 0700) == 0)
+    g_file_set_contents (filename, data, length, NULL);
+
+  g_free (dirname);
+  g_free (filename);
+  g_free (data);
+}
+
+/* Loads the share list from disk, returns FALSE if there is none or it
+   is too old to be trusted */
+static gboolean
+load_disk_cache (GVfsBackendSmbBrowse *backend)
+{
+  GKeyFile *key_file;
+  GList *entries;
+  char *filename, **groups, *name, *comment;
+  gint64 timestamp;
+  time_t now;
+  int i;
+
+  key_file = g_key_file_new ();
+  filename = get_disk_cache_filename (backend);
+
+  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL))
+    {
+      g_free (filename);
+      g_key_file_free (key_file);
+      return FALSE;
+    }
+  g_free (filename);
+
+  now = time (NULL);
+  timestamp = g_key_file_get_int64 (key_file, "Cache", "Timestamp", NULL);
+  if (timestamp <= 0 || timestamp > now || now - timestamp > DISK_CACHE_MAX_AGE)
+    {
+      g_key_file_free (key_file);
+      return FALSE;
+    }
+
+  entries = NULL;
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (i = 0; groups[i] != NULL; i++)
+    {
+      if (!g_str_has_prefix (groups[i], "Entry "))
+	continue;
+
+      name = g_key_file_get_string (key_file, groups[i], "Name", NULL);
+      if (name == NULL)
+	continue;
+      comment = g_key_file_get_string (key_file, groups[i], "Comment", NULL);
+
+      entries = g_list_prepend (entries,
+				browse_entry_new (g_key_file_get_integer (key_file, groups[i], "Type", NULL),
+						  name, comment ? comment : ""));
+      g_free (name);
+      g_free (comment);
+    }
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+
+  g_mutex_lock (&backend->entries_lock);
+  g_list_foreach (backend->entries, (GFunc)browse_entry_free, NULL);
+  g_list_free (backend->entries);
+  backend->entries = g_list_reverse (entries);
+  backend->entry_errno = 0;
+  /* Keep the original age, so the first access triggers a refresh */
+  backend->last_entry_update = timestamp;
+  g_mutex_unlock (&backend->entries_lock);
+
+  return TRUE;
+}
+
+/* Tells monitoring clients which entries came and went */
+static void
+emit_entries_changed (GVfsBackendSmbBrowse *backend,
+		      GList *old_entries,
+		      GList *new_entries)
+{
+  GHashTable *old_names, *new_names;
+  GList *l;
+  char *path;
+
+  old_names = g_hash_table_new (g_str_hash, g_str_equal);
+  for (l = old_entries; l != NULL; l = l->next)
+    g_hash_table_insert (old_names, ((BrowseEntry *)l->data)->name, l->data);
+
+  new_names = g_hash_table_new (g_str_hash, g_str_equal);
+  for (l = new_entries; l != NULL; l = l->next)
+    g_hash_table_insert (new_names, ((BrowseEntry *)l->data)->name, l->data);
+
+  for (l = old_entries; l != NULL; l = l->next)
+    {
+      BrowseEntry *entry = l->data;
+
+      if (!g_hash_table_lookup (new_names, entry->name))
+	{
+	  path = g_strconcat ("/", entry->name, NULL);
+	  g_vfs_monitor_emit_event (backend->root_monitor,
+				    G_FILE_MONITOR_EVENT_DELETED,
+				    path, NULL);
+	  g_free (path);
+	}
+    }
+
+  for (l = new_entries; l != NULL; l = l->next)
+    {
+      BrowseEntry *entry = l->data;
+
+      if (!g_hash_table_lookup (old_names, entry->name))
+	{
+	  path = g_strconcat ("/", entry->name, NULL);
+	  g_vfs_monitor_emit_event (backend->root_monitor,
+				    G_FILE_MONITOR_EVENT_CREATED,
+				    path, NULL);
+	  g_free (path);
+	}
+    }
+
+  g_hash_table_destroy (old_names);
+  g_hash_table_destroy (new_names);
+}
+
 static gboolean
 update_cache (GVfsBackendSmbBrowse *backend, SMBCFILE *supplied_dir)
 {
   GString *uri;
   char dirents[1024*4];
   struct smbc_dirent *dirp;
-  GList *entries;
+  GList *entries, *old_entries;
   int entry_errno;
   SMBCFILE *dir;
   int res;
+  time_t now;
   smbc_opendir_fn smbc_opendir;
   smbc_getdents_fn smbc_getdents;
   smbc_closedir_fn smbc_closedir;
@@ -623,8 +843,11 @@ update_cache (GVfsBackendSmbBrowse *backend, SMBCFILE *supplied_dir)
       if (res <= 0)
         {
           if (res < 0)
-            DEBUG ("update_cache - smbc_getdents returned %d, errno = [%d] %s\n", 
-                   res, errno, g_strerror (errno));
+            {
+              entry_errno = errno;
+              DEBUG ("update_cache - smbc_getdents returned %d, errno = [%d] %s\n", 
+                     res, errno, g_strerror (errno));
+            }
 	  break;
 	}  
       
@@ -638,47 +861,83 @@ update_cache (GVfsBackendSmbBrowse *backend, SMBCFILE *supplied_dir)
 	      dirp->smbc_type != SMBC_PRINTER_SHARE &&
 	      strcmp (dirp->name, ".") != 0 &&
 	      strcmp (dirp->name, "..") != 0)
-	    {
-	      BrowseEntry *entry = g_new (BrowseEntry, 1);
-	      gboolean valid_utf8;
-
-	      entry->smbc_type = dirp->smbc_type;
-	      entry->name = g_strdup (dirp->name);
-	      entry->name_utf8 = smb_name_to_utf8 (dirp->name, &valid_utf8);
-	      entry->name_normalized = normalize_smb_name_helper (dirp->name, -1, valid_utf8);
-	      entry->comment = smb_name_to_utf8 (dirp->comment, NULL);
-	      
-	      entries = g_list_prepend (entries, entry);
-	    }
+	    entries = g_list_prepend (entries,
+				      browse_entry_new (dirp->smbc_type,
+							dirp->name,
+							dirp->comment));
 		  
 	  dirlen = dirp->dirlen;
 	  dirp = (struct smbc_dirent *) (((char *)dirp) + dirlen);
 	  res -= dirlen;
 	}
-
-      entries = g_list_reverse (entries);
     }
 
+  entries = g_list_reverse (entries);
+
   if (! supplied_dir)
     smbc_closedir (backend->smb_context, dir);
 
 
  out:
 
-  g_mutex_lock (&backend->entries_lock);
-  
-  /* Clear old cache */
-  g_list_foreach (backend->entries, (GFunc)browse_entry_free, NULL);
-  g_list_free (backend->entries);
-  backend->entries = entries;
-  backend->entry_errno = entry_errno;
-  backend->last_entry_update = time (NULL);
+  now = time (NULL);
 
-  DEBUG ("update_cache - done.\n");
+  if (res < 0)
+    {
+      /* Keep serving what we had, a partial or empty list would look
+         like all shares went away. Retry once the cache expires again. */
+      g_list_foreach (entries, (GFunc)browse_entry_free, NULL);
+      g_list_free (entries);
+      entries = NULL;
+      old_entries = NULL;
+
+      g_mutex_lock (&backend->entries_lock);
+      backend->entry_errno = entry_errno;
+      backend->last_entry_update = now;
+      g_mutex_unlock (&backend->entries_lock);
+
+      DEBUG ("update_cache - failed, keeping old entries.\n");
+    }
+  else
+    {
+      g_mutex_lock (&backend->entries_lock);
+
+      /* Swap in the new list, the old one is freed once monitors are notified */
+      old_entries = backend->entries;
+      backend->entries = entries;
+      backend->entry_errno = 0;
+      backend->last_entry_update = now;
+
+      DEBUG ("update_cache - done.\n");
+
+      g_mutex_unlock (&backend->entries_lock);
+
+      /* Only this function changes the list, so it is safe to walk it
+         while we hold update_cache_lock */
+      if (backend->root_monitor)
+        emit_entries_changed (backend, old_entries, entries);
+    }
+
+  if (backend->can_refresh_unattended)
+    {
+      if (res >= 0)
+	save_disk_cache (backend, entries, now);
+      else if (entry_errno == EPERM || entry_errno == EACCES)
+	{
+	  char *filename;
+
+	  /* Browsing needs a password now, make the next mount ask for it */
+	  filename = get_disk_cache_filename (backend);
+	  g_unlink (filename);
+	  g_free (filename);
+	}
+    }
 
-  g_mutex_unlock (&backend->entries_lock);
   g_mutex_unlock (&backend->update_cache_lock);
 
+  g_list_foreach (old_entries, (GFunc)browse_entry_free, NULL);
+  g_list_free (old_entries);
+
   return (res >= 0);
 }
 
@@ -786,22 +1045,50 @@ has_name (GVfsBackendSmbBrowse *backend,
   return res;
 }
 
+/* Returns TRUE if the job has to go to the job thread because the
+ * entries have to be fetched or refreshed. libsmbclient is not thread
+ * safe here, so smb_context is only ever used from the job thread.
+ */
 static gboolean
 cache_needs_updating (GVfsBackendSmbBrowse *backend)
 {
   time_t now;
   gboolean res;
 
-  /*  If there's already cache update in progress, lock and wait until update is finished, then recheck  */
-  g_mutex_lock (&backend->update_cache_lock);
+  g_mutex_lock (&backend->entries_lock);
   now = time (NULL);
   res = now < backend->last_entry_update ||
     (now - backend->last_entry_update) > DEFAULT_CACHE_EXPIRATION_TIME;
-  g_mutex_unlock (&backend->update_cache_lock);
+  g_mutex_unlock (&backend->entries_lock);
   
   return res; 
 }
 
+/* Fetches the entries if there are none yet. Outdated entries are
+ * served as they are and refreshed by refresh_outdated_cache() once
+ * the job has been answered.
+ */
+static void
+ensure_cache (GVfsBackendSmbBrowse *backend)
+{
+  gboolean empty;
+
+  g_mutex_lock (&backend->entries_lock);
+  empty = backend->last_entry_update == 0;
+  g_mutex_unlock (&backend->entries_lock);
+
+  if (empty)
+    update_cache (backend, NULL);
+}
+
+/* Changes found by the refresh are reported to the root monitor */
+static void
+refresh_outdated_cache (GVfsBackendSmbBrowse *backend)
+{
+  if (cache_needs_updating (backend))
+    update_cache (backend, NULL);
+}
+
 static void
 do_mount (GVfsBackend *backend,
 	  GVfsJobMount *job,
@@ -817,7 +1104,7 @@ do_mount (GVfsBackend *backend,
   int debug_val;
   char *icon;
   GString *uri;
-  gboolean res;
+  gboolean res, from_disk_cache;
   GMountSpec *browse_mount_spec;
   smbc_opendir_fn smbc_opendir;
   smbc_closedir_fn smbc_closedir;
@@ -918,6 +1205,12 @@ do_mount (GVfsBackend *backend,
   g_vfs_backend_set_mount_spec (backend, browse_mount_spec);
   g_mount_spec_unref (browse_mount_spec);
 
+  /* If anonymous browsing worked before, the share list from the disk
+     cache is served until the first refresh. The server is still
+     contacted below, so an unreachable server doesn't get mounted. */
+  from_disk_cache = op_backend->user == NULL && op_backend->domain == NULL &&
+    load_disk_cache (op_backend);
+
   op_backend->mount_source = mount_source;
   op_backend->mount_try = 0;
   op_backend->password_save = G_PASSWORD_SAVE_NEVER;
@@ -957,8 +1250,15 @@ do_mount (GVfsBackend *backend,
 
       if (dir != NULL)
         {
-          /*  Let update_cache() do enumeration, check for the smbc_getdents() result */
-          res = update_cache (op_backend, dir);
+          if (from_disk_cache && op_backend->mount_try == 0)
+            {
+              /* Reachable without a password, so the cached list is valid */
+              DEBUG ("do_mount - using share list from disk cache\n");
+              res = TRUE;
+            }
+          else
+            /*  Let update_cache() do enumeration, check for the smbc_getdents() result */
+            res = update_cache (op_backend, dir);
           smbc_closedir (smb_context, dir);
           DEBUG ("do_mount - login successful, res = %d\n", res);
           if (res)
@@ -1013,6 +1313,19 @@ do_mount (GVfsBackend *backend,
 			       op_backend->last_password,
 			       op_backend->password_save);
 
+  /* No password was needed, so later refreshes can run without asking
+     and the share list can be shared with other mounts */
+  op_backend->can_refresh_unattended = op_backend->mount_try == 0 &&
+    op_backend->user == NULL && op_backend->domain == NULL;
+  if (op_backend->can_refresh_unattended && !from_disk_cache)
+    {
+      g_mutex_lock (&op_backend->update_cache_lock);
+      save_disk_cache (op_backend, op_backend->entries, op_backend->last_entry_update);
+      g_mutex_unlock (&op_backend->update_cache_lock);
+    }
+
+  op_backend->root_monitor = g_vfs_monitor_new (backend);
+
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
@@ -1112,12 +1425,14 @@ do_mount_mountable (GVfsBackend *backend,
 {
   GVfsBackendSmbBrowse *op_backend = G_VFS_BACKEND_SMB_BROWSE (backend);
 
-  update_cache (op_backend, NULL);
+  ensure_cache (op_backend);
 
   run_mount_mountable (op_backend,
 		       job,
 		       filename,
 		       mount_source);
+
+  refresh_outdated_cache (op_backend);
 }
 
 static gboolean
@@ -1168,9 +1483,11 @@ do_open_for_read (GVfsBackend *backend,
 {
   GVfsBackendSmbBrowse *op_backend = G_VFS_BACKEND_SMB_BROWSE (backend);
 
-  update_cache (op_backend, NULL);
+  ensure_cache (op_backend);
 
   run_open_for_read (op_backend, job, filename);
+
+  refresh_outdated_cache (op_backend);
 }
 
 static gboolean
@@ -1343,9 +1660,11 @@ do_query_info (GVfsBackend *backend,
 {
   GVfsBackendSmbBrowse *op_backend = G_VFS_BACKEND_SMB_BROWSE (backend);
 
-  update_cache (op_backend, NULL);
+  ensure_cache (op_backend);
 
   run_query_info (op_backend, job, filename, info, matcher);
+
+  refresh_outdated_cache (op_backend);
 }
 
 
@@ -1438,9 +1757,11 @@ do_enumerate (GVfsBackend *backend,
 {
   GVfsBackendSmbBrowse *op_backend = G_VFS_BACKEND_SMB_BROWSE (backend);
 
-  update_cache (op_backend, NULL);
+  ensure_cache (op_backend);
 
   run_enumerate (op_backend, job, filename, matcher);
+
+  refresh_outdated_cache (op_backend);
 }
 
 static gboolean
@@ -1460,6 +1781,28 @@ try_enumerate (GVfsBackend *backend,
   return TRUE;
 }
 
+static gboolean
+try_create_dir_monitor (GVfsBackend *backend,
+			GVfsJobCreateMonitor *job,
+			const char *filename,
+			GFileMonitorFlags flags)
+{
+  GVfsBackendSmbBrowse *op_backend = G_VFS_BACKEND_SMB_BROWSE (backend);
+
+  if (!is_root (filename) || op_backend->root_monitor == NULL)
+    {
+      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
+			G_IO_ERROR_NOT_SUPPORTED,
+			_("Can't monitor file or directory."));
+      return TRUE;
+    }
+
+  g_vfs_job_create_monitor_set_monitor (job, op_backend->root_monitor);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  return TRUE;
+}
+
 static void
 g_vfs_backend_smb_browse_class_init (GVfsBackendSmbBrowseClass *klass)
 {
@@ -1481,6 +1824,7 @@ g_vfs_backend_smb_browse_class_init (GVfsBackendSmbBrowseClass *klass)
   backend_class->try_query_info = try_query_info;
   backend_class->enumerate = do_enumerate;
   backend_class->try_enumerate = try_enumerate;
+  backend_class->try_create_dir_monitor = try_create_dir_monitor;
 }
 
 void
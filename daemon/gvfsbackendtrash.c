@@ -16,6 +16,7 @@
 
 #include "trashlib/trashwatcher.h"
 #include "trashlib/trashitem.h"
+#include "trashlib/trashexpunge.h"
 
 #include "gvfsjobcreatemonitor.h"
 #include "gvfsjobopenforread.h"
@@ -38,6 +39,9 @@ struct OPAQUE_TYPE__GVfsBackendTrash
   TrashRoot *root;
 
   guint thaw_timeout_id;
+
+  /* set while an expunge progress notification is scheduled */
+  gint expunge_notify_id;
 };
 
 G_DEFINE_TYPE (GVfsBackendTrash, g_vfs_backend_trash, G_VFS_TYPE_BACKEND);
@@ -156,6 +160,36 @@ trash_backend_item_count_changed (gpointer user_data)
     }
 }
 
+static gboolean
+trash_backend_expunge_notify (gpointer user_data)
+{
+  GVfsBackendTrash *backend = user_data;
+
+  g_atomic_int_set (&backend->expunge_notify_id, 0);
+
+  /* the number of items still being deleted is part of the root info */
+  trash_backend_item_count_changed (backend);
+
+  return FALSE;
+}
+
+/* called from the expunge threads */
+static void
+trash_backend_expunge_progress (guint    n_pending,
+                                gpointer user_data)
+{
+  GVfsBackendTrash *backend = user_data;
+  guint id;
+
+  /* don't flood the monitors when deleting lots of items */
+  if (g_atomic_int_get (&backend->expunge_notify_id) != 0)
+    return;
+
+  id = g_timeout_add (500, trash_backend_expunge_notify, backend);
+  if (!g_atomic_int_compare_and_exchange (&backend->expunge_notify_id, 0, id))
+    g_source_remove (id);
+}
+
 
 static GFile *
 trash_backend_get_file (GVfsBackendTrash  *backend,
@@ -686,6 +720,7 @@ trash_backend_mount (GVfsBackend  *vfs_backend,
                                   trash_backend_item_count_changed,
                                   backend);
   backend->watcher = trash_watcher_new (backend->root);
+  trash_expunge_set_progress_func (trash_backend_expunge_progress, backend);
 
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
@@ -760,6 +795,8 @@ trash_backend_query_info (GVfsBackend           *vfs_backend,
       g_object_unref (icon);
 
       g_file_info_set_attribute_uint32 (info, "trash::item-count", n_items);
+      g_file_info_set_attribute_uint32 (info, "trash::expunge-pending",
+                                        trash_expunge_get_n_pending ());
 
       g_vfs_job_succeeded (G_VFS_JOB (job));
     }
@@ -838,6 +875,10 @@ trash_backend_finalize (GObject *object)
 {
   GVfsBackendTrash *backend = G_VFS_BACKEND_TRASH (object);
 
+  trash_expunge_set_progress_func (NULL, NULL);
+  if (backend->expunge_notify_id)
+    g_source_remove (backend->expunge_notify_id);
+
   /* get rid of these first to stop a flood of event notifications
    * from being emitted while we're tearing down the TrashWatcher
    */
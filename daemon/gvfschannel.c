@@ -41,6 +41,7 @@
 #include <gvfsjobcloseread.h>
 #include <gvfsjobclosewrite.h>
 #include <gvfsfileinfo.h>
+#include <gvfstrace.h>
 
 static void g_vfs_channel_job_source_iface_init (GVfsJobSourceIface *iface);
 
@@ -418,6 +419,8 @@ got_request (GVfsChannel *channel,
   req->data_len = data_len;
   req->data = data;
 
+  GVFS_TRACE4 (channel__request, channel, req->command, req->seq_nr, req->arg1);
+
   channel->priv->queued_requests =
     g_list_append (channel->priv->queued_requests,
 		   req);
@@ -608,6 +611,8 @@ send_reply_cb (GObject *source_object,
   /* Sent full reply */
   channel->priv->output_data = NULL;
 
+  GVFS_TRACE2 (channel__reply__sent, channel, channel->priv->current_job_seq_nr);
+
   job = channel->priv->current_job;
   channel->priv->current_job = NULL;
   g_vfs_job_emit_finished (job);
@@ -650,6 +655,7 @@ g_vfs_channel_send_reply (GVfsChannel *channel,
 			  const void *data,
 			  gsize data_len)
 {
+  GVFS_TRACE3 (channel__reply, channel, channel->priv->current_job_seq_nr, data_len);
   
   channel->priv->output_data = data;
   channel->priv->output_data_size = data_len;
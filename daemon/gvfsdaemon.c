@@ -41,6 +41,8 @@
 #include <gvfsjobmount.h>
 #include <gvfsjobopenforread.h>
 #include <gvfsjobopenforwrite.h>
+#include <gvfsjobmetrics.h>
+#include <gvfstrace.h>
 
 enum {
   PROP_0
@@ -62,6 +64,12 @@ struct _GVfsDaemon
   gboolean main_daemon;
 
   GThreadPool *thread_pool;
+  /* Each backend gets its own job threads, so that with several mounts
+     in one process a busy mount can't hold up the others. Not with a
+     single job thread, which backends use to serialize access to
+     library state that isn't thread safe. */
+  GHashTable *backend_thread_pools; /* GVfsBackend -> GThreadPool */
+  gint max_threads;
   GHashTable *registered_paths;
   GHashTable *client_connections;
   GList *jobs;
@@ -74,6 +82,7 @@ struct _GVfsDaemon
   GDBusConnection *conn;
   GVfsDBusDaemon *daemon_skeleton;
   GVfsDBusMountable *mountable_skeleton;
+  GVfsDBusMetrics *metrics_skeleton;
   guint name_watcher;
   gboolean lost_main_daemon;
 };
@@ -108,6 +117,9 @@ static gboolean          daemon_handle_mount       (GVfsDBusMountable     *objec
                                                     gboolean               arg_automount,
                                                     GVariant              *arg_mount_source,
                                                     gpointer               user_data);
+static gboolean          handle_get_metrics        (GVfsDBusMetrics       *object,
+                                                    GDBusMethodInvocation *invocation,
+                                                    gpointer               user_data);
 static void              g_vfs_daemon_re_register_job_sources (GVfsDaemon *daemon);
 
 
@@ -154,9 +166,15 @@ g_vfs_daemon_finalize (GObject *object)
       g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (daemon->mountable_skeleton));
       g_object_unref (daemon->mountable_skeleton);
     }
+  if (daemon->metrics_skeleton != NULL)
+    {
+      g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (daemon->metrics_skeleton));
+      g_object_unref (daemon->metrics_skeleton);
+    }
   if (daemon->conn != NULL)
     g_object_unref (daemon->conn);
   
+  g_hash_table_destroy (daemon->backend_thread_pools);
   g_hash_table_destroy (daemon->registered_paths);
   g_hash_table_destroy (daemon->client_connections);
   g_mutex_clear (&daemon->lock);
@@ -212,6 +230,13 @@ name_vanished_handler (GDBusConnection *connection,
   daemon->lost_main_daemon = TRUE;
 }
 
+static void
+backend_thread_pool_free (GThreadPool *pool)
+{
+  /* Jobs already queued still run */
+  g_thread_pool_free (pool, FALSE, FALSE);
+}
+
 static void
 g_vfs_daemon_init (GVfsDaemon *daemon)
 {
@@ -224,6 +249,10 @@ g_vfs_daemon_init (GVfsDaemon *daemon)
 					   FALSE, NULL);
   /* TODO: verify thread_pool != NULL in a nicer way */
   g_assert (daemon->thread_pool != NULL);
+  daemon->max_threads = max_threads;
+  daemon->backend_thread_pools =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			   NULL, (GDestroyNotify)backend_thread_pool_free);
 
   g_mutex_init (&daemon->lock);
 
@@ -270,6 +299,20 @@ g_vfs_daemon_init (GVfsDaemon *daemon)
                   error->message, g_quark_to_string (error->domain), error->code);
       g_error_free (error);
     }
+
+  daemon->metrics_skeleton = gvfs_dbus_metrics_skeleton_new ();
+  g_signal_connect (daemon->metrics_skeleton, "handle-get-metrics", G_CALLBACK (handle_get_metrics), daemon);
+
+  error = NULL;
+  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (daemon->metrics_skeleton),
+                                         daemon->conn,
+                                         G_VFS_DBUS_METRICS_PATH,
+                                         &error))
+    {
+      g_warning ("Error exporting metrics interface: %s (%s, %d)\n",
+                  error->message, g_quark_to_string (error->domain), error->code);
+      g_error_free (error);
+    }
 }
 
 static void
@@ -340,7 +383,19 @@ void
 g_vfs_daemon_set_max_threads (GVfsDaemon                    *daemon,
 			      gint                           max_threads)
 {
+  GHashTableIter iter;
+  GThreadPool *pool;
+
+  g_mutex_lock (&daemon->lock);
+
+  daemon->max_threads = max_threads;
   g_thread_pool_set_max_threads (daemon->thread_pool, max_threads, NULL);
+
+  g_hash_table_iter_init (&iter, daemon->backend_thread_pools);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&pool))
+    g_thread_pool_set_max_threads (pool, max_threads, NULL);
+
+  g_mutex_unlock (&daemon->lock);
 }
 
 static gboolean
@@ -367,12 +422,27 @@ daemon_schedule_exit (GVfsDaemon *daemon)
     daemon->exit_tag = g_timeout_add_seconds (1, exit_at_idle, daemon);
 }
 
+static void daemon_queue_job (GVfsDaemon  *daemon,
+                              GVfsJob     *job,
+                              GVfsBackend *backend);
+
 static void
 job_source_new_job_callback (GVfsJobSource *job_source,
 			     GVfsJob *job,
 			     GVfsDaemon *daemon)
 {
-  g_vfs_daemon_queue_job (daemon, job);
+  GVfsBackend *backend;
+
+  backend = NULL;
+  if (G_VFS_IS_BACKEND (job_source))
+    backend = G_VFS_BACKEND (job_source);
+  else if (G_VFS_IS_CHANNEL (job_source))
+    backend = g_vfs_channel_get_backend (G_VFS_CHANNEL (job_source));
+
+  if (backend)
+    g_vfs_job_set_metrics (job, g_vfs_backend_get_metrics (backend));
+
+  daemon_queue_job (daemon, job, backend);
 }
 
 static void
@@ -390,6 +460,8 @@ job_source_closed_callback (GVfsJobSource *job_source,
   g_signal_handlers_disconnect_by_func (job_source,
 					(GCallback)job_source_closed_callback,
 					daemon);
+
+  g_hash_table_remove (daemon->backend_thread_pools, job_source);
   
   g_object_unref (job_source);
 
@@ -453,6 +525,13 @@ g_vfs_daemon_add_job_source (GVfsDaemon *daemon,
 		    (GCallback)job_source_new_job_callback, daemon);
   g_signal_connect (job_source, "closed",
 		    (GCallback)job_source_closed_callback, daemon);
+
+  if (G_VFS_IS_BACKEND (job_source) && daemon->max_threads != 1)
+    g_hash_table_insert (daemon->backend_thread_pools, job_source,
+			 g_thread_pool_new (job_handler_callback,
+					    daemon,
+					    daemon->max_threads,
+					    FALSE, NULL));
   
   g_mutex_unlock (&daemon->lock);
 }
@@ -556,11 +635,15 @@ job_finished_callback (GVfsJob *job,
   g_object_unref (job);
 }
 
-void
-g_vfs_daemon_queue_job (GVfsDaemon *daemon,
-			GVfsJob *job)
+static void
+daemon_queue_job (GVfsDaemon  *daemon,
+                  GVfsJob     *job,
+                  GVfsBackend *backend)
 {
+  GThreadPool *pool;
+
   g_debug ("Queued new job %p (%s)\n", job, g_type_name_from_instance ((gpointer)job));
+  GVFS_TRACE2 (job__queue, job, g_type_name_from_instance ((gpointer)job));
   
   g_object_ref (job);
   g_signal_connect (job, "finished", (GCallback)job_finished_callback, daemon);
@@ -574,10 +657,24 @@ g_vfs_daemon_queue_job (GVfsDaemon *daemon,
   if (!g_vfs_job_try (job))
     {
       /* Couldn't finish / run async, queue worker thread */
-      g_thread_pool_push (daemon->thread_pool, job, NULL); /* TODO: Check error */
+      g_mutex_lock (&daemon->lock);
+      pool = NULL;
+      if (backend)
+        pool = g_hash_table_lookup (daemon->backend_thread_pools, backend);
+      if (pool == NULL)
+        pool = daemon->thread_pool;
+      g_thread_pool_push (pool, job, NULL); /* TODO: Check error */
+      g_mutex_unlock (&daemon->lock);
     }
 }
 
+void
+g_vfs_daemon_queue_job (GVfsDaemon *daemon,
+			GVfsJob *job)
+{
+  daemon_queue_job (daemon, job, NULL);
+}
+
 static void
 new_connection_data_free (void *memory)
 {
@@ -915,6 +1012,37 @@ handle_cancel (GVfsDBusDaemon *object,
   return TRUE;
 }
 
+static gboolean
+handle_get_metrics (GVfsDBusMetrics *object,
+                    GDBusMethodInvocation *invocation,
+                    gpointer user_data)
+{
+  GVfsDaemon *daemon = G_VFS_DAEMON (user_data);
+  GVariantBuilder builder;
+  GVfsBackend *backend;
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa{sv})"));
+
+  g_mutex_lock (&daemon->lock);
+  for (l = daemon->job_sources; l != NULL; l = l->next)
+    {
+      if (G_VFS_IS_BACKEND (l->data))
+        {
+          backend = G_VFS_BACKEND (l->data);
+          g_vfs_job_metrics_add_to_builder (g_vfs_backend_get_metrics (backend),
+                                            g_vfs_backend_get_object_path (backend),
+                                            &builder);
+        }
+    }
+  g_mutex_unlock (&daemon->lock);
+
+  gvfs_dbus_metrics_complete_get_metrics (object, invocation,
+                                          g_variant_builder_end (&builder));
+
+  return TRUE;
+}
+
 static gboolean
 daemon_handle_mount (GVfsDBusMountable *object,
                      GDBusMethodInvocation *invocation,
@@ -988,21 +1116,25 @@ g_vfs_daemon_initiate_mount (GVfsDaemon *daemon,
   g_object_unref (backend);
 
   job = g_vfs_job_mount_new (mount_spec, mount_source, is_automount, object, invocation, backend);
-  g_vfs_daemon_queue_job (daemon, job);
+  g_vfs_job_set_metrics (job, g_vfs_backend_get_metrics (backend));
+  daemon_queue_job (daemon, job, backend);
   g_object_unref (job);
 }
 
 /**
  * g_vfs_daemon_get_blocking_processes:
  * @daemon: A #GVfsDaemon.
+ * @backend: The backend being unmounted.
  *
- * Gets all processes that blocks unmounting, e.g. processes with open
- * file handles.
+ * Gets all processes that blocks unmounting @backend, e.g. processes
+ * with open file handles on it. Other mounts served by the same process
+ * are not taken into account.
  *
  * Returns: An array of #GPid. Free with g_array_unref().
  */
 GArray *
-g_vfs_daemon_get_blocking_processes (GVfsDaemon *daemon)
+g_vfs_daemon_get_blocking_processes (GVfsDaemon    *daemon,
+                                     GVfsJobSource *backend)
 {
   GArray *processes;
   GList *l;
@@ -1010,7 +1142,8 @@ g_vfs_daemon_get_blocking_processes (GVfsDaemon *daemon)
   processes = g_array_new (FALSE, FALSE, sizeof (GPid));
   for (l = daemon->job_sources; l != NULL; l = l->next)
     {
-      if (G_VFS_IS_CHANNEL (l->data))
+      if (G_VFS_IS_CHANNEL (l->data) &&
+          (GVfsJobSource *)g_vfs_channel_get_backend (G_VFS_CHANNEL (l->data)) == backend)
         {
           GPid pid;
           pid = g_vfs_channel_get_actual_consumer (G_VFS_CHANNEL (l->data));
@@ -1028,12 +1161,16 @@ g_vfs_daemon_run_job_in_thread (GVfsDaemon *daemon,
   g_thread_pool_push (daemon->thread_pool, job, NULL); /* TODO: Check error */
 }
 
+/* Only closes the channels of @backend, other mounts in the same
+   process keep their open files */
 void
-g_vfs_daemon_close_active_channels (GVfsDaemon *daemon)
+g_vfs_daemon_close_active_channels (GVfsDaemon    *daemon,
+                                    GVfsJobSource *backend)
 {
   GList *l;
 
    for (l = daemon->job_sources; l != NULL; l = l->next)
-      if (G_VFS_IS_CHANNEL (l->data))
+      if (G_VFS_IS_CHANNEL (l->data) &&
+          (GVfsJobSource *)g_vfs_channel_get_backend (G_VFS_CHANNEL (l->data)) == backend)
         g_vfs_channel_force_close (G_VFS_CHANNEL (l->data));
 }
@@ -75,10 +75,12 @@ void        g_vfs_daemon_initiate_mount  (GVfsDaemon                    *daemon,
 					  gboolean                       is_automount,
 	                                  GVfsDBusMountable             *object,
 					  GDBusMethodInvocation         *invocation);
-GArray     *g_vfs_daemon_get_blocking_processes (GVfsDaemon             *daemon);
+GArray     *g_vfs_daemon_get_blocking_processes (GVfsDaemon             *daemon,
+                                                 GVfsJobSource          *backend);
 void        g_vfs_daemon_run_job_in_thread      (GVfsDaemon             *daemon,
 						 GVfsJob                *job);
-void       g_vfs_daemon_close_active_channels (GVfsDaemon                *daemon);
+void       g_vfs_daemon_close_active_channels (GVfsDaemon                *daemon,
+                                               GVfsJobSource             *backend);
 
 G_END_DECLS
 
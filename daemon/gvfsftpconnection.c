@@ -28,6 +28,7 @@
 #include <glib/gi18n.h>
 
 #include "gvfsbackendftp.h"
+#include "gvfstrace.h"
 
 /* used for identifying the connection during debugging */
 static volatile int debug_id = 0;
@@ -134,9 +135,15 @@ g_vfs_ftp_connection_send (GVfsFtpConnection *conn,
   g_return_val_if_fail (command[len-2] == '\r' && command[len-1] == '\n', FALSE);
 
   if (g_str_has_prefix (command, "PASS"))
-    g_debug ("--%2d ->  PASS ***\r\n", conn->debug_id);
+    {
+      g_debug ("--%2d ->  PASS ***\r\n", conn->debug_id);
+      GVFS_TRACE2 (ftp__send, conn->debug_id, "PASS ***\r\n");
+    }
   else
-    g_debug ("--%2d ->  %s", conn->debug_id, command);
+    {
+      g_debug ("--%2d ->  %s", conn->debug_id, command);
+      GVFS_TRACE2 (ftp__send, conn->debug_id, command);
+    }
 
   conn->waiting_for_reply = TRUE;
   return g_output_stream_write_all (g_io_stream_get_output_stream (conn->commands),
@@ -234,6 +241,8 @@ g_vfs_ftp_connection_receive (GVfsFtpConnection *conn,
   if (response >= 200)
     conn->waiting_for_reply = FALSE;
 
+  GVFS_TRACE2 (ftp__reply, conn->debug_id, response);
+
   return response;
 
 fail:
@@ -32,6 +32,8 @@
 #include <gio/gio.h>
 #include "gvfsjob.h"
 #include "gvfsjobsource.h"
+#include "gvfsjobmetrics.h"
+#include "gvfstrace.h"
 
 G_DEFINE_TYPE (GVfsJob, g_vfs_job, G_TYPE_OBJECT)
 
@@ -52,7 +54,13 @@ enum {
 
 struct _GVfsJobPrivate
 {
-  int dummy;
+  GVfsJobMetrics *metrics;
+
+  /* Monotonic times in usec, 0 if not reached */
+  gint64 queued_time;
+  gint64 started_time;
+  gint64 replied_time;
+  gint64 finished_time;
 };
 
 static guint signals[LAST_SIGNAL] = { 0 };
@@ -80,6 +88,9 @@ g_vfs_job_finalize (GObject *object)
     job->backend_data_destroy (job->backend_data);
 
   g_object_unref (job->cancellable);
+
+  if (job->priv->metrics)
+    g_vfs_job_metrics_unref (job->priv->metrics);
   
   if (G_OBJECT_CLASS (g_vfs_job_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_job_parent_class)->finalize) (object);
@@ -136,7 +147,7 @@ g_vfs_job_init (GVfsJob *job)
   job->priv = G_TYPE_INSTANCE_GET_PRIVATE (job, G_VFS_TYPE_JOB, GVfsJobPrivate);
 
   job->cancellable = g_cancellable_new ();
-  
+  job->priv->queued_time = g_get_monotonic_time ();
 }
 
 void
@@ -193,7 +204,9 @@ g_vfs_job_run (GVfsJob *job)
    * we call g_vfs_job_succeed/fail()
    */
   g_object_ref (job);
-  
+
+  job->priv->started_time = g_get_monotonic_time ();
+  GVFS_TRACE2 (job__start, job, 1);
   class->run (job);
   
   g_object_unref (job);
@@ -212,6 +225,8 @@ g_vfs_job_try (GVfsJob *job)
    * we call g_vfs_job_succeed/fail()
    */
   g_object_ref (job);
+  job->priv->started_time = g_get_monotonic_time ();
+  GVFS_TRACE2 (job__start, job, 0);
   res = class->try (job);
   g_object_unref (job);
 
@@ -233,6 +248,8 @@ static void
 g_vfs_job_send_reply (GVfsJob *job)
 {
   job->sent_reply = TRUE;
+  job->priv->replied_time = g_get_monotonic_time ();
+  GVFS_TRACE2 (job__reply, job, job->failed);
   g_signal_emit (job, signals[SEND_REPLY], 0);
 }
 
@@ -322,5 +339,34 @@ g_vfs_job_emit_finished (GVfsJob *job)
   g_assert (!job->finished);
   
   job->finished = TRUE;
+  job->priv->finished_time = g_get_monotonic_time ();
+  GVFS_TRACE1 (job__finish, job);
+
+  if (job->priv->metrics)
+    g_vfs_job_metrics_record (job->priv->metrics, job);
+
   g_signal_emit (job, signals[FINISHED], 0);
 }
+
+/* Finished jobs are recorded in metrics */
+void
+g_vfs_job_set_metrics (GVfsJob        *job,
+                       GVfsJobMetrics *metrics)
+{
+  if (job->priv->metrics)
+    g_vfs_job_metrics_unref (job->priv->metrics);
+  job->priv->metrics = metrics ? g_vfs_job_metrics_ref (metrics) : NULL;
+}
+
+void
+g_vfs_job_get_times (GVfsJob *job,
+                     gint64  *queued,
+                     gint64  *started,
+                     gint64  *replied,
+                     gint64  *finished)
+{
+  *queued = job->priv->queued_time;
+  *started = job->priv->started_time;
+  *replied = job->priv->replied_time;
+  *finished = job->priv->finished_time;
+}
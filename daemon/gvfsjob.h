@@ -41,6 +41,7 @@ typedef struct _GVfsJobClass   GVfsJobClass;
 
 /* Defined here to avoid circular includes */
 typedef struct _GVfsJobSource GVfsJobSource;
+typedef struct _GVfsJobMetrics GVfsJobMetrics;
 
 struct _GVfsJob
 {
@@ -102,6 +103,13 @@ void     g_vfs_job_failed_from_error (GVfsJob     *job,
 void     g_vfs_job_failed_from_errno (GVfsJob     *job,
 				      gint         errno_arg);
 void     g_vfs_job_succeeded         (GVfsJob     *job);
+void     g_vfs_job_set_metrics       (GVfsJob     *job,
+				      GVfsJobMetrics *metrics);
+void     g_vfs_job_get_times         (GVfsJob     *job,
+				      gint64      *queued,
+				      gint64      *started,
+				      gint64      *replied,
+				      gint64      *finished);
 
 G_END_DECLS
 
@@ -254,6 +254,59 @@ g_vfs_job_enumerate_done (GVfsJobEnumerate *job)
   g_vfs_job_emit_finished (G_VFS_JOB (job));
 }
 
+static void
+send_failed_cb (GVfsDBusEnumerator *proxy,
+                GAsyncResult *res,
+                gpointer user_data)
+{
+  GError *error = NULL;
+
+  gvfs_dbus_enumerator_call_failed_finish (proxy, res, &error);
+  if (error != NULL)
+    {
+      /* Older clients only know Done, end the listing at least */
+      if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        gvfs_dbus_enumerator_call_done (proxy,
+                                        NULL,
+                                        (GAsyncReadyCallback) send_done_cb,
+                                        NULL);
+      else
+        g_warning ("send_failed_cb: %s (%s, %d)\n", error->message, g_quark_to_string (error->domain), error->code);
+      g_error_free (error);
+    }
+}
+
+/* Ends an enumeration that has already succeeded with an error, e.g.
+   when the listing breaks off half way. The infos added so far are
+   delivered first. */
+void
+g_vfs_job_enumerate_failed (GVfsJobEnumerate *job,
+                            const GError *error)
+{
+  GVfsDBusEnumerator *proxy;
+  char *error_name;
+
+  g_assert (!G_VFS_JOB (job)->failed);
+
+  if (job->building_infos != NULL)
+    send_infos (job);
+
+  proxy = create_enumerator_proxy (job);
+  g_assert (proxy != NULL);
+
+  error_name = g_dbus_error_encode_gerror (error);
+  gvfs_dbus_enumerator_call_failed (proxy,
+                                    error_name,
+                                    error->message,
+                                    NULL,
+                                    (GAsyncReadyCallback) send_failed_cb,
+                                    NULL);
+  g_free (error_name);
+  g_object_unref (proxy);
+
+  g_vfs_job_emit_finished (G_VFS_JOB (job));
+}
+
 static void
 run (GVfsJob *job)
 {
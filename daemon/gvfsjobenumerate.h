@@ -76,6 +76,8 @@ void     g_vfs_job_enumerate_add_info   (GVfsJobEnumerate      *job,
 void     g_vfs_job_enumerate_add_infos  (GVfsJobEnumerate      *job,
 					 const GList           *info);
 void     g_vfs_job_enumerate_done       (GVfsJobEnumerate      *job);
+void     g_vfs_job_enumerate_failed     (GVfsJobEnumerate      *job,
+					 const GError          *error);
 
 G_END_DECLS
 
@@ -0,0 +1,285 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gvfsjobmetrics.h>
+#include <gvfsjobread.h>
+#include <gvfsjobwrite.h>
+
+/* Histograms are in microseconds. Values below HISTOGRAM_LINEAR get
+ * a bucket of their own, above that every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS buckets, which keeps the relative error below
+ * 1/HISTOGRAM_SUB_BUCKETS up to 2^HISTOGRAM_MAX_EXP usec (~12 days). */
+#define HISTOGRAM_SUB_BITS    3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_LINEAR      (2 * HISTOGRAM_SUB_BUCKETS)
+#define HISTOGRAM_MAX_EXP     40
+#define HISTOGRAM_N_BUCKETS   (HISTOGRAM_LINEAR + \
+                               (HISTOGRAM_MAX_EXP - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_BUCKETS)
+
+/* There are about 40 job types, anything past this is not recorded */
+#define MAX_JOB_TYPES 64
+
+typedef struct {
+  volatile gint count;
+  volatile gint failed;
+  volatile gsize bytes;
+
+  volatile gint queue_time[HISTOGRAM_N_BUCKETS];
+  volatile gint run_time[HISTOGRAM_N_BUCKETS];
+  volatile gint reply_time[HISTOGRAM_N_BUCKETS];
+} JobTypeStats;
+
+struct _GVfsJobMetrics
+{
+  volatile gint ref_count;
+
+  /* Indexed by job type, allocated on first use */
+  JobTypeStats *types[MAX_JOB_TYPES];
+};
+
+/* Job types get small indexes the first time a job of that type is
+   recorded in any backend */
+static GType job_types[MAX_JOB_TYPES];
+static volatile gint n_job_types = 0;
+static GQuark job_type_index_quark = 0;
+G_LOCK_DEFINE_STATIC (job_types);
+
+static int
+get_job_type_index (GType type)
+{
+  guint index;
+
+  index = GPOINTER_TO_UINT (g_type_get_qdata (type, job_type_index_quark));
+  if (index != 0)
+    return index - 1;
+
+  G_LOCK (job_types);
+
+  index = GPOINTER_TO_UINT (g_type_get_qdata (type, job_type_index_quark));
+  if (index == 0 && n_job_types < MAX_JOB_TYPES)
+    {
+      job_types[n_job_types] = type;
+      index = n_job_types + 1;
+      g_type_set_qdata (type, job_type_index_quark, GUINT_TO_POINTER (index));
+      g_atomic_int_set (&n_job_types, index);
+    }
+
+  G_UNLOCK (job_types);
+
+  return (int)index - 1;
+}
+
+static guint
+bucket_for_value (guint64 value)
+{
+  guint exp, sub;
+
+  if (value < HISTOGRAM_LINEAR)
+    return value;
+
+  exp = g_bit_storage (value) - 1;
+  if (exp >= HISTOGRAM_MAX_EXP)
+    return HISTOGRAM_N_BUCKETS - 1;
+
+  sub = (value >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+  return HISTOGRAM_LINEAR + (exp - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/* The smallest value that falls into bucket */
+static guint64
+bucket_lower_bound (guint bucket)
+{
+  guint exp, sub;
+
+  if (bucket < HISTOGRAM_LINEAR)
+    return bucket;
+
+  bucket -= HISTOGRAM_LINEAR;
+  exp = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS + 1;
+  sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+  return ((guint64)(HISTOGRAM_SUB_BUCKETS + sub)) << (exp - HISTOGRAM_SUB_BITS);
+}
+
+static void
+histogram_add (volatile gint *histogram,
+               gint64         usec)
+{
+  g_atomic_int_inc (&histogram[bucket_for_value (MAX (usec, 0))]);
+}
+
+static GVariant *
+histogram_to_variant (volatile gint *histogram)
+{
+  GVariantBuilder builder;
+  guint i, count;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tu)"));
+  for (i = 0; i < HISTOGRAM_N_BUCKETS; i++)
+    {
+      count = g_atomic_int_get (&histogram[i]);
+      if (count != 0)
+        g_variant_builder_add (&builder, "(tu)", bucket_lower_bound (i), count);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+GVfsJobMetrics *
+g_vfs_job_metrics_new (void)
+{
+  GVfsJobMetrics *metrics;
+
+  if (job_type_index_quark == 0)
+    job_type_index_quark = g_quark_from_static_string ("gvfs-job-metrics-index");
+
+  metrics = g_new0 (GVfsJobMetrics, 1);
+  metrics->ref_count = 1;
+
+  return metrics;
+}
+
+GVfsJobMetrics *
+g_vfs_job_metrics_ref (GVfsJobMetrics *metrics)
+{
+  g_atomic_int_inc (&metrics->ref_count);
+  return metrics;
+}
+
+void
+g_vfs_job_metrics_unref (GVfsJobMetrics *metrics)
+{
+  int i;
+
+  if (!g_atomic_int_dec_and_test (&metrics->ref_count))
+    return;
+
+  for (i = 0; i < MAX_JOB_TYPES; i++)
+    g_free (metrics->types[i]);
+  g_free (metrics);
+}
+
+static JobTypeStats *
+get_stats (GVfsJobMetrics *metrics,
+           GType           type)
+{
+  JobTypeStats *stats;
+  int index;
+
+  index = get_job_type_index (type);
+  if (index < 0)
+    return NULL;
+
+  stats = g_atomic_pointer_get (&metrics->types[index]);
+  if (stats == NULL)
+    {
+      stats = g_new0 (JobTypeStats, 1);
+      if (!g_atomic_pointer_compare_and_exchange (&metrics->types[index], NULL, stats))
+        {
+          /* Another thread was faster */
+          g_free (stats);
+          stats = g_atomic_pointer_get (&metrics->types[index]);
+        }
+    }
+
+  return stats;
+}
+
+/* Might be called on an i/o thread */
+void
+g_vfs_job_metrics_record (GVfsJobMetrics *metrics,
+                          GVfsJob        *job)
+{
+  JobTypeStats *stats;
+  gint64 queued, started, replied, finished;
+  gsize bytes;
+
+  stats = get_stats (metrics, G_OBJECT_TYPE (job));
+  if (stats == NULL)
+    return;
+
+  g_vfs_job_get_times (job, &queued, &started, &replied, &finished);
+
+  /* Jobs cancelled before they ran or replied */
+  if (started == 0)
+    started = queued;
+  if (replied == 0)
+    replied = finished;
+
+  histogram_add (stats->queue_time, started - queued);
+  histogram_add (stats->run_time, replied - started);
+  histogram_add (stats->reply_time, finished - replied);
+
+  g_atomic_int_inc (&stats->count);
+  if (job->failed)
+    g_atomic_int_inc (&stats->failed);
+
+  bytes = 0;
+  if (G_VFS_IS_JOB_READ (job))
+    bytes = G_VFS_JOB_READ (job)->data_count;
+  else if (G_VFS_IS_JOB_WRITE (job))
+    bytes = G_VFS_JOB_WRITE (job)->written_size;
+
+  if (bytes != 0)
+    g_atomic_pointer_add (&stats->bytes, bytes);
+}
+
+/* Adds a (object_path, job_type, stats) entry per job type */
+void
+g_vfs_job_metrics_add_to_builder (GVfsJobMetrics  *metrics,
+                                  const char      *object_path,
+                                  GVariantBuilder *builder)
+{
+  GVariantBuilder stats_builder;
+  JobTypeStats *stats;
+  int i, n;
+
+  n = g_atomic_int_get (&n_job_types);
+  for (i = 0; i < n; i++)
+    {
+      stats = g_atomic_pointer_get (&metrics->types[i]);
+      if (stats == NULL)
+        continue;
+
+      g_variant_builder_init (&stats_builder, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add (&stats_builder, "{sv}", "count",
+                             g_variant_new_uint64 ((guint) g_atomic_int_get (&stats->count)));
+      g_variant_builder_add (&stats_builder, "{sv}", "failed",
+                             g_variant_new_uint64 ((guint) g_atomic_int_get (&stats->failed)));
+      g_variant_builder_add (&stats_builder, "{sv}", "bytes",
+                             g_variant_new_uint64 ((gsize) g_atomic_pointer_get (&stats->bytes)));
+      g_variant_builder_add (&stats_builder, "{sv}", "queue-time",
+                             histogram_to_variant (stats->queue_time));
+      g_variant_builder_add (&stats_builder, "{sv}", "run-time",
+                             histogram_to_variant (stats->run_time));
+      g_variant_builder_add (&stats_builder, "{sv}", "reply-time",
+                             histogram_to_variant (stats->reply_time));
+
+      g_variant_builder_add (builder, "(ssa{sv})",
+                             object_path,
+                             g_type_name (job_types[i]),
+                             &stats_builder);
+    }
+}
@@ -0,0 +1,47 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __G_VFS_JOB_METRICS_H__
+#define __G_VFS_JOB_METRICS_H__
+
+#include <glib-object.h>
+#include <gvfsjob.h>
+
+G_BEGIN_DECLS
+
+/* Per-backend job statistics. For every job type it keeps the number
+ * of jobs, failures, transferred bytes and log-linear histograms of
+ * the time spent queued, running and sending the reply. Recording
+ * only uses atomic operations, so finishing jobs on different
+ * threads never contend on a lock.
+ */
+
+GVfsJobMetrics *g_vfs_job_metrics_new    (void);
+GVfsJobMetrics *g_vfs_job_metrics_ref    (GVfsJobMetrics  *metrics);
+void            g_vfs_job_metrics_unref  (GVfsJobMetrics  *metrics);
+void            g_vfs_job_metrics_record (GVfsJobMetrics  *metrics,
+                                          GVfsJob         *job);
+void            g_vfs_job_metrics_add_to_builder (GVfsJobMetrics  *metrics,
+                                                  const char      *object_path,
+                                                  GVariantBuilder *builder);
+
+G_END_DECLS
+
+#endif /* __G_VFS_JOB_METRICS_H__ */
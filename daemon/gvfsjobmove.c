@@ -132,8 +132,7 @@ run (GVfsJob *job)
                progress_job->send_progress ? g_vfs_job_progress_callback : NULL,
                progress_job->send_progress ? job : NULL);
   
-  if (progress_job->progress_proxy)
-    g_clear_object (&progress_job->progress_proxy);
+  g_vfs_job_progress_clear_proxy (job);
 }
 
 static gboolean
@@ -157,8 +156,7 @@ try (GVfsJob *job)
 		         progress_job->send_progress ? g_vfs_job_progress_callback : NULL,
 		         progress_job->send_progress ? job : NULL);
   
-  if (progress_job->progress_proxy)
-    g_clear_object (&progress_job->progress_proxy);
+  g_vfs_job_progress_clear_proxy (job);
 
   return res;
 }
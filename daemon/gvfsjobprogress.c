@@ -31,8 +31,15 @@
 #include <glib/gi18n.h>
 #include "gvfsjobprogress.h"
 
+/* Progress is sent at most this often, unless it moved by at least
+   1/PROGRESS_STEPS of the total since the last update */
+#define PROGRESS_INTERVAL_USEC (100 * 1000)
+#define PROGRESS_STEPS 100
+
 G_DEFINE_TYPE (GVfsJobProgress, g_vfs_job_progress, G_VFS_TYPE_JOB_DBUS)
 
+static void send_reply (GVfsJob *job);
+
 static void
 g_vfs_job_progress_finalize (GObject *object)
 {
@@ -50,8 +57,10 @@ static void
 g_vfs_job_progress_class_init (GVfsJobProgressClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GVfsJobClass *job_class = G_VFS_JOB_CLASS (klass);
   
   gobject_class->finalize = g_vfs_job_progress_finalize;
+  job_class->send_reply = send_reply;
 }
 
 static void
@@ -59,26 +68,55 @@ g_vfs_job_progress_init (GVfsJobProgress *job)
 {
 }
 
+static void
+send_progress (GVfsJobProgress *job,
+               goffset current_num_bytes,
+               goffset total_num_bytes)
+{
+  /* No flush here, the message is queued and sent by the GDBus worker
+     thread in order with the job reply, without stalling the transfer */
+  gvfs_dbus_progress_call_progress (job->progress_proxy,
+                                    current_num_bytes,
+                                    total_num_bytes,
+                                    NULL,
+                                    NULL,
+                                    NULL);
+
+  job->last_sent_time = g_get_monotonic_time ();
+  job->last_sent_bytes = current_num_bytes;
+  job->have_pending = FALSE;
+}
+
 void
 g_vfs_job_progress_callback (goffset current_num_bytes,
                              goffset total_num_bytes,
                              gpointer user_data)
 {
   GVfsJobProgress *job = G_VFS_JOB_PROGRESS (user_data);
-  GVfsJobDBus *dbus_job = G_VFS_JOB_DBUS (job);
+  gint64 now;
 
   g_debug ("g_vfs_job_progress_callback %" G_GOFFSET_FORMAT "/%" G_GOFFSET_FORMAT "\n", current_num_bytes, total_num_bytes);
 
   if (job->callback_obj_path == NULL || job->progress_proxy == NULL)
     return;
 
-  gvfs_dbus_progress_call_progress (job->progress_proxy,
-                                    current_num_bytes,
-                                    total_num_bytes,
-                                    NULL,
-                                    NULL,
-                                    NULL);
-  g_dbus_connection_flush_sync (g_dbus_method_invocation_get_connection (dbus_job->invocation), NULL, NULL);
+  now = g_get_monotonic_time ();
+
+  if (current_num_bytes == total_num_bytes ||
+      job->last_sent_time == 0 ||
+      now - job->last_sent_time >= PROGRESS_INTERVAL_USEC ||
+      (total_num_bytes > 0 &&
+       current_num_bytes - job->last_sent_bytes >= total_num_bytes / PROGRESS_STEPS))
+    {
+      send_progress (job, current_num_bytes, total_num_bytes);
+    }
+  else
+    {
+      /* Remember it so the final numbers are always sent */
+      job->have_pending = TRUE;
+      job->pending_current = current_num_bytes;
+      job->pending_total = total_num_bytes;
+    }
 }
 
 void
@@ -103,3 +141,26 @@ g_vfs_job_progress_construct_proxy (GVfsJob *job)
       g_error_free (error);
     }
 }
+
+void
+g_vfs_job_progress_clear_proxy (GVfsJob *job)
+{
+  GVfsJobProgress *progress_job = G_VFS_JOB_PROGRESS (job);
+
+  g_clear_object (&progress_job->progress_proxy);
+}
+
+/* The client stops listening for progress once it has the reply, so
+   the last skipped update has to be queued before it */
+static void
+send_reply (GVfsJob *job)
+{
+  GVfsJobProgress *progress_job = G_VFS_JOB_PROGRESS (job);
+
+  if (progress_job->progress_proxy != NULL && progress_job->have_pending)
+    send_progress (progress_job,
+                   progress_job->pending_current,
+                   progress_job->pending_total);
+
+  G_VFS_JOB_CLASS (g_vfs_job_progress_parent_class)->send_reply (job);
+}
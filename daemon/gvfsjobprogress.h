@@ -46,6 +46,13 @@ struct _GVfsJobProgress
   gboolean send_progress;
   char *callback_obj_path;
   GVfsDBusProgress *progress_proxy;
+
+  /* Rate limiting of progress updates */
+  gint64 last_sent_time;
+  goffset last_sent_bytes;
+  gboolean have_pending;
+  goffset pending_current;
+  goffset pending_total;
 };
 
 struct _GVfsJobProgressClass
@@ -60,6 +67,7 @@ void g_vfs_job_progress_callback (goffset current_num_bytes,
                                   gpointer user_data);
 
 void g_vfs_job_progress_construct_proxy (GVfsJob *job);
+void g_vfs_job_progress_clear_proxy     (GVfsJob *job);
 
 
 G_END_DECLS
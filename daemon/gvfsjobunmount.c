@@ -295,7 +295,7 @@ unregister_mount_callback (GVfsDBusMountTracker *proxy,
   daemon = g_vfs_backend_get_daemon (backend);
   g_vfs_job_source_closed (G_VFS_JOB_SOURCE (backend));
 
-  g_vfs_daemon_close_active_channels (daemon);
+  g_vfs_daemon_close_active_channels (daemon, G_VFS_JOB_SOURCE (backend));
 }
 
 /* Might be called on an i/o thread */
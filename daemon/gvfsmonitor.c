@@ -29,6 +29,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <fcntl.h>
+#include <stdlib.h>
 
 #include <glib.h>
 #include <glib-object.h>
@@ -42,14 +43,28 @@
 
 #define OBJ_PATH_PREFIX "/org/gtk/vfs/daemon/dirmonitor/"
 
+/* Events are queued for this long so that bursts can be merged and
+   sent in one message, override with GVFS_MONITOR_EVENT_DELAY (in ms) */
+#define DEFAULT_EVENT_DELAY_MS 50
+#define MAX_EVENT_DELAY_MS 5000
+/* Most events sent in one ChangedMany call */
+#define MAX_EVENTS_PER_MESSAGE 1000
 
 typedef struct {
   GDBusConnection *connection;
   char *id;
   char *object_path;
   GVfsMonitor *monitor;
+  GVfsDBusMonitorClient *proxy;
+  gboolean no_changed_many; /* Old client, send one event at a time */
 } Subscriber;
 
+typedef struct {
+  GFileMonitorEvent event_type;
+  char *file_path;
+  char *other_file_path;
+} QueuedEvent;
+
 struct _GVfsMonitorPrivate
 {
   GVfsDaemon *daemon;
@@ -57,11 +72,19 @@ struct _GVfsMonitorPrivate
   GMountSpec *mount_spec;
   char *object_path;
   GList *subscribers;
+
+  /* Protects the event queue, events can be emitted from any thread */
+  GMutex queue_lock;
+  GQueue *events;
+  GHashTable *last_event_for_path; /* path -> last QueuedEvent for it */
+  guint flush_timeout;
 };
 
 /* atomic */
 static volatile gint path_counter = 1;
 
+static guint event_delay_ms = DEFAULT_EVENT_DELAY_MS;
+
 G_DEFINE_TYPE (GVfsMonitor, g_vfs_monitor, G_TYPE_OBJECT)
 
 static void unsubscribe (Subscriber *subscriber);
@@ -99,6 +122,11 @@ g_vfs_monitor_finalize (GObject *object)
   g_mount_spec_unref (monitor->priv->mount_spec);
   
   g_free (monitor->priv->object_path);
+
+  /* A pending flush keeps the monitor alive, so the queue is empty */
+  g_queue_free (monitor->priv->events);
+  g_hash_table_destroy (monitor->priv->last_event_for_path);
+  g_mutex_clear (&monitor->priv->queue_lock);
   
   if (G_OBJECT_CLASS (g_vfs_monitor_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_monitor_parent_class)->finalize) (object);
@@ -108,10 +136,15 @@ static void
 g_vfs_monitor_class_init (GVfsMonitorClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  const char *delay;
 
   g_type_class_add_private (klass, sizeof (GVfsMonitorPrivate));
   
   gobject_class->finalize = g_vfs_monitor_finalize;
+
+  delay = g_getenv ("GVFS_MONITOR_EVENT_DELAY");
+  if (delay)
+    event_delay_ms = CLAMP (atoi (delay), 0, MAX_EVENT_DELAY_MS);
 }
 
 static void
@@ -125,6 +158,10 @@ g_vfs_monitor_init (GVfsMonitor *monitor)
   
   id = g_atomic_int_add (&path_counter, 1);
   monitor->priv->object_path = g_strdup_printf (OBJ_PATH_PREFIX"%d", id);
+
+  g_mutex_init (&monitor->priv->queue_lock);
+  monitor->priv->events = g_queue_new ();
+  monitor->priv->last_event_for_path = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 static gboolean
@@ -146,6 +183,7 @@ unsubscribe (Subscriber *subscriber)
   subscriber->monitor->priv->subscribers = g_list_remove (subscriber->monitor->priv->subscribers, subscriber);
   
   g_signal_handlers_disconnect_by_data (subscriber->connection, subscriber);
+  g_clear_object (&subscriber->proxy);
   g_object_unref (subscriber->connection);
   g_free (subscriber->id);
   g_free (subscriber->object_path);
@@ -272,26 +310,46 @@ g_vfs_monitor_get_object_path (GVfsMonitor *monitor)
 }
 
 
-typedef struct {
-  GVfsMonitor *monitor;
-  GFileMonitorEvent event_type;
-  gchar *file_path;
-  gchar *other_file_path;
-} EmitEventData;
-
 static void
-emit_event_data_free (EmitEventData *data)
+queued_event_free (QueuedEvent *event)
 {
-  g_object_unref (data->monitor);
-  g_free (data->file_path);
-  g_free (data->other_file_path);
-  g_free (data);
+  g_free (event->file_path);
+  g_free (event->other_file_path);
+  g_free (event);
+}
+
+static GVfsDBusMonitorClient *
+subscriber_get_proxy (Subscriber *subscriber)
+{
+  GError *error;
+
+  if (subscriber->proxy == NULL)
+    {
+      /* Doesn't block, there are no properties to load and the
+         name, if any, is a unique name */
+      error = NULL;
+      subscriber->proxy =
+        gvfs_dbus_monitor_client_proxy_new_sync (subscriber->connection,
+                                                 G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                 subscriber->id,
+                                                 subscriber->object_path,
+                                                 NULL,
+                                                 &error);
+      if (subscriber->proxy == NULL)
+        {
+          g_printerr ("Error creating proxy: %s (%s, %d)\n",
+                      error->message, g_quark_to_string (error->domain), error->code);
+          g_error_free (error);
+        }
+    }
+
+  return subscriber->proxy;
 }
 
 static void
 changed_cb (GVfsDBusMonitorClient *proxy,
             GAsyncResult *res,
-            EmitEventData *data)
+            gpointer user_data)
 {
   GError *error = NULL;
 
@@ -301,38 +359,166 @@ changed_cb (GVfsDBusMonitorClient *proxy,
                   error->message, g_quark_to_string (error->domain), error->code);
       g_error_free (error);
     }
-  
-  emit_event_data_free (data);
 }
 
 static void
-got_proxy_cb (GObject *source_object,
-              GAsyncResult *res,
-              EmitEventData *data)
+send_events_one_by_one (GVfsMonitor *monitor,
+                        GVfsDBusMonitorClient *proxy,
+                        GPtrArray *events)
+{
+  QueuedEvent *event;
+  guint i;
+
+  for (i = 0; i < events->len; i++)
+    {
+      event = g_ptr_array_index (events, i);
+      gvfs_dbus_monitor_client_call_changed (proxy,
+                                             event->event_type,
+                                             g_mount_spec_to_dbus (monitor->priv->mount_spec),
+                                             event->file_path,
+                                             g_mount_spec_to_dbus (monitor->priv->mount_spec),
+                                             event->other_file_path ? event->other_file_path : "",
+                                             NULL,
+                                             (GAsyncReadyCallback) changed_cb,
+                                             NULL);
+    }
+}
+
+typedef struct {
+  GVfsMonitor *monitor;
+  GPtrArray *events;
+} ChangedManyData;
+
+static void
+changed_many_cb (GVfsDBusMonitorClient *proxy,
+                 GAsyncResult *res,
+                 ChangedManyData *data)
 {
   GError *error = NULL;
+  Subscriber *subscriber;
+  GList *l;
+
+  if (! gvfs_dbus_monitor_client_call_changed_many_finish (proxy, res, &error))
+    {
+      if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        {
+          /* Client predates ChangedMany, fall back to Changed for good */
+          for (l = data->monitor->priv->subscribers; l != NULL; l = l->next)
+            {
+              subscriber = l->data;
+              if (subscriber->proxy == proxy)
+                subscriber->no_changed_many = TRUE;
+            }
+          send_events_one_by_one (data->monitor, proxy, data->events);
+        }
+      else
+        g_printerr ("Error calling org.gtk.vfs.MonitorClient.ChangedMany(): %s (%s, %d)\n",
+                    error->message, g_quark_to_string (error->domain), error->code);
+      g_error_free (error);
+    }
+
+  g_object_unref (data->monitor);
+  g_ptr_array_unref (data->events);
+  g_free (data);
+}
+
+static void
+send_events (GVfsMonitor *monitor,
+             Subscriber *subscriber,
+             GPtrArray *events)
+{
   GVfsDBusMonitorClient *proxy;
-  
-  proxy = gvfs_dbus_monitor_client_proxy_new_finish (res, &error);
+  ChangedManyData *data;
+  GVariantBuilder builder;
+  QueuedEvent *event;
+  guint i;
+
+  proxy = subscriber_get_proxy (subscriber);
   if (proxy == NULL)
+    return;
+
+  if (events->len == 1 || subscriber->no_changed_many)
     {
-      g_printerr ("Error creating proxy: %s (%s, %d)\n",
-                  error->message, g_quark_to_string (error->domain), error->code);
-      g_error_free (error);
-      emit_event_data_free (data);
+      send_events_one_by_one (monitor, proxy, events);
       return;
     }
-  
-  gvfs_dbus_monitor_client_call_changed (proxy,
-                                         data->event_type,
-                                         g_mount_spec_to_dbus (data->monitor->priv->mount_spec),
-                                         data->file_path,
-                                         g_mount_spec_to_dbus (data->monitor->priv->mount_spec),
-                                         data->other_file_path ? data->other_file_path : "",
-                                         NULL,
-                                         (GAsyncReadyCallback) changed_cb,
-                                         data);
-  g_object_unref (proxy);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uayay)"));
+  for (i = 0; i < events->len; i++)
+    {
+      event = g_ptr_array_index (events, i);
+      g_variant_builder_add (&builder, "(u^ay^ay)",
+                             event->event_type,
+                             event->file_path,
+                             event->other_file_path ? event->other_file_path : "");
+    }
+
+  data = g_new0 (ChangedManyData, 1);
+  data->monitor = g_object_ref (monitor);
+  data->events = g_ptr_array_ref (events);
+
+  gvfs_dbus_monitor_client_call_changed_many (proxy,
+                                              g_mount_spec_to_dbus (monitor->priv->mount_spec),
+                                              g_variant_builder_end (&builder),
+                                              NULL,
+                                              (GAsyncReadyCallback) changed_many_cb,
+                                              data);
+}
+
+static gboolean
+flush_events (gpointer user_data)
+{
+  GVfsMonitor *monitor = user_data;
+  GPtrArray *events;
+  QueuedEvent *event;
+  GList *l;
+
+  g_mutex_lock (&monitor->priv->queue_lock);
+  monitor->priv->flush_timeout = 0;
+  g_hash_table_remove_all (monitor->priv->last_event_for_path);
+
+  while (!g_queue_is_empty (monitor->priv->events))
+    {
+      events = g_ptr_array_new_with_free_func ((GDestroyNotify)queued_event_free);
+      while (events->len < MAX_EVENTS_PER_MESSAGE &&
+             (event = g_queue_pop_head (monitor->priv->events)) != NULL)
+        g_ptr_array_add (events, event);
+      g_mutex_unlock (&monitor->priv->queue_lock);
+
+      for (l = monitor->priv->subscribers; l != NULL; l = l->next)
+        send_events (monitor, l->data, events);
+      g_ptr_array_unref (events);
+
+      g_mutex_lock (&monitor->priv->queue_lock);
+    }
+
+  g_mutex_unlock (&monitor->priv->queue_lock);
+
+  return FALSE;
+}
+
+/* Another CHANGED or ATTRIBUTE_CHANGED for a file that is still waiting
+   to be sent, with nothing else happening to it in between, carries no
+   new information */
+static gboolean
+event_is_redundant (GVfsMonitor       *monitor,
+                    GFileMonitorEvent  event_type,
+                    const char        *file_path,
+                    const char        *other_file_path)
+{
+  QueuedEvent *last;
+
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGED &&
+      event_type != G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return FALSE;
+
+  if (other_file_path != NULL)
+    return FALSE;
+
+  last = g_hash_table_lookup (monitor->priv->last_event_for_path, file_path);
+  return last != NULL &&
+    last->event_type == event_type &&
+    last->other_file_path == NULL;
 }
 
 void
@@ -341,27 +527,35 @@ g_vfs_monitor_emit_event (GVfsMonitor       *monitor,
 			  const char        *file_path,
 			  const char        *other_file_path)
 {
-  GList *l;
-  Subscriber *subscriber;
+  QueuedEvent *event;
 
-  for (l = monitor->priv->subscribers; l != NULL; l = l->next)
-    {
-      EmitEventData *data;
-      
-      subscriber = l->data;
+  if (monitor->priv->subscribers == NULL)
+    return;
+
+  g_mutex_lock (&monitor->priv->queue_lock);
 
-      data = g_new0 (EmitEventData, 1);
-      data->monitor = g_object_ref (monitor);
-      data->event_type = event_type;
-      data->file_path = g_strdup (file_path);
-      data->other_file_path = g_strdup (other_file_path);
-
-      gvfs_dbus_monitor_client_proxy_new (subscriber->connection,
-                                          G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
-                                          subscriber->id,
-                                          subscriber->object_path,
-                                          NULL,
-                                          (GAsyncReadyCallback) got_proxy_cb,
-                                          data);
+  if (!event_is_redundant (monitor, event_type, file_path, other_file_path))
+    {
+      event = g_new0 (QueuedEvent, 1);
+      event->event_type = event_type;
+      event->file_path = g_strdup (file_path);
+      event->other_file_path = g_strdup (other_file_path);
+
+      g_queue_push_tail (monitor->priv->events, event);
+      g_hash_table_insert (monitor->priv->last_event_for_path,
+                           event->file_path, event);
+      if (event->other_file_path)
+        g_hash_table_insert (monitor->priv->last_event_for_path,
+                             event->other_file_path, event);
+
+      if (monitor->priv->flush_timeout == 0)
+        monitor->priv->flush_timeout =
+          g_timeout_add_full (G_PRIORITY_DEFAULT,
+                              event_delay_ms,
+                              flush_events,
+                              g_object_ref (monitor),
+                              g_object_unref);
     }
+
+  g_mutex_unlock (&monitor->priv->queue_lock);
 }
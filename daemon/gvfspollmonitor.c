@@ -0,0 +1,381 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gvfspollmonitor.h>
+
+/* Poll intervals in milliseconds */
+#define POLL_INITIAL_INTERVAL 5000
+#define POLL_MIN_INTERVAL     2000
+#define POLL_MAX_INTERVAL     60000
+
+/* Synchronous listings run on this many shared threads */
+#define POLL_MAX_THREADS 2
+
+struct _GVfsPollMonitor
+{
+  volatile gint ref_count;
+
+  GVfsBackend *backend; /* only reffed while a listing runs */
+  GVfsMonitor *monitor; /* weak ref */
+  char *path;
+
+  GVfsPollMonitorListFunc list_func;
+  GVfsPollMonitorListSyncFunc list_sync_func;
+
+  GHashTable *snapshot; /* name -> fingerprint, NULL before first listing */
+  guint interval;
+  guint timeout_id;
+  volatile gint dead; /* also read by the listing threads */
+};
+
+typedef struct {
+  GVfsPollMonitor *poll;
+  GList *infos;
+  GError *error;
+} ListResult;
+
+static GThreadPool *list_thread_pool = NULL;
+G_LOCK_DEFINE_STATIC (list_thread_pool);
+
+static void poll_monitor_start_listing (GVfsPollMonitor *poll);
+
+static GVfsPollMonitor *
+poll_monitor_ref (GVfsPollMonitor *poll)
+{
+  g_atomic_int_inc (&poll->ref_count);
+  return poll;
+}
+
+static void
+poll_monitor_unref (GVfsPollMonitor *poll)
+{
+  if (!g_atomic_int_dec_and_test (&poll->ref_count))
+    return;
+
+  if (poll->snapshot)
+    g_hash_table_destroy (poll->snapshot);
+  g_free (poll->path);
+  g_free (poll);
+}
+
+static void
+poll_monitor_destroyed (gpointer user_data,
+                        GObject *where_the_object_was)
+{
+  GVfsPollMonitor *poll = user_data;
+
+  poll->monitor = NULL;
+  g_atomic_int_set (&poll->dead, TRUE);
+  if (poll->timeout_id)
+    {
+      g_source_remove (poll->timeout_id);
+      poll->timeout_id = 0;
+    }
+
+  poll_monitor_unref (poll);
+}
+
+/* Anything that is different in here is reported as a change */
+static char *
+get_fingerprint (GFileInfo *info)
+{
+  const char *etag;
+
+  etag = g_file_info_get_etag (info);
+
+  return g_strdup_printf ("%d:%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%u:%s",
+                          g_file_info_get_file_type (info),
+                          g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE),
+                          g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                          g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+                          etag ? etag : "");
+}
+
+static GHashTable *
+snapshot_from_infos (GList *infos)
+{
+  GHashTable *snapshot;
+  const char *name;
+  GList *l;
+
+  snapshot = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  for (l = infos; l != NULL; l = l->next)
+    {
+      name = g_file_info_get_name (l->data);
+      if (name == NULL ||
+          strcmp (name, ".") == 0 ||
+          strcmp (name, "..") == 0)
+        continue;
+
+      g_hash_table_replace (snapshot, g_strdup (name), get_fingerprint (l->data));
+    }
+
+  return snapshot;
+}
+
+static void
+emit_event (GVfsPollMonitor  *poll,
+            GFileMonitorEvent event_type,
+            const char       *name)
+{
+  char *path;
+
+  path = g_build_filename (poll->path, name, NULL);
+  g_vfs_monitor_emit_event (poll->monitor, event_type, path, NULL);
+  g_free (path);
+}
+
+/* Emits the differences between the old and the new snapshot,
+   returns the number of changes */
+static guint
+emit_changes (GVfsPollMonitor *poll,
+              GHashTable      *old_snapshot,
+              GHashTable      *new_snapshot)
+{
+  GHashTableIter iter;
+  const char *name, *fingerprint, *old_fingerprint;
+  guint n_changes;
+
+  n_changes = 0;
+
+  g_hash_table_iter_init (&iter, old_snapshot);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, NULL))
+    {
+      if (!g_hash_table_contains (new_snapshot, name))
+        {
+          emit_event (poll, G_FILE_MONITOR_EVENT_DELETED, name);
+          n_changes++;
+        }
+    }
+
+  g_hash_table_iter_init (&iter, new_snapshot);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&fingerprint))
+    {
+      old_fingerprint = g_hash_table_lookup (old_snapshot, name);
+      if (old_fingerprint == NULL)
+        {
+          emit_event (poll, G_FILE_MONITOR_EVENT_CREATED, name);
+          n_changes++;
+        }
+      else if (strcmp (old_fingerprint, fingerprint) != 0)
+        {
+          emit_event (poll, G_FILE_MONITOR_EVENT_CHANGED, name);
+          emit_event (poll, G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT, name);
+          n_changes++;
+        }
+    }
+
+  return n_changes;
+}
+
+static gboolean
+poll_timeout (gpointer user_data)
+{
+  GVfsPollMonitor *poll = user_data;
+
+  poll->timeout_id = 0;
+  poll_monitor_start_listing (poll);
+
+  return FALSE;
+}
+
+static gboolean
+list_done_idle (gpointer user_data)
+{
+  ListResult *result = user_data;
+  GVfsPollMonitor *poll = result->poll;
+  GHashTable *snapshot;
+  guint n_changes;
+
+  if (g_atomic_int_get (&poll->dead))
+    goto out;
+
+  if (result->error)
+    {
+      g_debug ("poll monitor: listing %s failed: %s\n", poll->path, result->error->message);
+      poll->interval = MIN (poll->interval * 2, POLL_MAX_INTERVAL);
+    }
+  else
+    {
+      snapshot = snapshot_from_infos (result->infos);
+
+      n_changes = 0;
+      if (poll->snapshot)
+        {
+          n_changes = emit_changes (poll, poll->snapshot, snapshot);
+          g_hash_table_destroy (poll->snapshot);
+        }
+      poll->snapshot = snapshot;
+
+      /* Busy directories are polled more often, quiet ones less */
+      if (n_changes > 0)
+        poll->interval = MAX (poll->interval / 2, POLL_MIN_INTERVAL);
+      else
+        poll->interval = MIN (poll->interval + poll->interval / 2, POLL_MAX_INTERVAL);
+    }
+
+  poll->timeout_id = g_timeout_add (poll->interval, poll_timeout, poll);
+
+ out:
+  g_list_free_full (result->infos, g_object_unref);
+  if (result->error)
+    g_error_free (result->error);
+  g_object_unref (poll->backend);
+  poll_monitor_unref (poll);
+  g_free (result);
+
+  return FALSE;
+}
+
+/**
+ * g_vfs_poll_monitor_list_done:
+ * @poll: the poll monitor passed to the list function
+ * @infos: (transfer full): the children of the directory
+ * @error: (transfer full): error or %NULL
+ *
+ * Finishes a listing started by a #GVfsPollMonitorListFunc. May be
+ * called from any thread.
+ */
+void
+g_vfs_poll_monitor_list_done (GVfsPollMonitor *poll,
+                              GList           *infos,
+                              GError          *error)
+{
+  ListResult *result;
+
+  result = g_new0 (ListResult, 1);
+  result->poll = poll;
+  result->infos = infos;
+  result->error = error;
+
+  g_idle_add (list_done_idle, result);
+}
+
+static void
+list_thread_func (gpointer data,
+                  gpointer user_data)
+{
+  GVfsPollMonitor *poll = data;
+  GError *error;
+  GList *infos;
+
+  /* The monitor went away while we were queued */
+  if (g_atomic_int_get (&poll->dead))
+    {
+      g_vfs_poll_monitor_list_done (poll, NULL, NULL);
+      return;
+    }
+
+  error = NULL;
+  infos = poll->list_sync_func (poll->backend, poll->path, &error);
+
+  g_vfs_poll_monitor_list_done (poll, infos, error);
+}
+
+static void
+poll_monitor_start_listing (GVfsPollMonitor *poll)
+{
+  /* Released in list_done_idle, the backend may be unmounted while
+     the listing runs */
+  poll_monitor_ref (poll);
+  g_object_ref (poll->backend);
+
+  if (poll->list_func)
+    {
+      poll->list_func (poll->backend, poll->path, poll);
+      return;
+    }
+
+  G_LOCK (list_thread_pool);
+  if (list_thread_pool == NULL)
+    list_thread_pool = g_thread_pool_new (list_thread_func, NULL,
+                                          POLL_MAX_THREADS, FALSE, NULL);
+  G_UNLOCK (list_thread_pool);
+
+  g_thread_pool_push (list_thread_pool, poll, NULL);
+}
+
+static GVfsMonitor *
+poll_monitor_new (GVfsBackend                 *backend,
+                  const char                  *path,
+                  GVfsPollMonitorListFunc      list_func,
+                  GVfsPollMonitorListSyncFunc  list_sync_func)
+{
+  GVfsPollMonitor *poll;
+
+  poll = g_new0 (GVfsPollMonitor, 1);
+  poll->ref_count = 1; /* Owned by the GVfsMonitor */
+  poll->backend = backend;
+  poll->path = g_strdup (path);
+  poll->list_func = list_func;
+  poll->list_sync_func = list_sync_func;
+  poll->interval = POLL_INITIAL_INTERVAL;
+
+  poll->monitor = g_vfs_monitor_new (backend);
+  g_object_weak_ref (G_OBJECT (poll->monitor), poll_monitor_destroyed, poll);
+
+  /* The first listing is the baseline, it emits no events */
+  poll_monitor_start_listing (poll);
+
+  return poll->monitor;
+}
+
+/**
+ * g_vfs_poll_monitor_new:
+ * @backend: the backend
+ * @path: the directory to watch
+ * @list_func: function that starts listing the directory
+ *
+ * Returns: (transfer full): a #GVfsMonitor for @path, polling stops
+ *     when it is finalized
+ */
+GVfsMonitor *
+g_vfs_poll_monitor_new (GVfsBackend             *backend,
+                        const char              *path,
+                        GVfsPollMonitorListFunc  list_func)
+{
+  return poll_monitor_new (backend, path, list_func, NULL);
+}
+
+/**
+ * g_vfs_poll_monitor_new_sync:
+ * @backend: the backend
+ * @path: the directory to watch
+ * @list_func: blocking function that lists the directory
+ *
+ * Like g_vfs_poll_monitor_new(), for backends that can list a
+ * directory synchronously from any thread.
+ *
+ * Returns: (transfer full): a #GVfsMonitor for @path
+ */
+GVfsMonitor *
+g_vfs_poll_monitor_new_sync (GVfsBackend                 *backend,
+                             const char                  *path,
+                             GVfsPollMonitorListSyncFunc  list_func)
+{
+  return poll_monitor_new (backend, path, NULL, list_func);
+}
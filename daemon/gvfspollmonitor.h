@@ -0,0 +1,62 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __G_VFS_POLL_MONITOR_H__
+#define __G_VFS_POLL_MONITOR_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gvfsbackend.h>
+#include <gvfsmonitor.h>
+
+G_BEGIN_DECLS
+
+/* A directory monitor for backends without change notification. It
+ * periodically lists the directory, compares the listing with the
+ * previous one and emits the differences on a GVfsMonitor. The poll
+ * interval shrinks while the directory changes and grows while it is
+ * quiet. Polling stops when the last client unsubscribes.
+ */
+typedef struct _GVfsPollMonitor GVfsPollMonitor;
+
+/* Starts listing path, must eventually call g_vfs_poll_monitor_list_done().
+   Called on the main thread. */
+typedef void    (*GVfsPollMonitorListFunc)     (GVfsBackend      *backend,
+                                                const char       *path,
+                                                GVfsPollMonitor  *poll);
+
+/* Lists path, returning a list of GFileInfos. Called on a worker thread. */
+typedef GList * (*GVfsPollMonitorListSyncFunc) (GVfsBackend      *backend,
+                                                const char       *path,
+                                                GError          **error);
+
+GVfsMonitor *g_vfs_poll_monitor_new        (GVfsBackend                 *backend,
+                                            const char                  *path,
+                                            GVfsPollMonitorListFunc      list_func);
+GVfsMonitor *g_vfs_poll_monitor_new_sync   (GVfsBackend                 *backend,
+                                            const char                  *path,
+                                            GVfsPollMonitorListSyncFunc  list_func);
+void         g_vfs_poll_monitor_list_done  (GVfsPollMonitor             *poll,
+                                            GList                       *infos,
+                                            GError                      *error);
+
+G_END_DECLS
+
+#endif /* __G_VFS_POLL_MONITOR_H__ */
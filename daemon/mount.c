@@ -23,8 +23,10 @@
 #include <config.h>
 
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/types.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -51,6 +53,10 @@ typedef struct {
 
   /* Mount details */
   GMountSpec *mount_spec;
+  char *spec_key; /* Key in mounts_by_spec */
+
+  /* Cached vfs_mount_to_dbus() result */
+  GVariant *dbus_value;
 } VfsMount;
 
 typedef struct  {
@@ -62,6 +68,8 @@ typedef struct  {
   char **scheme_aliases;
   int default_port;
   gboolean hostname_is_inet;
+  int prespawn; /* Idle processes to keep around for spawning */
+  int mounts_per_process; /* Mounts sharing one spawned process */
 } VfsMountable; 
 
 typedef void (*MountCallback) (VfsMountable *mountable,
@@ -71,8 +79,24 @@ typedef void (*MountCallback) (VfsMountable *mountable,
 static GList *mountables = NULL;
 static GList *mounts = NULL;
 
+/* Indexes into the lists above. Lookups happen for every file a
+   client touches, so they must not walk all mounts. */
+static GHashTable *mountables_by_type = NULL; /* type -> VfsMountable */
+static GHashTable *mounts_by_object = NULL;   /* "dbus_id object_path" -> VfsMount */
+static GHashTable *mounts_by_spec = NULL;     /* spec items -> GList of VfsMount, newest first */
+static GHashTable *mounts_by_fuse_path = NULL; /* fuse mountpoint -> VfsMount */
+static GHashTable *pending_mounts = NULL;     /* dbus_id -> number of mounts in progress */
+
+/* Cached ListMounts reply, NULL when out of date */
+static GVariant *list_mounts_reply = NULL;
+
 static gboolean fuse_available;
 
+/* Pre-spawned idle backend processes, see backend_pool_take() */
+static GList *backend_pool = NULL;
+static guint backend_pool_timeout = 0;
+static gboolean backend_pool_disabled = FALSE;
+
 static GVfsDBusMountTracker *mount_tracker = NULL;
 
 
@@ -81,53 +105,85 @@ static void lookup_mount (GVfsDBusMountTracker *object,
                           GMountSpec *spec,
                           gboolean do_automount);
 
+static char *
+object_key (const char *dbus_id,
+            const char *obj_path)
+{
+  /* Neither bus names nor object paths contain spaces */
+  return g_strconcat (dbus_id, " ", obj_path, NULL);
+}
+
+/* Two specs have the same key exactly when their items are equal,
+   the mount prefix is not part of it */
+static char *
+spec_key (GMountSpec *spec)
+{
+  GString *key;
+  int i;
+
+  key = g_string_new (NULL);
+  for (i = 0; i < spec->items->len; i++)
+    {
+      GMountSpecItem *item = &g_array_index (spec->items, GMountSpecItem, i);
+
+      g_string_append_uri_escaped (key, item->key, NULL, TRUE);
+      g_string_append_c (key, '=');
+      g_string_append_uri_escaped (key, item->value, NULL, TRUE);
+      g_string_append_c (key, ',');
+    }
+
+  return g_string_free (key, FALSE);
+}
+
 static VfsMount *
 find_vfs_mount (const char *dbus_id,
 		const char *obj_path)
 {
-  GList *l;
-  for (l = mounts; l != NULL; l = l->next)
-    {
-      VfsMount *mount = l->data;
+  VfsMount *mount;
+  char *key;
 
-      if (strcmp (mount->dbus_id, dbus_id) == 0 &&
-	  strcmp (mount->object_path, obj_path) == 0)
-	return mount;
-    }
+  key = object_key (dbus_id, obj_path);
+  mount = g_hash_table_lookup (mounts_by_object, key);
+  g_free (key);
   
-  return NULL;
+  return mount;
 }
 
 static VfsMount *
 find_vfs_mount_by_fuse_path (const char *fuse_path)
 {
-  GList *l;
+  VfsMount *mount;
+  char *path, *p;
 
   if (!fuse_available)
     return NULL;
-  
-  for (l = mounts; l != NULL; l = l->next)
-    {
-      VfsMount *mount = l->data;
 
-      if (mount->fuse_mountpoint != NULL &&
-	  g_str_has_prefix (fuse_path, mount->fuse_mountpoint))
-	{
-	  int len = strlen (mount->fuse_mountpoint);
-	  if (fuse_path[len] == 0 ||
-	      fuse_path[len] == '/')
-	    return mount;
-	}
+  /* Try every prefix of the path that ends at a directory boundary,
+     mountpoints never nest so at most one can match */
+  path = g_strdup (fuse_path);
+  mount = g_hash_table_lookup (mounts_by_fuse_path, path);
+  while (mount == NULL && (p = strrchr (path, '/')) != NULL && p != path)
+    {
+      *p = 0;
+      mount = g_hash_table_lookup (mounts_by_fuse_path, path);
     }
+  g_free (path);
   
-  return NULL;
+  return mount;
 }
 
 static VfsMount *
 match_vfs_mount (GMountSpec *match)
 {
   GList *l;
-  for (l = mounts; l != NULL; l = l->next)
+  char *key;
+
+  key = spec_key (match);
+  l = g_hash_table_lookup (mounts_by_spec, key);
+  g_free (key);
+
+  /* Only mounts with different prefixes share a bucket */
+  for (; l != NULL; l = l->next)
     {
       VfsMount *mount = l->data;
 
@@ -141,17 +197,7 @@ match_vfs_mount (GMountSpec *match)
 static VfsMountable *
 find_mountable (const char *type)
 {
-  GList *l;
-
-  for (l = mountables; l != NULL; l = l->next)
-    {
-      VfsMountable *mountable = l->data;
-
-      if (strcmp (mountable->type, type) == 0)
-	return mountable;
-    }
-  
-  return NULL;
+  return g_hash_table_lookup (mountables_by_type, type);
 }
 
 static VfsMountable *
@@ -192,7 +238,10 @@ vfs_mount_free (VfsMount *mount)
   g_free (mount->default_location);
   g_free (mount->dbus_id);
   g_free (mount->object_path);
+  g_free (mount->spec_key);
   g_mount_spec_unref (mount->mount_spec);
+  if (mount->dbus_value)
+    g_variant_unref (mount->dbus_value);
 
   g_free (mount);
 }
@@ -219,6 +268,15 @@ vfs_mount_to_dbus (VfsMount *mount)
                         mount->default_location ? mount->default_location : "");
 }
 
+static GVariant *
+vfs_mount_get_dbus_value (VfsMount *mount)
+{
+  if (mount->dbus_value == NULL)
+    mount->dbus_value = g_variant_ref_sink (vfs_mount_to_dbus (mount));
+
+  return mount->dbus_value;
+}
+
 static GVariant *
 vfs_mountable_to_dbus (VfsMountable *mountable)
 {
@@ -248,13 +306,43 @@ typedef struct {
   char *obj_path;
   gboolean spawned;
   GVfsDBusSpawner *spawner;
+  char *dbus_id; /* Process the mount request was sent to */
 } MountData;
 
 static void spawn_mount (MountData *data);
 
+static void
+pending_mount_begin (MountData *data, const char *dbus_id)
+{
+  int count;
+
+  data->dbus_id = g_strdup (dbus_id);
+  count = GPOINTER_TO_INT (g_hash_table_lookup (pending_mounts, dbus_id));
+  g_hash_table_insert (pending_mounts, g_strdup (dbus_id), GINT_TO_POINTER (count + 1));
+}
+
+static void
+pending_mount_end (MountData *data)
+{
+  int count;
+
+  if (data->dbus_id == NULL)
+    return;
+
+  count = GPOINTER_TO_INT (g_hash_table_lookup (pending_mounts, data->dbus_id));
+  if (count > 1)
+    g_hash_table_insert (pending_mounts, g_strdup (data->dbus_id), GINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (pending_mounts, data->dbus_id);
+
+  g_free (data->dbus_id);
+  data->dbus_id = NULL;
+}
+
 static void
 mount_data_free (MountData *data)
 {
+  pending_mount_end (data);
   g_object_unref (data->source);
   g_mount_spec_unref (data->mount_spec);
   g_free (data->obj_path);
@@ -336,6 +424,11 @@ static void
 mountable_mount_with_name (MountData *data,
 			   const char *dbus_name)
 {
+  /* Counted against the process until the mount finishes, so that
+     concurrent requests don't exceed MountsPerProcess */
+  pending_mount_end (data);
+  pending_mount_begin (data, dbus_name);
+
   gvfs_dbus_mountable_proxy_new_for_bus (G_BUS_TYPE_SESSION,
                                          G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS | G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
                                          dbus_name,
@@ -432,6 +525,374 @@ spawn_mount (MountData *data)
     }
 }
 
+/************************************************************************
+ * Pool of pre-spawned backend processes                                *
+ ************************************************************************/
+
+/* Starting a backend process (loading modules, connecting to the bus,
+   registering the backends) dominates the time of the first access to
+   e.g. sftp:// or smb://. For mountables with a Prespawn key we keep
+   that many processes started but not yet mounted. They are spawned
+   like in spawn_mount(), and handed the mount spec through the normal
+   Mountable.Mount call when needed. Processes are keyed by exec line,
+   so types served by the same binary share them. */
+
+/* Seconds between checks for refilling or trimming the pool */
+#define BACKEND_POOL_CHECK_INTERVAL 30
+/* Idle processes are killed when less memory than this is available */
+#define BACKEND_POOL_MIN_AVAILABLE_PERCENT 10
+
+typedef struct {
+  char *exec;
+  GPid pid;
+  char *obj_path;
+  GVfsDBusSpawner *spawner;
+  char *dbus_id; /* NULL until the process reported being spawned */
+} PooledBackend;
+
+static void backend_pool_update (void);
+
+static void
+pooled_backend_free (PooledBackend *pooled)
+{
+  if (pooled->spawner)
+    {
+      g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (pooled->spawner));
+      g_object_unref (pooled->spawner);
+    }
+  g_free (pooled->exec);
+  g_free (pooled->obj_path);
+  g_free (pooled->dbus_id);
+  g_free (pooled);
+}
+
+/* Owns the PooledBackend, it lives as long as the process */
+static void
+pooled_backend_exited (GPid pid,
+                       gint status,
+                       gpointer user_data)
+{
+  PooledBackend *pooled = user_data;
+
+  /* Processes that died while idle are replaced on the next check,
+     not immediately, to avoid respawning a crashing binary in a loop */
+  backend_pool = g_list_remove (backend_pool, pooled);
+
+  g_spawn_close_pid (pid);
+  pooled_backend_free (pooled);
+}
+
+static gboolean
+pooled_backend_handle_spawned (GVfsDBusSpawner *object,
+                               GDBusMethodInvocation *invocation,
+                               gboolean arg_succeeded,
+                               const gchar *arg_error_message,
+                               gpointer user_data)
+{
+  PooledBackend *pooled = user_data;
+
+  /* On failure the process exits by itself */
+  if (arg_succeeded)
+    pooled->dbus_id = g_strdup (g_dbus_method_invocation_get_sender (invocation));
+  else
+    g_warning ("Error pre-spawning %s: %s", pooled->exec, arg_error_message);
+
+  gvfs_dbus_spawner_complete_spawned (object, invocation);
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (pooled->spawner));
+  g_clear_object (&pooled->spawner);
+
+  return TRUE;
+}
+
+static void
+backend_pool_spawn (const char *exec)
+{
+  PooledBackend *pooled;
+  GDBusConnection *connection;
+  GError *error;
+  char **exec_argv, **argv;
+  int exec_argc, i;
+  static int pool_id = 0;
+
+  error = NULL;
+  if (!g_shell_parse_argv (exec, &exec_argc, &exec_argv, &error))
+    {
+      g_warning ("Error pre-spawning %s: %s", exec, error->message);
+      g_error_free (error);
+      return;
+    }
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  if (! connection)
+    {
+      g_warning ("Error pre-spawning %s: %s", exec, error->message);
+      g_error_free (error);
+      g_strfreev (exec_argv);
+      return;
+    }
+
+  pooled = g_new0 (PooledBackend, 1);
+  pooled->exec = g_strdup (exec);
+  pooled->obj_path = g_strdup_printf ("/org/gtk/gvfs/exec_spaw/pool%d", pool_id++);
+  pooled->spawner = gvfs_dbus_spawner_skeleton_new ();
+  g_signal_connect (pooled->spawner, "handle-spawned", G_CALLBACK (pooled_backend_handle_spawned), pooled);
+
+  argv = g_new0 (char *, exec_argc + 4);
+  for (i = 0; i < exec_argc; i++)
+    argv[i] = exec_argv[i];
+  argv[i++] = "--spawner";
+  argv[i++] = (char *) g_dbus_connection_get_unique_name (connection);
+  argv[i++] = pooled->obj_path;
+
+  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (pooled->spawner),
+                                         connection,
+                                         pooled->obj_path,
+                                         &error) ||
+      !g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                      NULL, NULL,
+                      &pooled->pid, &error))
+    {
+      g_warning ("Error pre-spawning %s: %s", exec, error->message);
+      g_error_free (error);
+      pooled_backend_free (pooled);
+    }
+  else
+    {
+      g_child_watch_add (pooled->pid, pooled_backend_exited, pooled);
+      backend_pool = g_list_prepend (backend_pool, pooled);
+    }
+
+  g_free (argv);
+  g_strfreev (exec_argv);
+  g_object_unref (connection);
+}
+
+/* Removes the process from the pool, it exits as it has no mounts.
+   The PooledBackend itself is freed when the exit is noticed. */
+static void
+backend_pool_kill (PooledBackend *pooled)
+{
+  backend_pool = g_list_remove (backend_pool, pooled);
+  kill (pooled->pid, SIGTERM);
+}
+
+static gboolean
+backend_pool_memory_is_low (void)
+{
+  char *contents, *p;
+  guint64 total, available;
+
+  if (!g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+    return FALSE;
+
+  total = available = 0;
+  if ((p = strstr (contents, "MemTotal:")) != NULL)
+    total = g_ascii_strtoull (p + strlen ("MemTotal:"), NULL, 10);
+  if ((p = strstr (contents, "MemAvailable:")) != NULL)
+    available = g_ascii_strtoull (p + strlen ("MemAvailable:"), NULL, 10);
+  g_free (contents);
+
+  /* Older kernels don't have MemAvailable */
+  if (total == 0 || p == NULL)
+    return FALSE;
+
+  return available * 100 < total * BACKEND_POOL_MIN_AVAILABLE_PERCENT;
+}
+
+/* Number of idle processes wanted for the exec line */
+static int
+backend_pool_target (const char *exec)
+{
+  GList *l;
+  int target;
+
+  target = 0;
+  for (l = mountables; l != NULL; l = l->next)
+    {
+      VfsMountable *mountable = l->data;
+
+      if (mountable->exec != NULL &&
+          mountable->dbus_name == NULL &&
+          strcmp (mountable->exec, exec) == 0)
+        target = MAX (target, mountable->prespawn);
+    }
+
+  return target;
+}
+
+static int
+backend_pool_count (const char *exec)
+{
+  GList *l;
+  int count;
+
+  count = 0;
+  for (l = backend_pool; l != NULL; l = l->next)
+    {
+      PooledBackend *pooled = l->data;
+
+      if (strcmp (pooled->exec, exec) == 0)
+        count++;
+    }
+
+  return count;
+}
+
+/* Brings the pool in line with the configuration and memory situation */
+static void
+backend_pool_update (void)
+{
+  GList *l, *next;
+  gboolean low_memory;
+  int count;
+
+  if (backend_pool_disabled)
+    return;
+
+  low_memory = backend_pool_memory_is_low ();
+
+  for (l = backend_pool; l != NULL; l = next)
+    {
+      PooledBackend *pooled = l->data;
+      next = l->next;
+
+      if (low_memory ||
+          backend_pool_count (pooled->exec) > backend_pool_target (pooled->exec))
+        backend_pool_kill (pooled);
+    }
+
+  if (low_memory)
+    return;
+
+  for (l = mountables; l != NULL; l = l->next)
+    {
+      VfsMountable *mountable = l->data;
+
+      if (mountable->prespawn <= 0 || mountable->exec == NULL || mountable->dbus_name != NULL)
+        continue;
+
+      count = backend_pool_count (mountable->exec);
+      while (count++ < backend_pool_target (mountable->exec))
+        backend_pool_spawn (mountable->exec);
+    }
+}
+
+static gboolean
+backend_pool_timeout_cb (gpointer user_data)
+{
+  backend_pool_update ();
+  return TRUE;
+}
+
+/* Returns the dbus id of an idle process for the mountable, or NULL */
+static char *
+backend_pool_take (VfsMountable *mountable)
+{
+  GList *l;
+  char *dbus_id;
+
+  if (mountable->exec == NULL)
+    return NULL;
+
+  for (l = backend_pool; l != NULL; l = l->next)
+    {
+      PooledBackend *pooled = l->data;
+
+      if (pooled->dbus_id != NULL &&
+          strcmp (pooled->exec, mountable->exec) == 0)
+        {
+          dbus_id = g_strdup (pooled->dbus_id);
+          backend_pool = g_list_delete_link (backend_pool, l);
+
+          /* Start a replacement right away */
+          backend_pool_update ();
+
+          return dbus_id;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+backend_pool_init (void)
+{
+  if (g_getenv ("GVFS_DISABLE_PRESPAWN") != NULL)
+    {
+      backend_pool_disabled = TRUE;
+      return;
+    }
+
+  backend_pool_timeout = g_timeout_add_seconds (BACKEND_POOL_CHECK_INTERVAL,
+                                                backend_pool_timeout_cb, NULL);
+  backend_pool_update ();
+}
+
+static void
+backend_pool_finalize (void)
+{
+  if (backend_pool_timeout != 0)
+    {
+      g_source_remove (backend_pool_timeout);
+      backend_pool_timeout = 0;
+    }
+
+  while (backend_pool != NULL)
+    backend_pool_kill (backend_pool->data);
+}
+
+/* Returns the dbus id of a running process of the mountable that
+   hosts fewer than MountsPerProcess mounts, counting the ones still
+   being mounted, or NULL. Mounts sharing
+   a process also share its fate if it crashes, so the key bounds how
+   many mounts a crash takes down. */
+static char *
+find_shared_process (VfsMountable *mountable)
+{
+  GHashTable *counts;
+  GList *l;
+  char *dbus_id;
+  int count;
+
+  if (mountable->mounts_per_process <= 1 || mountable->exec == NULL)
+    return NULL;
+
+  dbus_id = NULL;
+  counts = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Oldest first, so processes fill up in the order they were started */
+  for (l = g_list_last (mounts); l != NULL; l = l->prev)
+    {
+      VfsMount *mount = l->data;
+      VfsMountable *other;
+
+      other = lookup_mountable (mount->mount_spec);
+      if (other == NULL || other->exec == NULL || other->dbus_name != NULL ||
+          strcmp (other->exec, mountable->exec) != 0)
+        continue;
+
+      count = GPOINTER_TO_INT (g_hash_table_lookup (counts, mount->dbus_id)) + 1;
+      g_hash_table_insert (counts, mount->dbus_id, GINT_TO_POINTER (count));
+    }
+
+  for (l = g_list_last (mounts); l != NULL && dbus_id == NULL; l = l->prev)
+    {
+      VfsMount *mount = l->data;
+
+      count = GPOINTER_TO_INT (g_hash_table_lookup (counts, mount->dbus_id));
+      if (count > 0)
+        count += GPOINTER_TO_INT (g_hash_table_lookup (pending_mounts, mount->dbus_id));
+      if (count > 0 && count < mountable->mounts_per_process)
+        dbus_id = g_strdup (mount->dbus_id);
+    }
+
+  g_hash_table_destroy (counts);
+
+  return dbus_id;
+}
+
 static void
 mountable_mount (VfsMountable *mountable,
 		 GMountSpec *mount_spec,
@@ -441,6 +902,7 @@ mountable_mount (VfsMountable *mountable,
 		 gpointer user_data)
 {
   MountData *data;
+  char *dbus_id;
 
   data = g_new0 (MountData, 1);
   data->automount = automount;
@@ -450,10 +912,18 @@ mountable_mount (VfsMountable *mountable,
   data->callback = callback;
   data->user_data = user_data;
 
-  if (mountable->dbus_name == NULL)
-    spawn_mount (data);
-  else
+  if (mountable->dbus_name != NULL)
     mountable_mount_with_name (data, mountable->dbus_name);
+  else if ((dbus_id = find_shared_process (mountable)) != NULL ||
+           (dbus_id = backend_pool_take (mountable)) != NULL)
+    {
+      /* If the process went away meanwhile dbus_mount_reply()
+         falls back to spawn_mount() */
+      mountable_mount_with_name (data, dbus_id);
+      g_free (dbus_id);
+    }
+  else
+    spawn_mount (data);
 }
 
 static void
@@ -465,8 +935,12 @@ read_mountable_config (void)
   GKeyFile *keyfile;
   char **types;
   VfsMountable *mountable;
+  const char *mounts_per_process_override;
   int i;
   
+  /* For measuring, see test/measure-mount-rss.sh */
+  mounts_per_process_override = g_getenv ("GVFS_MOUNTS_PER_PROCESS");
+
   mount_dir = MOUNTABLE_DIR;
   dir = g_dir_open (mount_dir, 0, NULL);
 
@@ -496,11 +970,19 @@ read_mountable_config (void)
 			    g_key_file_get_string_list (keyfile, "Mount", "SchemeAliases", NULL, NULL);
 			  mountable->default_port = g_key_file_get_integer (keyfile, "Mount", "DefaultPort", NULL);
 			  mountable->hostname_is_inet = g_key_file_get_boolean (keyfile, "Mount", "HostnameIsInetAddress", NULL);
+			  mountable->prespawn = g_key_file_get_integer (keyfile, "Mount", "Prespawn", NULL);
+			  mountable->mounts_per_process = g_key_file_get_integer (keyfile, "Mount", "MountsPerProcess", NULL);
+			  /* Only types known to cope with sharing a process */
+			  if (mounts_per_process_override != NULL &&
+			      g_key_file_has_key (keyfile, "Mount", "MountsPerProcess", NULL))
+			    mountable->mounts_per_process = atoi (mounts_per_process_override);
 
 			  if (mountable->scheme == NULL)
 			    mountable->scheme = g_strdup (mountable->type);
 			  
 			  mountables = g_list_prepend (mountables, mountable);
+			  /* Like the list, later files win */
+			  g_hash_table_replace (mountables_by_type, mountable->type, mountable);
 			}
 		    }
 		  g_strfreev (types);
@@ -516,11 +998,13 @@ read_mountable_config (void)
 static void
 re_read_mountable_config (void)
 {
+  g_hash_table_remove_all (mountables_by_type);
   g_list_foreach (mountables, (GFunc)vfs_mountable_free, NULL);
   g_list_free (mountables);
   mountables = NULL;
 
   read_mountable_config ();
+  backend_pool_update ();
 }
 
 /************************************************************************
@@ -532,9 +1016,103 @@ signal_mounted_unmounted (VfsMount *mount,
 			  gboolean mounted)
 {
   if (mounted)
-    gvfs_dbus_mount_tracker_emit_mounted (mount_tracker, vfs_mount_to_dbus (mount));
+    gvfs_dbus_mount_tracker_emit_mounted (mount_tracker, vfs_mount_get_dbus_value (mount));
+  else
+    gvfs_dbus_mount_tracker_emit_unmounted (mount_tracker, vfs_mount_get_dbus_value (mount));
+}
+
+static void
+invalidate_list_mounts_reply (void)
+{
+  if (list_mounts_reply)
+    {
+      g_variant_unref (list_mounts_reply);
+      list_mounts_reply = NULL;
+    }
+}
+
+/* For when something vfs_mount_to_dbus() depends on changes */
+static void
+invalidate_mount_replies (void)
+{
+  GList *l;
+
+  for (l = mounts; l != NULL; l = l->next)
+    {
+      VfsMount *mount = l->data;
+
+      if (mount->dbus_value)
+        {
+          g_variant_unref (mount->dbus_value);
+          mount->dbus_value = NULL;
+        }
+    }
+
+  invalidate_list_mounts_reply ();
+}
+
+static void
+add_mount (VfsMount *mount)
+{
+  GList *bucket;
+
+  mounts = g_list_prepend (mounts, mount);
+
+  g_hash_table_insert (mounts_by_object,
+                       object_key (mount->dbus_id, mount->object_path),
+                       mount);
+
+  mount->spec_key = spec_key (mount->mount_spec);
+  bucket = g_hash_table_lookup (mounts_by_spec, mount->spec_key);
+  g_hash_table_replace (mounts_by_spec, g_strdup (mount->spec_key),
+                        g_list_prepend (bucket, mount));
+
+  if (mount->fuse_mountpoint)
+    g_hash_table_replace (mounts_by_fuse_path, mount->fuse_mountpoint, mount);
+
+  invalidate_list_mounts_reply ();
+}
+
+static void
+remove_mount (VfsMount *mount)
+{
+  GList *bucket, *l;
+  char *key;
+
+  mounts = g_list_remove (mounts, mount);
+
+  key = object_key (mount->dbus_id, mount->object_path);
+  g_hash_table_remove (mounts_by_object, key);
+  g_free (key);
+
+  bucket = g_hash_table_lookup (mounts_by_spec, mount->spec_key);
+  bucket = g_list_remove (bucket, mount);
+  if (bucket)
+    g_hash_table_replace (mounts_by_spec, g_strdup (mount->spec_key), bucket);
   else
-    gvfs_dbus_mount_tracker_emit_unmounted (mount_tracker, vfs_mount_to_dbus (mount));
+    g_hash_table_remove (mounts_by_spec, mount->spec_key);
+
+  if (mount->fuse_mountpoint &&
+      g_hash_table_lookup (mounts_by_fuse_path, mount->fuse_mountpoint) == mount)
+    {
+      g_hash_table_remove (mounts_by_fuse_path, mount->fuse_mountpoint);
+
+      /* Stable names can clash, an older mount with the same
+         mountpoint takes over again */
+      for (l = mounts; l != NULL; l = l->next)
+        {
+          VfsMount *other = l->data;
+
+          if (other->fuse_mountpoint &&
+              strcmp (other->fuse_mountpoint, mount->fuse_mountpoint) == 0)
+            {
+              g_hash_table_insert (mounts_by_fuse_path, other->fuse_mountpoint, other);
+              break;
+            }
+        }
+    }
+
+  invalidate_list_mounts_reply ();
 }
 
 static void
@@ -552,8 +1130,8 @@ dbus_client_disconnected (const char *dbus_id)
 	{
 	  signal_mounted_unmounted (mount, FALSE);
 	  
+	  remove_mount (mount);
 	  vfs_mount_free (mount);
-	  mounts = g_list_delete_link (mounts, l);
 	}
     }
 }
@@ -636,7 +1214,7 @@ handle_register_mount (GVfsDBusMountTracker *object,
             mount->fuse_mountpoint = g_build_filename (g_get_user_runtime_dir(), "gvfs", fs_name, NULL);
         }
       
-      mounts = g_list_prepend (mounts, mount);
+      add_mount (mount);
 
       /* watch the mount for being disconnected */
       mount->name_watcher_id = g_bus_watch_name (G_BUS_TYPE_SESSION,
@@ -736,7 +1314,7 @@ lookup_mount (GVfsDBusMountTracker *object,
     maybe_automount (spec, object, invocation, do_automount);
   else
     gvfs_dbus_mount_tracker_complete_lookup_mount (object, invocation,
-                                                   vfs_mount_to_dbus (mount)); 
+                                                   vfs_mount_get_dbus_value (mount)); 
 }
 
 static gboolean 
@@ -780,7 +1358,7 @@ handle_lookup_mount_by_fuse_path (GVfsDBusMountTracker *object,
   else
     gvfs_dbus_mount_tracker_complete_lookup_mount_by_fuse_path (object,
                                                                 invocation,
-                                                                vfs_mount_to_dbus (mount));
+                                                                vfs_mount_get_dbus_value (mount));
   
   return TRUE;
 }
@@ -793,12 +1371,16 @@ handle_list_mounts (GVfsDBusMountTracker *object,
   GList *l;
   GVariantBuilder mounts_array;
 
-  g_variant_builder_init (&mounts_array, G_VARIANT_TYPE (VFS_MOUNT_ARRAY_DBUS_STRUCT_TYPE));
-  for (l = mounts; l != NULL; l = l->next)
-    g_variant_builder_add_value (&mounts_array, vfs_mount_to_dbus (l->data));
+  if (list_mounts_reply == NULL)
+    {
+      g_variant_builder_init (&mounts_array, G_VARIANT_TYPE (VFS_MOUNT_ARRAY_DBUS_STRUCT_TYPE));
+      for (l = mounts; l != NULL; l = l->next)
+        g_variant_builder_add_value (&mounts_array, vfs_mount_get_dbus_value (l->data));
+      list_mounts_reply = g_variant_ref_sink (g_variant_builder_end (&mounts_array));
+    }
   
   gvfs_dbus_mount_tracker_complete_list_mounts (object, invocation,
-                                                g_variant_builder_end (&mounts_array));
+                                                list_mounts_reply);
   
   return TRUE;
 }
@@ -923,7 +1505,12 @@ handle_register_fuse (GVfsDBusMountTracker *object,
                       GDBusMethodInvocation *invocation,
                       gpointer user_data)
 {
-  fuse_available = TRUE;
+  if (!fuse_available)
+    {
+      fuse_available = TRUE;
+      /* Mounts are sent with their fuse mountpoint from now on */
+      invalidate_mount_replies ();
+    }
   gvfs_dbus_mount_tracker_complete_register_fuse (object, invocation);
   
   return TRUE;
@@ -965,6 +1552,12 @@ mount_init (void)
   
   res = TRUE;
 
+  mountables_by_type = g_hash_table_new (g_str_hash, g_str_equal);
+  mounts_by_object = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  mounts_by_spec = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  mounts_by_fuse_path = g_hash_table_new (g_str_hash, g_str_equal);
+  pending_mounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   read_mountable_config ();
 
   if (pipe (reload_pipes) != -1)
@@ -1013,6 +1606,9 @@ mount_init (void)
       res = FALSE;
     }
   g_object_unref (conn);
+
+  if (res)
+    backend_pool_init ();
   
   return res;
 }
@@ -1020,6 +1616,8 @@ mount_init (void)
 void
 mount_finalize (void)
 {
+  backend_pool_finalize ();
+
   if (mount_tracker != NULL)
     {
       g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (mount_tracker));
@@ -13,10 +13,19 @@
 
 #include "dirwatch.h"
 
+/* how long to wait for more monitor events before notifying the
+ * TrashRoot's listeners about the changes */
+#define TRASH_DIR_THAW_DELAY 50
+
 struct OPAQUE_TYPE__TrashDir
 {
   TrashRoot *root;
-  GSList *items;
+
+  /* basenames of the files in the directory as far as we know.  kept
+   * up to date from the monitor events so that rescans only need to
+   * report the differences.
+   */
+  GHashTable *items;
 
   GFile *directory;
   GFile *topdir;
@@ -24,73 +33,73 @@ struct OPAQUE_TYPE__TrashDir
 
   DirWatch *watch;
   GFileMonitor *monitor;
+  guint thaw_id;
 };
 
-static gint
-compare_basename (gconstpointer a,
-                  gconstpointer b)
+static void
+trash_dir_add_item (TrashDir   *dir,
+                    const char *name)
 {
-  GFile *file_a, *file_b;
-  char *name_a, *name_b;
-  gint result;
-
-  file_a = (GFile *) a;
-  file_b = (GFile *) b;
+  GFile *file;
 
-  name_a = g_file_get_basename (file_a);
-  name_b = g_file_get_basename (file_b);
+  if (g_hash_table_lookup_extended (dir->items, name, NULL, NULL))
+    return;
 
-  result = strcmp (name_a, name_b);
+  g_hash_table_add (dir->items, g_strdup (name));
 
-  g_free (name_a);
-  g_free (name_b);
-
-  return result;
+  file = g_file_get_child (dir->directory, name);
+  trash_root_add_item (dir->root, file, dir->is_homedir);
+  g_object_unref (file);
 }
 
 static void
-trash_dir_set_files (TrashDir *dir,
-                     GSList   *items)
+trash_dir_remove_item (TrashDir   *dir,
+                       const char *name)
 {
-  GSList **old, *new;
+  GFile *file;
 
-  items = g_slist_sort (items, (GCompareFunc) compare_basename);
-  old = &dir->items;
-  new = items;
+  if (!g_hash_table_remove (dir->items, name))
+    return;
 
-  while (new || *old)
+  file = g_file_get_child (dir->directory, name);
+  trash_root_remove_item (dir->root, file, dir->is_homedir);
+  g_object_unref (file);
+}
+
+/* consumes 'names' */
+static void
+trash_dir_set_files (TrashDir   *dir,
+                     GHashTable *names)
+{
+  GHashTableIter iter;
+  GPtrArray *removed;
+  gpointer name;
+  guint i;
+
+  /* old entries that are gone */
+  removed = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, dir->items);
+  while (g_hash_table_iter_next (&iter, &name, NULL))
+    if (names == NULL || !g_hash_table_lookup_extended (names, name, NULL, NULL))
+      g_ptr_array_add (removed, g_strdup (name));
+
+  for (i = 0; i < removed->len; i++)
     {
-      int result;
+      trash_dir_remove_item (dir, removed->pdata[i]);
+      g_free (removed->pdata[i]);
+    }
+  g_ptr_array_free (removed, TRUE);
 
-      if ((result = (new == NULL) - (*old == NULL)) == 0)
-        result = compare_basename (new->data, (*old)->data);
+  /* new entries */
+  if (names != NULL)
+    {
+      g_hash_table_iter_init (&iter, names);
+      while (g_hash_table_iter_next (&iter, &name, NULL))
+        trash_dir_add_item (dir, name);
 
-      if (result < 0)
-        {
-          /* new entry.  add it. */
-          *old = g_slist_prepend (*old, new->data); /* take reference */
-          old = &(*old)->next;
-          trash_root_add_item (dir->root, new->data, dir->is_homedir);
-          new = new->next;
-        }
-      else if (result > 0)
-        {
-          /* old entry.  remove it. */
-          trash_root_remove_item (dir->root, (*old)->data, dir->is_homedir);
-          g_object_unref ((*old)->data);
-          *old = g_slist_delete_link (*old, *old);
-        }
-      else
-        {
-          /* match.  no change. */
-          old = &(*old)->next;
-          g_object_unref (new->data);
-          new = new->next;
-        }
+      g_hash_table_unref (names);
     }
 
-  g_slist_free (items);
-
   trash_root_thaw (dir->root);
 }
 
@@ -104,7 +113,9 @@ static void
 trash_dir_enumerate (TrashDir *dir)
 {
   GFileEnumerator *enumerator;
-  GSList *files = NULL;
+  GHashTable *names;
+
+  names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   enumerator = g_file_enumerate_children (dir->directory,
                                           G_FILE_ATTRIBUTE_STANDARD_NAME,
@@ -117,19 +128,25 @@ trash_dir_enumerate (TrashDir *dir)
 
       while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)))
         {
-          GFile *file;
-
-          file = g_file_get_child (dir->directory,
-                                   g_file_info_get_name (info));
-          files = g_slist_prepend (files, file);
-
+          g_hash_table_add (names, g_strdup (g_file_info_get_name (info)));
           g_object_unref (info);
         }
 
       g_object_unref (enumerator);
     }
 
-  trash_dir_set_files (dir, files); /* consumes files */
+  trash_dir_set_files (dir, names); /* consumes names */
+}
+
+static gboolean
+trash_dir_thaw_timeout (gpointer user_data)
+{
+  TrashDir *dir = user_data;
+
+  dir->thaw_id = 0;
+  trash_root_thaw (dir->root);
+
+  return FALSE;
 }
 
 static void
@@ -140,12 +157,21 @@ trash_dir_changed (GFileMonitor      *monitor,
                    gpointer           user_data)
 {
   TrashDir *dir = user_data;
+  char *basename;
 
   if (event_type == G_FILE_MONITOR_EVENT_CREATED)
-    trash_root_add_item (dir->root, file, dir->is_homedir);
+    {
+      basename = g_file_get_basename (file);
+      trash_dir_add_item (dir, basename);
+      g_free (basename);
+    }
 
   else if (event_type == G_FILE_MONITOR_EVENT_DELETED)
-    trash_root_remove_item (dir->root, file, dir->is_homedir);
+    {
+      basename = g_file_get_basename (file);
+      trash_dir_remove_item (dir, basename);
+      g_free (basename);
+    }
 
   else if (event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT ||
            event_type == G_FILE_MONITOR_EVENT_UNMOUNTED)
@@ -177,7 +203,12 @@ trash_dir_changed (GFileMonitor      *monitor,
       g_free (name);
     }
 
-  trash_root_thaw (dir->root);
+  /* events tend to come in bursts (eg: emptying the trash); notify
+   * once for the whole burst.
+   */
+  if (dir->thaw_id == 0)
+    dir->thaw_id = g_timeout_add (TRASH_DIR_THAW_DELAY,
+                                  trash_dir_thaw_timeout, dir);
 }
 
 static void
@@ -331,7 +362,8 @@ trash_dir_new (TrashRoot  *root,
   dir = g_slice_new (TrashDir);
 
   dir->root = root;
-  dir->items = NULL;
+  dir->items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  dir->thaw_id = 0;
   dir->topdir = g_file_new_for_path (mount_point);
   dir->directory = g_file_get_child (dir->topdir, rel);
   dir->monitor = NULL;
@@ -370,7 +402,11 @@ trash_dir_free (TrashDir *dir)
   if (dir->monitor)
     g_object_unref (dir->monitor);
 
+  if (dir->thaw_id)
+    g_source_remove (dir->thaw_id);
+
   trash_dir_set_files (dir, NULL);
+  g_hash_table_unref (dir->items);
 
   g_object_unref (dir->directory);
   g_object_unref (dir->topdir);
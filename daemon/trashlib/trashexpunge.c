@@ -8,12 +8,56 @@
 
 #include "trashexpunge.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <glib/gstdio.h>
+
+/* number of threads deleting files in parallel */
+#define TRASH_EXPUNGE_N_WORKERS 4
+
 static gsize trash_expunge_initialised;
 static GHashTable *trash_expunge_queue;
 static gboolean trash_expunge_alive;
 static GMutex trash_expunge_lock;
 static GCond trash_expunge_wait;
 
+/* the workers and the trashed items they are currently deleting;
+ * protected by trash_expunge_lock */
+static GThreadPool *trash_expunge_pool;
+static GHashTable *trash_expunge_in_progress;
+
+/* held while the progress func runs, so that once
+ * trash_expunge_set_progress_func() returns the old func is not
+ * running and won't be called again */
+static GMutex trash_expunge_progress_lock;
+static trash_expunge_progress_func trash_expunge_progress;
+static gpointer trash_expunge_progress_data;
+
+/* A directory being deleted by the workers.  Each subdirectory is a
+ * task of its own so that one huge trashed item is split among all
+ * the workers.  The directory is removed once its own files are gone
+ * and all of its subdirectory tasks have finished.
+ */
+typedef struct _ExpungeTask ExpungeTask;
+struct _ExpungeTask
+{
+  ExpungeTask *parent;
+  char *path;
+  gboolean is_dir;
+
+  /* one for scanning the directory plus one per unfinished subtask */
+  gint pending;
+};
+
 static void
 trash_expunge_delete_everything_under (GFile *directory)
 {
@@ -55,6 +99,219 @@ trash_expunge_delete_everything_under (GFile *directory)
     }
 }
 
+static void
+trash_expunge_notify_progress (void)
+{
+  guint n_pending;
+
+  g_mutex_lock (&trash_expunge_lock);
+  n_pending = g_hash_table_size (trash_expunge_in_progress);
+  g_mutex_unlock (&trash_expunge_lock);
+
+  g_mutex_lock (&trash_expunge_progress_lock);
+  if (trash_expunge_progress)
+    trash_expunge_progress (n_pending, trash_expunge_progress_data);
+  g_mutex_unlock (&trash_expunge_progress_lock);
+}
+
+#if defined(__linux__) && defined(SYS_ioprio_set) && defined(SYS_ioprio_get)
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+/* don't compete with interactive I/O.  returns the previous priority,
+ * to be handed back to trash_expunge_restore_priority() since the pool
+ * threads are shared with the rest of the process.
+ */
+static int
+trash_expunge_set_idle_priority (void)
+{
+  int old_prio = -1;
+
+#ifdef IOPRIO_CLASS_IDLE
+  /* a "process" of 0 is the calling thread */
+  old_prio = syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+  if (old_prio != -1)
+    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+             IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+
+  return old_prio;
+}
+
+static void
+trash_expunge_restore_priority (int old_prio)
+{
+#ifdef IOPRIO_CLASS_IDLE
+  if (old_prio != -1)
+    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, old_prio);
+#endif
+}
+
+static ExpungeTask *
+expunge_task_new (ExpungeTask *parent,
+                  char        *path)
+{
+  ExpungeTask *task;
+
+  task = g_slice_new (ExpungeTask);
+  task->parent = parent;
+  task->path = path;
+  task->is_dir = FALSE;
+  task->pending = 1;
+
+  if (parent)
+    g_atomic_int_inc (&parent->pending);
+
+  return task;
+}
+
+static void
+expunge_task_done (ExpungeTask *task)
+{
+  while (task && g_atomic_int_dec_and_test (&task->pending))
+    {
+      ExpungeTask *parent = task->parent;
+
+      if (task->is_dir)
+        g_rmdir (task->path);
+
+      if (parent == NULL)
+        {
+          /* a whole trashed item is gone */
+          g_mutex_lock (&trash_expunge_lock);
+          g_hash_table_remove (trash_expunge_in_progress, task->path);
+          g_mutex_unlock (&trash_expunge_lock);
+
+          trash_expunge_notify_progress ();
+        }
+
+      g_free (task->path);
+      g_slice_free (ExpungeTask, task);
+
+      task = parent;
+    }
+}
+
+static void
+expunge_task_run (ExpungeTask *task)
+{
+  struct dirent *entry;
+  struct stat buf;
+  DIR *dirp;
+  int fd;
+
+  if (g_lstat (task->path, &buf) != 0)
+    return;
+
+  if (!S_ISDIR (buf.st_mode))
+    {
+      g_unlink (task->path);
+      return;
+    }
+
+  task->is_dir = TRUE;
+
+  /* never chmod by path: the directory could be replaced by a symlink
+   * after the lstat above.  only unreadable directories need fixing
+   * before they can be opened, and fchmodat() refuses symlinks there.
+   */
+  fd = open (task->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+  if (fd < 0 && errno == EACCES &&
+      fchmodat (AT_FDCWD, task->path, 0700, AT_SYMLINK_NOFOLLOW) == 0)
+    fd = open (task->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+  if (fd < 0)
+    return;
+
+  /* we need write access to delete the contents */
+  fchmod (fd, 0700);
+
+  dirp = fdopendir (fd);
+  if (dirp == NULL)
+    {
+      close (fd);
+      return;
+    }
+
+  while ((entry = readdir (dirp)))
+    {
+      gboolean is_dir;
+
+      if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        continue;
+
+      if (entry->d_type == DT_UNKNOWN)
+        is_dir = fstatat (fd, entry->d_name, &buf, AT_SYMLINK_NOFOLLOW) == 0 &&
+                 S_ISDIR (buf.st_mode);
+      else
+        is_dir = entry->d_type == DT_DIR;
+
+      if (is_dir)
+        {
+          ExpungeTask *sub;
+
+          sub = expunge_task_new (task, g_build_filename (task->path,
+                                                          entry->d_name,
+                                                          NULL));
+          g_thread_pool_push (trash_expunge_pool, sub, NULL);
+        }
+      else
+        unlinkat (fd, entry->d_name, 0);
+    }
+
+  closedir (dirp);
+}
+
+static void
+trash_expunge_worker (gpointer data,
+                      gpointer user_data)
+{
+  ExpungeTask *task = data;
+  int old_prio;
+
+  old_prio = trash_expunge_set_idle_priority ();
+  expunge_task_run (task);
+  expunge_task_done (task);
+  trash_expunge_restore_priority (old_prio);
+}
+
+/* hands each item in 'path' to the workers, unless they already have it */
+static void
+trash_expunge_dispatch (const char *path)
+{
+  const char *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      char *item_path;
+
+      item_path = g_build_filename (path, name, NULL);
+
+      g_mutex_lock (&trash_expunge_lock);
+      if (g_hash_table_contains (trash_expunge_in_progress, item_path))
+        {
+          g_mutex_unlock (&trash_expunge_lock);
+          g_free (item_path);
+          continue;
+        }
+      g_hash_table_add (trash_expunge_in_progress, g_strdup (item_path));
+      g_mutex_unlock (&trash_expunge_lock);
+
+      g_thread_pool_push (trash_expunge_pool,
+                          expunge_task_new (NULL, item_path), NULL);
+    }
+
+  g_dir_close (dir);
+
+  trash_expunge_notify_progress ();
+}
+
 static gboolean
 just_return_true (gpointer a,
                   gpointer b,
@@ -75,13 +332,22 @@ trash_expunge_thread (gpointer data)
       while (g_hash_table_size (trash_expunge_queue))
         {
           GFile *directory;
+          char *path;
          
           directory = g_hash_table_find (trash_expunge_queue,
                                          just_return_true, NULL);
           g_hash_table_remove (trash_expunge_queue, directory);
 
           g_mutex_unlock (&trash_expunge_lock);
-          trash_expunge_delete_everything_under (directory);
+
+          /* trash directories are always local, but just in case... */
+          path = g_file_get_path (directory);
+          if (path)
+            trash_expunge_dispatch (path);
+          else
+            trash_expunge_delete_everything_under (directory);
+          g_free (path);
+
           g_mutex_lock (&trash_expunge_lock);
 
           g_object_unref (directory);
@@ -100,15 +366,27 @@ trash_expunge_thread (gpointer data)
   return NULL;
 }
 
-void
-trash_expunge (GFile *directory)
+static void
+trash_expunge_init (void)
 {
   if G_UNLIKELY (g_once_init_enter (&trash_expunge_initialised))
     {
       trash_expunge_queue = g_hash_table_new (g_file_hash,
                                               (GEqualFunc) g_file_equal);
+      trash_expunge_in_progress = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal,
+                                                         g_free, NULL);
+      trash_expunge_pool = g_thread_pool_new (trash_expunge_worker, NULL,
+                                              TRASH_EXPUNGE_N_WORKERS,
+                                              FALSE, NULL);
       g_once_init_leave (&trash_expunge_initialised, 1);
     }
+}
+
+void
+trash_expunge (GFile *directory)
+{
+  trash_expunge_init ();
 
   g_mutex_lock (&trash_expunge_lock);
 
@@ -130,3 +408,29 @@ trash_expunge (GFile *directory)
 
   g_mutex_unlock (&trash_expunge_lock);
 }
+
+void
+trash_expunge_set_progress_func (trash_expunge_progress_func func,
+                                 gpointer                    user_data)
+{
+  trash_expunge_init ();
+
+  g_mutex_lock (&trash_expunge_progress_lock);
+  trash_expunge_progress = func;
+  trash_expunge_progress_data = user_data;
+  g_mutex_unlock (&trash_expunge_progress_lock);
+}
+
+guint
+trash_expunge_get_n_pending (void)
+{
+  guint n_pending;
+
+  trash_expunge_init ();
+
+  g_mutex_lock (&trash_expunge_lock);
+  n_pending = g_hash_table_size (trash_expunge_in_progress);
+  g_mutex_unlock (&trash_expunge_lock);
+
+  return n_pending;
+}
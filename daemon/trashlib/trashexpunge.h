@@ -12,6 +12,15 @@
 #include <gio/gio.h>
 
 typedef struct OPAQUE_TYPE__TrashExpunger TrashExpunger;
-void trash_expunge (GFile *expunge_directory);
+
+/* called from the expunge threads whenever the number of trashed
+ * items still being deleted changes */
+typedef void (*trash_expunge_progress_func) (guint    n_pending,
+                                             gpointer user_data);
+
+void  trash_expunge                   (GFile                       *expunge_directory);
+void  trash_expunge_set_progress_func (trash_expunge_progress_func  func,
+                                       gpointer                     user_data);
+guint trash_expunge_get_n_pending     (void);
 
 #endif /* _trashexpunger_h_ */
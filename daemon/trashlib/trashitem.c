@@ -41,10 +41,15 @@ struct OPAQUE_TYPE__TrashItem
   char *escaped_name;
   GFile *file;
 
+  /* read from the .trashinfo file when first asked for */
+  gboolean have_trashinfo;
   GFile *original;
   char *delete_date;
 };
 
+/* protects the lazily loaded trashinfo fields of all items */
+G_LOCK_DEFINE_STATIC (trashinfo);
+
 static char *
 trash_item_escape_name (GFile    *file,
                         gboolean  in_homedir)
@@ -200,10 +205,11 @@ trash_item_get_trashinfo (GFile  *path,
   g_free (trashinfo);
 }
 
+/* takes 'escaped_name' */
 static TrashItem *
 trash_item_new (TrashRoot *root,
                 GFile         *file,
-                gboolean       in_homedir)
+                char          *escaped_name)
 {
   TrashItem *item;
 
@@ -211,12 +217,26 @@ trash_item_new (TrashRoot *root,
   item->root = root;
   item->ref_count = 1;
   item->file = g_object_ref (file);
-  item->escaped_name = trash_item_escape_name (file, in_homedir);
-  trash_item_get_trashinfo (item->file, &item->original, &item->delete_date);
+  item->escaped_name = escaped_name;
+  item->have_trashinfo = FALSE;
+  item->original = NULL;
+  item->delete_date = NULL;
 
   return item;
 }
 
+static void
+trash_item_ensure_trashinfo (TrashItem *item)
+{
+  G_LOCK (trashinfo);
+  if (!item->have_trashinfo)
+    {
+      trash_item_get_trashinfo (item->file, &item->original, &item->delete_date);
+      item->have_trashinfo = TRUE;
+    }
+  G_UNLOCK (trashinfo);
+}
+
 static TrashItem *
 trash_item_ref (TrashItem *item)
 {
@@ -250,12 +270,14 @@ trash_item_get_escaped_name (TrashItem *item)
 const char *
 trash_item_get_delete_date (TrashItem *item)
 {
+  trash_item_ensure_trashinfo (item);
   return item->delete_date;
 }
 
 GFile *
 trash_item_get_original (TrashItem *item)
 {
+  trash_item_ensure_trashinfo (item);
   return item->original;
 }
 
@@ -373,20 +395,23 @@ trash_root_add_item (TrashRoot *list,
                      gboolean   in_homedir)
 {
   TrashItem *item;
+  char *escaped;
 
-  item = trash_item_new (list, file, in_homedir);
+  escaped = trash_item_escape_name (file, in_homedir);
 
   g_rw_lock_writer_lock (&list->lock);
 
-  if (g_hash_table_lookup (list->item_table, item->escaped_name))
+  if (g_hash_table_lookup (list->item_table, escaped))
     {
       g_rw_lock_writer_unlock (&list->lock);
 
       /* already exists... */
-      trash_item_unref (item);
+      g_free (escaped);
       return;
     }
 
+  item = trash_item_new (list, file, escaped);
+
   g_hash_table_insert (list->item_table, item->escaped_name, item);
   trash_item_queue_notify (item, item->root->create_notify);
 
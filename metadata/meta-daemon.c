@@ -394,6 +394,135 @@ handle_move (GVfsMetadata *object,
   return TRUE;
 }
 
+static void
+batch_add_data (MetaTreeBatch *batch,
+		const char *path,
+		GVariant *data)
+{
+  const gchar *key;
+  GVariantIter iter;
+  GVariant *value;
+  const gchar **strv;
+
+  g_variant_iter_init (&iter, data);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+	{
+	  strv = g_variant_get_strv (value, NULL);
+	  meta_tree_batch_set_stringv (batch, path, key, (gchar **) strv);
+	  g_free (strv);
+	}
+      else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+	meta_tree_batch_set_string (batch, path, key,
+				    g_variant_get_string (value, NULL));
+      else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTE))
+	meta_tree_batch_unset (batch, path, key);
+      g_variant_unref (value);
+    }
+}
+
+static gboolean
+handle_set_many (GVfsMetadata *object,
+                 GDBusMethodInvocation *invocation,
+                 const gchar *arg_treefile,
+                 GVariant *arg_data,
+                 GVfsMetadata *daemon)
+{
+  TreeInfo *info;
+  MetaTreeBatch *batch;
+  const gchar *path;
+  GVariantIter iter;
+  GVariant *data;
+  gboolean res;
+
+  info = tree_info_lookup (arg_treefile);
+  if (info == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_IO_ERROR,
+                                             G_IO_ERROR_NOT_FOUND,
+                                             _("Can't find metadata file %s"),
+                                             arg_treefile);
+      return TRUE;
+    }
+
+  batch = meta_tree_batch_new ();
+
+  g_variant_iter_init (&iter, arg_data);
+  while (g_variant_iter_next (&iter, "(^&ay@a{sv})", &path, &data))
+    {
+      batch_add_data (batch, path, data);
+      g_variant_unref (data);
+    }
+
+  res = meta_tree_batch_apply (info->tree, batch);
+  meta_tree_batch_free (batch);
+
+  /* A failed batch may still have been partly applied */
+  tree_info_schedule_writeout (info);
+
+  if (!res)
+    {
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_IO_ERROR,
+                                                     G_IO_ERROR_FAILED,
+                                                     _("Unable to set metadata key"));
+      return TRUE;
+    }
+
+  gvfs_metadata_complete_set_many (object, invocation);
+
+  return TRUE;
+}
+
+static gboolean
+handle_remove_many (GVfsMetadata *object,
+                    GDBusMethodInvocation *invocation,
+                    const gchar *arg_treefile,
+                    const gchar *const *arg_paths,
+                    GVfsMetadata *daemon)
+{
+  TreeInfo *info;
+  MetaTreeBatch *batch;
+  gboolean res;
+  int i;
+
+  info = tree_info_lookup (arg_treefile);
+  if (info == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_IO_ERROR,
+                                             G_IO_ERROR_NOT_FOUND,
+                                             _("Can't find metadata file %s"),
+                                             arg_treefile);
+      return TRUE;
+    }
+
+  batch = meta_tree_batch_new ();
+  for (i = 0; arg_paths[i] != NULL; i++)
+    meta_tree_batch_remove (batch, arg_paths[i]);
+
+  res = meta_tree_batch_apply (info->tree, batch);
+  meta_tree_batch_free (batch);
+
+  /* A failed batch may still have been partly applied */
+  tree_info_schedule_writeout (info);
+
+  if (!res)
+    {
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_IO_ERROR,
+                                                     G_IO_ERROR_FAILED,
+                                                     _("Unable to remove metadata keys"));
+      return TRUE;
+    }
+
+  gvfs_metadata_complete_remove_many (object, invocation);
+
+  return TRUE;
+}
+
 static void
 on_name_acquired (GDBusConnection *connection,
                   const gchar     *name,
@@ -408,6 +537,8 @@ on_name_acquired (GDBusConnection *connection,
   g_signal_connect (skeleton, "handle-get", G_CALLBACK (handle_get), skeleton);
   g_signal_connect (skeleton, "handle-remove", G_CALLBACK (handle_remove), skeleton);
   g_signal_connect (skeleton, "handle-move", G_CALLBACK (handle_move), skeleton);
+  g_signal_connect (skeleton, "handle-set-many", G_CALLBACK (handle_set_many), skeleton);
+  g_signal_connect (skeleton, "handle-remove-many", G_CALLBACK (handle_remove_many), skeleton);
 
   error = NULL;
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton), connection,
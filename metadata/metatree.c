@@ -133,12 +133,25 @@ typedef struct {
   char path[1];
 } MetaJournalEntry;
 
+/* In-memory index of the journal entries, one node per path element.
+ * Each node holds the offsets of the entries whose path is exactly
+ * that node, in journal order, so lookups only need to look at the
+ * entries that can possibly affect a path instead of the whole journal.
+ */
+typedef struct {
+  GHashTable *children; /* name -> MetaJournalNode */
+  GArray *key_entries; /* guint32 offsets of set/setv/unset entries */
+  GArray *path_entries; /* guint32 offsets of copy/remove entries */
+} MetaJournalNode;
+
 typedef struct {
   char *filename;
   int fd;
   char *data;
   gsize len;
 
+  MetaJournalNode *index;
+
   MetaJournalHeader *header;
   MetaJournalEntry *first_entry;
   guint last_entry_num;
@@ -858,9 +871,53 @@ get_journal_filename (const char *filename, guint32 random_tag)
   return g_strconcat (filename, "-", tag, ".log", NULL);
 }
 
+static void
+meta_journal_node_free (MetaJournalNode *node)
+{
+  if (node->children)
+    g_hash_table_destroy (node->children);
+  if (node->key_entries)
+    g_array_free (node->key_entries, TRUE);
+  if (node->path_entries)
+    g_array_free (node->path_entries, TRUE);
+  g_free (node);
+}
+
+static MetaJournalNode *
+meta_journal_node_new (void)
+{
+  return g_new0 (MetaJournalNode, 1);
+}
+
+static MetaJournalNode *
+meta_journal_node_get_child (MetaJournalNode *node,
+			     const char *name,
+			     gboolean create)
+{
+  MetaJournalNode *child;
+
+  child = NULL;
+  if (node->children)
+    child = g_hash_table_lookup (node->children, name);
+
+  if (child == NULL && create)
+    {
+      if (node->children == NULL)
+	node->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free,
+						(GDestroyNotify)meta_journal_node_free);
+      child = meta_journal_node_new ();
+      g_hash_table_insert (node->children, g_strdup (name), child);
+    }
+
+  return child;
+}
+
 static void
 meta_journal_free (MetaJournal *journal)
 {
+  if (journal->index)
+    meta_journal_node_free (journal->index);
   g_free (journal->filename);
   munmap(journal->data, journal->len);
   close (journal->fd);
@@ -914,6 +971,58 @@ verify_journal_entry (MetaJournal *journal,
   return (MetaJournalEntry *)(journal->data + offset + entry_len);
 }
 
+static gboolean journal_entry_is_key_type  (MetaJournalEntry *entry);
+static gboolean journal_entry_is_path_type (MetaJournalEntry *entry);
+
+/* Add a validated entry to the path index, call with writer lock */
+static void
+meta_journal_index_entry (MetaJournal *journal,
+			  MetaJournalEntry *entry)
+{
+  MetaJournalNode *node;
+  GArray **entries;
+  char *path, *name, *end;
+  guint32 offset;
+
+  if (!journal_entry_is_key_type (entry) &&
+      !journal_entry_is_path_type (entry))
+    {
+      g_warning ("Unknown journal entry type %d\n", entry->entry_type);
+      return;
+    }
+
+  offset = (char *)entry - journal->data;
+  path = g_strdup (&entry->path[0]);
+  node = journal->index;
+  name = path;
+  while (TRUE)
+    {
+      while (*name == '/')
+	name++;
+      if (*name == 0)
+	break;
+
+      end = strchr (name, '/');
+      if (end != NULL)
+	*end++ = 0;
+      else
+	end = name + strlen (name);
+
+      node = meta_journal_node_get_child (node, name, TRUE);
+      name = end;
+    }
+  g_free (path);
+
+  if (journal_entry_is_key_type (entry))
+    entries = &node->key_entries;
+  else
+    entries = &node->path_entries;
+
+  if (*entries == NULL)
+    *entries = g_array_new (FALSE, FALSE, sizeof (guint32));
+  g_array_append_val (*entries, offset);
+}
+
 /* Try to validate more entries, call with writer lock */
 static void
 meta_journal_validate_more (MetaJournal *journal)
@@ -939,6 +1048,8 @@ meta_journal_validate_more (MetaJournal *journal)
 	  break;
 	}
 
+      meta_journal_index_entry (journal, entry);
+
       entry = next_entry;
       i++;
     }
@@ -1106,10 +1217,14 @@ meta_journal_entry_new_unset (guint64 mtime,
 }
 
 
-/* Call with writer lock held */
+/* Appends n_entries finished entries stored back to back in entries.
+   They are made visible to readers all at once by a single update of
+   num_entries. Call with writer lock held */
 static gboolean
-meta_journal_add_entry (MetaJournal *journal,
-			GString *entry)
+meta_journal_add_entries (MetaJournal *journal,
+			  const char *entries,
+			  gsize len,
+			  guint32 n_entries)
 {
   char *ptr;
   guint32 offset;
@@ -1119,19 +1234,27 @@ meta_journal_add_entry (MetaJournal *journal,
   ptr = (char *)journal->last_entry;
   offset =  ptr - journal->data;
 
-  /* Does the entry fit? */
-  if (entry->len > journal->len - offset)
+  /* Do the entries fit? */
+  if (len > journal->len - offset)
     return FALSE;
 
-  memcpy (ptr, entry->str, entry->len);
+  memcpy (ptr, entries, len);
 
-  journal->header->num_entries = GUINT_TO_BE (journal->last_entry_num + 1);
+  journal->header->num_entries = GUINT_TO_BE (journal->last_entry_num + n_entries);
   meta_journal_validate_more (journal);
   g_assert (journal->journal_valid);
 
   return TRUE;
 }
 
+/* Call with writer lock held */
+static gboolean
+meta_journal_add_entry (MetaJournal *journal,
+			GString *entry)
+{
+  return meta_journal_add_entries (journal, entry->str, entry->len, 1);
+}
+
 static MetaJournal *
 meta_journal_open (MetaTree *tree, const char *filename, gboolean for_write, guint32 tag)
 {
@@ -1182,6 +1305,7 @@ meta_journal_open (MetaTree *tree, const char *filename, gboolean for_write, gui
   journal->first_entry = (MetaJournalEntry *)(data + sizeof (MetaJournalHeader));
   journal->last_entry = journal->first_entry;
   journal->last_entry_num = 0;
+  journal->index = meta_journal_node_new ();
 
   if (memcmp (journal->header->magic, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0)
     goto err;
@@ -1275,72 +1399,203 @@ typedef gboolean (*journal_path_callback) (MetaJournal *journal,
 					   char **iter_path,
 					   gpointer user_data);
 
+static void
+append_entry_offsets (GArray *entries,
+		      guint32 limit,
+		      GArray *offsets)
+{
+  guint32 offset;
+  guint i;
+
+  if (entries == NULL)
+    return;
+
+  /* entries are in journal order, stop at the first one past limit */
+  for (i = 0; i < entries->len; i++)
+    {
+      offset = g_array_index (entries, guint32, i);
+      if (offset >= limit)
+	break;
+      g_array_append_val (offsets, offset);
+    }
+}
+
+static void
+append_subtree_offsets (MetaJournalNode *node,
+			guint32 limit,
+			GArray *offsets)
+{
+  GHashTableIter iter;
+  MetaJournalNode *child;
+
+  append_entry_offsets (node->key_entries, limit, offsets);
+  append_entry_offsets (node->path_entries, limit, offsets);
+
+  if (node->children == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, node->children);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&child))
+    append_subtree_offsets (child, limit, offsets);
+}
+
+/* Collects the offsets of all entries before limit that can affect path:
+ * copies and removes of any parent, everything on path itself and, if
+ * include_children is set, everything below it. */
+static void
+meta_journal_collect_entries (MetaJournal *journal,
+			      const char *path,
+			      gboolean include_children,
+			      guint32 limit,
+			      GArray *offsets)
+{
+  MetaJournalNode *node;
+  char *path_copy, *name, *end;
+
+  path_copy = g_strdup (path);
+  node = journal->index;
+  name = path_copy;
+  while (TRUE)
+    {
+      while (*name == '/')
+	name++;
+      if (*name == 0)
+	break;
+
+      append_entry_offsets (node->path_entries, limit, offsets);
+
+      end = strchr (name, '/');
+      if (end != NULL)
+	*end++ = 0;
+      else
+	end = name + strlen (name);
+
+      node = meta_journal_node_get_child (node, name, FALSE);
+      if (node == NULL)
+	break;
+      name = end;
+    }
+  g_free (path_copy);
+
+  if (node == NULL)
+    return;
+
+  if (include_children)
+    append_subtree_offsets (node, limit, offsets);
+  else
+    {
+      append_entry_offsets (node->key_entries, limit, offsets);
+      append_entry_offsets (node->path_entries, limit, offsets);
+    }
+}
+
+static int
+compare_offsets_reverse (gconstpointer a,
+			 gconstpointer b)
+{
+  guint32 offset_a = *(const guint32 *)a;
+  guint32 offset_b = *(const guint32 *)b;
+
+  if (offset_a > offset_b)
+    return -1;
+  if (offset_a < offset_b)
+    return 1;
+  return 0;
+}
+
+/* Calls the callbacks for the entries that may affect path, newest
+ * first, like walking the journal backwards would. Key entries are
+ * only passed for path itself (and its children if include_children
+ * is set), so callbacks can't rely on seeing unrelated entries. */
 static char *
 meta_journal_iterate (MetaJournal *journal,
 		      const char *path,
+		      gboolean include_children,
 		      journal_key_callback key_callback,
 		      journal_path_callback path_callback,
 		      gpointer user_data)
 {
   MetaJournalEntry *entry;
-  guint32 *sizep;
+  GArray *offsets;
   char *journal_path, *journal_key, *source_path;
-  char *path_copy, *value;
-  gboolean res;
+  char *path_copy, *old_path_copy, *value;
+  gboolean res, remapped;
   guint64 mtime;
+  guint32 limit, offset;
+  guint i;
 
   path_copy = g_strdup (path);
 
   if (journal == NULL)
     return path_copy;
 
-  entry = journal->last_entry;
-  while (entry > journal->first_entry)
+  offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+  limit = (char *)journal->last_entry - journal->data;
+
+  do
     {
-      sizep = (guint32 *)entry;
-      entry = (MetaJournalEntry *)((char *)entry - GUINT32_FROM_BE (*(sizep-1)));
+      remapped = FALSE;
 
-      mtime = GUINT64_FROM_BE (entry->mtime);
-      journal_path = &entry->path[0];
+      g_array_set_size (offsets, 0);
+      meta_journal_collect_entries (journal, path_copy, include_children,
+				    limit, offsets);
+      g_array_sort (offsets, compare_offsets_reverse);
 
-      if (journal_entry_is_key_type (entry) &&
-	  key_callback) /* set, setv or unset */
+      for (i = 0; i < offsets->len && !remapped; i++)
 	{
-	  journal_key = get_next_arg (journal_path);
-	  value = get_next_arg (journal_key);
+	  offset = g_array_index (offsets, guint32, i);
+	  entry = (MetaJournalEntry *)(journal->data + offset);
+
+	  mtime = GUINT64_FROM_BE (entry->mtime);
+	  journal_path = &entry->path[0];
 
-	  /* Only affects is path is exactly the same */
-	  res = key_callback (journal, entry->entry_type,
-			      journal_path, mtime, journal_key,
-			      value,
-			      &path_copy, user_data);
-	  if (!res)
+	  if (journal_entry_is_key_type (entry) &&
+	      key_callback) /* set, setv or unset */
 	    {
-	      g_free (path_copy);
-	      return NULL;
+	      journal_key = get_next_arg (journal_path);
+	      value = get_next_arg (journal_key);
+
+	      /* Only affects is path is exactly the same */
+	      res = key_callback (journal, entry->entry_type,
+				  journal_path, mtime, journal_key,
+				  value,
+				  &path_copy, user_data);
+	      if (!res)
+		goto stop;
 	    }
-	}
-      else if (journal_entry_is_path_type (entry) &&
-	       path_callback) /* copy or remove */
-	{
-	  source_path = NULL;
-	  if (entry->entry_type == JOURNAL_OP_COPY_PATH)
-	    source_path = get_next_arg (journal_path);
-
-	  res = path_callback (journal, entry->entry_type,
-			       journal_path, mtime, source_path,
-			       &path_copy, user_data);
-	  if (!res)
+	  else if (journal_entry_is_path_type (entry) &&
+		   path_callback) /* copy or remove */
 	    {
-	      g_free (path_copy);
-	      return NULL;
+	      source_path = NULL;
+	      if (entry->entry_type == JOURNAL_OP_COPY_PATH)
+		source_path = get_next_arg (journal_path);
+
+	      old_path_copy = path_copy;
+	      res = path_callback (journal, entry->entry_type,
+				   journal_path, mtime, source_path,
+				   &path_copy, user_data);
+	      if (!res)
+		goto stop;
+
+	      /* Copied from elsewhere, continue with the entries
+		 older than this one for the source path */
+	      if (path_copy != old_path_copy)
+		{
+		  limit = offset;
+		  remapped = TRUE;
+		}
 	    }
 	}
-      else
-	g_warning ("Unknown journal entry type %d\n", entry->entry_type);
     }
+  while (remapped);
 
+  g_array_free (offsets, TRUE);
   return path_copy;
+
+ stop:
+  g_array_free (offsets, TRUE);
+  g_free (path_copy);
+  return NULL;
 }
 
 typedef struct {
@@ -1447,6 +1702,7 @@ meta_journal_reverse_map_path_and_key (MetaJournal *journal,
   data.key = key;
   res_path = meta_journal_iterate (journal,
 				   path,
+				   FALSE,
 				   journal_iter_key,
 				   journal_iter_path,
 				   &data);
@@ -1862,11 +2118,12 @@ enumerate_dir (MetaTree *tree,
   return TRUE;
 }
 
-void
-meta_tree_enumerate_dir (MetaTree                         *tree,
-			 const char                       *path,
-			 meta_tree_dir_enumerate_callback  callback,
-			 gpointer                          user_data)
+/* Call with reader lock held */
+static void
+enumerate_dir_locked (MetaTree                         *tree,
+		      const char                       *path,
+		      meta_tree_dir_enumerate_callback  callback,
+		      gpointer                          user_data)
 {
   EnumDirData data;
   GHashTable *children;
@@ -1876,8 +2133,6 @@ meta_tree_enumerate_dir (MetaTree                         *tree,
   MetaFileDir *dir;
   char *res_path;
 
-  g_rw_lock_reader_lock (&metatree_lock);
-
   data.children = children =
     g_hash_table_new_full (g_str_hash,
 			   g_str_equal,
@@ -1887,6 +2142,7 @@ meta_tree_enumerate_dir (MetaTree                         *tree,
 
   res_path = meta_journal_iterate (tree->journal,
 				   path,
+				   TRUE,
 				   enum_dir_iter_key,
 				   enum_dir_iter_path,
 				   &data);
@@ -1922,6 +2178,16 @@ meta_tree_enumerate_dir (MetaTree                         *tree,
  out:
   g_free (res_path);
   g_hash_table_destroy (children);
+}
+
+void
+meta_tree_enumerate_dir (MetaTree                         *tree,
+			 const char                       *path,
+			 meta_tree_dir_enumerate_callback  callback,
+			 gpointer                          user_data)
+{
+  g_rw_lock_reader_lock (&metatree_lock);
+  enumerate_dir_locked (tree, path, callback, user_data);
   g_rw_lock_reader_unlock (&metatree_lock);
 }
 
@@ -2103,21 +2369,62 @@ enumerate_data (MetaTree *tree,
   return TRUE;
 }
 
-void
-meta_tree_enumerate_keys (MetaTree                         *tree,
-			  const char                       *path,
-			  meta_tree_keys_enumerate_callback callback,
-			  gpointer                          user_data)
+/* Reports the keys set in the journal, returns FALSE if the callback
+   stopped */
+static gboolean
+enumerate_journal_keys (GHashTable                       *keys,
+			meta_tree_keys_enumerate_callback callback,
+			gpointer                          user_data)
+{
+  GHashTableIter iter;
+  EnumKeysInfo *info;
+  gpointer value;
+  gboolean res;
+
+  res = TRUE;
+  g_hash_table_iter_init (&iter, keys);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer  *)&info))
+    {
+      if (info->type == META_KEY_TYPE_NONE)
+	continue;
+
+      if (info->type == META_KEY_TYPE_STRING)
+	value = info->value;
+      else
+	{
+	  g_assert (info->type == META_KEY_TYPE_STRINGV);
+	  value = get_stringv_from_journal (info->value, FALSE);
+	}
+
+      res = callback (info->key,
+		      info->type,
+		      value,
+		      user_data);
+
+      if (info->type == META_KEY_TYPE_STRINGV)
+	g_free (value);
+
+      if (!res)
+	break;
+    }
+
+  return res;
+}
+
+/* Call with reader lock held, returns FALSE if the callback stopped */
+static gboolean
+enumerate_keys_locked (MetaTree                         *tree,
+		       const char                       *path,
+		       meta_tree_keys_enumerate_callback callback,
+		       gpointer                          user_data)
 {
   EnumKeysData keydata;
   GHashTable *keys;
-  EnumKeysInfo *info;
   MetaFileData *data;
-  GHashTableIter iter;
   char *res_path;
+  gboolean res;
 
-  g_rw_lock_reader_lock (&metatree_lock);
-
+  res = TRUE;
   keydata.keys = keys =
     g_hash_table_new_full (g_str_hash,
 			   g_str_equal,
@@ -2127,6 +2434,7 @@ meta_tree_enumerate_keys (MetaTree                         *tree,
 
   res_path = meta_journal_iterate (tree->journal,
 				   path,
+				   FALSE,
 				   enum_keys_iter_key,
 				   enum_keys_iter_path,
 				   &keydata);
@@ -2137,42 +2445,277 @@ meta_tree_enumerate_keys (MetaTree                         *tree,
       if (data != NULL)
 	{
 	  if (!enumerate_data (tree, data, keys, callback, user_data))
-	    goto out;
+	    {
+	      res = FALSE;
+	      goto out;
+	    }
 	}
     }
 
-  g_hash_table_iter_init (&iter, keys);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer  *)&info))
+  res = enumerate_journal_keys (keys, callback, user_data);
+
+ out:
+  g_free (res_path);
+  g_hash_table_destroy (keys);
+  return res;
+}
+
+void
+meta_tree_enumerate_keys (MetaTree                         *tree,
+			  const char                       *path,
+			  meta_tree_keys_enumerate_callback callback,
+			  gpointer                          user_data)
+{
+  g_rw_lock_reader_lock (&metatree_lock);
+  enumerate_keys_locked (tree, path, callback, user_data);
+  g_rw_lock_reader_unlock (&metatree_lock);
+}
+
+typedef struct {
+  char *name;
+  GHashTable *keys; /* key -> EnumKeysInfo, newest journal entry wins */
+
+  gboolean removed; /* older entries and the tree data don't apply */
+  gboolean copied;  /* older data comes from the copy source */
+  gboolean reported;
+} EnumDirKeysChild;
+
+typedef struct {
+  GHashTable *children; /* name -> EnumDirKeysChild */
+} EnumDirKeysJournalData;
+
+typedef struct {
+  const char *entry;
+  meta_tree_dir_keys_enumerate_callback callback;
+  gpointer user_data;
+} EnumDirKeysData;
+
+static void
+dir_keys_child_free (EnumDirKeysChild *child)
+{
+  g_free (child->name);
+  g_hash_table_destroy (child->keys);
+  g_free (child);
+}
+
+/* Returns the child if remainder names a direct child, NULL otherwise */
+static EnumDirKeysChild *
+get_dir_keys_child (EnumDirKeysJournalData *data,
+		    const char *remainder)
+{
+  EnumDirKeysChild *child;
+
+  if (*remainder == 0 || strchr (remainder, '/') != NULL)
+    return NULL;
+
+  child = g_hash_table_lookup (data->children, remainder);
+  if (child == NULL)
     {
-      gpointer value;
+      child = g_new0 (EnumDirKeysChild, 1);
+      child->name = g_strdup (remainder);
+      child->keys = g_hash_table_new_full (g_str_hash,
+					   g_str_equal,
+					   NULL,
+					   (GDestroyNotify)key_info_free);
+      g_hash_table_insert (data->children, child->name, child);
+    }
 
-      if (info->type == META_KEY_TYPE_NONE)
-	continue;
+  return child;
+}
 
-      if (info->type == META_KEY_TYPE_STRING)
-	value = info->value;
+static gboolean
+enum_dir_keys_iter_key (MetaJournal *journal,
+			MetaJournalEntryType entry_type,
+			const char *path,
+			guint64 mtime,
+			const char *key,
+			gpointer value,
+			char **iter_path,
+			gpointer user_data)
+{
+  EnumDirKeysJournalData *data = user_data;
+  EnumDirKeysChild *child;
+  EnumKeysData keydata;
+  EnumKeysInfo *info;
+  const char *remainder;
+
+  remainder = get_prefix_match (path, *iter_path);
+  if (remainder == NULL)
+    return TRUE; /* continue */
+
+  child = get_dir_keys_child (data, remainder);
+  if (child == NULL || child->removed || child->copied)
+    return TRUE; /* continue */
+
+  keydata.keys = child->keys;
+  info = get_key_info (&keydata, key);
+  if (!info->seen)
+    {
+      info->seen = TRUE;
+      if (entry_type == JOURNAL_OP_UNSET_KEY)
+	info->type = META_KEY_TYPE_NONE;
+      else if (entry_type == JOURNAL_OP_SET_KEY)
+	info->type = META_KEY_TYPE_STRING;
       else
+	info->type = META_KEY_TYPE_STRINGV;
+      info->value = value;
+    }
+
+  return TRUE; /* continue */
+}
+
+static gboolean
+enum_dir_keys_iter_path (MetaJournal *journal,
+			 MetaJournalEntryType entry_type,
+			 const char *path,
+			 guint64 mtime,
+			 const char *source_path,
+			 char **iter_path,
+			 gpointer user_data)
+{
+  EnumDirKeysJournalData *data = user_data;
+  EnumDirKeysChild *child;
+  const char *remainder;
+
+  /* A child itself removed or copied over cuts off its older data */
+  remainder = get_prefix_match (path, *iter_path);
+  if (remainder != NULL &&
+      (child = get_dir_keys_child (data, remainder)) != NULL)
+    {
+      if (!child->removed && !child->copied)
 	{
-	  g_assert (info->type == META_KEY_TYPE_STRINGV);
-	  value = get_stringv_from_journal (info->value, FALSE);
+	  if (entry_type == JOURNAL_OP_REMOVE_PATH)
+	    child->removed = TRUE;
+	  else if (entry_type == JOURNAL_OP_COPY_PATH)
+	    child->copied = TRUE;
 	}
+      return TRUE;
+    }
 
-      if (!callback (info->key,
-		     info->type,
-		     value,
-		     user_data))
-	break;
+  /* The directory itself or a parent, like for a single file */
+  return enum_keys_iter_path (journal, entry_type, path, mtime,
+			      source_path, iter_path, NULL);
+}
 
-      if (info->type == META_KEY_TYPE_STRINGV)
-	g_free (value);
+static gboolean
+enum_dir_keys_callback (const char *key,
+			MetaKeyType type,
+			gpointer value,
+			gpointer user_data)
+{
+  EnumDirKeysData *data = user_data;
+
+  return data->callback (data->entry, key, type, value, data->user_data);
+}
+
+/* Reports the keys of all children of path in one go: one journal pass
+   over the directory and everything below it, one tree lookup for the
+   directory and a walk over its entries. Only children that were
+   copied over in the journal are looked up on their own, their older
+   keys live under the copy source. */
+void
+meta_tree_enumerate_dir_keys (MetaTree                              *tree,
+			      const char                            *path,
+			      meta_tree_dir_keys_enumerate_callback  callback,
+			      gpointer                               user_data)
+{
+  EnumDirKeysJournalData journal_data;
+  EnumDirKeysData data;
+  EnumDirKeysChild *child;
+  GHashTable *children, *no_keys;
+  GHashTableIter iter;
+  MetaFileDirEnt *dirent;
+  MetaFileData *file_data;
+  MetaFileDir *dir;
+  guint32 i, num_children;
+  char *res_path, *name, *child_path;
+
+  journal_data.children = children =
+    g_hash_table_new_full (g_str_hash,
+			   g_str_equal,
+			   NULL,
+			   (GDestroyNotify)dir_keys_child_free);
+  no_keys = g_hash_table_new (g_str_hash, g_str_equal);
+
+  data.callback = callback;
+  data.user_data = user_data;
+
+  g_rw_lock_reader_lock (&metatree_lock);
+
+  res_path = meta_journal_iterate (tree->journal,
+				   path,
+				   TRUE,
+				   enum_dir_keys_iter_key,
+				   enum_dir_keys_iter_path,
+				   &journal_data);
+
+  dir = NULL;
+  if (res_path != NULL)
+    {
+      dirent = meta_tree_lookup (tree, res_path);
+      if (dirent != NULL && dirent->children != 0)
+	dir = verify_children_block (tree, dirent->children);
+    }
+
+  num_children = dir ? GUINT32_FROM_BE (dir->num_children) : 0;
+  for (i = 0; i < num_children; i++)
+    {
+      dirent = &dir->children[i];
+      name = verify_string (tree, dirent->name);
+      if (name == NULL)
+	continue;
 
+      child = g_hash_table_lookup (children, name);
+      if (child != NULL && child->copied)
+	continue; /* handled below */
+      if (child != NULL)
+	child->reported = TRUE;
+
+      data.entry = name;
+      file_data = NULL;
+      if (child == NULL || !child->removed)
+	file_data = verify_metadata_block (tree, dirent->metadata);
+      if (file_data != NULL &&
+	  !enumerate_data (tree, file_data, child ? child->keys : no_keys,
+			   enum_dir_keys_callback, &data))
+	goto out;
+
+      if (child != NULL &&
+	  !enumerate_journal_keys (child->keys, enum_dir_keys_callback, &data))
+	goto out;
     }
+
+  /* Children only known to the journal */
+  g_hash_table_iter_init (&iter, children);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&child))
+    {
+      if (child->reported)
+	continue;
+
+      data.entry = child->name;
+      if (child->copied)
+	{
+	  child_path = g_build_filename (path, child->name, NULL);
+	  if (!enumerate_keys_locked (tree, child_path,
+				      enum_dir_keys_callback, &data))
+	    {
+	      g_free (child_path);
+	      break;
+	    }
+	  g_free (child_path);
+	}
+      else if (!enumerate_journal_keys (child->keys,
+					enum_dir_keys_callback, &data))
+	break;
+    }
+
  out:
-  g_free (res_path);
-  g_hash_table_destroy (keys);
   g_rw_lock_reader_unlock (&metatree_lock);
-}
 
+  g_free (res_path);
+  g_hash_table_destroy (no_keys);
+  g_hash_table_destroy (children);
+}
 
 static void
 copy_tree_to_builder (MetaTree *tree,
@@ -2573,6 +3116,145 @@ meta_tree_copy (MetaTree                         *tree,
   return res;
 }
 
+struct _MetaTreeBatch {
+  guint64 mtime;
+  GString *entries;
+  GArray *entry_sizes;
+};
+
+MetaTreeBatch *
+meta_tree_batch_new (void)
+{
+  MetaTreeBatch *batch;
+
+  batch = g_new0 (MetaTreeBatch, 1);
+  batch->mtime = time (NULL);
+  batch->entries = g_string_new (NULL);
+  batch->entry_sizes = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  return batch;
+}
+
+void
+meta_tree_batch_free (MetaTreeBatch *batch)
+{
+  g_string_free (batch->entries, TRUE);
+  g_array_free (batch->entry_sizes, TRUE);
+  g_free (batch);
+}
+
+static void
+meta_tree_batch_append (MetaTreeBatch *batch,
+			GString *entry)
+{
+  guint32 size;
+
+  size = entry->len;
+  g_string_append_len (batch->entries, entry->str, entry->len);
+  g_array_append_val (batch->entry_sizes, size);
+  g_string_free (entry, TRUE);
+}
+
+void
+meta_tree_batch_set_string (MetaTreeBatch *batch,
+			    const char    *path,
+			    const char    *key,
+			    const char    *value)
+{
+  meta_tree_batch_append (batch,
+			  meta_journal_entry_new_set (batch->mtime, path, key, value));
+}
+
+void
+meta_tree_batch_set_stringv (MetaTreeBatch *batch,
+			     const char    *path,
+			     const char    *key,
+			     char         **value)
+{
+  meta_tree_batch_append (batch,
+			  meta_journal_entry_new_setv (batch->mtime, path, key, value));
+}
+
+void
+meta_tree_batch_unset (MetaTreeBatch *batch,
+		       const char    *path,
+		       const char    *key)
+{
+  meta_tree_batch_append (batch,
+			  meta_journal_entry_new_unset (batch->mtime, path, key));
+}
+
+void
+meta_tree_batch_remove (MetaTreeBatch *batch,
+			const char    *path)
+{
+  meta_tree_batch_append (batch,
+			  meta_journal_entry_new_remove (batch->mtime, path));
+}
+
+/* Writes all the changes in the batch to the journal in one go. If
+   the batch doesn't even fit in a freshly rotated journal the entries
+   are added one at a time instead, rotating as needed. When that
+   fails, FALSE is returned with the earlier entries already applied. */
+gboolean
+meta_tree_batch_apply (MetaTree      *tree,
+		       MetaTreeBatch *batch)
+{
+  const char *entry;
+  guint32 size;
+  gboolean res;
+  guint i;
+
+  if (batch->entry_sizes->len == 0)
+    return TRUE;
+
+  g_rw_lock_writer_lock (&metatree_lock);
+
+  if (tree->journal == NULL ||
+      !tree->journal->journal_valid)
+    {
+      res = FALSE;
+      goto out;
+    }
+
+  res = TRUE;
+  if (meta_journal_add_entries (tree->journal,
+				batch->entries->str, batch->entries->len,
+				batch->entry_sizes->len))
+    goto out;
+
+  if (!meta_tree_flush_locked (tree))
+    {
+      res = FALSE;
+      goto out;
+    }
+
+  if (meta_journal_add_entries (tree->journal,
+				batch->entries->str, batch->entries->len,
+				batch->entry_sizes->len))
+    goto out;
+
+  entry = batch->entries->str;
+  for (i = 0; i < batch->entry_sizes->len; i++)
+    {
+      size = g_array_index (batch->entry_sizes, guint32, i);
+      if (!meta_journal_add_entries (tree->journal, entry, size, 1))
+	{
+	  if (!meta_tree_flush_locked (tree) ||
+	      !meta_journal_add_entries (tree->journal, entry, size, 1))
+	    {
+	      res = FALSE;
+	      break;
+	    }
+	}
+      entry += size;
+    }
+
+ out:
+  g_rw_lock_writer_unlock (&metatree_lock);
+  return res;
+}
+
 static char *
 canonicalize_filename (const char *filename)
 {
@@ -2757,6 +3439,127 @@ struct _MetaLookupCache {
   char *last_device_tree;
 };
 
+/* MetaLookupCaches are often short-lived (one per get or set), so the
+ * expensive results are also kept in a process wide cache. It is
+ * flushed whenever /proc/self/mountinfo signals a change. Symlinks can
+ * change without that, so resolved parents also expire after a while.
+ */
+#define SHARED_PARENT_TIMEOUT_USEC (2 * G_USEC_PER_SEC)
+#define SHARED_PARENT_MAX 1024
+
+typedef struct {
+  char *expanded;
+  dev_t dev;
+  char *mountpoint; /* NULL if not looked up yet */
+  char *mountpoint_extra_prefix;
+  gint64 expires;
+} SharedParentInfo;
+
+static GHashTable *shared_parents = NULL; /* parent -> SharedParentInfo */
+static GHashTable *shared_device_trees = NULL; /* dev_t -> tree name or NULL */
+static guint shared_mount_generation = 0;
+G_LOCK_DEFINE_STATIC (shared_lookup_cache);
+
+static guint get_mount_generation (void);
+
+static void
+shared_parent_info_free (SharedParentInfo *info)
+{
+  g_free (info->expanded);
+  g_free (info->mountpoint);
+  g_free (info->mountpoint_extra_prefix);
+  g_free (info);
+}
+
+/* Call with shared_lookup_cache lock held */
+static void
+shared_cache_ensure_locked (guint mount_generation)
+{
+  if (shared_parents == NULL)
+    {
+      shared_parents = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free,
+					      (GDestroyNotify)shared_parent_info_free);
+      shared_device_trees = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+						   g_free, g_free);
+    }
+  else if (shared_mount_generation != mount_generation ||
+	   g_hash_table_size (shared_parents) > SHARED_PARENT_MAX)
+    {
+      g_hash_table_remove_all (shared_parents);
+      if (shared_mount_generation != mount_generation)
+	g_hash_table_remove_all (shared_device_trees);
+    }
+
+  shared_mount_generation = mount_generation;
+}
+
+/* Fills in the cache from the shared cache, returns FALSE on a miss */
+static gboolean
+shared_cache_lookup_parent (MetaLookupCache *cache,
+			    const char *parent)
+{
+  SharedParentInfo *info;
+  guint generation;
+  gboolean res;
+
+  generation = get_mount_generation ();
+
+  G_LOCK (shared_lookup_cache);
+  shared_cache_ensure_locked (generation);
+
+  res = FALSE;
+  info = g_hash_table_lookup (shared_parents, parent);
+  if (info != NULL && info->expires < g_get_monotonic_time ())
+    {
+      g_hash_table_remove (shared_parents, parent);
+      info = NULL;
+    }
+
+  if (info != NULL)
+    {
+      cache->last_parent_expanded = g_strdup (info->expanded);
+      cache->last_parent_dev = info->dev;
+      cache->last_parent_mountpoint = g_strdup (info->mountpoint);
+      cache->last_parent_mountpoint_extra_prefix = g_strdup (info->mountpoint_extra_prefix);
+      res = TRUE;
+    }
+
+  G_UNLOCK (shared_lookup_cache);
+
+  return res;
+}
+
+static void
+shared_cache_store_parent (MetaLookupCache *cache)
+{
+  SharedParentInfo *info;
+
+  G_LOCK (shared_lookup_cache);
+
+  if (shared_parents != NULL)
+    {
+      info = g_hash_table_lookup (shared_parents, cache->last_parent);
+      if (info == NULL)
+	{
+	  info = g_new0 (SharedParentInfo, 1);
+	  info->expanded = g_strdup (cache->last_parent_expanded);
+	  info->dev = cache->last_parent_dev;
+	  info->expires = g_get_monotonic_time () + SHARED_PARENT_TIMEOUT_USEC;
+	  g_hash_table_insert (shared_parents, g_strdup (cache->last_parent), info);
+	}
+
+      if (info->mountpoint == NULL &&
+	  cache->last_parent_mountpoint != NULL)
+	{
+	  info->mountpoint = g_strdup (cache->last_parent_mountpoint);
+	  info->mountpoint_extra_prefix = g_strdup (cache->last_parent_mountpoint_extra_prefix);
+	}
+    }
+
+  G_UNLOCK (shared_lookup_cache);
+}
+
 #ifdef HAVE_LIBUDEV
 
 static struct udev *udev;
@@ -2804,11 +3607,35 @@ get_tree_for_device (MetaLookupCache *cache,
 		     dev_t device)
 {
 #ifdef HAVE_LIBUDEV
+  gint64 devnum;
+  gpointer tree;
+
   if (device != cache->last_device)
     {
       cache->last_device = device;
       g_free (cache->last_device_tree);
-      cache->last_device_tree = get_tree_from_udev (cache, device);
+
+      devnum = device;
+      G_LOCK (shared_lookup_cache);
+      if (shared_device_trees != NULL &&
+	  g_hash_table_lookup_extended (shared_device_trees, &devnum, NULL, &tree))
+	{
+	  cache->last_device_tree = g_strdup (tree);
+	  G_UNLOCK (shared_lookup_cache);
+	}
+      else
+	{
+	  G_UNLOCK (shared_lookup_cache);
+
+	  cache->last_device_tree = get_tree_from_udev (cache, device);
+
+	  G_LOCK (shared_lookup_cache);
+	  if (shared_device_trees != NULL)
+	    g_hash_table_insert (shared_device_trees,
+				 g_memdup (&devnum, sizeof (gint64)),
+				 g_strdup (cache->last_device_tree));
+	  G_UNLOCK (shared_lookup_cache);
+	}
     }
 
   return cache->last_device_tree;
@@ -2827,6 +3654,7 @@ typedef struct {
 static gboolean mountinfo_initialized = FALSE;
 static int mountinfo_fd = -1;
 static MountinfoEntry *mountinfo_roots = NULL;
+static guint mountinfo_generation = 0;
 G_LOCK_DEFINE_STATIC (mountinfo);
 
 /* We want to avoid mmap and stat as these are not ideal
@@ -3010,6 +3838,7 @@ update_mountinfo (void)
     }
 
   free_mountinfo ();
+  mountinfo_generation++;
   contents = read_contents (mountinfo_fd);
   lseek (mountinfo_fd, SEEK_SET, 0);
   if (contents)
@@ -3048,6 +3877,27 @@ find_mountinfo_root_for_mountpoint (const char *mountpoint)
   return res;
 }
 
+static guint
+get_mount_generation (void)
+{
+  guint res;
+
+  G_LOCK (mountinfo);
+  update_mountinfo ();
+  res = mountinfo_generation;
+  G_UNLOCK (mountinfo);
+
+  return res;
+}
+
+#else
+
+static guint
+get_mount_generation (void)
+{
+  return 0;
+}
+
 #endif
 
 
@@ -3108,6 +3958,9 @@ find_mountpoint_for (MetaLookupCache *cache,
 	  g_free (dir);
 	  cache->last_parent_mountpoint = last;
 	  cache->last_parent_mountpoint_extra_prefix = get_extra_prefix_for_mount (last);
+	  /* Only valid for siblings if file isn't a mountpoint itself */
+	  if (dev == cache->last_parent_dev)
+	    shared_cache_store_parent (cache);
 	  break;
 	}
 
@@ -3236,12 +4089,18 @@ expand_parents (MetaLookupCache *cache,
       g_free (cache->last_parent);
       g_free (cache->last_parent_expanded);
       cache->last_parent = parent;
-      cache->last_parent_expanded = expand_all_symlinks (parent, &parent_dev);
-      cache->last_parent_dev = parent_dev;
+      cache->last_parent_expanded = NULL;
       g_free (cache->last_parent_mountpoint);
       cache->last_parent_mountpoint = NULL;
       g_free (cache->last_parent_mountpoint_extra_prefix);
       cache->last_parent_mountpoint_extra_prefix = NULL;
+
+      if (!shared_cache_lookup_parent (cache, parent))
+	{
+	  cache->last_parent_expanded = expand_all_symlinks (parent, &parent_dev);
+	  cache->last_parent_dev = parent_dev;
+	  shared_cache_store_parent (cache);
+	}
    }
   else
     g_free (parent);
@@ -27,6 +27,7 @@
 
 typedef struct _MetaTree MetaTree;
 typedef struct _MetaLookupCache MetaLookupCache;
+typedef struct _MetaTreeBatch MetaTreeBatch;
 
 typedef enum {
   META_KEY_TYPE_NONE,
@@ -47,6 +48,12 @@ typedef gboolean (*meta_tree_keys_enumerate_callback) (const char *key,
 						       gpointer value,
 						       gpointer user_data);
 
+typedef gboolean (*meta_tree_dir_keys_enumerate_callback) (const char *entry,
+							   const char *key,
+							   MetaKeyType type,
+							   gpointer value,
+							   gpointer user_data);
+
 /* MetaLookupCache is not threadsafe */
 MetaLookupCache *meta_lookup_cache_new         (void);
 void             meta_lookup_cache_free        (MetaLookupCache *cache);
@@ -86,6 +93,10 @@ void        meta_tree_enumerate_keys   (MetaTree                         *tree,
 					const char                       *path,
 					meta_tree_keys_enumerate_callback callback,
 					gpointer                          user_data);
+void        meta_tree_enumerate_dir_keys (MetaTree                              *tree,
+					  const char                            *path,
+					  meta_tree_dir_keys_enumerate_callback  callback,
+					  gpointer                               user_data);
 gboolean    meta_tree_flush            (MetaTree                         *tree);
 gboolean    meta_tree_unset            (MetaTree                         *tree,
 					const char                       *path,
@@ -103,4 +114,23 @@ gboolean    meta_tree_remove           (MetaTree                         *tree,
 gboolean    meta_tree_copy             (MetaTree                         *tree,
 					const char                       *src,
 					const char                       *dest);
+
+/* A set of changes that is written to the journal at once */
+MetaTreeBatch *meta_tree_batch_new         (void);
+void           meta_tree_batch_free        (MetaTreeBatch  *batch);
+void           meta_tree_batch_set_string  (MetaTreeBatch  *batch,
+					    const char     *path,
+					    const char     *key,
+					    const char     *value);
+void           meta_tree_batch_set_stringv (MetaTreeBatch  *batch,
+					    const char     *path,
+					    const char     *key,
+					    char          **value);
+void           meta_tree_batch_unset       (MetaTreeBatch  *batch,
+					    const char     *path,
+					    const char     *key);
+void           meta_tree_batch_remove      (MetaTreeBatch  *batch,
+					    const char     *path);
+gboolean       meta_tree_batch_apply       (MetaTree       *tree,
+					    MetaTreeBatch  *batch);
 #endif /* __META_TREE_H__ */
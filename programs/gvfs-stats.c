@@ -0,0 +1,297 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <locale.h>
+#include <gio/gio.h>
+
+#define DAEMON_NAME         "org.gtk.vfs.Daemon"
+#define MOUNTTRACKER_PATH   "/org/gtk/vfs/mounttracker"
+#define MOUNTTRACKER_IFACE  "org.gtk.vfs.MountTracker"
+#define METRICS_PATH        "/org/gtk/vfs/metrics"
+#define METRICS_IFACE       "org.gtk.vfs.Metrics"
+
+static gboolean show_histograms = FALSE;
+static GOptionEntry entries[] =
+{
+  { "histograms", 'H', 0, G_OPTION_ARG_NONE, &show_histograms, N_("Show the full histograms"), NULL },
+  { NULL }
+};
+
+static char *
+format_usec (guint64 usec)
+{
+  if (usec < 1000)
+    return g_strdup_printf ("%" G_GUINT64_FORMAT "us", usec);
+  else if (usec < 1000 * 1000)
+    return g_strdup_printf ("%.1fms", usec / 1000.0);
+  else
+    return g_strdup_printf ("%.2fs", usec / (1000.0 * 1000.0));
+}
+
+/* Returns the lower bound of the bucket holding the given percentile */
+static guint64
+histogram_percentile (GVariant *histogram,
+                      double    percentile)
+{
+  GVariantIter iter;
+  guint64 bound, last_bound, total, seen;
+  guint32 count;
+
+  total = 0;
+  g_variant_iter_init (&iter, histogram);
+  while (g_variant_iter_next (&iter, "(tu)", &bound, &count))
+    total += count;
+
+  if (total == 0)
+    return 0;
+
+  seen = 0;
+  last_bound = 0;
+  g_variant_iter_init (&iter, histogram);
+  while (g_variant_iter_next (&iter, "(tu)", &bound, &count))
+    {
+      seen += count;
+      last_bound = bound;
+      if (seen >= total * percentile)
+        break;
+    }
+
+  return last_bound;
+}
+
+static void
+print_histogram (const char *name,
+                 GVariant   *histogram)
+{
+  GVariantIter iter;
+  guint64 bound;
+  guint32 count;
+  char *p50, *p90, *p99, *max, *str;
+
+  if (histogram == NULL)
+    return;
+
+  p50 = format_usec (histogram_percentile (histogram, 0.5));
+  p90 = format_usec (histogram_percentile (histogram, 0.9));
+  p99 = format_usec (histogram_percentile (histogram, 0.99));
+  max = format_usec (histogram_percentile (histogram, 1.0));
+
+  g_print ("    %-10s p50 %-8s p90 %-8s p99 %-8s max %s\n", name, p50, p90, p99, max);
+
+  g_free (p50);
+  g_free (p90);
+  g_free (p99);
+  g_free (max);
+
+  if (!show_histograms)
+    return;
+
+  g_variant_iter_init (&iter, histogram);
+  while (g_variant_iter_next (&iter, "(tu)", &bound, &count))
+    {
+      str = format_usec (bound);
+      g_print ("      >= %-10s %u\n", str, count);
+      g_free (str);
+    }
+}
+
+static void
+print_metrics (GVariant   *metrics,
+               GHashTable *display_names)
+{
+  GVariantIter iter;
+  const char *object_path, *job_type, *display_name, *last_path;
+  GVariant *stats, *histogram;
+  guint64 count, failed, bytes;
+  char *size;
+
+  last_path = NULL;
+  g_variant_iter_init (&iter, metrics);
+  while (g_variant_iter_next (&iter, "(&s&s@a{sv})", &object_path, &job_type, &stats))
+    {
+      if (last_path == NULL || strcmp (last_path, object_path) != 0)
+        {
+          display_name = g_hash_table_lookup (display_names, object_path);
+          g_print ("%s (%s)\n", display_name ? display_name : _("Unknown mount"), object_path);
+          last_path = object_path;
+        }
+
+      count = failed = bytes = 0;
+      g_variant_lookup (stats, "count", "t", &count);
+      g_variant_lookup (stats, "failed", "t", &failed);
+      g_variant_lookup (stats, "bytes", "t", &bytes);
+
+      /* Strip the common prefix of the type names */
+      if (g_str_has_prefix (job_type, "GVfsJob"))
+        job_type += strlen ("GVfsJob");
+
+      g_print ("  %s: %" G_GUINT64_FORMAT " jobs, %" G_GUINT64_FORMAT " failed",
+               job_type, count, failed);
+      if (bytes != 0)
+        {
+          size = g_format_size (bytes);
+          g_print (", %s", size);
+          g_free (size);
+        }
+      g_print ("\n");
+
+      histogram = g_variant_lookup_value (stats, "queue-time", G_VARIANT_TYPE ("a(tu)"));
+      print_histogram (_("queued"), histogram);
+      if (histogram)
+        g_variant_unref (histogram);
+
+      histogram = g_variant_lookup_value (stats, "run-time", G_VARIANT_TYPE ("a(tu)"));
+      print_histogram (_("running"), histogram);
+      if (histogram)
+        g_variant_unref (histogram);
+
+      histogram = g_variant_lookup_value (stats, "reply-time", G_VARIANT_TYPE ("a(tu)"));
+      print_histogram (_("replying"), histogram);
+      if (histogram)
+        g_variant_unref (histogram);
+
+      g_variant_unref (stats);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  GError *error;
+  GOptionContext *context;
+  GDBusConnection *connection;
+  GVariant *mounts, *mount_list, *metrics, *metrics_list;
+  GVariantIter iter;
+  GHashTable *display_names;
+  GPtrArray *dbus_ids;
+  const char *dbus_id, *object_path, *display_name;
+  int retval = 0;
+  guint i;
+
+  setlocale (LC_ALL, "");
+
+  bindtextdomain (GETTEXT_PACKAGE, GVFS_LOCALEDIR);
+  bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+  textdomain (GETTEXT_PACKAGE);
+
+  g_type_init ();
+
+  error = NULL;
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context, _("Show job statistics of the mount daemons."));
+  g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+  g_option_context_parse (context, &argc, &argv, &error);
+  g_option_context_free (context);
+
+  if (error != NULL)
+    {
+      g_printerr (_("Error parsing commandline options: %s\n"), error->message);
+      g_printerr ("\n");
+      g_printerr (_("Try \"%s --help\" for more information."), g_get_prgname ());
+      g_printerr ("\n");
+      g_error_free (error);
+      return 1;
+    }
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  if (connection == NULL)
+    {
+      g_printerr (_("Error connecting to the session bus: %s\n"), error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  mounts = g_dbus_connection_call_sync (connection,
+                                        DAEMON_NAME,
+                                        MOUNTTRACKER_PATH,
+                                        MOUNTTRACKER_IFACE,
+                                        "ListMounts",
+                                        NULL,
+                                        G_VARIANT_TYPE ("(a(sosssssbay(aya{sv})ay))"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1, NULL, &error);
+  if (mounts == NULL)
+    {
+      g_printerr (_("Error listing mounts: %s\n"), error->message);
+      g_error_free (error);
+      g_object_unref (connection);
+      return 1;
+    }
+
+  /* A daemon may handle several mounts */
+  display_names = g_hash_table_new (g_str_hash, g_str_equal);
+  dbus_ids = g_ptr_array_new ();
+
+  mount_list = g_variant_get_child_value (mounts, 0);
+  g_variant_iter_init (&iter, mount_list);
+  while (g_variant_iter_next (&iter, "(&s&o&s@s@s@s@s@b@ay@(aya{sv})@ay)",
+                              &dbus_id, &object_path, &display_name,
+                              NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL))
+    {
+      g_hash_table_insert (display_names, (gpointer) object_path, (gpointer) display_name);
+
+      for (i = 0; i < dbus_ids->len; i++)
+        if (strcmp (g_ptr_array_index (dbus_ids, i), dbus_id) == 0)
+          break;
+      if (i == dbus_ids->len)
+        g_ptr_array_add (dbus_ids, (gpointer) dbus_id);
+    }
+
+  for (i = 0; i < dbus_ids->len; i++)
+    {
+      dbus_id = g_ptr_array_index (dbus_ids, i);
+
+      metrics = g_dbus_connection_call_sync (connection,
+                                             dbus_id,
+                                             METRICS_PATH,
+                                             METRICS_IFACE,
+                                             "GetMetrics",
+                                             NULL,
+                                             G_VARIANT_TYPE ("(a(ssa{sv}))"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             -1, NULL, &error);
+      if (metrics == NULL)
+        {
+          g_printerr (_("Error getting statistics from %s: %s\n"), dbus_id, error->message);
+          g_clear_error (&error);
+          retval = 1;
+          continue;
+        }
+
+      metrics_list = g_variant_get_child_value (metrics, 0);
+      print_metrics (metrics_list, display_names);
+      g_variant_unref (metrics_list);
+      g_variant_unref (metrics);
+    }
+
+  g_ptr_array_free (dbus_ids, TRUE);
+  g_hash_table_destroy (display_names);
+  g_variant_unref (mount_list);
+  g_variant_unref (mounts);
+  g_object_unref (connection);
+
+  return retval;
+}
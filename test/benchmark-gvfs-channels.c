@@ -0,0 +1,898 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Load generator for the data channels of a backend daemon. It opens
+ * channels with OpenForRead/OpenForWrite like the client does, but then
+ * talks the GVfsDaemonSocketProtocol directly from one thread per
+ * channel, with a configurable mix of reads, writes, seeks, cancels and
+ * info queries. It reports throughput, latency percentiles per request
+ * type and the resident memory of the backend process as JSON.
+ *
+ * Usage example, against a localtest mount:
+ *   benchmark-gvfs-channels --readers 64 --duration 30 localtest: /tmp/big-file
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <locale.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+#include "gvfsdaemonprotocol.h"
+#include "gmountspec.h"
+#include "gmounttracker.h"
+#include "gvfsdbus.h"
+
+#define QUERY_INFO_ATTRIBUTES "standard::type,standard::size,time::modified"
+#define RSS_SAMPLE_INTERVAL   (G_USEC_PER_SEC / 10)
+
+typedef enum {
+  OP_OPEN,
+  OP_READ,
+  OP_WRITE,
+  OP_SEEK,
+  OP_QUERY_INFO,
+  OP_CANCEL,
+  OP_CLOSE,
+  N_OPS
+} OpType;
+
+static const char *op_names[N_OPS] = {
+  "open", "read", "write", "seek", "query-info", "cancel", "close"
+};
+
+typedef struct {
+  int index;
+  gboolean writer;
+  int fd;
+  guint32 seq_nr;
+  guint64 file_size;
+  guint64 offset;
+  GRand *rand;
+
+  char *buffer;
+  gsize buffer_size;
+
+  GArray *samples[N_OPS]; /* gint64, usec */
+  guint64 errors[N_OPS];
+  guint64 bytes_read;
+  guint64 bytes_written;
+  guint64 readahead_bytes;
+  char *failure;
+
+  GThread *thread;
+} Channel;
+
+typedef struct {
+  guint32 type;
+  guint32 seq_nr;
+  guint32 arg1;
+  guint32 arg2;
+  gsize data_len;
+} Reply;
+
+static gint n_readers = 8;
+static gint n_writers = 0;
+static gint duration = 10;
+static gint block_size = 64 * 1024;
+static gint max_write_size = 64;
+static gint seed = 1;
+static char *mix = NULL;
+static char *label = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "readers", 'r', 0, G_OPTION_ARG_INT, &n_readers, "Number of read channels", "N" },
+  { "writers", 'w', 0, G_OPTION_ARG_INT, &n_writers, "Number of write channels, each writes PATH.<n>", "N" },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Seconds to run", "SECONDS" },
+  { "block-size", 'b', 0, G_OPTION_ARG_INT, &block_size, "Size of reads and writes", "BYTES" },
+  { "max-write-size", 0, 0, G_OPTION_ARG_INT, &max_write_size, "Writers seek back to the start after this many MiB", "MIB" },
+  { "mix", 'm', 0, G_OPTION_ARG_STRING, &mix, "Request weights, default read=80,write=80,seek=10,query-info=5,cancel=5", "MIX" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed for choosing requests and offsets", "N" },
+  { "label", 'l', 0, G_OPTION_ARG_STRING, &label, "Name of the run, copied to the output", "LABEL" },
+  { NULL }
+};
+
+static guint weights[N_OPS];
+static volatile gint stop = 0;
+
+static GMountInfo *mount_info = NULL;
+static char *path = NULL;
+
+static gboolean
+parse_mix (const char *str,
+           GError    **error)
+{
+  char **items, **kv;
+  guint i, op;
+  gboolean res;
+
+  if (str == NULL)
+    str = "read=80,write=80,seek=10,query-info=5,cancel=5";
+
+  memset (weights, 0, sizeof (weights));
+
+  res = TRUE;
+  items = g_strsplit (str, ",", -1);
+  for (i = 0; res && items[i] != NULL; i++)
+    {
+      kv = g_strsplit (items[i], "=", 2);
+      for (op = OP_READ; op <= OP_CANCEL; op++)
+        if (kv[0] != NULL && strcmp (g_strstrip (kv[0]), op_names[op]) == 0)
+          break;
+
+      if (op > OP_CANCEL || kv[1] == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "Invalid mix entry '%s'", items[i]);
+          res = FALSE;
+        }
+      else
+        weights[op] = g_ascii_strtoull (kv[1], NULL, 10);
+
+      g_strfreev (kv);
+    }
+  g_strfreev (items);
+
+  return res;
+}
+
+static gboolean
+write_all (int         fd,
+           const char *data,
+           gsize       len)
+{
+  gssize res;
+
+  while (len > 0)
+    {
+      res = write (fd, data, len);
+      if (res == -1 && errno == EINTR)
+        continue;
+      if (res <= 0)
+        return FALSE;
+
+      data += res;
+      len -= res;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+read_all (int   fd,
+          char *data,
+          gsize len)
+{
+  gssize res;
+
+  while (len > 0)
+    {
+      res = read (fd, data, len);
+      if (res == -1 && errno == EINTR)
+        continue;
+      if (res <= 0)
+        return FALSE;
+
+      data += res;
+      len -= res;
+    }
+
+  return TRUE;
+}
+
+static guint32
+send_request (Channel    *channel,
+              guint32     command,
+              guint32     arg1,
+              guint32     arg2,
+              const char *data,
+              gsize       data_len)
+{
+  GVfsDaemonSocketProtocolRequest request;
+  guint32 seq_nr;
+
+  /* 0 is used for readahead replies */
+  seq_nr = ++channel->seq_nr;
+  if (seq_nr == 0)
+    seq_nr = ++channel->seq_nr;
+
+  request.command = g_htonl (command);
+  request.seq_nr = g_htonl (seq_nr);
+  request.arg1 = g_htonl (arg1);
+  request.arg2 = g_htonl (arg2);
+  request.data_len = g_htonl (data_len);
+
+  if (!write_all (channel->fd, (char *)&request, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE) ||
+      (data_len > 0 && !write_all (channel->fd, data, data_len)))
+    {
+      if (channel->failure == NULL)
+        channel->failure = g_strdup_printf ("Failed to send request: %s", g_strerror (errno));
+      return 0;
+    }
+
+  return seq_nr;
+}
+
+/* Waits for the reply to seq_nr, the payload ends up in channel->buffer.
+   Readahead data sent in between is counted and dropped. */
+static gboolean
+wait_reply (Channel *channel,
+            guint32  seq_nr,
+            Reply   *reply)
+{
+  GVfsDaemonSocketProtocolReply header;
+
+  if (seq_nr == 0)
+    return FALSE;
+
+  while (TRUE)
+    {
+      if (!read_all (channel->fd, (char *)&header, G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE))
+        goto closed;
+
+      reply->type = g_ntohl (header.type);
+      reply->seq_nr = g_ntohl (header.seq_nr);
+      reply->arg1 = g_ntohl (header.arg1);
+      reply->arg2 = g_ntohl (header.arg2);
+
+      switch (reply->type)
+        {
+        case G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA:
+          reply->data_len = reply->arg1;
+          break;
+        case G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR:
+        case G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_INFO:
+          reply->data_len = reply->arg2;
+          break;
+        default:
+          reply->data_len = 0;
+          break;
+        }
+
+      if (reply->data_len > channel->buffer_size)
+        {
+          channel->buffer_size = reply->data_len;
+          channel->buffer = g_realloc (channel->buffer, channel->buffer_size);
+        }
+
+      if (reply->data_len > 0 &&
+          !read_all (channel->fd, channel->buffer, reply->data_len))
+        goto closed;
+
+      if (reply->seq_nr == seq_nr)
+        return TRUE;
+
+      if (reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+        channel->readahead_bytes += reply->data_len;
+    }
+
+ closed:
+  if (channel->failure == NULL)
+    channel->failure = g_strdup ("Channel closed by the daemon");
+  return FALSE;
+}
+
+static gboolean
+reply_is_cancelled (Channel *channel,
+                    Reply   *reply)
+{
+  const char *domain;
+
+  if (reply->type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR ||
+      reply->data_len == 0)
+    return FALSE;
+
+  /* Payload is the error domain and message, both nul terminated */
+  domain = channel->buffer;
+  return memchr (domain, 0, reply->data_len) != NULL &&
+    g_quark_try_string (domain) == G_IO_ERROR &&
+    reply->arg1 == G_IO_ERROR_CANCELLED;
+}
+
+static gboolean
+do_seek (Channel *channel,
+         guint32  command,
+         guint64  offset,
+         Reply   *reply)
+{
+  guint32 seq_nr;
+
+  seq_nr = send_request (channel, command,
+                         offset & 0xffffffff, offset >> 32,
+                         NULL, 0);
+  if (!wait_reply (channel, seq_nr, reply))
+    return FALSE;
+
+  if (reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SEEK_POS)
+    channel->offset = ((guint64)reply->arg1) | (((guint64)reply->arg2) << 32);
+
+  return TRUE;
+}
+
+static void
+add_sample (Channel *channel,
+            OpType   op,
+            gint64   start,
+            gboolean failed)
+{
+  gint64 usec;
+
+  usec = g_get_monotonic_time () - start;
+  g_array_append_val (channel->samples[op], usec);
+  if (failed)
+    channel->errors[op]++;
+}
+
+static gboolean
+open_channel (Channel *channel)
+{
+  GVfsDBusMount *proxy;
+  GUnixFDList *fd_list;
+  GVariant *fd_id_val;
+  GError *error;
+  gboolean can_seek, res;
+  guint64 initial_offset;
+  char *write_path;
+  gint64 start;
+
+  error = NULL;
+  proxy = gvfs_dbus_mount_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
+                                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                  mount_info->dbus_id,
+                                                  mount_info->object_path,
+                                                  NULL, &error);
+  if (proxy == NULL)
+    goto error;
+
+  fd_list = NULL;
+  fd_id_val = NULL;
+
+  start = g_get_monotonic_time ();
+  if (channel->writer)
+    {
+      write_path = g_strdup_printf ("%s.%d", path, channel->index);
+      /* 2 is replace, like g_file_replace() */
+      res = gvfs_dbus_mount_call_open_for_write_sync (proxy, write_path, 2, "", FALSE, 0,
+                                                      getpid (), NULL,
+                                                      &fd_id_val, &can_seek, &initial_offset,
+                                                      &fd_list, NULL, &error);
+      g_free (write_path);
+    }
+  else
+    res = gvfs_dbus_mount_call_open_for_read_sync (proxy, path, getpid (), NULL,
+                                                   &fd_id_val, &can_seek,
+                                                   &fd_list, NULL, &error);
+  add_sample (channel, OP_OPEN, start, !res);
+  g_object_unref (proxy);
+
+  if (!res)
+    goto error;
+
+  if (fd_list == NULL || fd_id_val == NULL ||
+      g_unix_fd_list_get_length (fd_list) != 1 ||
+      (channel->fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_id_val), &error)) == -1)
+    {
+      if (error == NULL)
+        g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Didn't get stream file descriptor");
+      if (fd_id_val)
+        g_variant_unref (fd_id_val);
+      if (fd_list)
+        g_object_unref (fd_list);
+      goto error;
+    }
+
+  g_variant_unref (fd_id_val);
+  g_object_unref (fd_list);
+
+  return TRUE;
+
+ error:
+  channel->failure = g_strdup_printf ("Failed to open channel: %s", error->message);
+  g_error_free (error);
+  return FALSE;
+}
+
+static OpType
+choose_op (Channel *channel)
+{
+  guint total, r, op;
+  OpType data_op;
+
+  data_op = channel->writer ? OP_WRITE : OP_READ;
+
+  total = 0;
+  for (op = OP_READ; op <= OP_CANCEL; op++)
+    if (op != (channel->writer ? OP_READ : OP_WRITE))
+      total += weights[op];
+
+  if (total == 0)
+    return data_op;
+
+  r = g_rand_int_range (channel->rand, 0, total);
+  for (op = OP_READ; op <= OP_CANCEL; op++)
+    {
+      if (op == (channel->writer ? OP_READ : OP_WRITE))
+        continue;
+      if (r < weights[op])
+        return op;
+      r -= weights[op];
+    }
+
+  return data_op;
+}
+
+/* Sends a read or a write */
+static guint32
+send_data_request (Channel *channel)
+{
+  if (channel->writer)
+    return send_request (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_WRITE,
+                         block_size, 0, channel->buffer, block_size);
+  else
+    return send_request (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_READ,
+                         block_size, 0, NULL, 0);
+}
+
+static void
+account_data_reply (Channel *channel,
+                    Reply   *reply)
+{
+  if (reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+    {
+      channel->bytes_read += reply->data_len;
+      channel->offset += reply->data_len;
+    }
+  else if (reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_WRITTEN)
+    {
+      channel->bytes_written += reply->arg1;
+      channel->offset += reply->arg1;
+    }
+}
+
+static gboolean
+run_op (Channel *channel,
+        OpType   op)
+{
+  Reply reply;
+  guint32 seq_nr, cancel_seq_nr;
+  guint64 offset, n_blocks;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+
+  switch (op)
+    {
+    case OP_READ:
+    case OP_WRITE:
+      seq_nr = send_data_request (channel);
+      if (!wait_reply (channel, seq_nr, &reply))
+        return FALSE;
+      add_sample (channel, op, start, reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR);
+      account_data_reply (channel, &reply);
+
+      /* Wrap around at the end of the file */
+      if ((op == OP_READ && reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA && reply.data_len == 0) ||
+          (op == OP_WRITE && channel->offset >= (guint64) max_write_size * 1024 * 1024))
+        return do_seek (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_SET, 0, &reply);
+      break;
+
+    case OP_SEEK:
+      n_blocks = MAX (channel->writer ?
+                      (guint64) max_write_size * 1024 * 1024 / block_size :
+                      channel->file_size / block_size, 1);
+      offset = (guint64) g_rand_int_range (channel->rand, 0, (gint32) MIN (n_blocks, G_MAXINT32)) * block_size;
+      if (!do_seek (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_SET, offset, &reply))
+        return FALSE;
+      add_sample (channel, op, start, reply.type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SEEK_POS);
+      break;
+
+    case OP_QUERY_INFO:
+      seq_nr = send_request (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_QUERY_INFO,
+                             0, 0, QUERY_INFO_ATTRIBUTES, strlen (QUERY_INFO_ATTRIBUTES));
+      if (!wait_reply (channel, seq_nr, &reply))
+        return FALSE;
+      add_sample (channel, op, start, reply.type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_INFO);
+      break;
+
+    case OP_CANCEL:
+      /* Time until the cancelled request is answered, either with
+         its normal reply or with G_IO_ERROR_CANCELLED */
+      seq_nr = send_data_request (channel);
+      cancel_seq_nr = send_request (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_CANCEL,
+                                    seq_nr, 0, NULL, 0);
+      if (cancel_seq_nr == 0 || !wait_reply (channel, seq_nr, &reply))
+        return FALSE;
+      add_sample (channel, op, start,
+                  reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR &&
+                  !reply_is_cancelled (channel, &reply));
+      account_data_reply (channel, &reply);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  return TRUE;
+}
+
+static gpointer
+channel_thread (gpointer user_data)
+{
+  Channel *channel = user_data;
+  Reply reply;
+  guint32 seq_nr;
+  gint64 start;
+
+  if (!open_channel (channel))
+    return NULL;
+
+  if (!channel->writer)
+    {
+      /* Seeking to the end tells us the size */
+      if (!do_seek (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_END, 0, &reply) ||
+          reply.type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SEEK_POS)
+        {
+          if (channel->failure == NULL)
+            channel->failure = g_strdup ("Stream is not seekable");
+          goto out;
+        }
+      channel->file_size = channel->offset;
+
+      if (!do_seek (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_SET, 0, &reply))
+        goto out;
+    }
+
+  while (!g_atomic_int_get (&stop))
+    {
+      if (!run_op (channel, choose_op (channel)))
+        goto out;
+    }
+
+  start = g_get_monotonic_time ();
+  seq_nr = send_request (channel, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_CLOSE, 0, 0, NULL, 0);
+  if (wait_reply (channel, seq_nr, &reply))
+    add_sample (channel, OP_CLOSE, start, reply.type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_CLOSED);
+
+ out:
+  close (channel->fd);
+  channel->fd = -1;
+
+  return NULL;
+}
+
+static gboolean
+lookup_mount (const char *spec_string,
+              GError    **error)
+{
+  GVfsDBusMountTracker *proxy;
+  GMountSpec *spec;
+  GVariant *mount;
+
+  spec = g_mount_spec_new_from_string (spec_string, error);
+  if (spec == NULL)
+    return FALSE;
+
+  proxy = gvfs_dbus_mount_tracker_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
+                                                          G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                          G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                          G_VFS_DBUS_DAEMON_NAME,
+                                                          G_VFS_DBUS_MOUNTTRACKER_PATH,
+                                                          NULL, error);
+  if (proxy == NULL)
+    {
+      g_mount_spec_unref (spec);
+      return FALSE;
+    }
+
+  if (gvfs_dbus_mount_tracker_call_lookup_mount_sync (proxy,
+                                                      g_mount_spec_to_dbus_with_path (spec, path),
+                                                      &mount, NULL, error))
+    {
+      mount_info = g_mount_info_from_dbus (mount);
+      g_variant_unref (mount);
+      if (mount_info == NULL)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Invalid mount info from the daemon");
+    }
+
+  g_object_unref (proxy);
+  g_mount_spec_unref (spec);
+
+  return mount_info != NULL;
+}
+
+static guint32
+get_backend_pid (void)
+{
+  GDBusConnection *connection;
+  GVariant *res;
+  guint32 pid;
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  if (connection == NULL)
+    return 0;
+
+  pid = 0;
+  res = g_dbus_connection_call_sync (connection,
+                                     "org.freedesktop.DBus",
+                                     "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus",
+                                     "GetConnectionUnixProcessID",
+                                     g_variant_new ("(s)", mount_info->dbus_id),
+                                     G_VARIANT_TYPE ("(u)"),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1, NULL, NULL);
+  if (res)
+    {
+      g_variant_get (res, "(u)", &pid);
+      g_variant_unref (res);
+    }
+
+  g_object_unref (connection);
+  return pid;
+}
+
+/* In kB, 0 if unknown */
+static guint64
+get_rss (guint32 pid)
+{
+  char *filename, *contents, *line;
+  guint64 rss;
+
+  if (pid == 0)
+    return 0;
+
+  rss = 0;
+  filename = g_strdup_printf ("/proc/%u/status", pid);
+  if (g_file_get_contents (filename, &contents, NULL, NULL))
+    {
+      line = strstr (contents, "\nVmRSS:");
+      if (line)
+        rss = g_ascii_strtoull (line + strlen ("\nVmRSS:"), NULL, 10);
+      g_free (contents);
+    }
+  g_free (filename);
+
+  return rss;
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static gint64
+percentile (GArray *samples,
+            double  p)
+{
+  guint rank;
+
+  rank = (guint) (p * samples->len + 0.999999);
+  rank = CLAMP (rank, 1, samples->len);
+
+  return g_array_index (samples, gint64, rank - 1);
+}
+
+static void
+print_op (OpType    op,
+          GArray   *samples,
+          guint64   errors,
+          double    seconds,
+          gboolean *first)
+{
+  if (samples->len == 0)
+    return;
+
+  g_array_sort (samples, compare_samples);
+
+  g_print ("%s    \"%s\": {\n", *first ? "" : ",\n", op_names[op]);
+  g_print ("      \"ops\": %u,\n", samples->len);
+  g_print ("      \"errors\": %" G_GUINT64_FORMAT ",\n", errors);
+  g_print ("      \"ops_per_sec\": %.1f,\n", samples->len / seconds);
+  g_print ("      \"latency_usec\": {");
+  g_print (" \"min\": %" G_GINT64_FORMAT, g_array_index (samples, gint64, 0));
+  g_print (", \"p50\": %" G_GINT64_FORMAT, percentile (samples, 0.50));
+  g_print (", \"p90\": %" G_GINT64_FORMAT, percentile (samples, 0.90));
+  g_print (", \"p99\": %" G_GINT64_FORMAT, percentile (samples, 0.99));
+  g_print (", \"p999\": %" G_GINT64_FORMAT, percentile (samples, 0.999));
+  g_print (", \"max\": %" G_GINT64_FORMAT, g_array_index (samples, gint64, samples->len - 1));
+  g_print (" }\n    }");
+
+  *first = FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error;
+  Channel *channels;
+  GArray *samples[N_OPS];
+  guint64 errors[N_OPS];
+  guint64 bytes_read, bytes_written, readahead_bytes;
+  guint64 rss, rss_start, rss_peak, rss_end;
+  gint64 start, elapsed;
+  double seconds;
+  guint32 pid;
+  gboolean first;
+  char *escaped;
+  int i, n_channels, n_failed, op;
+
+  setlocale (LC_ALL, "");
+
+  g_type_init ();
+
+  error = NULL;
+  context = g_option_context_new ("MOUNT-SPEC PATH - drive gvfs data channels directly");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc != 3)
+    {
+      g_printerr ("Usage: %s [OPTION...] MOUNT-SPEC PATH, e.g. localtest: /tmp/file\n", argv[0]);
+      return 1;
+    }
+
+  n_channels = n_readers + n_writers;
+  if (n_readers < 0 || n_writers < 0 || n_channels == 0 ||
+      duration < 1 || block_size < 1 || max_write_size < 1)
+    {
+      g_printerr ("Invalid channel count, duration or size\n");
+      return 1;
+    }
+
+  if (!parse_mix (mix, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  path = g_strdup (argv[2]);
+  if (!lookup_mount (argv[1], &error))
+    {
+      g_printerr ("Failed to find the mount for %s: %s\n", path, error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  pid = get_backend_pid ();
+  rss_start = rss_peak = get_rss (pid);
+
+  channels = g_new0 (Channel, n_channels);
+  for (i = 0; i < n_channels; i++)
+    {
+      channels[i].index = i;
+      channels[i].writer = i >= n_readers;
+      channels[i].fd = -1;
+      channels[i].rand = g_rand_new_with_seed (seed + i);
+      channels[i].buffer_size = block_size;
+      channels[i].buffer = g_malloc0 (block_size);
+      for (op = 0; op < N_OPS; op++)
+        channels[i].samples[op] = g_array_new (FALSE, FALSE, sizeof (gint64));
+    }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_channels; i++)
+    channels[i].thread = g_thread_new ("channel", channel_thread, &channels[i]);
+
+  while (g_get_monotonic_time () - start < (gint64) duration * G_USEC_PER_SEC)
+    {
+      g_usleep (RSS_SAMPLE_INTERVAL);
+      rss = get_rss (pid);
+      rss_peak = MAX (rss_peak, rss);
+    }
+
+  g_atomic_int_set (&stop, 1);
+  for (i = 0; i < n_channels; i++)
+    g_thread_join (channels[i].thread);
+  elapsed = g_get_monotonic_time () - start;
+  seconds = elapsed / (double) G_USEC_PER_SEC;
+
+  rss_end = get_rss (pid);
+  rss_peak = MAX (rss_peak, rss_end);
+
+  /* Merge the channels */
+  bytes_read = bytes_written = readahead_bytes = 0;
+  n_failed = 0;
+  for (op = 0; op < N_OPS; op++)
+    {
+      samples[op] = g_array_new (FALSE, FALSE, sizeof (gint64));
+      errors[op] = 0;
+    }
+
+  for (i = 0; i < n_channels; i++)
+    {
+      for (op = 0; op < N_OPS; op++)
+        {
+          g_array_append_vals (samples[op], channels[i].samples[op]->data, channels[i].samples[op]->len);
+          errors[op] += channels[i].errors[op];
+          g_array_free (channels[i].samples[op], TRUE);
+        }
+      bytes_read += channels[i].bytes_read;
+      bytes_written += channels[i].bytes_written;
+      readahead_bytes += channels[i].readahead_bytes;
+
+      if (channels[i].failure)
+        {
+          g_printerr ("Channel %d: %s\n", i, channels[i].failure);
+          g_free (channels[i].failure);
+          n_failed++;
+        }
+
+      g_rand_free (channels[i].rand);
+      g_free (channels[i].buffer);
+    }
+
+  g_print ("{\n  \"benchmark\": \"gvfs-channels\",\n");
+  escaped = g_strescape (label ? label : "", NULL);
+  g_print ("  \"label\": \"%s\",\n", escaped);
+  g_free (escaped);
+  g_print ("  \"readers\": %d,\n  \"writers\": %d,\n", n_readers, n_writers);
+  g_print ("  \"block_size\": %d,\n", block_size);
+  g_print ("  \"elapsed_usec\": %" G_GINT64_FORMAT ",\n", elapsed);
+  g_print ("  \"failed_channels\": %d,\n", n_failed);
+  g_print ("  \"bytes_read\": %" G_GUINT64_FORMAT ",\n", bytes_read);
+  g_print ("  \"bytes_written\": %" G_GUINT64_FORMAT ",\n", bytes_written);
+  g_print ("  \"readahead_bytes_dropped\": %" G_GUINT64_FORMAT ",\n", readahead_bytes);
+  g_print ("  \"read_bytes_per_sec\": %.0f,\n", bytes_read / seconds);
+  g_print ("  \"write_bytes_per_sec\": %.0f,\n", bytes_written / seconds);
+  g_print ("  \"backend_pid\": %u,\n", pid);
+  g_print ("  \"backend_rss_kb\": { \"start\": %" G_GUINT64_FORMAT ", \"peak\": %" G_GUINT64_FORMAT ", \"end\": %" G_GUINT64_FORMAT " },\n",
+           rss_start, rss_peak, rss_end);
+  g_print ("  \"requests\": {\n");
+
+  first = TRUE;
+  for (op = 0; op < N_OPS; op++)
+    {
+      print_op (op, samples[op], errors[op], seconds, &first);
+      g_array_free (samples[op], TRUE);
+    }
+
+  g_print ("\n  }\n}\n");
+
+  g_free (channels);
+  g_mount_info_unref (mount_info);
+  g_free (path);
+
+  return n_failed > 0 ? 1 : 0;
+}
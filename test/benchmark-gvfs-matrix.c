@@ -0,0 +1,935 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * Copyright (C) 2026 The GVfs Authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Runs a fixed matrix of workloads against a localtest:// mount and
+ * prints per-operation latency percentiles as JSON. The localtest
+ * backend only wraps local files, so with GVFS_LOCALTEST_* shaping
+ * (see daemon/gvfsbackendlocaltest.c) any change in the numbers comes
+ * from the client streams, the channels or the job handling.
+ *
+ * Fixtures are created directly in the scratch directory, only the
+ * measured operations go through gvfs. run-benchmark-matrix.sh runs
+ * this against a private gvfsd for a few link profiles.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#define SEQ_FILE_NAME     "seq"
+#define SMALL_DIR_NAME    "small"
+#define ENUMERATE_DIR_NAME "enumerate"
+#define METADATA_DIR_NAME "metadata"
+#define METADATA_KEY      "metadata::gvfs-benchmark"
+#define SMALL_FILE_SIZE   1024
+#define PREAD_SIZE        4096
+#define ENUMERATE_BATCH   1000
+
+typedef struct {
+  const char *name;
+  GArray *samples; /* gint64, usec per operation */
+  guint64 bytes;
+  guint64 items;
+  gint64 elapsed;
+  gboolean failed;
+} Workload;
+
+typedef gboolean (*WorkloadFunc) (Workload *workload);
+
+static char *label = NULL;
+static char *scratch_dir = NULL;
+static char *workload_names = NULL;
+static gint iterations = 3;
+static gint file_size_mb = 16;
+static gint block_size = 64 * 1024;
+static gint random_reads = 1000;
+static gint small_files = 1000;
+static gint enumerate_entries = 100000;
+static gint metadata_files = 200;
+static gint seed = 1;
+static gboolean keep_scratch = FALSE;
+
+static GOptionEntry entries[] =
+{
+  { "label", 'l', 0, G_OPTION_ARG_STRING, &label, "Name of the run, copied to the output", "LABEL" },
+  { "scratch-dir", 'd', 0, G_OPTION_ARG_FILENAME, &scratch_dir, "Local directory to run in, a temporary one by default", "DIR" },
+  { "workloads", 'w', 0, G_OPTION_ARG_STRING, &workload_names, "Comma separated workloads to run, all by default", "LIST" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Passes over the sequential and enumerate workloads", "N" },
+  { "file-size", 0, 0, G_OPTION_ARG_INT, &file_size_mb, "Size of the sequential file in MiB", "MIB" },
+  { "block-size", 0, 0, G_OPTION_ARG_INT, &block_size, "Block size of sequential reads and writes", "BYTES" },
+  { "random-reads", 0, 0, G_OPTION_ARG_INT, &random_reads, "Number of random preads", "N" },
+  { "small-files", 0, 0, G_OPTION_ARG_INT, &small_files, "Number of small files", "N" },
+  { "enumerate-entries", 0, 0, G_OPTION_ARG_INT, &enumerate_entries, "Number of entries in the enumerated directory", "N" },
+  { "metadata-files", 0, 0, G_OPTION_ARG_INT, &metadata_files, "Number of files to set and get metadata on", "N" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed for the random pread offsets", "N" },
+  { "keep", 'k', 0, G_OPTION_ARG_NONE, &keep_scratch, "Don't remove the scratch directory", NULL },
+  { NULL }
+};
+
+static GFile *base_dir = NULL;
+static GMainLoop *main_loop = NULL;
+
+static char *
+local_path (const char *name)
+{
+  return g_build_filename (scratch_dir, name, NULL);
+}
+
+static void
+workload_add (Workload *workload,
+              gint64    start)
+{
+  gint64 usec;
+
+  usec = g_get_monotonic_time () - start;
+  g_array_append_val (workload->samples, usec);
+}
+
+static gboolean
+workload_fail (Workload   *workload,
+               const char *what,
+               GError     *error)
+{
+  g_printerr ("%s: %s failed: %s\n", workload->name, what,
+              error ? error->message : "unexpected result");
+  if (error)
+    g_error_free (error);
+  workload->failed = TRUE;
+
+  return FALSE;
+}
+
+/* Creates the file with POSIX calls unless it already has the right size */
+static gboolean
+ensure_local_file (const char *path,
+                   gsize       size)
+{
+  struct stat st;
+  char buffer[64 * 1024];
+  gsize done, chunk;
+  int fd;
+
+  if (g_stat (path, &st) == 0 && (gsize) st.st_size == size)
+    return TRUE;
+
+  fd = g_open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    {
+      g_printerr ("Failed to create %s: %s\n", path, g_strerror (errno));
+      return FALSE;
+    }
+
+  memset (buffer, 0xaa, sizeof (buffer));
+  for (done = 0; done < size; done += chunk)
+    {
+      chunk = MIN (sizeof (buffer), size - done);
+      if (write (fd, buffer, chunk) != (gssize) chunk)
+        {
+          g_printerr ("Failed to populate %s: %s\n", path, g_strerror (errno));
+          close (fd);
+          return FALSE;
+        }
+    }
+
+  close (fd);
+  return TRUE;
+}
+
+static gboolean
+ensure_local_dir (const char *name,
+                  const char *pattern,
+                  gint        n_files,
+                  gsize       size)
+{
+  char *dir, *file_name, *path;
+  gboolean res;
+  gint i;
+
+  dir = local_path (name);
+  res = g_mkdir_with_parents (dir, 0755) == 0;
+  if (!res)
+    g_printerr ("Failed to create %s: %s\n", dir, g_strerror (errno));
+
+  for (i = 0; res && i < n_files; i++)
+    {
+      file_name = g_strdup_printf (pattern, i);
+      path = g_build_filename (dir, file_name, NULL);
+      res = ensure_local_file (path, size);
+      g_free (path);
+      g_free (file_name);
+    }
+
+  g_free (dir);
+  return res;
+}
+
+static GFile *
+get_file (const char *dir,
+          const char *pattern,
+          gint        i)
+{
+  GFile *file;
+  char *name, *path;
+
+  name = g_strdup_printf (pattern, i);
+  path = dir ? g_build_filename (dir, name, NULL) : g_strdup (name);
+  file = g_file_resolve_relative_path (base_dir, path);
+  g_free (path);
+  g_free (name);
+
+  return file;
+}
+
+static void
+remove_recursive (const char *path)
+{
+  GDir *dir;
+  const char *name;
+  char *child;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          child = g_build_filename (path, name, NULL);
+          remove_recursive (child);
+          g_free (child);
+        }
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+static gboolean
+run_seq_write (Workload *workload)
+{
+  GFileOutputStream *stream;
+  GFile *file;
+  GError *error = NULL;
+  char *buffer;
+  gsize size, done, written;
+  gint64 start;
+  gint i;
+
+  size = (gsize) file_size_mb * 1024 * 1024;
+  buffer = g_malloc (block_size);
+  memset (buffer, 0x55, block_size);
+  file = get_file (NULL, SEQ_FILE_NAME, 0);
+
+  for (i = 0; i < iterations && !workload->failed; i++)
+    {
+      stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+      if (stream == NULL)
+        {
+          workload_fail (workload, "replace", error);
+          break;
+        }
+
+      for (done = 0; done < size; done += written)
+        {
+          start = g_get_monotonic_time ();
+          if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream), buffer,
+                                          MIN ((gsize) block_size, size - done),
+                                          &written, NULL, &error))
+            {
+              workload_fail (workload, "write", error);
+              break;
+            }
+          workload_add (workload, start);
+          workload->bytes += written;
+        }
+
+      if (!g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error))
+        workload_fail (workload, "close", error);
+      g_object_unref (stream);
+    }
+
+  g_object_unref (file);
+  g_free (buffer);
+
+  return !workload->failed;
+}
+
+static gboolean
+run_seq_read (Workload *workload)
+{
+  GFileInputStream *stream;
+  GFile *file;
+  GError *error = NULL;
+  char *buffer, *path;
+  gsize read;
+  gint64 start;
+  gint i;
+
+  path = local_path (SEQ_FILE_NAME);
+  if (!ensure_local_file (path, (gsize) file_size_mb * 1024 * 1024))
+    {
+      g_free (path);
+      return workload_fail (workload, "setup", NULL);
+    }
+  g_free (path);
+
+  buffer = g_malloc (block_size);
+  file = get_file (NULL, SEQ_FILE_NAME, 0);
+
+  for (i = 0; i < iterations && !workload->failed; i++)
+    {
+      stream = g_file_read (file, NULL, &error);
+      if (stream == NULL)
+        {
+          workload_fail (workload, "open", error);
+          break;
+        }
+
+      do
+        {
+          start = g_get_monotonic_time ();
+          if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, block_size,
+                                        &read, NULL, &error))
+            {
+              workload_fail (workload, "read", error);
+              break;
+            }
+          workload_add (workload, start);
+          workload->bytes += read;
+        }
+      while (read == (gsize) block_size);
+
+      g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+      g_object_unref (stream);
+    }
+
+  g_object_unref (file);
+  g_free (buffer);
+
+  return !workload->failed;
+}
+
+static gboolean
+run_random_pread (Workload *workload)
+{
+  GFileInputStream *stream;
+  GFile *file;
+  GRand *rand;
+  GError *error = NULL;
+  char buffer[PREAD_SIZE];
+  char *path;
+  gsize read;
+  goffset offset;
+  gint64 start;
+  gint i, n_blocks;
+
+  path = local_path (SEQ_FILE_NAME);
+  if (!ensure_local_file (path, (gsize) file_size_mb * 1024 * 1024))
+    {
+      g_free (path);
+      return workload_fail (workload, "setup", NULL);
+    }
+  g_free (path);
+
+  file = get_file (NULL, SEQ_FILE_NAME, 0);
+  stream = g_file_read (file, NULL, &error);
+  g_object_unref (file);
+  if (stream == NULL)
+    return workload_fail (workload, "open", error);
+
+  /* The same offsets every run */
+  rand = g_rand_new_with_seed (seed);
+  n_blocks = MAX ((gint64) file_size_mb * 1024 * 1024 / PREAD_SIZE, 1);
+
+  for (i = 0; i < random_reads; i++)
+    {
+      offset = (goffset) g_rand_int_range (rand, 0, n_blocks) * PREAD_SIZE;
+
+      start = g_get_monotonic_time ();
+      if (!g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL, &error))
+        {
+          workload_fail (workload, "seek", error);
+          break;
+        }
+      if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, PREAD_SIZE,
+                                    &read, NULL, &error))
+        {
+          workload_fail (workload, "read", error);
+          break;
+        }
+      workload_add (workload, start);
+      workload->bytes += read;
+    }
+
+  g_rand_free (rand);
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  return !workload->failed;
+}
+
+static gboolean
+run_small_create (Workload *workload)
+{
+  GFileOutputStream *stream;
+  GFile *file;
+  GError *error = NULL;
+  char buffer[SMALL_FILE_SIZE];
+  char *dir;
+  gint64 start;
+  gint i;
+
+  dir = local_path (SMALL_DIR_NAME);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  memset (buffer, 0x55, sizeof (buffer));
+
+  for (i = 0; i < small_files; i++)
+    {
+      file = get_file (SMALL_DIR_NAME, "f%06d", i);
+
+      /* Leftovers of a previous pass */
+      g_file_delete (file, NULL, NULL);
+
+      start = g_get_monotonic_time ();
+      stream = g_file_create (file, G_FILE_CREATE_NONE, NULL, &error);
+      g_object_unref (file);
+      if (stream == NULL)
+        return workload_fail (workload, "create", error);
+
+      if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream), buffer, sizeof (buffer),
+                                      NULL, NULL, &error) ||
+          !g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error))
+        {
+          g_object_unref (stream);
+          return workload_fail (workload, "write", error);
+        }
+      workload_add (workload, start);
+      workload->bytes += sizeof (buffer);
+      workload->items++;
+
+      g_object_unref (stream);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+run_small_stat (Workload *workload)
+{
+  GFileInfo *info;
+  GFile *file;
+  GError *error = NULL;
+  gint64 start;
+  gint i;
+
+  if (!ensure_local_dir (SMALL_DIR_NAME, "f%06d", small_files, SMALL_FILE_SIZE))
+    return workload_fail (workload, "setup", NULL);
+
+  for (i = 0; i < small_files; i++)
+    {
+      file = get_file (SMALL_DIR_NAME, "f%06d", i);
+
+      start = g_get_monotonic_time ();
+      info = g_file_query_info (file, "standard::*,time::*,unix::*", 0, NULL, &error);
+      g_object_unref (file);
+      if (info == NULL)
+        return workload_fail (workload, "query_info", error);
+      workload_add (workload, start);
+      workload->items++;
+
+      g_object_unref (info);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+run_small_delete (Workload *workload)
+{
+  GFile *file;
+  GError *error = NULL;
+  gint64 start;
+  gint i;
+
+  if (!ensure_local_dir (SMALL_DIR_NAME, "f%06d", small_files, SMALL_FILE_SIZE))
+    return workload_fail (workload, "setup", NULL);
+
+  for (i = 0; i < small_files; i++)
+    {
+      file = get_file (SMALL_DIR_NAME, "f%06d", i);
+
+      start = g_get_monotonic_time ();
+      if (!g_file_delete (file, NULL, &error))
+        {
+          g_object_unref (file);
+          return workload_fail (workload, "delete", error);
+        }
+      workload_add (workload, start);
+      workload->items++;
+
+      g_object_unref (file);
+    }
+
+  return TRUE;
+}
+
+/* Samples are the time to get each batch of ENUMERATE_BATCH entries,
+   the first one includes starting the enumeration */
+static gboolean
+run_enumerate (Workload *workload)
+{
+  GFileEnumerator *enumerator;
+  GFile *dir;
+  GError *error = NULL;
+  GList *infos;
+  guint64 n_entries;
+  gint64 start;
+  gint i;
+
+  if (!ensure_local_dir (ENUMERATE_DIR_NAME, "entry-%06d", enumerate_entries, 0))
+    return workload_fail (workload, "setup", NULL);
+
+  dir = get_file (NULL, ENUMERATE_DIR_NAME, 0);
+
+  for (i = 0; i < iterations && !workload->failed; i++)
+    {
+      n_entries = 0;
+
+      start = g_get_monotonic_time ();
+      enumerator = g_file_enumerate_children (dir, "standard::name,standard::type,standard::size,time::modified",
+                                              0, NULL, &error);
+      if (enumerator == NULL)
+        {
+          workload_fail (workload, "enumerate", error);
+          break;
+        }
+
+      while (TRUE)
+        {
+          infos = g_file_enumerator_next_files (enumerator, ENUMERATE_BATCH, NULL, &error);
+          if (error)
+            {
+              workload_fail (workload, "next_files", error);
+              break;
+            }
+          if (infos == NULL)
+            break;
+
+          workload_add (workload, start);
+          n_entries += g_list_length (infos);
+          g_list_free_full (infos, g_object_unref);
+
+          start = g_get_monotonic_time ();
+        }
+
+      g_file_enumerator_close (enumerator, NULL, NULL);
+      g_object_unref (enumerator);
+
+      workload->items += n_entries;
+      if (!workload->failed && n_entries != (guint64) enumerate_entries)
+        {
+          g_printerr ("%s: got %" G_GUINT64_FORMAT " entries, expected %d\n",
+                      workload->name, n_entries, enumerate_entries);
+          workload->failed = TRUE;
+        }
+    }
+
+  g_object_unref (dir);
+
+  return !workload->failed;
+}
+
+static gboolean
+run_metadata_set (Workload *workload)
+{
+  GFile *file;
+  GError *error = NULL;
+  char *value;
+  gint64 start;
+  gint i;
+
+  if (!ensure_local_dir (METADATA_DIR_NAME, "m%06d", metadata_files, 0))
+    return workload_fail (workload, "setup", NULL);
+
+  for (i = 0; i < metadata_files; i++)
+    {
+      file = get_file (METADATA_DIR_NAME, "m%06d", i);
+      value = g_strdup_printf ("value-%d", i);
+
+      start = g_get_monotonic_time ();
+      if (!g_file_set_attribute_string (file, METADATA_KEY, value, 0, NULL, &error))
+        {
+          g_free (value);
+          g_object_unref (file);
+          return workload_fail (workload, "set_attribute", error);
+        }
+      workload_add (workload, start);
+      workload->items++;
+
+      g_free (value);
+      g_object_unref (file);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+run_metadata_get (Workload *workload)
+{
+  GFileInfo *info;
+  GFile *file;
+  GError *error = NULL;
+  gint64 start;
+  gint i;
+
+  if (!ensure_local_dir (METADATA_DIR_NAME, "m%06d", metadata_files, 0))
+    return workload_fail (workload, "setup", NULL);
+
+  for (i = 0; i < metadata_files; i++)
+    {
+      file = get_file (METADATA_DIR_NAME, "m%06d", i);
+
+      start = g_get_monotonic_time ();
+      info = g_file_query_info (file, METADATA_KEY, 0, NULL, &error);
+      g_object_unref (file);
+      if (info == NULL)
+        return workload_fail (workload, "query_info", error);
+      workload_add (workload, start);
+      workload->items++;
+
+      g_object_unref (info);
+    }
+
+  return TRUE;
+}
+
+/* In the order they run, later ones reuse the files of earlier ones */
+static const struct {
+  const char *name;
+  WorkloadFunc func;
+} workloads[] = {
+  { "seq-write", run_seq_write },
+  { "seq-read", run_seq_read },
+  { "random-pread", run_random_pread },
+  { "small-create", run_small_create },
+  { "small-stat", run_small_stat },
+  { "small-delete", run_small_delete },
+  { "enumerate", run_enumerate },
+  { "metadata-set", run_metadata_set },
+  { "metadata-get", run_metadata_get },
+};
+
+static void
+print_json_string (const char *str)
+{
+  const char *p;
+
+  if (str == NULL)
+    {
+      g_print ("null");
+      return;
+    }
+
+  g_print ("\"");
+  for (p = str; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        g_print ("\\%c", *p);
+      else if ((guchar) *p < 0x20)
+        g_print ("\\u%04x", (guchar) *p);
+      else
+        g_print ("%c", *p);
+    }
+  g_print ("\"");
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Nearest rank, samples must be sorted */
+static gint64
+percentile (GArray *samples,
+            double  p)
+{
+  guint rank;
+
+  rank = (guint) (p * samples->len + 0.999999);
+  rank = CLAMP (rank, 1, samples->len);
+
+  return g_array_index (samples, gint64, rank - 1);
+}
+
+static void
+print_workload (Workload *workload,
+                gboolean  last)
+{
+  GArray *samples = workload->samples;
+  gint64 total;
+  double seconds;
+  guint i;
+
+  g_array_sort (samples, compare_samples);
+
+  g_print ("    {\n      \"name\": ");
+  print_json_string (workload->name);
+  g_print (",\n      \"failed\": %s", workload->failed ? "true" : "false");
+  g_print (",\n      \"ops\": %u", samples->len);
+  g_print (",\n      \"elapsed_usec\": %" G_GINT64_FORMAT, workload->elapsed);
+
+  seconds = workload->elapsed / (double) G_USEC_PER_SEC;
+  if (workload->bytes > 0)
+    {
+      g_print (",\n      \"bytes\": %" G_GUINT64_FORMAT, workload->bytes);
+      if (seconds > 0)
+        g_print (",\n      \"bytes_per_sec\": %.0f", workload->bytes / seconds);
+    }
+  if (workload->items > 0)
+    {
+      g_print (",\n      \"items\": %" G_GUINT64_FORMAT, workload->items);
+      if (seconds > 0)
+        g_print (",\n      \"items_per_sec\": %.1f", workload->items / seconds);
+    }
+
+  if (samples->len > 0)
+    {
+      total = 0;
+      for (i = 0; i < samples->len; i++)
+        total += g_array_index (samples, gint64, i);
+
+      g_print (",\n      \"latency_usec\": {");
+      g_print (" \"min\": %" G_GINT64_FORMAT, g_array_index (samples, gint64, 0));
+      g_print (", \"mean\": %" G_GINT64_FORMAT, total / samples->len);
+      g_print (", \"p50\": %" G_GINT64_FORMAT, percentile (samples, 0.50));
+      g_print (", \"p90\": %" G_GINT64_FORMAT, percentile (samples, 0.90));
+      g_print (", \"p99\": %" G_GINT64_FORMAT, percentile (samples, 0.99));
+      g_print (", \"p999\": %" G_GINT64_FORMAT, percentile (samples, 0.999));
+      g_print (", \"max\": %" G_GINT64_FORMAT, g_array_index (samples, gint64, samples->len - 1));
+      g_print (" }");
+    }
+
+  g_print ("\n    }%s\n", last ? "" : ",");
+}
+
+static void
+print_env (const char *name,
+           gboolean    last)
+{
+  g_print ("    ");
+  print_json_string (name);
+  g_print (": ");
+  print_json_string (g_getenv (name));
+  g_print ("%s\n", last ? "" : ",");
+}
+
+static void
+mount_done_cb (GObject      *object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  GError **error = user_data;
+
+  g_file_mount_enclosing_volume_finish (G_FILE (object), res, error);
+  g_main_loop_quit (main_loop);
+}
+
+static gboolean
+mount_base_dir (void)
+{
+  GError *error = NULL;
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  g_file_mount_enclosing_volume (base_dir, G_MOUNT_MOUNT_NONE, NULL, NULL,
+                                 mount_done_cb, &error);
+  g_main_loop_run (main_loop);
+  g_main_loop_unref (main_loop);
+
+  if (error && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_ALREADY_MOUNTED))
+    {
+      g_printerr ("Failed to mount localtest://: %s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  g_clear_error (&error);
+  return TRUE;
+}
+
+static gboolean
+is_selected (const char *name)
+{
+  char **names;
+  gboolean res;
+  int i;
+
+  if (workload_names == NULL)
+    return TRUE;
+
+  names = g_strsplit (workload_names, ",", -1);
+  res = FALSE;
+  for (i = 0; names[i] != NULL; i++)
+    if (strcmp (g_strstrip (names[i]), name) == 0)
+      res = TRUE;
+  g_strfreev (names);
+
+  return res;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GPtrArray *results;
+  Workload *workload;
+  gboolean own_scratch_dir;
+  char *file_uri, *uri;
+  gint64 start;
+  guint i;
+  int retval;
+
+  setlocale (LC_ALL, "");
+
+  g_type_init ();
+
+  context = g_option_context_new ("- benchmark gvfs against the localtest backend");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (iterations < 1 || file_size_mb < 1 || block_size < 1)
+    {
+      g_printerr ("Iterations, file size and block size must be positive\n");
+      return 1;
+    }
+
+  own_scratch_dir = scratch_dir == NULL;
+  if (own_scratch_dir)
+    {
+      scratch_dir = g_dir_make_tmp ("gvfs-benchmark-XXXXXX", &error);
+      if (scratch_dir == NULL)
+        {
+          g_printerr ("Failed to create scratch directory: %s\n", error->message);
+          g_error_free (error);
+          return 1;
+        }
+    }
+  else if (g_mkdir_with_parents (scratch_dir, 0755) != 0)
+    {
+      g_printerr ("Failed to create %s: %s\n", scratch_dir, g_strerror (errno));
+      return 1;
+    }
+
+  /* localtest paths are local paths */
+  file_uri = g_filename_to_uri (scratch_dir, NULL, NULL);
+  uri = g_strconcat ("localtest", strchr (file_uri, ':'), NULL);
+  base_dir = g_file_new_for_uri (uri);
+  g_free (file_uri);
+
+  if (!mount_base_dir ())
+    {
+      g_object_unref (base_dir);
+      g_free (uri);
+      return 1;
+    }
+
+  retval = 0;
+  results = g_ptr_array_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (workloads); i++)
+    {
+      if (!is_selected (workloads[i].name))
+        continue;
+
+      workload = g_new0 (Workload, 1);
+      workload->name = workloads[i].name;
+      workload->samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+      start = g_get_monotonic_time ();
+      if (!workloads[i].func (workload))
+        retval = 1;
+      workload->elapsed = g_get_monotonic_time () - start;
+
+      g_ptr_array_add (results, workload);
+    }
+
+  g_print ("{\n  \"benchmark\": \"gvfs-matrix\",\n  \"label\": ");
+  print_json_string (label);
+  g_print (",\n  \"uri\": ");
+  print_json_string (uri);
+  g_print (",\n  \"parameters\": {\n");
+  g_print ("    \"iterations\": %d,\n", iterations);
+  g_print ("    \"file_size\": %" G_GINT64_FORMAT ",\n", (gint64) file_size_mb * 1024 * 1024);
+  g_print ("    \"block_size\": %d,\n", block_size);
+  g_print ("    \"random_reads\": %d,\n", random_reads);
+  g_print ("    \"small_files\": %d,\n", small_files);
+  g_print ("    \"enumerate_entries\": %d,\n", enumerate_entries);
+  g_print ("    \"metadata_files\": %d,\n", metadata_files);
+  g_print ("    \"seed\": %d\n", seed);
+  g_print ("  },\n  \"link\": {\n");
+  print_env ("GVFS_LOCALTEST_LATENCY", FALSE);
+  print_env ("GVFS_LOCALTEST_JITTER", FALSE);
+  print_env ("GVFS_LOCALTEST_BANDWIDTH", FALSE);
+  print_env ("GVFS_LOCALTEST_SHAPE_OPS", FALSE);
+  print_env ("GVFS_LOCALTEST_SEED", TRUE);
+  g_print ("  },\n  \"workloads\": [\n");
+
+  for (i = 0; i < results->len; i++)
+    {
+      workload = g_ptr_array_index (results, i);
+      print_workload (workload, i == results->len - 1);
+      g_array_free (workload->samples, TRUE);
+      g_free (workload);
+    }
+
+  g_print ("  ]\n}\n");
+
+  if (own_scratch_dir && !keep_scratch)
+    remove_recursive (scratch_dir);
+
+  g_ptr_array_free (results, TRUE);
+  g_object_unref (base_dir);
+  g_free (uri);
+
+  return retval;
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Measures the memory used by localtest mounts with one process per
+# mount and with all mounts sharing a process (the MountsPerProcess
+# key in .mount files), against a private session bus and gvfsd.
+#
+# Usage: measure-mount-rss.sh <gvfsd> <gvfs-mount> [count...]
+#
+# For each mode and mount count (1, 10 and 100 by default) prints one
+# JSON object with the number of gvfsd-localtest processes and the sum
+# of their VmRSS in kB.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <gvfsd> <gvfs-mount> [count...]" >&2
+  exit 1
+fi
+
+gvfsd=$1
+gvfs_mount=$2
+shift 2
+
+counts=${*:-1 10 100}
+
+backend_rss () {
+  processes=0
+  rss=0
+  for dir in /proc/[0-9]*; do
+    [ "`cat $dir/comm 2> /dev/null`" = gvfsd-localtest ] || continue
+    kb=`sed -n 's/^VmRSS:[^0-9]*\([0-9]*\).*/\1/p' $dir/status 2> /dev/null`
+    [ -n "$kb" ] || continue
+    processes=`expr $processes + 1`
+    rss=`expr $rss + $kb`
+  done
+  echo "$processes $rss"
+}
+
+measure () {
+  mode=$1
+  per_process=$2
+  count=$3
+
+  eval `dbus-launch --sh-syntax`
+
+  GVFS_MOUNTS_PER_PROCESS=$per_process \
+  GVFS_DISABLE_PRESPAWN=1 \
+    "$gvfsd" --replace --no-fuse > /dev/null 2>&1 &
+  gvfsd_pid=$!
+  sleep 1
+
+  i=0
+  while [ $i -lt $count ]; do
+    "$gvfs_mount" "localtest://m$i/" || echo "Mounting localtest://m$i/ failed" >&2
+    i=`expr $i + 1`
+  done
+  # Let the backends settle after mounting
+  sleep 2
+
+  set -- `backend_rss`
+
+  kill $gvfsd_pid 2> /dev/null || true
+  kill $DBUS_SESSION_BUS_PID 2> /dev/null || true
+  # The backends exit when the bus goes away
+  sleep 1
+
+  echo "{ \"mode\": \"$mode\", \"mounts\": $count, \"processes\": $1, \"rss_kb\": $2 }"
+}
+
+for count in $counts; do
+  measure separate 1 $count
+  measure shared $count $count
+done
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Runs benchmark-gvfs-matrix against a private session bus and gvfsd
+# for each link profile and writes benchmark-<profile>.json.
+#
+# Usage: run-benchmark-matrix.sh <benchmark-gvfs-matrix> <gvfsd> [profile...]
+#
+# Profiles are "local" (no shaping), "lan" and "wan". The mount files
+# and backends are the installed ones, as with the other benchmarks.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <benchmark-gvfs-matrix> <gvfsd> [profile...]" >&2
+  exit 1
+fi
+
+benchmark=$1
+gvfsd=$2
+shift 2
+
+profiles=${*:-local lan wan}
+
+run_profile () {
+  profile=$1
+  shift
+
+  case $profile in
+    local)
+      latency=0; jitter=0; bandwidth=0; args= ;;
+    lan)
+      latency=200; jitter=100; bandwidth=100000000; args= ;;
+    wan)
+      # Fewer small operations, each one pays the round trip
+      latency=20000; jitter=5000; bandwidth=2000000
+      args="--iterations 1 --random-reads 200 --small-files 200 --metadata-files 50" ;;
+    *)
+      echo "Unknown profile $profile" >&2
+      return 1 ;;
+  esac
+
+  eval `dbus-launch --sh-syntax`
+
+  GVFS_LOCALTEST_LATENCY=$latency \
+  GVFS_LOCALTEST_JITTER=$jitter \
+  GVFS_LOCALTEST_BANDWIDTH=$bandwidth \
+  GVFS_LOCALTEST_SEED=1 \
+    "$gvfsd" --replace --no-fuse > "benchmark-$profile-gvfsd.log" 2>&1 &
+  gvfsd_pid=$!
+  sleep 1
+
+  status=0
+  GVFS_LOCALTEST_LATENCY=$latency \
+  GVFS_LOCALTEST_JITTER=$jitter \
+  GVFS_LOCALTEST_BANDWIDTH=$bandwidth \
+  GVFS_LOCALTEST_SEED=1 \
+    "$benchmark" --label "$profile" $args > "benchmark-$profile.json" || status=$?
+
+  kill $gvfsd_pid 2> /dev/null || true
+  kill $DBUS_SESSION_BUS_PID 2> /dev/null || true
+
+  if [ $status -ne 0 ]; then
+    echo "Profile $profile failed, see benchmark-$profile-gvfsd.log" >&2
+    return $status
+  fi
+
+  echo "Wrote benchmark-$profile.json"
+}
+
+for profile in $profiles; do
+  run_profile $profile
+done
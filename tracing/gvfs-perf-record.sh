@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Records all gvfs probes of a running process with perf, then prints
+# them in order with timestamps.
+#
+# Usage: gvfs-perf-record.sh PID [SECONDS]
+
+if [ -z "$1" ]; then
+  echo "Usage: $0 PID [SECONDS]" >&2
+  exit 1
+fi
+
+pid=$1
+seconds=${2:-10}
+exe=$(readlink /proc/$pid/exe) || exit 1
+output=gvfs-$pid.perf.data
+
+# The probes of the daemons are in the executable, the client ones in
+# the gio module
+for object in $exe $(grep -o '/[^ ]*libgvfsdbus[^ ]*\.so' /proc/$pid/maps | sort -u); do
+  perf buildid-cache --add "$object" || exit 1
+  perf probe --quiet --exec "$object" --add 'sdt_gvfs:*' 2>/dev/null
+done
+
+perf record -o "$output" -e 'sdt_gvfs:*' -p "$pid" -- sleep "$seconds" || exit 1
+perf script -i "$output" -F comm,tid,time,event,trace
+
+perf probe --quiet --del 'sdt_gvfs:*'